@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <cassert>
+#include <sstream>
+
+#include "CameraPath.h"
+
+#include "../Utilities/Debug.h"
+#include "../Utilities/File.h"
+
+namespace
+{
+	// Catmull-Rom interpolation between p1 and p2, with p0 and p3 as neighbors.
+	Float3d catmullRom(const Float3d &p0, const Float3d &p1, const Float3d &p2,
+		const Float3d &p3, double t)
+	{
+		const double t2 = t * t;
+		const double t3 = t2 * t;
+		return ((p1 * 2.0) + ((p2 - p0) * t) +
+			(((p0 * 2.0) - (p1 * 5.0) + (p2 * 4.0) - p3) * t2) +
+			(((p1 * 3.0) - p0 - (p2 * 3.0) + p3) * t3)) * 0.5;
+	}
+}
+
+CameraPath::CameraPath(const std::string &filename)
+{
+	std::istringstream iss(File::toString(filename));
+
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(iss, line))
+	{
+		lineNumber++;
+
+		// Skip blank lines and comments.
+		const size_t first = line.find_first_not_of(" \t\r");
+		if ((first == std::string::npos) || (line.at(first) == '#'))
+		{
+			continue;
+		}
+
+		Keyframe keyframe;
+		double x, y, z, dirX, dirY, dirZ;
+		std::istringstream lineStream(line);
+		const bool valid = static_cast<bool>(lineStream >> keyframe.time >> x >> y >> z >>
+			dirX >> dirY >> dirZ);
+		Debug::check(valid, "Camera Path", "Bad keyframe at line " +
+			std::to_string(lineNumber) + " in \"" + filename + "\".");
+
+		keyframe.position = Float3d(x, y, z);
+		keyframe.direction = Float3d(dirX, dirY, dirZ).normalized();
+
+		Debug::check(this->keyframes.empty() ||
+			(keyframe.time > this->keyframes.back().time), "Camera Path",
+			"Keyframe times must increase (line " + std::to_string(lineNumber) + ").");
+
+		this->keyframes.push_back(keyframe);
+	}
+
+	Debug::check(this->keyframes.size() > 0, "Camera Path",
+		"No keyframes in \"" + filename + "\".");
+}
+
+CameraPath::~CameraPath()
+{
+
+}
+
+void CameraPath::getSegment(double time, int &index, double &percent) const
+{
+	const int lastIndex = static_cast<int>(this->keyframes.size()) - 1;
+	if ((lastIndex == 0) || (time <= this->keyframes.front().time))
+	{
+		index = 0;
+		percent = 0.0;
+		return;
+	}
+	else if (time >= this->keyframes.back().time)
+	{
+		index = lastIndex;
+		percent = 0.0;
+		return;
+	}
+
+	// First keyframe after the time.
+	const auto nextIter = std::upper_bound(this->keyframes.begin(), this->keyframes.end(),
+		time, [](double t, const Keyframe &keyframe) { return t < keyframe.time; });
+	index = static_cast<int>(nextIter - this->keyframes.begin()) - 1;
+
+	const Keyframe &keyframe = this->keyframes.at(index);
+	const Keyframe &nextKeyframe = this->keyframes.at(index + 1);
+	percent = (time - keyframe.time) / (nextKeyframe.time - keyframe.time);
+}
+
+double CameraPath::getStartTime() const
+{
+	return this->keyframes.front().time;
+}
+
+double CameraPath::getEndTime() const
+{
+	return this->keyframes.back().time;
+}
+
+Float3d CameraPath::getPosition(double time) const
+{
+	int index;
+	double percent;
+	this->getSegment(time, index, percent);
+
+	// The ends use themselves as their missing neighbors.
+	const int lastIndex = static_cast<int>(this->keyframes.size()) - 1;
+	const Float3d &p0 = this->keyframes.at(std::max(index - 1, 0)).position;
+	const Float3d &p1 = this->keyframes.at(index).position;
+	const Float3d &p2 = this->keyframes.at(std::min(index + 1, lastIndex)).position;
+	const Float3d &p3 = this->keyframes.at(std::min(index + 2, lastIndex)).position;
+	return catmullRom(p0, p1, p2, p3, percent);
+}
+
+Float3d CameraPath::getDirection(double time) const
+{
+	int index;
+	double percent;
+	this->getSegment(time, index, percent);
+
+	const int lastIndex = static_cast<int>(this->keyframes.size()) - 1;
+	const Float3d &d0 = this->keyframes.at(std::max(index - 1, 0)).direction;
+	const Float3d &d1 = this->keyframes.at(index).direction;
+	const Float3d &d2 = this->keyframes.at(std::min(index + 1, lastIndex)).direction;
+	const Float3d &d3 = this->keyframes.at(std::min(index + 2, lastIndex)).direction;
+	return catmullRom(d0, d1, d2, d3, percent).normalized();
+}
@@ -0,0 +1,48 @@
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include <string>
+#include <vector>
+
+#include "../Math/Float3.h"
+
+// A camera path is a smooth curve through keyframes of camera positions and 
+// directions, for flying the camera the same way every time (i.e., for a timedemo).
+
+// The keyframes are read from a text file with one keyframe per line:
+// time x y z directionX directionY directionZ
+// The time is in seconds and must increase from line to line. Blank lines and lines
+// starting with '#' are ignored.
+
+// Positions and directions are interpolated with a Catmull-Rom spline, so the camera
+// passes through every keyframe without sudden turns. Directions are normalized 
+// after interpolating.
+
+class CameraPath
+{
+private:
+	struct Keyframe
+	{
+		double time;
+		Float3d position, direction;
+	};
+
+	std::vector<Keyframe> keyframes;
+
+	// Gets the index of the keyframe at or before the given time, and how far the time
+	// is towards the next keyframe in [0, 1].
+	void getSegment(double time, int &index, double &percent) const;
+public:
+	CameraPath(const std::string &filename);
+	~CameraPath();
+
+	// Time of the first and last keyframes.
+	double getStartTime() const;
+	double getEndTime() const;
+
+	// Times outside the path are clamped to its ends.
+	Float3d getPosition(double time) const;
+	Float3d getDirection(double time) const;
+};
+
+#endif
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cassert>
 
 #include "SDL.h"
@@ -14,7 +15,7 @@
 #include "../Media/MusicName.h"
 #include "../Media/TextureManager.h"
 #include "../Media/TextureName.h"
-#include "../Rendering/CLProgram.h"
+#include "../Rendering/RenderProgram.h"
 #include "../Rendering/Renderer.h"
 #include "../Utilities/Debug.h"
 
@@ -124,14 +125,18 @@ void GameState::resizeWindow(int width, int height)
 	
 	if (this->gameDataIsActive())
 	{
-		// Rebuild OpenCL program with new dimensions.		
-		this->gameData->getCLProgram() = std::move(CLProgram(
-			this->gameData->getWorldWidth(),
-			this->gameData->getWorldHeight(),
-			this->gameData->getWorldDepth(),
-			this->getTextureManager(),
-			this->getRenderer(),
-			this->getOptions().getRenderQuality()));
+		// Resize the render program's frame buffers (and build kernel.cl again if it
+		// has the render size compiled in). Render dimensions are clamped to at least 1
+		// like when the render program is created.
+		const Int2 windowDimensions = this->renderer->getWindowDimensions();
+		const double renderQuality = this->getOptions().getRenderQuality();
+		const int renderWidth = std::max(
+			static_cast<int>(windowDimensions.getX() * renderQuality), 1);
+		const int renderHeight = std::max(
+			static_cast<int>(windowDimensions.getY() * renderQuality), 1);
+
+		this->gameData->getRenderProgram().resize(renderWidth, renderHeight,
+			this->getRenderer());
 	}
 }
 
@@ -5,7 +5,8 @@
 #include "../Utilities/Debug.h"
 
 Options::Options(std::string &&dataPath, int screenWidth, int screenHeight, bool fullscreen,
-    double renderQuality, double verticalFOV, double letterboxAspect, double cursorScale, 
+    double renderQuality, const RenderSettings &renderSettings,
+	double verticalFOV, double letterboxAspect, double cursorScale, 
 	double hSensitivity, double vSensitivity, std::string &&soundfont, double musicVolume, 
 	double soundVolume, int soundChannels, bool skipIntro)
     : arenaPath(std::move(dataPath)), soundfont(std::move(soundfont))
@@ -15,6 +16,14 @@ Options::Options(std::string &&dataPath, int screenWidth, int screenHeight, bool
 	Debug::check(screenHeight > 0, "Options", "Screen height must be positive.");
 	Debug::check((renderQuality >= 0.25) && (renderQuality <= 1.0), "Options", 
 		"Render quality must be between 0.25 and 1.0.");
+	Debug::check((renderSettings.minRenderQuality >= 0.25) &&
+		(renderSettings.minRenderQuality <= renderQuality), "Options",
+		"Min render quality must be between 0.25 and the render quality.");
+	Debug::check(renderSettings.targetFrameTime > 0.0, "Options",
+		"Target frame time must be positive.");
+	Debug::check((renderSettings.refineBlockSize == 1) ||
+		(renderSettings.refineBlockSize == 2) || (renderSettings.refineBlockSize == 4),
+		"Options", "Refine block size must be 1, 2, or 4.");
 	Debug::check((verticalFOV > 0.0) && (verticalFOV < 180.0), "Options", 
 		"Field of view must be between 0.0 and 180.0 exclusive.");
 	Debug::check(letterboxAspect > 0.0, "Options", "Letterbox aspect must be positive.");
@@ -31,6 +40,7 @@ Options::Options(std::string &&dataPath, int screenWidth, int screenHeight, bool
 	this->screenHeight = screenHeight;
 	this->fullscreen = fullscreen;
 	this->renderQuality = renderQuality;
+	this->renderSettings = renderSettings;
 	this->verticalFOV = verticalFOV;
 	this->letterboxAspect = letterboxAspect;
 	this->cursorScale = cursorScale;
@@ -67,6 +77,11 @@ double Options::getRenderQuality() const
 	return this->renderQuality;
 }
 
+const RenderSettings &Options::getRenderSettings() const
+{
+	return this->renderSettings;
+}
+
 double Options::getVerticalFOV() const
 {
 	return this->verticalFOV;
@@ -146,6 +161,17 @@ void Options::setRenderQuality(double percent)
 	this->renderQuality = percent;
 }
 
+void Options::setRenderSettings(const RenderSettings &renderSettings)
+{
+	assert((renderSettings.minRenderQuality >= 0.25) &&
+		(renderSettings.minRenderQuality <= this->renderQuality));
+	assert(renderSettings.targetFrameTime > 0.0);
+	assert((renderSettings.refineBlockSize == 1) || (renderSettings.refineBlockSize == 2) ||
+		(renderSettings.refineBlockSize == 4));
+
+	this->renderSettings = renderSettings;
+}
+
 void Options::setVerticalFOV(double fov)
 {
 	assert(fov > 0.0);
@@ -3,6 +3,8 @@
 
 #include <string>
 
+#include "../Rendering/RenderSettings.h"
+
 // Settings found in the options menu are saved in this object, which should live in
 // the game state object since it persists for the lifetime of the program.
 
@@ -13,6 +15,7 @@ private:
 	int screenWidth, screenHeight;
 	bool fullscreen;
 	double renderQuality; // Percent.
+	RenderSettings renderSettings;
 	double verticalFOV; // In degrees.
 	double letterboxAspect;
 	double cursorScale;
@@ -30,7 +33,8 @@ private:
 	bool skipIntro;
 public:
 	Options(std::string &&arenaPath, int screenWidth, int screenHeight, bool fullscreen,
-        double renderQuality, double verticalFOV, double zetterboxAspect, double cursorScale, 
+        double renderQuality, const RenderSettings &renderSettings,
+		double verticalFOV, double letterboxAspect, double cursorScale, 
 		double hSensitivity, double vSensitivity, std::string &&soundfont, double musicVolume, 
 		double soundVolume, int soundChannels, bool skipIntro);
 	~Options();
@@ -39,6 +43,7 @@ public:
 	int getScreenHeight() const;
 	bool isFullscreen() const;
 	double getRenderQuality() const;
+	const RenderSettings &getRenderSettings() const;
 	double getVerticalFOV() const;
 	double getLetterboxAspect() const;
 	double getCursorScale() const;
@@ -55,6 +60,7 @@ public:
 	void setScreenHeight(int height);
 	void setFullscreen(bool fullscreen);
 	void setRenderQuality(double percent);
+	void setRenderSettings(const RenderSettings &renderSettings);
 	void setVerticalFOV(double fov);
 	void setLetterboxAspect(double aspect);
 	void setCursorScale(double cursorScale);
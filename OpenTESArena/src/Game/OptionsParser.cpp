@@ -3,6 +3,8 @@
 #include "OptionsParser.h"
 
 #include "Options.h"
+#include "../Rendering/RenderSettings.h"
+#include "../Utilities/Debug.h"
 #include "../Utilities/KvpTextMap.h"
 
 const std::string OptionsParser::PATH = "options/";
@@ -12,6 +14,18 @@ const std::string OptionsParser::SCREEN_WIDTH_KEY = "ScreenWidth";
 const std::string OptionsParser::SCREEN_HEIGHT_KEY = "ScreenHeight";
 const std::string OptionsParser::FULLSCREEN_KEY = "Fullscreen";
 const std::string OptionsParser::RENDER_QUALITY_KEY = "RenderQuality";
+const std::string OptionsParser::DYNAMIC_RESOLUTION_KEY = "DynamicResolution";
+const std::string OptionsParser::MIN_RENDER_QUALITY_KEY = "MinRenderQuality";
+const std::string OptionsParser::TARGET_FRAME_TIME_KEY = "TargetFrameTime";
+const std::string OptionsParser::RENDER_BACKEND_KEY = "RenderBackend";
+const std::string OptionsParser::PIPELINED_RENDERING_KEY = "PipelinedRendering";
+const std::string OptionsParser::KERNEL_MODE_KEY = "KernelMode";
+const std::string OptionsParser::DEVICE_SPLIT_KEY = "DeviceSplit";
+const std::string OptionsParser::REPROJECTION_KEY = "Reprojection";
+const std::string OptionsParser::REFINE_BLOCK_SIZE_KEY = "RefineBlockSize";
+const std::string OptionsParser::VOXEL_LAYOUT_KEY = "VoxelLayout";
+const std::string OptionsParser::SPRITE_MODE_KEY = "SpriteMode";
+const std::string OptionsParser::PROFILE_RENDERING_KEY = "ProfileRendering";
 const std::string OptionsParser::VERTICAL_FOV_KEY = "VerticalFieldOfView";
 const std::string OptionsParser::LETTERBOX_ASPECT_KEY = "LetterboxAspect";
 const std::string OptionsParser::CURSOR_SCALE_KEY = "CursorScale";
@@ -41,6 +55,102 @@ std::unique_ptr<Options> OptionsParser::parse()
 	double letterboxAspect = textMap.getDouble(OptionsParser::LETTERBOX_ASPECT_KEY);
 	double cursorScale = textMap.getDouble(OptionsParser::CURSOR_SCALE_KEY);
 
+	// The render settings are newer than most options files, so each one that's missing
+	// keeps its default (the renderer from before the setting existed).
+	RenderSettings renderSettings;
+	renderSettings.minRenderQuality = renderQuality;
+
+	if (textMap.hasKey(OptionsParser::DYNAMIC_RESOLUTION_KEY))
+	{
+		renderSettings.dynamicResolution =
+			textMap.getBoolean(OptionsParser::DYNAMIC_RESOLUTION_KEY);
+	}
+
+	if (textMap.hasKey(OptionsParser::MIN_RENDER_QUALITY_KEY))
+	{
+		renderSettings.minRenderQuality =
+			textMap.getDouble(OptionsParser::MIN_RENDER_QUALITY_KEY);
+	}
+
+	if (textMap.hasKey(OptionsParser::TARGET_FRAME_TIME_KEY))
+	{
+		renderSettings.targetFrameTime =
+			textMap.getDouble(OptionsParser::TARGET_FRAME_TIME_KEY);
+	}
+
+	// The render backend is either the OpenCL ray tracer or the CPU ray tracer.
+	if (textMap.hasKey(OptionsParser::RENDER_BACKEND_KEY))
+	{
+		const std::string renderBackend = textMap.getString(OptionsParser::RENDER_BACKEND_KEY);
+		Debug::check((renderBackend == "OpenCL") || (renderBackend == "CPU"),
+			"Options Parser", "Render backend must be \"OpenCL\" or \"CPU\".");
+		renderSettings.renderProgramType = (renderBackend == "CPU") ?
+			RenderProgramType::CPU : RenderProgramType::OpenCL;
+	}
+
+	if (textMap.hasKey(OptionsParser::PIPELINED_RENDERING_KEY))
+	{
+		renderSettings.pipelined = textMap.getBoolean(OptionsParser::PIPELINED_RENDERING_KEY);
+	}
+
+	// The OpenCL kernels are either the ones in kernel.cl, or the bandwidth-lean ones.
+	if (textMap.hasKey(OptionsParser::KERNEL_MODE_KEY))
+	{
+		const std::string kernelMode = textMap.getString(OptionsParser::KERNEL_MODE_KEY);
+		Debug::check((kernelMode == "Full") || (kernelMode == "Lean") ||
+			(kernelMode == "Fused"), "Options Parser",
+			"Kernel mode must be \"Full\", \"Lean\", or \"Fused\".");
+		renderSettings.clKernelMode = (kernelMode == "Lean") ? CLKernelMode::Lean :
+			((kernelMode == "Fused") ? CLKernelMode::Fused : CLKernelMode::Full);
+	}
+
+	// The OpenCL frame is either on one device, or split across devices or NUMA nodes.
+	if (textMap.hasKey(OptionsParser::DEVICE_SPLIT_KEY))
+	{
+		const std::string deviceSplit = textMap.getString(OptionsParser::DEVICE_SPLIT_KEY);
+		Debug::check((deviceSplit == "None") || (deviceSplit == "Devices") ||
+			(deviceSplit == "NUMA"), "Options Parser",
+			"Device split must be \"None\", \"Devices\", or \"NUMA\".");
+		renderSettings.clDeviceSplit = (deviceSplit == "Devices") ? CLDeviceSplit::Devices :
+			((deviceSplit == "NUMA") ? CLDeviceSplit::NUMA : CLDeviceSplit::None);
+	}
+
+	if (textMap.hasKey(OptionsParser::REPROJECTION_KEY))
+	{
+		renderSettings.reprojected = textMap.getBoolean(OptionsParser::REPROJECTION_KEY);
+	}
+
+	if (textMap.hasKey(OptionsParser::REFINE_BLOCK_SIZE_KEY))
+	{
+		renderSettings.refineBlockSize =
+			textMap.getInteger(OptionsParser::REFINE_BLOCK_SIZE_KEY);
+	}
+
+	// The per-voxel render lists are either in X, Y, Z order, or in tiles.
+	if (textMap.hasKey(OptionsParser::VOXEL_LAYOUT_KEY))
+	{
+		const std::string voxelLayout = textMap.getString(OptionsParser::VOXEL_LAYOUT_KEY);
+		Debug::check((voxelLayout == "Linear") || (voxelLayout == "Tiled"),
+			"Options Parser", "Voxel layout must be \"Linear\" or \"Tiled\".");
+		renderSettings.voxelLayout = (voxelLayout == "Tiled") ?
+			VoxelLayout::Tiled : VoxelLayout::Linear;
+	}
+
+	// Sprites are either found by the rays, or drawn over the traced frame.
+	if (textMap.hasKey(OptionsParser::SPRITE_MODE_KEY))
+	{
+		const std::string spriteMode = textMap.getString(OptionsParser::SPRITE_MODE_KEY);
+		Debug::check((spriteMode == "Traced") || (spriteMode == "Rasterized"),
+			"Options Parser", "Sprite mode must be \"Traced\" or \"Rasterized\".");
+		renderSettings.spriteMode = (spriteMode == "Rasterized") ?
+			SpriteMode::Rasterized : SpriteMode::Traced;
+	}
+
+	if (textMap.hasKey(OptionsParser::PROFILE_RENDERING_KEY))
+	{
+		renderSettings.profiled = textMap.getBoolean(OptionsParser::PROFILE_RENDERING_KEY);
+	}
+
 	// Input.
 	double hSensitivity = textMap.getDouble(OptionsParser::H_SENSITIVITY_KEY);
 	double vSensitivity = textMap.getDouble(OptionsParser::V_SENSITIVITY_KEY);
@@ -56,7 +166,7 @@ std::unique_ptr<Options> OptionsParser::parse()
 	bool skipIntro = textMap.getBoolean(OptionsParser::SKIP_INTRO_KEY);
 	
 	return std::unique_ptr<Options>(new Options(std::move(arenaPath),
-		screenWidth, screenHeight, fullscreen, renderQuality, verticalFOV, 
+		screenWidth, screenHeight, fullscreen, renderQuality, renderSettings, verticalFOV,
 		letterboxAspect, cursorScale, hSensitivity, vSensitivity, std::move(soundfont), 
 		musicVolume, soundVolume, soundChannels, skipIntro));
 }
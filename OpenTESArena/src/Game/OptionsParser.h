@@ -19,6 +19,18 @@ private:
 	static const std::string SCREEN_HEIGHT_KEY;
 	static const std::string FULLSCREEN_KEY;
 	static const std::string RENDER_QUALITY_KEY;
+	static const std::string DYNAMIC_RESOLUTION_KEY;
+	static const std::string MIN_RENDER_QUALITY_KEY;
+	static const std::string TARGET_FRAME_TIME_KEY;
+	static const std::string RENDER_BACKEND_KEY;
+	static const std::string PIPELINED_RENDERING_KEY;
+	static const std::string KERNEL_MODE_KEY;
+	static const std::string DEVICE_SPLIT_KEY;
+	static const std::string REPROJECTION_KEY;
+	static const std::string REFINE_BLOCK_SIZE_KEY;
+	static const std::string VOXEL_LAYOUT_KEY;
+	static const std::string SPRITE_MODE_KEY;
+	static const std::string PROFILE_RENDERING_KEY;
 	static const std::string VERTICAL_FOV_KEY;
 	static const std::string LETTERBOX_ASPECT_KEY;
 	static const std::string CURSOR_SCALE_KEY;
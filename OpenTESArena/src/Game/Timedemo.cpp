@@ -0,0 +1,275 @@
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+
+#include "SDL.h"
+
+#include "Timedemo.h"
+
+#include "CameraPath.h"
+#include "Options.h"
+#include "OptionsParser.h"
+#include "../Math/Float3.h"
+#include "../Media/TextureManager.h"
+#include "../Rendering/RenderProfiler.h"
+#include "../Rendering/RenderProgram.h"
+#include "../Rendering/RenderSettings.h"
+#include "../Rendering/Renderer.h"
+#include "../Utilities/Debug.h"
+
+#include "components/vfs/manager.hpp"
+
+Timedemo::Timedemo(const std::string &pathFilename, int frameCount, int warmupFrameCount)
+{
+	Debug::check(frameCount > 0, "Timedemo", "Frame count must be positive.");
+	Debug::check(warmupFrameCount >= 0, "Timedemo",
+		"Warmup frame count must not be negative.");
+
+	this->pathFilename = pathFilename;
+	this->frameCount = frameCount;
+	this->warmupFrameCount = warmupFrameCount;
+	this->dumpInterval = 0;
+	this->maxPercentile99 = 0.0;
+	this->voxelLayout = VoxelLayout::Linear;
+	this->voxelLayoutOverridden = false;
+	this->chunkSkipping = true;
+	this->stepCounted = false;
+	this->averageSteps = -1.0;
+}
+
+Timedemo::~Timedemo()
+{
+
+}
+
+double Timedemo::getPercentile(double percent) const
+{
+	assert(this->frameTimes.size() > 0);
+
+	std::vector<double> sortedTimes = this->frameTimes;
+	std::sort(sortedTimes.begin(), sortedTimes.end());
+
+	const int count = static_cast<int>(sortedTimes.size());
+	const int rank = static_cast<int>(std::ceil((percent / 100.0) * count));
+	return sortedTimes.at(std::min(std::max(rank, 1), count) - 1);
+}
+
+std::string Timedemo::getReport(const std::string &profilerReport) const
+{
+	const auto minMax = std::minmax_element(this->frameTimes.begin(),
+		this->frameTimes.end());
+	double totalTime = 0.0;
+	for (const double frameTime : this->frameTimes)
+	{
+		totalTime += frameTime;
+	}
+
+	const double average = totalTime / static_cast<double>(this->frameTimes.size());
+
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(3);
+	ss << "timedemo: render only (no game logic, input, audio, or interface)" << '\n';
+	ss << "path: " << this->pathFilename << '\n';
+	ss << "voxel layout: " <<
+		((this->voxelLayout == VoxelLayout::Tiled) ? "Tiled" : "Linear") << '\n';
+	ss << "chunk skipping: " << (this->chunkSkipping ? "On" : "Off") << '\n';
+	ss << "frames: " << this->frameTimes.size() << " (warmup " <<
+		this->warmupFrameCount << ")" << '\n';
+	ss << "average: " << average << " ms (" << (1000.0 / average) << " fps)" << '\n';
+	ss << "p50: " << this->getPercentile(50.0) << " ms" << '\n';
+	ss << "p95: " << this->getPercentile(95.0) << " ms" << '\n';
+	ss << "p99: " << this->getPercentile(99.0) << " ms" << '\n';
+	ss << "min: " << *minMax.first << " ms" << '\n';
+	ss << "max: " << *minMax.second << " ms" << '\n';
+
+	if (this->stepCounted)
+	{
+		ss << "steps per ray: ";
+		if (this->averageSteps >= 0.0)
+		{
+			ss << this->averageSteps << '\n';
+		}
+		else
+		{
+			ss << "not counted by this render program" << '\n';
+		}
+	}
+
+	if (profilerReport.size() > 0)
+	{
+		ss << '\n' << "stages:" << '\n' << profilerReport;
+	}
+
+	ss << '\n' << "frame,milliseconds" << '\n';
+	for (size_t i = 0; i < this->frameTimes.size(); ++i)
+	{
+		ss << i << ',' << this->frameTimes.at(i) << '\n';
+	}
+
+	return ss.str();
+}
+
+void Timedemo::setReportFilename(const std::string &filename)
+{
+	this->reportFilename = filename;
+}
+
+void Timedemo::setFrameDumps(const std::string &directory, int interval)
+{
+	Debug::check(interval > 0, "Timedemo", "Dump interval must be positive.");
+
+	this->dumpDirectory = directory;
+	this->dumpInterval = interval;
+}
+
+void Timedemo::setMaxPercentile99(double milliseconds)
+{
+	Debug::check(milliseconds > 0.0, "Timedemo",
+		"Max 99th percentile must be positive.");
+
+	this->maxPercentile99 = milliseconds;
+}
+
+void Timedemo::setVoxelLayout(VoxelLayout voxelLayout)
+{
+	this->voxelLayout = voxelLayout;
+	this->voxelLayoutOverridden = true;
+}
+
+void Timedemo::setChunkSkipping(bool chunkSkipping)
+{
+	this->chunkSkipping = chunkSkipping;
+}
+
+void Timedemo::setStepCounting(bool stepCounted)
+{
+	this->stepCounted = stepCounted;
+}
+
+int Timedemo::run()
+{
+	Debug::mention("Timedemo", "Running \"" + this->pathFilename + "\".");
+
+	const CameraPath cameraPath(this->pathFilename);
+
+	// Only what the game world needs is set up, in the same order as the game state.
+	std::unique_ptr<Options> options = OptionsParser::parse();
+	RenderSettings renderSettings = options->getRenderSettings();
+	if (this->voxelLayoutOverridden)
+	{
+		renderSettings.voxelLayout = this->voxelLayout;
+	}
+
+	this->voxelLayout = renderSettings.voxelLayout;
+	renderSettings.chunkSkipping = this->chunkSkipping;
+	renderSettings.stepCounted = this->stepCounted;
+	VFS::Manager::get().initialize(std::string(options->getArenaPath()));
+
+	Renderer renderer(options->getScreenWidth(), options->getScreenHeight(),
+		options->isFullscreen(), options->getLetterboxAspect());
+	TextureManager textureManager(renderer);
+
+	// Same test world dimensions as a new character gets.
+	const int worldWidth = 32;
+	const int worldHeight = 5;
+	const int worldDepth = 32;
+
+	std::unique_ptr<RenderProgram> renderProgram = RenderProgram::make(worldWidth,
+		worldHeight, worldDepth, textureManager, renderer, options->getRenderQuality(),
+		renderSettings);
+
+	// Fixed step along the path, with the warmup frames at the start of it.
+	const double startTime = cameraPath.getStartTime();
+	const double pathTime = cameraPath.getEndTime() - startTime;
+	const double timeStep = (this->frameCount > 1) ?
+		(pathTime / static_cast<double>(this->frameCount - 1)) : 0.0;
+	const double verticalFOV = options->getVerticalFOV();
+
+	this->frameTimes.clear();
+	this->frameTimes.reserve(this->frameCount);
+
+	const int totalFrameCount = this->warmupFrameCount + this->frameCount;
+	for (int i = 0; i < totalFrameCount; ++i)
+	{
+		const int frameIndex = std::max(i - this->warmupFrameCount, 0);
+		const double time = startTime + (timeStep * static_cast<double>(frameIndex));
+
+		// Only the timed frames are profiled and have their rays counted. The profiler
+		// keeps a sample per stage for every one of them.
+		if (i == this->warmupFrameCount)
+		{
+			renderProgram->resetProfiler(this->frameCount);
+			renderProgram->resetStepCounts();
+		}
+
+		// Keep the window responsive on a real video driver.
+		SDL_PumpEvents();
+
+		const auto frameStartTime = std::chrono::high_resolution_clock::now();
+
+		renderProgram->updateCamera(cameraPath.getPosition(time),
+			cameraPath.getDirection(time), verticalFOV);
+		renderProgram->updateGameTime(time);
+		renderProgram->render(renderer);
+		renderer.present();
+
+		const auto frameEndTime = std::chrono::high_resolution_clock::now();
+
+		if (i < this->warmupFrameCount)
+		{
+			continue;
+		}
+
+		this->frameTimes.push_back(std::chrono::duration<double, std::milli>(
+			frameEndTime - frameStartTime).count());
+
+		// Dumping is outside the timed part of the frame.
+		if ((this->dumpInterval > 0) && ((frameIndex % this->dumpInterval) == 0))
+		{
+			std::stringstream ss;
+			ss << this->dumpDirectory << "/frame" << std::setw(5) <<
+				std::setfill('0') << frameIndex << ".bmp";
+			renderer.saveNative(ss.str());
+		}
+	}
+
+	// The last frames' device timings might not be in yet.
+	renderProgram->waitForFrames();
+	this->averageSteps = renderProgram->getAverageStepsPerRay();
+
+	const RenderProfiler *profiler = renderProgram->getProfiler();
+	const std::string report = this->getReport(
+		(profiler != nullptr) ? profiler->getReport() : std::string());
+
+	if (this->reportFilename.size() > 0)
+	{
+		std::ofstream ofs(this->reportFilename);
+		Debug::check(ofs.is_open(), "Timedemo",
+			"Couldn't write \"" + this->reportFilename + "\".");
+		ofs << report;
+		Debug::mention("Timedemo", "Wrote report to \"" +
+			this->reportFilename + "\".");
+	}
+	else
+	{
+		Debug::mention("Timedemo", "Report:\n" + report);
+	}
+
+	const double percentile99 = this->getPercentile(99.0);
+	if ((this->maxPercentile99 > 0.0) && (percentile99 > this->maxPercentile99))
+	{
+		std::stringstream ss;
+		ss << std::fixed << std::setprecision(3) << "p99 of " << percentile99 <<
+			" ms is over the limit of " << this->maxPercentile99 << " ms.";
+		Debug::mention("Timedemo", ss.str());
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,87 @@
+#ifndef TIMEDEMO_H
+#define TIMEDEMO_H
+
+#include <string>
+#include <vector>
+
+#include "../Rendering/VoxelLayout.h"
+
+// A timedemo flies the camera along a camera path (see CameraPath) through the test
+// world and times every frame, so render changes can be compared on the same frames
+// from run to run. It skips the menus and character creation, and doesn't start the
+// audio manager or load cinematics.
+
+// It only measures rendering. The render program is driven straight from the camera
+// path without a game state, so a frame's time has no game logic, input, audio, or
+// interface drawing in it, and the report's header says so.
+
+// The path is sampled at a fixed step so that every run renders the same frames, no 
+// matter how fast they render. Some frames are rendered first as a warmup and aren't
+// timed (for kernel compilation, buffer creation, etc.). The render profiler and step
+// counts start over after them too.
+
+// The report has the average, 50th, 95th, and 99th percentile, min, and max frame 
+// times, the render profiler's stages if profiling is on, and a line per frame for
+// plotting. The stages are for the same timed frames as the frame times.
+
+// With SDL's dummy video driver, nothing is shown and no display is needed, so it can
+// run on a build machine. The frames can still be dumped to BMP files for checking
+// that a change didn't alter the image.
+
+// Some render settings can be overridden for one run (i.e., the voxel layout), so the
+// same path can be compared with each setting without editing the options file. Chunk
+// skipping can only be turned off here, to measure what it saves. Steps per ray can
+// only be counted here too; counting slows the rays down, so a counted run's frame
+// times aren't comparable to an uncounted one's.
+
+class Timedemo
+{
+private:
+	std::string pathFilename, reportFilename, dumpDirectory;
+	std::vector<double> frameTimes; // In milliseconds.
+	int frameCount, warmupFrameCount, dumpInterval;
+	double maxPercentile99; // In milliseconds, or zero for no limit.
+	VoxelLayout voxelLayout; // The options' layout unless overridden.
+	bool voxelLayoutOverridden;
+	bool chunkSkipping;
+	bool stepCounted;
+	double averageSteps; // Steps per ray, or negative if not counted.
+
+	// Gets the frame time at or below which the given percent of frames are, using the
+	// nearest rank.
+	double getPercentile(double percent) const;
+
+	// Gets the summary and per-frame times as text. The profiler report is appended
+	// if there is one.
+	std::string getReport(const std::string &profilerReport) const;
+public:
+	// Constructs a timedemo that renders the given number of timed frames spread evenly
+	// over the camera path in the given file.
+	Timedemo(const std::string &pathFilename, int frameCount, int warmupFrameCount);
+	~Timedemo();
+
+	// Writes the report to a file instead of the log.
+	void setReportFilename(const std::string &filename);
+
+	// Saves every Nth timed frame to a BMP file in the given directory.
+	void setFrameDumps(const std::string &directory, int interval);
+
+	// Makes run() fail if the 99th percentile frame time is over the given time.
+	void setMaxPercentile99(double milliseconds);
+
+	// Uses the given voxel layout instead of the one in the options.
+	void setVoxelLayout(VoxelLayout voxelLayout);
+
+	// Sets whether rays jump over empty chunks (on by default).
+	void setChunkSkipping(bool chunkSkipping);
+
+	// Sets whether the average voxel grid steps per ray of the timed frames goes in
+	// the report (off by default).
+	void setStepCounting(bool stepCounted);
+
+	// Sets up the renderer and test world, renders the frames, and writes the report.
+	// Returns EXIT_SUCCESS, or EXIT_FAILURE if the frames were too slow.
+	int run();
+};
+
+#endif
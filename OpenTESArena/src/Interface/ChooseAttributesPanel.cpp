@@ -28,7 +28,7 @@
 #include "../Media/TextureManager.h"
 #include "../Media/TextureName.h"
 #include "../Media/TextureSequenceName.h"
-#include "../Rendering/CLProgram.h"
+#include "../Rendering/RenderProgram.h"
 #include "../Rendering/Renderer.h"
 #include "../Utilities/Debug.h"
 #include "../Utilities/String.h"
@@ -107,7 +107,7 @@ ChooseAttributesPanel::ChooseAttributesPanel(GameState *gameState,
 		{
 			// Make placeholders here for the game data. They'll be more informed
 			// in the future once the player has a place in the world and the options
-			// menu has settings for the CLProgram.
+			// menu has settings for the render program.
 			std::unique_ptr<EntityManager> entityManager(new EntityManager());
 
 			Float3d position = Float3d(1.50, 1.70, 2.50); // Arbitrary player height.
@@ -127,15 +127,16 @@ ChooseAttributesPanel::ChooseAttributesPanel(GameState *gameState,
 			int worldHeight = 5;
 			int worldDepth = 32;
 
-			std::unique_ptr<CLProgram> clProgram(new CLProgram(
+			std::unique_ptr<RenderProgram> renderProgram = RenderProgram::make(
 				worldWidth, worldHeight, worldDepth,
 				gameState->getTextureManager(),
 				gameState->getRenderer(),
-				gameState->getOptions().getRenderQuality()));
+				gameState->getOptions().getRenderQuality(),
+				gameState->getOptions().getRenderSettings());
 
 			double gameTime = 0.0; // In seconds. Also affects sun position.
 			std::unique_ptr<GameData> gameData(new GameData(
-				std::move(player), std::move(entityManager), std::move(clProgram),
+				std::move(player), std::move(entityManager), std::move(renderProgram),
 				gameTime, worldWidth, worldHeight, worldDepth));
 
 			// Set the game data before constructing the game world panel.
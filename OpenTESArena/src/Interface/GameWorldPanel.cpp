@@ -29,7 +29,8 @@
 #include "../Media/TextureFile.h"
 #include "../Media/TextureManager.h"
 #include "../Media/TextureName.h"
-#include "../Rendering/CLProgram.h"
+#include "../Rendering/RenderProfiler.h"
+#include "../Rendering/RenderProgram.h"
 #include "../Rendering/Renderer.h"
 #include "../Utilities/Debug.h"
 
@@ -104,6 +105,10 @@ GameWorldPanel::GameWorldPanel(GameState *gameState)
 		};
 		return std::unique_ptr<Button>(new Button(function));
 	}();
+
+	// The render program outlives the panel, so start it without the debug view.
+	this->debugView = false;
+	gameState->getGameData()->getRenderProgram().setDebugView(this->debugView);
 }
 
 GameWorldPanel::~GameWorldPanel()
@@ -149,6 +154,10 @@ void GameWorldPanel::handleEvents(bool &running)
 			(e.key.keysym.sym == SDLK_TAB);
 		bool worldMapHotkeyPressed = (e.type == SDL_KEYDOWN) &&
 			(e.key.keysym.sym == SDLK_m);
+		bool profileHotkeyPressed = (e.type == SDL_KEYDOWN) &&
+			(e.key.keysym.sym == SDLK_F3);
+		bool debugViewHotkeyPressed = (e.type == SDL_KEYDOWN) &&
+			(e.key.keysym.sym == SDLK_F4);
 
 		if (leftClick)
 		{
@@ -178,6 +187,33 @@ void GameWorldPanel::handleEvents(bool &running)
 			// Go to the world map.
 			this->worldMapButton->click(this->getGameState());
 		}
+		else if (profileHotkeyPressed)
+		{
+			// Print the render timings if the render program is being profiled.
+			const RenderProfiler *profiler =
+				this->getGameState()->getGameData()->getRenderProgram().getProfiler();
+			if (profiler != nullptr)
+			{
+				Debug::mention("GameWorldPanel", "Render timings:\n" +
+					profiler->getReport());
+			}
+		}
+		else if (debugViewHotkeyPressed)
+		{
+			// Toggle the render program's debug view (i.e., reused pixels).
+			RenderProgram &renderProgram =
+				this->getGameState()->getGameData()->getRenderProgram();
+			if (renderProgram.hasDebugView())
+			{
+				this->debugView = !this->debugView;
+				renderProgram.setDebugView(this->debugView);
+			}
+			else
+			{
+				Debug::mention("GameWorldPanel", "The debug view needs the OpenCL render "
+					"program with reprojection or edge refinement.");
+			}
+		}
 	}
 }
 
@@ -284,11 +320,11 @@ void GameWorldPanel::tick(double dt, bool &running)
 	auto &player = gameData->getPlayer();
 	player.tick(this->getGameState(), dt);
 
-	// Update CLProgram members that are refreshed each frame.
+	// Update render program members that are refreshed each frame.
 	double verticalFOV = this->getGameState()->getOptions().getVerticalFOV();
-	auto &clProgram = gameData->getCLProgram();
-	clProgram.updateCamera(player.getPosition(), player.getDirection(), verticalFOV);
-	clProgram.updateGameTime(gameData->getGameTime());
+	auto &renderProgram = gameData->getRenderProgram();
+	renderProgram.updateCamera(player.getPosition(), player.getDirection(), verticalFOV);
+	renderProgram.updateGameTime(gameData->getGameTime());
 }
 
 void GameWorldPanel::render(Renderer &renderer)
@@ -298,8 +334,8 @@ void GameWorldPanel::render(Renderer &renderer)
 	// Clear original frame buffer.
 	renderer.clearOriginal();
 
-	// Draw game world using OpenCL rendering.
-	this->getGameState()->getGameData()->getCLProgram().render(renderer);
+	// Draw game world using the selected render program.
+	this->getGameState()->getGameData()->getRenderProgram().render(renderer);
 
 	// Set screen palette.
 	auto &textureManager = this->getGameState()->getTextureManager();
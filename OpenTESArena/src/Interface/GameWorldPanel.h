@@ -22,6 +22,7 @@ private:
 	std::unique_ptr<TextBox> playerNameTextBox;
 	std::unique_ptr<Button> automapButton, characterSheetButton, logbookButton, 
 		pauseButton, worldMapButton;
+	bool debugView; // Whether the render program shows its debug view.
 protected:
 	virtual void handleEvents(bool &running) override;
 	virtual void handleMouse(double dt) override;
@@ -1,14 +1,190 @@
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
 #include <iostream>
+#include <string>
 
 #include "SDL.h"
 
 #include "Game/Game.h"
+#include "Game/Timedemo.h"
+#include "Rendering/VoxelLayout.h"
+#include "Utilities/Debug.h"
+
+namespace
+{
+	// Parses a whole argument value as an integer, stopping the program if it isn't one.
+	int parseInteger(const std::string &arg, const std::string &value)
+	{
+		char *end = nullptr;
+		errno = 0;
+		const long number = std::strtol(value.c_str(), &end, 10);
+		Debug::check((value.size() > 0) && (*end == '\0') && (errno == 0) &&
+			(number >= INT_MIN) && (number <= INT_MAX), "Main",
+			"Value \"" + value + "\" for \"" + arg + "\" must be an integer.");
+
+		return static_cast<int>(number);
+	}
+
+	// Parses a whole argument value as a number, stopping the program if it isn't one.
+	double parseDouble(const std::string &arg, const std::string &value)
+	{
+		char *end = nullptr;
+		errno = 0;
+		const double number = std::strtod(value.c_str(), &end);
+		Debug::check((value.size() > 0) && (*end == '\0') && (errno == 0), "Main",
+			"Value \"" + value + "\" for \"" + arg + "\" must be a number.");
+
+		return number;
+	}
+
+	// Returns whether the arguments ask for a timedemo.
+	bool isTimedemo(int argc, char *argv[])
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			if (std::string(argv[i]) == "--timedemo")
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	// Runs a timedemo with the given arguments (see the README). Returns the exit code.
+	int runTimedemo(int argc, char *argv[])
+	{
+		std::string pathFilename, reportFilename, dumpDirectory;
+		int frameCount = 1000;
+		int warmupFrameCount = 60;
+		int dumpInterval = 1;
+		double maxPercentile99 = 0.0;
+		std::string voxelLayout, chunkSkipping;
+		bool dummyVideo = false;
+		bool countSteps = false;
+
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string arg(argv[i]);
+			const bool hasValue = (i + 1) < argc;
+			if (arg == "--dummy-video")
+			{
+				dummyVideo = true;
+				continue;
+			}
+			else if (arg == "--count-steps")
+			{
+				countSteps = true;
+				continue;
+			}
+
+			Debug::check(hasValue, "Main", "Missing value for \"" + arg + "\".");
+			const std::string value(argv[++i]);
+			if (arg == "--timedemo")
+			{
+				pathFilename = value;
+			}
+			else if (arg == "--frames")
+			{
+				frameCount = parseInteger(arg, value);
+			}
+			else if (arg == "--warmup")
+			{
+				warmupFrameCount = parseInteger(arg, value);
+			}
+			else if (arg == "--report")
+			{
+				reportFilename = value;
+			}
+			else if (arg == "--dump-frames")
+			{
+				dumpDirectory = value;
+			}
+			else if (arg == "--dump-every")
+			{
+				dumpInterval = parseInteger(arg, value);
+				Debug::check(dumpInterval > 0, "Main", "Dump interval must be positive.");
+			}
+			else if (arg == "--max-p99")
+			{
+				maxPercentile99 = parseDouble(arg, value);
+				Debug::check(maxPercentile99 > 0.0, "Main",
+					"Max 99th percentile must be positive.");
+			}
+			else if (arg == "--voxel-layout")
+			{
+				Debug::check((value == "Linear") || (value == "Tiled"), "Main",
+					"Voxel layout must be \"Linear\" or \"Tiled\".");
+				voxelLayout = value;
+			}
+			else if (arg == "--chunk-skipping")
+			{
+				Debug::check((value == "On") || (value == "Off"), "Main",
+					"Chunk skipping must be \"On\" or \"Off\".");
+				chunkSkipping = value;
+			}
+			else
+			{
+				Debug::crash("Main", "Unrecognized argument \"" + arg + "\".");
+			}
+		}
+
+		Debug::check(pathFilename.size() > 0, "Main",
+			"\"--timedemo\" needs a camera path file.");
+
+		// The video driver has to be chosen before the window is created.
+		if (dummyVideo)
+		{
+			SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+		}
+
+		Timedemo timedemo(pathFilename, frameCount, warmupFrameCount);
+
+		if (reportFilename.size() > 0)
+		{
+			timedemo.setReportFilename(reportFilename);
+		}
+
+		if (dumpDirectory.size() > 0)
+		{
+			timedemo.setFrameDumps(dumpDirectory, dumpInterval);
+		}
+
+		if (maxPercentile99 > 0.0)
+		{
+			timedemo.setMaxPercentile99(maxPercentile99);
+		}
+
+		if (voxelLayout.size() > 0)
+		{
+			timedemo.setVoxelLayout((voxelLayout == "Tiled") ?
+				VoxelLayout::Tiled : VoxelLayout::Linear);
+		}
+
+		if (chunkSkipping.size() > 0)
+		{
+			timedemo.setChunkSkipping(chunkSkipping == "On");
+		}
+
+		if (countSteps)
+		{
+			timedemo.setStepCounting(true);
+		}
+
+		return timedemo.run();
+	}
+}
 
 int main(int argc, char *argv[])
 {
-	// It shouldn't be taking any command line arguments; it loads from text files.
-	static_cast<void>(argc);
-	static_cast<void>(argv);
+	// The game itself doesn't take any command line arguments; it loads from text 
+	// files. Arguments are only for running a timedemo, and anything else (i.e., the
+	// process serial number macOS passes) is ignored.
+	if (isTimedemo(argc, argv))
+	{
+		return runTimedemo(argc, argv);
+	}
 
 	Game g;
 	g.loop();
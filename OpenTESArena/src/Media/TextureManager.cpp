@@ -404,6 +404,11 @@ void TextureManager::setPalette(const std::string &paletteName)
 	this->activePalette = paletteName;
 }
 
+const Palette &TextureManager::getPalette() const
+{
+	return this->palettes.at(this->activePalette);
+}
+
 void TextureManager::preloadSequences()
 {
 	Debug::mention("Texture Manager", "Preloading sequences.");
@@ -82,6 +82,9 @@ public:
 	// built-in palette, an error occurs.
 	void setPalette(const std::string &filename);
 
+	// Gets the colors of the palette set by setPalette().
+	const Palette &getPalette() const;
+
 	// To do: remove this method once FLC movies can be loaded through "getTextures()".
 	// Since cinematics are now loaded image by image instead of all at the same time,
 	// there may be some stuttering that occurs. This method loads all of the sequences
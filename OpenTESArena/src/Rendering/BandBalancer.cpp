@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "BandBalancer.h"
+
+namespace
+{
+	// How much of each new frame's time per row goes into the smoothed time per row.
+	const double SMOOTHING = 0.2;
+
+	// Smallest time per row, so a band that measured nothing doesn't take every row.
+	const double MIN_ROW_COST = 0.000001;
+}
+
+BandBalancer::BandBalancer(int bandCount)
+{
+	assert(bandCount > 0);
+
+	this->rowCosts = std::vector<double>(bandCount, -1.0);
+}
+
+BandBalancer::~BandBalancer()
+{
+
+}
+
+int BandBalancer::getBandCount() const
+{
+	return static_cast<int>(this->rowCosts.size());
+}
+
+std::vector<int> BandBalancer::split(int rowCount) const
+{
+	assert(rowCount >= 0);
+
+	const int bandCount = this->getBandCount();
+
+	// Bands that haven't been timed yet count as equally fast as each other.
+	const bool timed = std::find_if(this->rowCosts.begin(), this->rowCosts.end(),
+		[](double rowCost) { return rowCost < 0.0; }) == this->rowCosts.end();
+	std::vector<double> speeds(bandCount, 1.0);
+	double totalSpeed = static_cast<double>(bandCount);
+	if (timed)
+	{
+		totalSpeed = 0.0;
+		for (int i = 0; i < bandCount; ++i)
+		{
+			speeds.at(i) = 1.0 / this->rowCosts.at(i);
+			totalSpeed += speeds.at(i);
+		}
+	}
+
+	// Round where each band ends instead of each band's height, so the heights always
+	// add up to the row count.
+	const int minRows = (rowCount >= bandCount) ? 1 : 0;
+	std::vector<int> bandRows(bandCount);
+	double share = 0.0;
+	int start = 0;
+	for (int i = 0; i < bandCount; ++i)
+	{
+		share += speeds.at(i) / totalSpeed;
+
+		const int bandsLeft = bandCount - i - 1;
+		int end = (bandsLeft == 0) ? rowCount :
+			static_cast<int>(std::round(static_cast<double>(rowCount) * share));
+		end = std::min(std::max(end, start + minRows), rowCount - (bandsLeft * minRows));
+
+		bandRows.at(i) = end - start;
+		start = end;
+	}
+
+	return bandRows;
+}
+
+void BandBalancer::update(int bandIndex, int rowCount, double milliseconds)
+{
+	assert(milliseconds >= 0.0);
+
+	// A band with no rows says nothing about its device's speed.
+	if (rowCount <= 0)
+	{
+		return;
+	}
+
+	double &rowCost = this->rowCosts.at(bandIndex);
+	const double cost = std::max(milliseconds / static_cast<double>(rowCount),
+		MIN_ROW_COST);
+	rowCost = (rowCost < 0.0) ? cost : (rowCost + ((cost - rowCost) * SMOOTHING));
+}
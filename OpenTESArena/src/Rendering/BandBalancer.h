@@ -0,0 +1,36 @@
+#ifndef BAND_BALANCER_H
+#define BAND_BALANCER_H
+
+#include <vector>
+
+// A band balancer splits the rows of a frame into horizontal bands, one per device,
+// so that every device finishes its band at about the same time. 
+
+// Each band's time per row is smoothed over the last few frames, and the next frame
+// gives every band a share of the rows that goes with its speed (rows per millisecond).
+// A device that took longer than the others this frame gets fewer rows next frame.
+// Rows aren't all equally costly (i.e., sky is cheap), so the split keeps adjusting
+// as the camera moves, but the smoothing keeps it from jumping around.
+
+// Rows are split evenly until every band has been timed once. Every band gets at 
+// least one row if there are enough rows to go around.
+
+class BandBalancer
+{
+private:
+	std::vector<double> rowCosts; // Smoothed milliseconds per row, or negative at first.
+public:
+	BandBalancer(int bandCount);
+	~BandBalancer();
+
+	int getBandCount() const;
+
+	// Gets the number of rows in each band, top to bottom, for a frame with the given
+	// number of rows. The counts add up to the row count.
+	std::vector<int> split(int rowCount) const;
+
+	// Adjusts a band's share of the rows with how long it took to render its rows.
+	void update(int bandIndex, int rowCount, double milliseconds);
+};
+
+#endif
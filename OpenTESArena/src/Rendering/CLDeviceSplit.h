@@ -0,0 +1,17 @@
+#ifndef CL_DEVICE_SPLIT_H
+#define CL_DEVICE_SPLIT_H
+
+// A device split decides which OpenCL devices share the rendering of each frame. 
+// None renders on one device. Devices splits the frame into horizontal bands across
+// every device of the chosen type on the platform (i.e., two GPUs). NUMA partitions
+// the device into one sub-device per NUMA node (i.e., each socket of a dual-socket 
+// CPU) and gives each one a band, so each socket works on its own memory.
+
+enum class CLDeviceSplit
+{
+	None,
+	Devices,
+	NUMA
+};
+
+#endif
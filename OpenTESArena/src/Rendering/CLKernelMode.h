@@ -0,0 +1,17 @@
+#ifndef CL_KERNEL_MODE_H
+#define CL_KERNEL_MODE_H
+
+// A kernel mode decides which kernels the OpenCL render program runs each frame.
+// Full uses the kernels in kernel.cl and their wide per-pixel buffers. Lean splits
+// the frame into an intersect kernel and a shade kernel that only share a depth and
+// a packed hit per pixel. Fused does everything in one kernel with no per-pixel 
+// buffers besides the output.
+
+enum class CLKernelMode
+{
+	Full,
+	Lean,
+	Fused
+};
+
+#endif
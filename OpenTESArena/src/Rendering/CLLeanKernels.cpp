@@ -0,0 +1,968 @@
+#include "CLLeanKernels.h"
+
+const std::string CLLeanKernels::INTERSECT_KERNEL = "leanIntersect";
+const std::string CLLeanKernels::SHADE_KERNEL = "leanShade";
+const std::string CLLeanKernels::FUSED_KERNEL = "fusedRender";
+const std::string CLLeanKernels::REPROJECT_KERNEL = "leanReproject";
+const std::string CLLeanKernels::REUSE_VIEW_KERNEL = "leanReuseView";
+const std::string CLLeanKernels::REFINE_CORNERS_KERNEL = "leanRefineCorners";
+const std::string CLLeanKernels::REFINE_KERNEL = "leanRefine";
+const std::string CLLeanKernels::SPRITES_KERNEL = "leanSprites";
+const int CLLeanKernels::WORLD_ARG_COUNT = 15;
+const int CLLeanKernels::REFRESH_INTERVAL = 8;
+
+const std::string CLLeanKernels::SOURCE = R"CL(
+// Ray offset for avoiding self-intersection with the surface a ray starts on.
+#define LEAN_RAY_EPSILON 1.0e-4f
+
+// Real-time seconds in one game day. The sun starts in the morning.
+#define LEAN_SECONDS_PER_DAY 120.0f
+#define LEAN_SUN_START_ANGLE (M_PI_F * 0.25f)
+
+// Each rectangle is p1, p2, p3, p1p2, p2p3, and normal as float3's, then a texture
+// reference (int offset, short width, short height, int mip level count) and padding.
+// That's seven float4's.
+#define LEAN_RECTANGLE_STRIDE 7
+
+// Each light is its position and radius, then its color. That's two float4's.
+#define LEAN_LIGHT_STRIDE 2
+
+// Camera members, in float4's.
+#define LEAN_CAMERA_EYE 0
+#define LEAN_CAMERA_FORWARD 1
+#define LEAN_CAMERA_RIGHT 2
+#define LEAN_CAMERA_UP 3
+#define LEAN_CAMERA_ZOOM 4
+
+// A packed hit is (rectangle index + 1) << 3 | face index, or zero for no hit. Face
+// indices are (axis * 2) + 1 if the normal facing the ray is negative along the axis.
+// Sprite hits have the top bit set and index the sprite rectangles instead. Sprites
+// aren't axis-aligned, so their face index is 1 if their normal is flipped.
+#define LEAN_NO_HIT 0u
+#define LEAN_SPRITE_HIT 0x80000000u
+
+// Rows whose index plus the refresh phase is a multiple of this are always traced in
+// full by the reprojection kernel, so a wrongly reused hit can't last more than this
+// many frames. Same as CLLeanKernels::REFRESH_INTERVAL.
+#define LEAN_REFRESH_INTERVAL 8
+
+// How much nearer than a reprojected point a last frame's neighbor can be before the
+// point counts as being on a silhouette edge (where it might be covered now).
+#define LEAN_REPROJECT_TOLERANCE 0.1f
+
+// How many times further than its nearest corner a block's farthest corner can be 
+// before the block is refined anyway. Blocks of a wall seen at a grazing angle cover
+// a lot of it, so small things in front of it are easier to miss.
+#define LEAN_REFINE_DEPTH_RATIO 1.5f
+
+// Width and height in pixels of the screen tiles that rasterized sprites are binned
+// into. Same as SpriteTiles::TILE_SIZE.
+#define LEAN_SPRITE_TILE_SIZE 32
+
+// Chunks in the coarse occupancy level along each axis. Defining LEAN_NO_CHUNK_SKIPPING
+// makes rays step through empty chunks voxel by voxel, for measuring what skipping saves.
+#define LEAN_CHUNKS_X ((WORLD_WIDTH + CHUNK_WIDTH - 1) / CHUNK_WIDTH)
+#define LEAN_CHUNKS_Y ((WORLD_HEIGHT + CHUNK_HEIGHT - 1) / CHUNK_HEIGHT)
+
+// The world buffers, gathered together so they can be passed around as one.
+typedef struct
+{
+	global const int2 *voxelRefs;
+	global const uint *chunkOccupancy; // One bit per chunk with any rectangles.
+	global const int2 *spriteRefs;
+	global const float4 *spriteRectangles;
+	global const int2 *lightRefs;
+	global const int *lightIndices; // Lights that reach into each voxel.
+	global const float4 *lights;
+	global const float4 *rectangles;
+	global const uchar *textures;
+	global const float4 *palette;
+	global uint *stepCounts; // Rays cast (0) and their grid steps (1), if counted.
+} LeanWorld;
+
+float3 leanRayDirection(global const float4 *camera, int x, int y, int renderWidth,
+	int renderHeight)
+{
+	const float screenX = ((2.0f * ((float)x + 0.5f)) / (float)renderWidth) - 1.0f;
+	const float screenY = 1.0f - ((2.0f * ((float)y + 0.5f)) / (float)renderHeight);
+	const float aspect = (float)renderWidth / (float)renderHeight;
+	const float zoom = ((global const float*)(camera + LEAN_CAMERA_ZOOM))[0];
+
+	return normalize((camera[LEAN_CAMERA_FORWARD].xyz * zoom) +
+		(camera[LEAN_CAMERA_RIGHT].xyz * (screenX * aspect)) +
+		(camera[LEAN_CAMERA_UP].xyz * screenY));
+}
+
+float3 leanFaceNormal(uint face)
+{
+	const float faceSign = ((face & 1u) != 0u) ? -1.0f : 1.0f;
+	const uint axis = face >> 1;
+	return (float3)((axis == 0u) ? faceSign : 0.0f, (axis == 1u) ? faceSign : 0.0f,
+		(axis == 2u) ? faceSign : 0.0f);
+}
+
+uint leanNormalToFace(float3 normal)
+{
+	const float3 absNormal = fabs(normal);
+	if ((absNormal.x >= absNormal.y) && (absNormal.x >= absNormal.z))
+	{
+		return (normal.x < 0.0f) ? 1u : 0u;
+	}
+	else if (absNormal.y >= absNormal.z)
+	{
+		return (normal.y < 0.0f) ? 3u : 2u;
+	}
+	else
+	{
+		return (normal.z < 0.0f) ? 5u : 4u;
+	}
+}
+
+// Gets the palette index of a rectangle's texel at the given texture coordinates and
+// mip level. Levels past the texture's smallest one use its smallest one. Each level
+// comes right after the one before it, at half the size (see RenderWorld). Index 0 is
+// transparent.
+uchar leanSampleTextureLevel(global const float4 *rect, global const uchar *textures,
+	float u, float v, int level)
+{
+	global const int *textureRef = (global const int*)(rect + 6);
+	int offset = textureRef[0];
+	const int dimensions = textureRef[1];
+	int width = dimensions & 0xFFFF;
+	int height = (dimensions >> 16) & 0xFFFF;
+	const int lastLevel = min(level, textureRef[2] - 1);
+	for (int i = 0; i < lastLevel; i++)
+	{
+		offset += width * height;
+		width = max(width >> 1, 1);
+		height = max(height >> 1, 1);
+	}
+
+	const int x = min((int)(u * (float)width), width - 1);
+	const int y = min((int)(v * (float)height), height - 1);
+	return textures[offset + x + (y * width)];
+}
+
+// Gets the palette index of a rectangle's full size texel at the given texture
+// coordinates. Hits are always found at full size, so mip levels can't change what
+// a ray sees through.
+uchar leanSampleTexture(global const float4 *rect, global const uchar *textures,
+	float u, float v)
+{
+	return leanSampleTextureLevel(rect, textures, u, v, 0);
+}
+
+// Picks the mip level whose texels are about as big as a pixel's footprint on a
+// rectangle. The footprint grows with distance and stretches at grazing angles. It
+// uses the geometric mean of the stretched and unstretched sides, so the ground down
+// a long street doesn't blur out.
+int leanTextureLevel(global const float4 *rect, float3 direction, float3 normal,
+	float t, float pixelAngle)
+{
+	global const int *textureRef = (global const int*)(rect + 6);
+	const int dimensions = textureRef[1];
+	const float width = (float)(dimensions & 0xFFFF);
+	const float height = (float)((dimensions >> 16) & 0xFFFF);
+	const float cosine = max(fabs(dot(direction, normal)), 0.05f);
+	const float footprint = (t * pixelAngle) / sqrt(cosine);
+	const float texels = footprint * fmax(width / length(rect[4].xyz),
+		height / length(rect[3].xyz));
+	return (texels > 1.0f) ? (int)log2(texels) : 0;
+}
+
+// Angle in radians that a pixel in the middle of the screen spans.
+float leanPixelAngle(global const float4 *camera, int renderHeight)
+{
+	const float zoom = ((global const float*)(camera + LEAN_CAMERA_ZOOM))[0];
+	return 2.0f / (zoom * (float)renderHeight);
+}
+
+// Texture coordinates of a point on a rectangle, inferred from the rectangle's points.
+float2 leanRectangleUV(global const float4 *rect, float3 point)
+{
+	const float3 local = point - rect[0].xyz;
+	const float3 p1p2 = rect[3].xyz;
+	const float3 p2p3 = rect[4].xyz;
+	return (float2)(dot(local, p2p3) / dot(p2p3, p2p3), dot(local, p1p2) / dot(p1p2, p1p2));
+}
+
+// Finds the closest opaque rectangle in a range that the ray hits closer than both
+// closestT and maxT, and updates closestT and the packed hit if there is one.
+void leanIntersectRectangles(float3 origin, float3 direction,
+	global const float4 *rectangles, int offset, int count, global const uchar *textures,
+	float maxT, bool sprites, float *closestT, uint *hit)
+{
+	for (int i = offset; i < (offset + count); i++)
+	{
+		global const float4 *rect = rectangles + (i * LEAN_RECTANGLE_STRIDE);
+		const float3 normal = rect[5].xyz;
+		const float denominator = dot(direction, normal);
+		if (denominator == 0.0f)
+		{
+			continue;
+		}
+
+		const float t = dot(rect[0].xyz - origin, normal) / denominator;
+		if ((t <= LEAN_RAY_EPSILON) || (t >= *closestT) || (t > maxT))
+		{
+			continue;
+		}
+
+		const float2 uv = leanRectangleUV(rect, origin + (direction * t));
+		if ((uv.x < 0.0f) || (uv.x > 1.0f) || (uv.y < 0.0f) || (uv.y > 1.0f))
+		{
+			continue;
+		}
+
+		if (leanSampleTexture(rect, textures, uv.x, uv.y) == 0)
+		{
+			continue;
+		}
+
+		// Save the face of the normal that faces the ray.
+		const float3 rayNormal = (denominator < 0.0f) ? normal : -normal;
+		*closestT = t;
+		*hit = sprites ?
+			(LEAN_SPRITE_HIT | (((uint)i + 1u) << 3) | ((denominator < 0.0f) ? 0u : 1u)) :
+			((((uint)i + 1u) << 3) | leanNormalToFace(rayNormal));
+	}
+}
+
+// Walks the voxel grid and finds the closest opaque rectangle the ray hits. Returns
+// the packed hit, and the distance to it in tHit. Every voxel or empty chunk stepped
+// through is added to the step count.
+uint leanWalkRay(float3 origin, float3 direction, const LeanWorld *world, float *tHit,
+	uint *stepCount)
+{
+	const float originArr[3] = { origin.x, origin.y, origin.z };
+	const float directionArr[3] = { direction.x, direction.y, direction.z };
+	const int gridSize[3] = { WORLD_WIDTH, WORLD_HEIGHT, WORLD_DEPTH };
+	const int chunkSize[3] = { CHUNK_WIDTH, CHUNK_HEIGHT, CHUNK_DEPTH };
+
+	// Clip the ray against the voxel grid's bounding box.
+	float tStart = 0.0f;
+	float tEnd = FLT_MAX;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		const float bound = (float)gridSize[axis];
+		if (directionArr[axis] == 0.0f)
+		{
+			if ((originArr[axis] < 0.0f) || (originArr[axis] > bound))
+			{
+				return LEAN_NO_HIT;
+			}
+		}
+		else
+		{
+			const float t1 = -originArr[axis] / directionArr[axis];
+			const float t2 = (bound - originArr[axis]) / directionArr[axis];
+			tStart = fmax(tStart, fmin(t1, t2));
+			tEnd = fmin(tEnd, fmax(t1, t2));
+		}
+	}
+
+	if (tStart > tEnd)
+	{
+		return LEAN_NO_HIT;
+	}
+
+	// Set up the 3D-DDA walk from the voxel the ray starts in.
+	int cell[3], step[3];
+	float tMax[3], tDelta[3];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		const float start = originArr[axis] + (directionArr[axis] * tStart);
+		cell[axis] = clamp((int)floor(start), 0, gridSize[axis] - 1);
+
+		if (directionArr[axis] > 0.0f)
+		{
+			step[axis] = 1;
+			tDelta[axis] = 1.0f / directionArr[axis];
+			tMax[axis] = ((float)(cell[axis] + 1) - originArr[axis]) / directionArr[axis];
+		}
+		else if (directionArr[axis] < 0.0f)
+		{
+			step[axis] = -1;
+			tDelta[axis] = -1.0f / directionArr[axis];
+			tMax[axis] = ((float)cell[axis] - originArr[axis]) / directionArr[axis];
+		}
+		else
+		{
+			step[axis] = 0;
+			tDelta[axis] = FLT_MAX;
+			tMax[axis] = FLT_MAX;
+		}
+	}
+
+	while (true)
+	{
+		(*stepCount)++;
+
+#ifndef LEAN_NO_CHUNK_SKIPPING
+		const int chunkIndex = (cell[0] / CHUNK_WIDTH) +
+			((cell[1] / CHUNK_HEIGHT) * LEAN_CHUNKS_X) +
+			((cell[2] / CHUNK_DEPTH) * LEAN_CHUNKS_X * LEAN_CHUNKS_Y);
+
+		if (((world->chunkOccupancy[chunkIndex >> 5] >> (chunkIndex & 31)) & 1u) == 0u)
+		{
+			// The chunk is empty, so jump to where the ray leaves it. Chunks on the 
+			// far edges of the grid can be cut short.
+			int chunkMin[3], chunkMax[3];
+			int exitAxis = 0;
+			float tExit = FLT_MAX;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				chunkMin[axis] = (cell[axis] / chunkSize[axis]) * chunkSize[axis];
+				chunkMax[axis] = min(chunkMin[axis] + chunkSize[axis], gridSize[axis]);
+
+				if (step[axis] != 0)
+				{
+					const int boundary = (step[axis] > 0) ? chunkMax[axis] : chunkMin[axis];
+					const float t = ((float)boundary - originArr[axis]) / directionArr[axis];
+					if (t < tExit)
+					{
+						tExit = t;
+						exitAxis = axis;
+					}
+				}
+			}
+
+			if (tExit > tEnd)
+			{
+				return LEAN_NO_HIT;
+			}
+
+			// Continue from the first voxel past the chunk on the exit axis, and the
+			// voxel the ray is in on the other axes.
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if (axis == exitAxis)
+				{
+					cell[axis] = (step[axis] > 0) ? chunkMax[axis] : (chunkMin[axis] - 1);
+					if ((cell[axis] < 0) || (cell[axis] >= gridSize[axis]))
+					{
+						return LEAN_NO_HIT;
+					}
+				}
+				else
+				{
+					const float exitPoint = originArr[axis] + (directionArr[axis] * tExit);
+					cell[axis] = clamp((int)floor(exitPoint), chunkMin[axis],
+						chunkMax[axis] - 1);
+				}
+
+				if (step[axis] > 0)
+				{
+					tMax[axis] = ((float)(cell[axis] + 1) - originArr[axis]) /
+						directionArr[axis];
+				}
+				else if (step[axis] < 0)
+				{
+					tMax[axis] = ((float)cell[axis] - originArr[axis]) / directionArr[axis];
+				}
+			}
+
+			continue;
+		}
+#endif
+
+		const int voxelIndex = getVoxelIndex(cell[0], cell[1], cell[2]);
+		const int2 voxelRef = world->voxelRefs[voxelIndex];
+		const int2 spriteRef = world->spriteRefs[voxelIndex];
+
+		// Geometry in a voxel never leaves the voxel, so the closest opaque hit in
+		// the first voxel with one is the closest hit overall. Sprites can stick out
+		// of the voxel, but they have a copy in every voxel they touch, so only their
+		// hits before the ray leaves this voxel count.
+		uint hit = LEAN_NO_HIT;
+		float closestT = FLT_MAX;
+		const float tVoxelExit = fmin(tMax[0], fmin(tMax[1], tMax[2]));
+		leanIntersectRectangles(origin, direction, world->rectangles, voxelRef.x,
+			voxelRef.y, world->textures, FLT_MAX, false, &closestT, &hit);
+		leanIntersectRectangles(origin, direction, world->spriteRectangles, spriteRef.x,
+			spriteRef.y, world->textures, tVoxelExit, true, &closestT, &hit);
+
+		if (hit != LEAN_NO_HIT)
+		{
+			*tHit = closestT;
+			return hit;
+		}
+
+		// Step to the next voxel along whichever axis boundary is closest.
+		const int axis = (tMax[0] < tMax[1]) ?
+			((tMax[0] < tMax[2]) ? 0 : 2) :
+			((tMax[1] < tMax[2]) ? 1 : 2);
+
+		if (tMax[axis] > tEnd)
+		{
+			return LEAN_NO_HIT;
+		}
+
+		cell[axis] += step[axis];
+		if ((cell[axis] < 0) || (cell[axis] >= gridSize[axis]))
+		{
+			return LEAN_NO_HIT;
+		}
+
+		tMax[axis] += tDelta[axis];
+	}
+}
+
+// Casts a ray with leanWalkRay(). Defining LEAN_COUNT_STEPS adds the ray and its steps
+// to the world's step counts, for measuring the average steps per ray.
+uint leanCastRay(float3 origin, float3 direction, const LeanWorld *world, float *tHit)
+{
+	uint stepCount = 0u;
+	const uint hit = leanWalkRay(origin, direction, world, tHit, &stepCount);
+
+#ifdef LEAN_COUNT_STEPS
+	atomic_inc(world->stepCounts);
+	atomic_add(world->stepCounts + 1, stepCount);
+#endif
+
+	return hit;
+}
+
+float3 leanSunDirection(float gameTime)
+{
+	const float angle = LEAN_SUN_START_ANGLE +
+		((2.0f * M_PI_F) * (gameTime / LEAN_SECONDS_PER_DAY));
+	return normalize((float3)(-0.25f, sin(angle), cos(angle)));
+}
+
+uint leanPackARGB(float3 color)
+{
+	const uint3 rgb = convert_uint3(clamp(color, 0.0f, 1.0f) * 255.0f);
+	return 0xFF000000u | (rgb.x << 16) | (rgb.y << 8) | rgb.z;
+}
+
+// Calculates the output pixel for a packed hit at the given distance along a ray. The
+// pixel angle picks the texture's mip level.
+uint leanShadeHit(float3 origin, float3 direction, float t, uint hit,
+	const LeanWorld *world, float gameTime, float pixelAngle)
+{
+	const float3 sunDirection = leanSunDirection(gameTime);
+	const float daylight = clamp((sunDirection.y * 2.0f) + 0.5f, 0.0f, 1.0f);
+
+	if (hit == LEAN_NO_HIT)
+	{
+		const float3 nightSky = (float3)(0.02f, 0.02f, 0.08f);
+		const float3 daySky = (float3)(0.55f, 0.70f, 0.95f);
+		return leanPackARGB(mix(nightSky, daySky, daylight));
+	}
+
+	const bool sprite = (hit & LEAN_SPRITE_HIT) != 0u;
+	const int rectIndex = (int)(((hit & ~LEAN_SPRITE_HIT) >> 3) - 1u);
+	global const float4 *rect = (sprite ? world->spriteRectangles : world->rectangles) +
+		(rectIndex * LEAN_RECTANGLE_STRIDE);
+	const float3 normal = sprite ? (rect[5].xyz * (((hit & 1u) != 0u) ? -1.0f : 1.0f)) :
+		leanFaceNormal(hit & 7u);
+	const float3 point = origin + (direction * t);
+	const float2 uv = clamp(leanRectangleUV(rect, point), 0.0f, 1.0f);
+
+	// A mip texel is only transparent if most of the texels under it are, so fall back
+	// to the full size texel that the hit was found on.
+	const int level = leanTextureLevel(rect, direction, normal, t, pixelAngle);
+	uchar texelIndex = leanSampleTextureLevel(rect, world->textures, uv.x, uv.y, level);
+	if (texelIndex == 0)
+	{
+		texelIndex = leanSampleTexture(rect, world->textures, uv.x, uv.y);
+	}
+
+	const float4 texel = world->palette[texelIndex];
+
+	const float sunIntensity = clamp(sunDirection.y * 3.0f, 0.0f, 1.0f) * 0.75f;
+	float light = 0.10f + (0.30f * daylight);
+
+	// Add sunlight if the surface faces the sun and nothing is in the way.
+	const float normalDotSun = dot(normal, sunDirection);
+	if ((sunIntensity > 0.0f) && (normalDotSun > 0.0f))
+	{
+		float shadowT;
+		const float3 shadowOrigin = point + (normal * LEAN_RAY_EPSILON);
+		if (leanCastRay(shadowOrigin, sunDirection, world, &shadowT) == LEAN_NO_HIT)
+		{
+			light += normalDotSun * sunIntensity;
+		}
+	}
+
+	// Add the point lights that reach into the voxel the hit point is in. The point is
+	// nudged off the surface so it's in the voxel on the ray's side.
+	const int3 gridSize = (int3)(WORLD_WIDTH, WORLD_HEIGHT, WORLD_DEPTH);
+	const int3 cell = clamp(convert_int3(floor(point + (normal * LEAN_RAY_EPSILON))),
+		(int3)(0, 0, 0), gridSize - 1);
+	const int2 lightRef = world->lightRefs[getVoxelIndex(cell.x, cell.y, cell.z)];
+
+	float3 lightColor = (float3)(light, light, light);
+	for (int i = lightRef.x; i < (lightRef.x + lightRef.y); i++)
+	{
+		global const float4 *pointLight = world->lights +
+			(world->lightIndices[i] * LEAN_LIGHT_STRIDE);
+		const float3 toLight = pointLight[0].xyz - point;
+		const float radius = pointLight[0].w;
+		const float distance = length(toLight);
+		if ((distance >= radius) || (distance == 0.0f))
+		{
+			continue;
+		}
+
+		const float normalDotLight = dot(normal, toLight) / distance;
+		if (normalDotLight <= 0.0f)
+		{
+			continue;
+		}
+
+		// Light fades out smoothly towards the edge of the radius.
+		const float falloff = 1.0f - (distance / radius);
+		lightColor += pointLight[1].xyz * (normalDotLight * falloff * falloff);
+	}
+
+	return leanPackARGB(texel.xyz * lightColor);
+}
+
+// Does the opposite of leanRayDirection(). Gets the screen position of a point seen 
+// by a camera, in pixels. Returns false if the point is behind the camera.
+bool leanProjectPoint(global const float4 *camera, float3 point, int renderWidth,
+	int renderHeight, float2 *pixel)
+{
+	const float3 local = point - camera[LEAN_CAMERA_EYE].xyz;
+	const float forward = dot(local, camera[LEAN_CAMERA_FORWARD].xyz);
+	if (forward <= LEAN_RAY_EPSILON)
+	{
+		return false;
+	}
+
+	// The camera's right and up are perpendicular to forward, so the point's distance
+	// along forward sets the scale of the screen plane it's on.
+	const float zoom = ((global const float*)(camera + LEAN_CAMERA_ZOOM))[0];
+	const float aspect = (float)renderWidth / (float)renderHeight;
+	const float scale = forward / zoom;
+	const float screenX = dot(local, camera[LEAN_CAMERA_RIGHT].xyz) / (scale * aspect);
+	const float screenY = dot(local, camera[LEAN_CAMERA_UP].xyz) / scale;
+	*pixel = (float2)((((screenX + 1.0f) * 0.5f) * (float)renderWidth) - 0.5f,
+		(((1.0f - screenY) * 0.5f) * (float)renderHeight) - 0.5f);
+	return true;
+}
+
+// Tries to find a pixel's hit among the hits around where its surface was on last 
+// frame's screen, which only takes a few rectangle tests instead of a voxel walk. 
+// Returns false if the pixel has to be traced in full: it was sky, its surface wasn't 
+// on last frame's screen (disoccluded), or the hit isn't one that last frame saw 
+// unobstructed.
+bool leanReprojectHit(float3 eye, float3 direction, int x, int y, int renderWidth,
+	int renderHeight, const LeanWorld *world, global const float4 *previousCamera,
+	global const float *previousDepths, global const uint *previousHits,
+	int previousWidth, int previousHeight, float *tHit, uint *hit)
+{
+	// Guess the surface's distance with last frame's depth at the same spot on the 
+	// screen. Last frame might have been rendered at another resolution.
+	const int sameX = min((int)((((float)x + 0.5f) * (float)previousWidth) /
+		(float)renderWidth), previousWidth - 1);
+	const int sameY = min((int)((((float)y + 0.5f) * (float)previousHeight) /
+		(float)renderHeight), previousHeight - 1);
+	const float guessT = previousDepths[sameX + (sameY * previousWidth)];
+	if (guessT == FLT_MAX)
+	{
+		return false;
+	}
+
+	float2 guessPixel;
+	if (!leanProjectPoint(previousCamera, eye + (direction * guessT), previousWidth,
+		previousHeight, &guessPixel))
+	{
+		return false;
+	}
+
+	// Test the ray against the rectangles that were hit around there.
+	const int guessX = (int)round(guessPixel.x);
+	const int guessY = (int)round(guessPixel.y);
+	float closestT = FLT_MAX;
+	uint closestHit = LEAN_NO_HIT;
+	for (int j = guessY - 1; j <= (guessY + 1); j++)
+	{
+		for (int i = guessX - 1; i <= (guessX + 1); i++)
+		{
+			if ((i < 0) || (i >= previousWidth) || (j < 0) || (j >= previousHeight))
+			{
+				continue;
+			}
+
+			const uint candidate = previousHits[i + (j * previousWidth)];
+			if (candidate == LEAN_NO_HIT)
+			{
+				continue;
+			}
+
+			const bool sprite = (candidate & LEAN_SPRITE_HIT) != 0u;
+			const int rectIndex = (int)(((candidate & ~LEAN_SPRITE_HIT) >> 3) - 1u);
+			leanIntersectRectangles(eye, direction,
+				sprite ? world->spriteRectangles : world->rectangles, rectIndex, 1,
+				world->textures, FLT_MAX, sprite, &closestT, &closestHit);
+		}
+	}
+
+	if (closestHit == LEAN_NO_HIT)
+	{
+		return false;
+	}
+
+	// The hit point has to have been seen last frame with the same hit, and with 
+	// nothing much nearer next to it. Otherwise it's on a silhouette edge, and 
+	// whatever was next to it might cover it now.
+	const float3 point = eye + (direction * closestT);
+	float2 previousPixel;
+	if (!leanProjectPoint(previousCamera, point, previousWidth, previousHeight,
+		&previousPixel))
+	{
+		return false;
+	}
+
+	const int previousX = (int)round(previousPixel.x);
+	const int previousY = (int)round(previousPixel.y);
+	if ((previousX < 1) || (previousX >= (previousWidth - 1)) || (previousY < 1) ||
+		(previousY >= (previousHeight - 1)))
+	{
+		return false;
+	}
+
+	if (previousHits[previousX + (previousY * previousWidth)] != closestHit)
+	{
+		return false;
+	}
+
+	const float previousT = length(point - previousCamera[LEAN_CAMERA_EYE].xyz);
+	const float minT = previousT * (1.0f - LEAN_REPROJECT_TOLERANCE);
+	for (int j = previousY - 1; j <= (previousY + 1); j++)
+	{
+		for (int i = previousX - 1; i <= (previousX + 1); i++)
+		{
+			if (previousDepths[i + (j * previousWidth)] < minT)
+			{
+				return false;
+			}
+		}
+	}
+
+	*tHit = closestT;
+	*hit = closestHit;
+	return true;
+}
+
+kernel void leanIntersect(global const float4 *camera, global const int2 *voxelRefs,
+	global const float4 *rectangles, global const uchar *textures,
+	global const float4 *palette, global const uint *chunkOccupancy,
+	global const int2 *spriteRefs, global const float4 *spriteRectangles,
+	global const int2 *lightRefs, global const int *lightIndices,
+	global const float4 *lights, global const float *gameTime, global uint *stepCounts,
+	int renderWidth, int renderHeight, global float *depths, global uint *hits)
+{
+	const int x = (int)get_global_id(0);
+	const int y = (int)get_global_id(1);
+	if ((x >= renderWidth) || (y >= renderHeight))
+	{
+		return;
+	}
+
+	const LeanWorld world = { voxelRefs, chunkOccupancy, spriteRefs, spriteRectangles,
+		lightRefs, lightIndices, lights, rectangles, textures, palette,
+		stepCounts };
+	const int index = x + (y * renderWidth);
+	const float3 direction = leanRayDirection(camera, x, y, renderWidth, renderHeight);
+
+	float t = FLT_MAX;
+	hits[index] = leanCastRay(camera[LEAN_CAMERA_EYE].xyz, direction, &world, &t);
+	depths[index] = t;
+}
+
+kernel void leanShade(global const float4 *camera, global const int2 *voxelRefs,
+	global const float4 *rectangles, global const uchar *textures,
+	global const float4 *palette, global const uint *chunkOccupancy,
+	global const int2 *spriteRefs, global const float4 *spriteRectangles,
+	global const int2 *lightRefs, global const int *lightIndices,
+	global const float4 *lights, global const float *gameTime, global uint *stepCounts,
+	int renderWidth, int renderHeight, global const float *depths, global const uint *hits,
+	global uint *output)
+{
+	const int x = (int)get_global_id(0);
+	const int y = (int)get_global_id(1);
+	if ((x >= renderWidth) || (y >= renderHeight))
+	{
+		return;
+	}
+
+	// The view and point are rebuilt from the camera and depth instead of stored.
+	const LeanWorld world = { voxelRefs, chunkOccupancy, spriteRefs, spriteRectangles,
+		lightRefs, lightIndices, lights, rectangles, textures, palette,
+		stepCounts };
+	const int index = x + (y * renderWidth);
+	const float3 direction = leanRayDirection(camera, x, y, renderWidth, renderHeight);
+	output[index] = leanShadeHit(camera[LEAN_CAMERA_EYE].xyz, direction, depths[index],
+		hits[index], &world, gameTime[0], leanPixelAngle(camera, renderHeight));
+}
+
+kernel void fusedRender(global const float4 *camera, global const int2 *voxelRefs,
+	global const float4 *rectangles, global const uchar *textures,
+	global const float4 *palette, global const uint *chunkOccupancy,
+	global const int2 *spriteRefs, global const float4 *spriteRectangles,
+	global const int2 *lightRefs, global const int *lightIndices,
+	global const float4 *lights, global const float *gameTime, global uint *stepCounts,
+	int renderWidth, int renderHeight, global uint *output)
+{
+	const int x = (int)get_global_id(0);
+	const int y = (int)get_global_id(1);
+	if ((x >= renderWidth) || (y >= renderHeight))
+	{
+		return;
+	}
+
+	const LeanWorld world = { voxelRefs, chunkOccupancy, spriteRefs, spriteRectangles,
+		lightRefs, lightIndices, lights, rectangles, textures, palette,
+		stepCounts };
+	const float3 eye = camera[LEAN_CAMERA_EYE].xyz;
+	const float3 direction = leanRayDirection(camera, x, y, renderWidth, renderHeight);
+
+	float t = FLT_MAX;
+	const uint hit = leanCastRay(eye, direction, &world, &t);
+	output[x + (y * renderWidth)] = leanShadeHit(eye, direction, t, hit, &world,
+		gameTime[0], leanPixelAngle(camera, renderHeight));
+}
+
+kernel void leanReproject(global const float4 *camera, global const int2 *voxelRefs,
+	global const float4 *rectangles, global const uchar *textures,
+	global const float4 *palette, global const uint *chunkOccupancy,
+	global const int2 *spriteRefs, global const float4 *spriteRectangles,
+	global const int2 *lightRefs, global const int *lightIndices,
+	global const float4 *lights, global const float *gameTime, global uint *stepCounts,
+	int renderWidth, int renderHeight, global float *depths, global uint *hits,
+	global const float4 *previousCamera, global const float *previousDepths,
+	global const uint *previousHits, int previousWidth, int previousHeight,
+	int refreshPhase, global uchar *reused, global uint *reuseCounts, int countReuse)
+{
+	const int x = (int)get_global_id(0);
+	const int y = (int)get_global_id(1);
+	if ((x >= renderWidth) || (y >= renderHeight))
+	{
+		return;
+	}
+
+	const LeanWorld world = { voxelRefs, chunkOccupancy, spriteRefs, spriteRectangles,
+		lightRefs, lightIndices, lights, rectangles, textures, palette,
+		stepCounts };
+	const int index = x + (y * renderWidth);
+	const float3 eye = camera[LEAN_CAMERA_EYE].xyz;
+	const float3 direction = leanRayDirection(camera, x, y, renderWidth, renderHeight);
+
+	// A previous width of zero means last frame's hits can't be used at all.
+	float t = FLT_MAX;
+	uint hit = LEAN_NO_HIT;
+	const bool refresh = ((y + refreshPhase) % LEAN_REFRESH_INTERVAL) == 0;
+	const bool reuse = !refresh && (previousWidth > 0) && leanReprojectHit(eye, direction,
+		x, y, renderWidth, renderHeight, &world, previousCamera, previousDepths,
+		previousHits, previousWidth, previousHeight, &t, &hit);
+
+	if (!reuse)
+	{
+		t = FLT_MAX;
+		hit = leanCastRay(eye, direction, &world, &t);
+	}
+
+	hits[index] = hit;
+	depths[index] = t;
+	reused[index] = reuse ? 1 : 0;
+
+	if (countReuse != 0)
+	{
+		atomic_inc(reuseCounts + (reuse ? 0 : 1));
+	}
+}
+
+kernel void leanRefineCorners(global const float4 *camera, global const int2 *voxelRefs,
+	global const float4 *rectangles, global const uchar *textures,
+	global const float4 *palette, global const uint *chunkOccupancy,
+	global const int2 *spriteRefs, global const float4 *spriteRectangles,
+	global const int2 *lightRefs, global const int *lightIndices,
+	global const float4 *lights, global const float *gameTime, global uint *stepCounts,
+	int renderWidth, int renderHeight, global float *cornerDepths, global uint *cornerHits,
+	int blockSize)
+{
+	const int cornerX = (int)get_global_id(0);
+	const int cornerY = (int)get_global_id(1);
+	const int cornersX = ((renderWidth + blockSize - 1) / blockSize) + 1;
+	const int cornersY = ((renderHeight + blockSize - 1) / blockSize) + 1;
+	if ((cornerX >= cornersX) || (cornerY >= cornersY))
+	{
+		return;
+	}
+
+	// Corners past the far edges of the frame use the last column or row instead.
+	const LeanWorld world = { voxelRefs, chunkOccupancy, spriteRefs, spriteRectangles,
+		lightRefs, lightIndices, lights, rectangles, textures, palette,
+		stepCounts };
+	const int x = min(cornerX * blockSize, renderWidth - 1);
+	const int y = min(cornerY * blockSize, renderHeight - 1);
+	const int index = cornerX + (cornerY * cornersX);
+	const float3 direction = leanRayDirection(camera, x, y, renderWidth, renderHeight);
+
+	float t = FLT_MAX;
+	cornerHits[index] = leanCastRay(camera[LEAN_CAMERA_EYE].xyz, direction, &world, &t);
+	cornerDepths[index] = t;
+}
+
+kernel void leanRefine(global const float4 *camera, global const int2 *voxelRefs,
+	global const float4 *rectangles, global const uchar *textures,
+	global const float4 *palette, global const uint *chunkOccupancy,
+	global const int2 *spriteRefs, global const float4 *spriteRectangles,
+	global const int2 *lightRefs, global const int *lightIndices,
+	global const float4 *lights, global const float *gameTime, global uint *stepCounts,
+	int renderWidth, int renderHeight, global float *depths, global uint *hits,
+	global const float *cornerDepths, global const uint *cornerHits, int blockSize,
+	global uchar *filled, global uint *fillCounts, int countFills)
+{
+	const int x = (int)get_global_id(0);
+	const int y = (int)get_global_id(1);
+	if ((x >= renderWidth) || (y >= renderHeight))
+	{
+		return;
+	}
+
+	const LeanWorld world = { voxelRefs, chunkOccupancy, spriteRefs, spriteRectangles,
+		lightRefs, lightIndices, lights, rectangles, textures, palette,
+		stepCounts };
+	const int index = x + (y * renderWidth);
+	const float3 eye = camera[LEAN_CAMERA_EYE].xyz;
+	const float3 direction = leanRayDirection(camera, x, y, renderWidth, renderHeight);
+
+	// The block's corners are the first pixels of it and of the blocks to its right,
+	// below it, and diagonally below it.
+	const int cornersX = ((renderWidth + blockSize - 1) / blockSize) + 1;
+	const int blockX = x / blockSize;
+	const int blockY = y / blockSize;
+	const int corner = blockX + (blockY * cornersX);
+	const uint hit = cornerHits[corner];
+	const bool sameHits = (cornerHits[corner + 1] == hit) &&
+		(cornerHits[corner + cornersX] == hit) && (cornerHits[corner + cornersX + 1] == hit);
+
+	float t = FLT_MAX;
+	uint pixelHit = LEAN_NO_HIT;
+	bool fill = false;
+	bool traced = false;
+
+	if ((x == (blockX * blockSize)) && (y == (blockY * blockSize)))
+	{
+		// The block's own corner was traced already.
+		t = cornerDepths[corner];
+		pixelHit = hit;
+		traced = true;
+	}
+	else if (sameHits && (hit == LEAN_NO_HIT))
+	{
+		// Sky all around.
+		fill = true;
+	}
+	else if (sameHits)
+	{
+		const float minDepth = min(min(cornerDepths[corner], cornerDepths[corner + 1]),
+			min(cornerDepths[corner + cornersX], cornerDepths[corner + cornersX + 1]));
+		const float maxDepth = max(max(cornerDepths[corner], cornerDepths[corner + 1]),
+			max(cornerDepths[corner + cornersX], cornerDepths[corner + cornersX + 1]));
+
+		// Every corner sees the same rectangle, so only test the pixel's ray against
+		// it. A transparent texel or the rectangle's edge inside the block fails the
+		// test and the pixel is traced after all.
+		if (maxDepth <= (minDepth * LEAN_REFINE_DEPTH_RATIO))
+		{
+			const bool sprite = (hit & LEAN_SPRITE_HIT) != 0u;
+			const int rectIndex = (int)(((hit & ~LEAN_SPRITE_HIT) >> 3) - 1u);
+			leanIntersectRectangles(eye, direction,
+				sprite ? world.spriteRectangles : world.rectangles, rectIndex, 1,
+				world.textures, FLT_MAX, sprite, &t, &pixelHit);
+			fill = pixelHit == hit;
+		}
+	}
+
+	if (!fill && !traced)
+	{
+		t = FLT_MAX;
+		pixelHit = leanCastRay(eye, direction, &world, &t);
+	}
+
+	hits[index] = fill ? hit : pixelHit;
+	depths[index] = t;
+	filled[index] = fill ? 1 : 0;
+
+	if (countFills != 0)
+	{
+		atomic_inc(fillCounts + (fill ? 0 : 1));
+	}
+}
+
+kernel void leanSprites(global const float4 *camera, global const int2 *voxelRefs,
+	global const float4 *rectangles, global const uchar *textures,
+	global const float4 *palette, global const uint *chunkOccupancy,
+	global const int2 *spriteRefs, global const float4 *spriteRectangles,
+	global const int2 *lightRefs, global const int *lightIndices,
+	global const float4 *lights, global const float *gameTime, global uint *stepCounts,
+	int renderWidth, int renderHeight, global const float *depths, global uint *output,
+	global const float4 *sprites, global const int2 *tileRanges, global const int *tileSprites,
+	int tileCountX)
+{
+	const int x = (int)get_global_id(0);
+	const int y = (int)get_global_id(1);
+	if ((x >= renderWidth) || (y >= renderHeight))
+	{
+		return;
+	}
+
+	const int2 tileRange = tileRanges[(x / LEAN_SPRITE_TILE_SIZE) +
+		((y / LEAN_SPRITE_TILE_SIZE) * tileCountX)];
+	if (tileRange.y == 0)
+	{
+		return;
+	}
+
+	// The tile's sprites are farthest first, so going through them backwards, the 
+	// first opaque texel nearer than the traced depth is the one that would be drawn
+	// last. Sprite hits are shaded from this frame's sorted sprites.
+	const LeanWorld world = { voxelRefs, chunkOccupancy, spriteRefs, sprites,
+		lightRefs, lightIndices, lights, rectangles, textures, palette,
+		stepCounts };
+	const int index = x + (y * renderWidth);
+	const float3 eye = camera[LEAN_CAMERA_EYE].xyz;
+	const float3 direction = leanRayDirection(camera, x, y, renderWidth, renderHeight);
+
+	for (int i = tileRange.x + tileRange.y - 1; i >= tileRange.x; i--)
+	{
+		float t = depths[index];
+		uint hit = LEAN_NO_HIT;
+		leanIntersectRectangles(eye, direction, sprites, tileSprites[i], 1, textures,
+			FLT_MAX, true, &t, &hit);
+
+		if (hit != LEAN_NO_HIT)
+		{
+			output[index] = leanShadeHit(eye, direction, t, hit, &world, gameTime[0],
+				leanPixelAngle(camera, renderHeight));
+			return;
+		}
+	}
+}
+
+kernel void leanReuseView(global const uchar *reused, global uint *output,
+	int renderWidth, int renderHeight)
+{
+	const int x = (int)get_global_id(0);
+	const int y = (int)get_global_id(1);
+	if ((x >= renderWidth) || (y >= renderHeight))
+	{
+		return;
+	}
+
+	// Reused (or filled) pixels are tinted green, and traced ones red.
+	const int index = x + (y * renderWidth);
+	const uint color = output[index];
+	const float3 rgb = (float3)((float)((color >> 16) & 0xFFu),
+		(float)((color >> 8) & 0xFFu), (float)(color & 0xFFu)) / 255.0f;
+	const float3 tint = (reused[index] != 0) ? (float3)(0.0f, 1.0f, 0.0f) :
+		(float3)(1.0f, 0.0f, 0.0f);
+	output[index] = leanPackARGB(mix(rgb, tint, 0.35f));
+}
+)CL";
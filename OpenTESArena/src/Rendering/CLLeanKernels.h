@@ -0,0 +1,98 @@
+#ifndef CL_LEAN_KERNELS_H
+#define CL_LEAN_KERNELS_H
+
+#include <string>
+
+// The lean kernels are an alternative to the kernels in kernel.cl that are written
+// with memory bandwidth in mind. They are built into the executable (not read from
+// the data folder) and compiled as their own OpenCL program, so they can't clash 
+// with anything in kernel.cl.
+
+// The kernel.cl kernels pass a wide G-buffer between them (depth, normal, view, point,
+// UV, rectangle index, and float3 color; about 84 bytes per pixel). The lean kernels
+// only keep a depth and a packed hit (rectangle index and face index) per pixel, and 
+// rebuild the point, view, normal, and UV from those and the camera. Their color 
+// goes straight to the 8-bit output buffer. The fused kernel does all of it at once 
+// and only writes the output buffer.
+
+// They read the same camera, voxel reference, and rectangle buffers as the kernel.cl
+// kernels, and shade the same way as the CPUProgram does. Their textures are palette
+// indices (uchar) instead of float4's, with a separate palette of 256 float4's. Index 
+// 0 is transparent.
+
+// Rays skip over empty chunks (see RenderWorld) using the chunk occupancy bits. They 
+// also test the sprite rectangles of each voxel (see SpriteHeap). Shading only looks
+// at the point lights in the light list of the hit point's voxel (see LightManager).
+
+// Every lean kernel takes these arguments first:
+// 0: camera, 1: voxel references, 2: rectangles, 3: textures, 4: palette, 
+// 5: chunk occupancy, 6: sprite references, 7: sprite rectangles, 8: light references,
+// 9: light indices, 10: lights, 11: game time, 12: step counts, 13: render width,
+// 14: render height. The step counts are only written when built with LEAN_COUNT_STEPS.
+
+class CLLeanKernels
+{
+private:
+	CLLeanKernels() = delete;
+	CLLeanKernels(const CLLeanKernels&) = delete;
+	~CLLeanKernels() = delete;
+public:
+	// OpenCL C source of the lean kernels. It needs the WORLD_* and CHUNK_* dimensions
+	// and the voxel index functions (see VoxelIndexer) to be defined before it.
+	static const std::string SOURCE;
+
+	// Writes depth (15) and packed hit (16) buffers.
+	static const std::string INTERSECT_KERNEL;
+
+	// Reads depth (15) and packed hit (16) buffers and writes the output buffer (17).
+	static const std::string SHADE_KERNEL;
+
+	// Writes the output buffer (15).
+	static const std::string FUSED_KERNEL;
+
+	// Does the same as the intersect kernel, but first tries to reuse last frame's
+	// hits near where each pixel's surface was on last frame's screen. Only pixels 
+	// that were sky, disoccluded, or fail validation are traced in full, along with
+	// every eighth row (picked by the refresh phase) so mistakes don't last.
+	// Writes depth (15) and packed hit (16) buffers. Reads the previous camera (17), 
+	// previous depth (18) and packed hit (19) buffers, and previous render width (20;
+	// zero if there's nothing to reuse) and height (21), then takes the refresh phase
+	// (22). Writes a reuse flag per pixel (23), and if the count flag (25) is set, 
+	// counts reused and traced pixels (24).
+	static const std::string REPROJECT_KERNEL;
+
+	// Traces the first pixel of every square block of pixels, plus a column and row of 
+	// corners past the far edges. Writes corner depth (15) and packed hit (16) buffers
+	// with a row per row of blocks plus one, and takes the block size (17).
+	static const std::string REFINE_CORNERS_KERNEL;
+
+	// Does the same as the intersect kernel, but fills the pixels of a block whose
+	// corners agree on the hit and roughly on the depth by only testing the corners' 
+	// rectangle. Other pixels (and those the test fails on, like at a transparent 
+	// texel) are traced in full. Writes depth (15) and packed hit (16) buffers. Reads
+	// the corner depth (17) and packed hit (18) buffers from the corners kernel, and 
+	// takes the block size (19). Writes a fill flag per pixel (20), and if the count 
+	// flag (22) is set, counts filled and traced pixels (21).
+	static const std::string REFINE_KERNEL;
+
+	// Draws rasterized sprites (see SpriteTiles) over the shaded output buffer (16) 
+	// where they're nearer than the depth buffer (15). Reads this frame's sprite 
+	// rectangles (17), sorted farthest first, and each screen tile's range (18) of 
+	// sprite indices (19), with the number of tiles in a row (20).
+	static const std::string SPRITES_KERNEL;
+
+	// Tints the output buffer (1) by the reuse flags (0) from the reprojection kernel 
+	// or the fill flags from the refine kernel, with the render width (2) and height
+	// (3). It takes no world arguments.
+	static const std::string REUSE_VIEW_KERNEL;
+
+	// Number of arguments shared by all lean kernels. The per-pixel buffers come after
+	// them.
+	static const int WORLD_ARG_COUNT;
+
+	// Frames it takes the reprojection kernel to trace every row in full once. The 
+	// refresh phase goes from zero up to one less than this.
+	static const int REFRESH_INTERVAL;
+};
+
+#endif
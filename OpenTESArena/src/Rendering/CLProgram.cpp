@@ -1,26 +1,39 @@
 #include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <sstream>
 
 #include "SDL.h"
 
 #include "CLProgram.h"
 
+#include "CLLeanKernels.h"
+#include "LightReference.h"
+#include "PassGraph.h"
+#include "PointLight.h"
+#include "RenderProfiler.h"
+#include "RenderWorld.h"
+#include "SpriteReference.h"
+#include "TextureReference.h"
+#include "VoxelIndexer.h"
+#include "VoxelReference.h"
 #include "../Entities/Directable.h"
 #include "../Interface/Surface.h"
 #include "../Math/Constants.h"
 #include "../Math/Float2.h"
 #include "../Math/Float3.h"
-#include "../Math/Float4.h"
 #include "../Math/Int2.h"
-#include "../Math/Random.h"
 #include "../Math/Rect3D.h"
-#include "../Media/PaletteFile.h"
-#include "../Media/PaletteName.h"
+#include "../Media/Color.h"
 #include "../Media/TextureManager.h"
 #include "../Rendering/Renderer.h"
 #include "../Utilities/Debug.h"
 #include "../Utilities/File.h"
+#include "../World/Chunk.h"
 
 namespace
 {
@@ -34,18 +47,199 @@ namespace
 	const cl::size_type SIZEOF_TEXTURE_REF = sizeof(cl_int) + (sizeof(cl_short) * 2);
 	const cl::size_type SIZEOF_RECTANGLE = (sizeof(cl_float3) * 6) + SIZEOF_TEXTURE_REF + 8;
 	const cl::size_type SIZEOF_VOXEL_REF = sizeof(cl_int) * 2;
+
+	// Number of frame constants slots in the staging ring. A slot is only written
+	// again once the transfer from it two frames ago is done, which it almost always 
+	// is by then.
+	const int FRAME_SLOT_COUNT = 3;
+
+	// Arguments the host gives each kernel.cl kernel before the frame width and height,
+	// which only a kernel.cl that doesn't read the render size defines takes.
+	const cl_uint INTERSECT_ARG_COUNT = 11;
+	const cl_uint RAY_TRACE_ARG_COUNT = 14;
+	const cl_uint CONVERT_TO_RGB_ARG_COUNT = 2;
+
+	// Debug view frames between mentions of the share of reused pixels.
+	const int REUSE_MENTION_INTERVAL = 60;
+
+	// The sun's path, the same as in the lean kernels.
+	const double SECONDS_PER_DAY = 120.0;
+	const double SUN_START_ANGLE = PI * 0.25;
+
+	// Game time that has to pass before the lean kernels shade a still frame again. 
+	// The sky and sunlight change by less than one color step in that time.
+	const double SHADING_TIME_STEP = 1.0 / 30.0;
+
+	// Sun height below which there's no sunlight and the sky is as dark as it gets.
+	const double NIGHT_SUN_HEIGHT = -0.25;
+
+	// Gets the direction towards the sun at the given game time.
+	Float3d getSunDirection(double gameTime)
+	{
+		const double angle = SUN_START_ANGLE + ((2.0 * PI) * (gameTime / SECONDS_PER_DAY));
+		return Float3d(-0.25, std::sin(angle), std::cos(angle)).normalized();
+	}
+
+	// 64-bit FNV-1a hash, for naming cached program binaries.
+	uint64_t hashString(const std::string &str)
+	{
+		uint64_t hash = 14695981039346656037ULL;
+		for (const char c : str)
+		{
+			hash ^= static_cast<uint8_t>(c);
+			hash *= 1099511628211ULL;
+		}
+
+		return hash;
+	}
+
+	std::string toHexString(uint64_t value)
+	{
+		std::stringstream ss;
+		ss << std::hex << value;
+		return ss.str();
+	}
+
+	// Writes a voxel reference into a host buffer in the kernel's format.
+	void writeVoxelRef(cl_char *ptr, const VoxelReference &voxelRef)
+	{
+		assert(voxelRef.getRectangleCount() >= 0);
+
+		// Number of rectangles to skip in the rectangles array.
+		cl_int *offsetPtr = reinterpret_cast<cl_int*>(ptr);
+		*(offsetPtr + 0) = voxelRef.getOffset();
+
+		cl_int *countPtr = reinterpret_cast<cl_int*>(ptr + sizeof(cl_int));
+		*(countPtr + 0) = voxelRef.getRectangleCount();
+	}
+
+	// Writes a sprite reference into a host buffer in the kernel's format.
+	void writeSpriteRef(cl_char *ptr, const SpriteReference &spriteRef)
+	{
+		assert(spriteRef.getRectangleCount() >= 0);
+
+		// Number of rectangles to skip in the sprite rectangles array.
+		cl_int *offsetPtr = reinterpret_cast<cl_int*>(ptr);
+		*(offsetPtr + 0) = spriteRef.getOffset();
+
+		cl_int *countPtr = reinterpret_cast<cl_int*>(ptr + sizeof(cl_int));
+		*(countPtr + 0) = spriteRef.getRectangleCount();
+	}
+
+	// Writes a light reference into a host buffer in the kernel's format.
+	void writeLightRef(cl_char *ptr, const LightReference &lightRef)
+	{
+		assert(lightRef.getLightCount() >= 0);
+
+		// Number of indices to skip in the light indices array.
+		cl_int *offsetPtr = reinterpret_cast<cl_int*>(ptr);
+		*(offsetPtr + 0) = lightRef.getOffset();
+
+		cl_int *countPtr = reinterpret_cast<cl_int*>(ptr + sizeof(cl_int));
+		*(countPtr + 0) = lightRef.getLightCount();
+	}
+
+	// Writes a point light into a host buffer in the kernel's format. The radius goes
+	// in the position's padding.
+	void writeLight(cl_char *ptr, const PointLight &light)
+	{
+		cl_float *positionPtr = reinterpret_cast<cl_float*>(ptr);
+		*(positionPtr + 0) = light.getPosition().getX();
+		*(positionPtr + 1) = light.getPosition().getY();
+		*(positionPtr + 2) = light.getPosition().getZ();
+		*(positionPtr + 3) = light.getRadius();
+
+		cl_float *colorPtr = reinterpret_cast<cl_float*>(ptr + sizeof(cl_float3));
+		*(colorPtr + 0) = light.getColor().getX();
+		*(colorPtr + 1) = light.getColor().getY();
+		*(colorPtr + 2) = light.getColor().getZ();
+		*(colorPtr + 3) = 0.0f;
+	}
+
+	// Writes a rectangle into a host buffer in the kernel's format.
+	void writeRectangle(cl_char *ptr, const Rect3D &rect, const TextureReference &textureRef)
+	{
+		cl_float *p1Ptr = reinterpret_cast<cl_float*>(ptr);
+		*(p1Ptr + 0) = static_cast<cl_float>(rect.getP1().getX());
+		*(p1Ptr + 1) = static_cast<cl_float>(rect.getP1().getY());
+		*(p1Ptr + 2) = static_cast<cl_float>(rect.getP1().getZ());
+
+		cl_float *p2Ptr = reinterpret_cast<cl_float*>(ptr + sizeof(cl_float3));
+		*(p2Ptr + 0) = static_cast<cl_float>(rect.getP2().getX());
+		*(p2Ptr + 1) = static_cast<cl_float>(rect.getP2().getY());
+		*(p2Ptr + 2) = static_cast<cl_float>(rect.getP2().getZ());
+
+		cl_float *p3Ptr = reinterpret_cast<cl_float*>(ptr + (sizeof(cl_float3) * 2));
+		*(p3Ptr + 0) = static_cast<cl_float>(rect.getP3().getX());
+		*(p3Ptr + 1) = static_cast<cl_float>(rect.getP3().getY());
+		*(p3Ptr + 2) = static_cast<cl_float>(rect.getP3().getZ());
+
+		const Float3f p1p2 = rect.getP2() - rect.getP1();
+		cl_float *p1p2Ptr = reinterpret_cast<cl_float*>(ptr + (sizeof(cl_float3) * 3));
+		*(p1p2Ptr + 0) = static_cast<cl_float>(p1p2.getX());
+		*(p1p2Ptr + 1) = static_cast<cl_float>(p1p2.getY());
+		*(p1p2Ptr + 2) = static_cast<cl_float>(p1p2.getZ());
+
+		const Float3f p2p3 = rect.getP3() - rect.getP2();
+		cl_float *p2p3Ptr = reinterpret_cast<cl_float*>(ptr + (sizeof(cl_float3) * 4));
+		*(p2p3Ptr + 0) = static_cast<cl_float>(p2p3.getX());
+		*(p2p3Ptr + 1) = static_cast<cl_float>(p2p3.getY());
+		*(p2p3Ptr + 2) = static_cast<cl_float>(p2p3.getZ());
+
+		const Float3f normal = rect.getNormal();
+		cl_float *normalPtr = reinterpret_cast<cl_float*>(ptr + (sizeof(cl_float3) * 5));
+		*(normalPtr + 0) = static_cast<cl_float>(normal.getX());
+		*(normalPtr + 1) = static_cast<cl_float>(normal.getY());
+		*(normalPtr + 2) = static_cast<cl_float>(normal.getZ());
+
+		cl_int *offsetPtr = reinterpret_cast<cl_int*>(ptr + (sizeof(cl_float3) * 6));
+		*(offsetPtr + 0) = textureRef.getOffset(); // Texels to skip in the texture buffer.
+
+		cl_short *dimPtr = reinterpret_cast<cl_short*>(ptr + (sizeof(cl_float3) * 6) +
+			sizeof(cl_int));
+		*(dimPtr + 0) = textureRef.getWidth();
+		*(dimPtr + 1) = textureRef.getHeight();
+
+		// Mip levels after the width and height, including the full size one. The
+		// mips follow the full size texels, each half the size of the one before.
+		cl_int *levelPtr = reinterpret_cast<cl_int*>(dimPtr + 2);
+		*(levelPtr + 0) = textureRef.getMipLevelCount();
+	}
+
+	// Writes a palette color into a host buffer as an RGBA float4. This is the texel
+	// format of the kernel.cl kernels and the palette format of the lean kernels.
+	void writeColor(cl_char *ptr, const Color &color, bool transparent)
+	{
+		cl_float *colorPtr = reinterpret_cast<cl_float*>(ptr);
+		*(colorPtr + 0) = static_cast<cl_float>(color.getR()) / 255.0f;
+		*(colorPtr + 1) = static_cast<cl_float>(color.getG()) / 255.0f;
+		*(colorPtr + 2) = static_cast<cl_float>(color.getB()) / 255.0f;
+
+		// Transparency depends on whether the texel is palette index 0.
+		*(colorPtr + 3) = static_cast<cl_float>(transparent ? 0.0f : 1.0f);
+	}
 }
 
 const std::string CLProgram::PATH = "data/kernels/";
 const std::string CLProgram::FILENAME = "kernel.cl";
+const std::string CLProgram::BINARY_PREFIX = "kernel_";
+const std::string CLProgram::BINARY_EXTENSION = ".bin";
 const std::string CLProgram::INTERSECT_KERNEL = "intersect";
 const std::string CLProgram::RAY_TRACE_KERNEL = "rayTrace";
 const std::string CLProgram::POST_PROCESS_KERNEL = "postProcess";
 const std::string CLProgram::CONVERT_TO_RGB_KERNEL = "convertToRGB";
+const std::string CLProgram::BUILD_OPTIONS = "-cl-fast-relaxed-math -cl-strict-aliasing";
 
 CLProgram::CLProgram(int worldWidth, int worldHeight, int worldDepth, 
-	TextureManager &textureManager, Renderer &renderer, double renderQuality)
-	: textureManager(textureManager)
+	TextureManager &textureManager, Renderer &renderer, double minRenderQuality,
+	double maxRenderQuality, double targetFrameTime, bool pipelined,
+	CLKernelMode kernelMode, CLDeviceSplit deviceSplit, bool reprojected,
+	int refineBlockSize, VoxelLayout voxelLayout, SpriteMode spriteMode,
+	bool chunkSkipping, bool stepCounted, bool profiled)
+	: textureManager(textureManager), world(worldWidth, worldHeight, worldDepth,
+		(kernelMode == CLKernelMode::Full) ? VoxelLayout::Linear : voxelLayout),
+	resolutionScaler((kernelMode == CLKernelMode::Full) ? maxRenderQuality : minRenderQuality,
+		maxRenderQuality, targetFrameTime)
 {
 	assert(worldWidth > 0);
 	assert(worldHeight > 0);
@@ -57,18 +251,54 @@ CLProgram::CLProgram(int worldWidth, int worldHeight, int worldDepth,
 	const int screenHeight = renderer.getWindowDimensions().getY();
 
 	// Render dimensions for ray tracing. To prevent issues when the user shrinks
-	// the window down too far, clamp them to at least 1.
-	this->renderWidth = std::max(static_cast<int>(screenWidth * renderQuality), 1);
-	this->renderHeight = std::max(static_cast<int>(screenHeight * renderQuality), 1);
+	// the window down too far, clamp them to at least 1. The per-pixel buffers are
+	// big enough for the max quality, and lower quality frames use less of them.
+	this->renderWidth = std::max(static_cast<int>(screenWidth * maxRenderQuality), 1);
+	this->renderHeight = std::max(static_cast<int>(screenHeight * maxRenderQuality), 1);
 
 	this->worldWidth = worldWidth;
 	this->worldHeight = worldHeight;
 	this->worldDepth = worldDepth;
+	this->pipelined = pipelined;
+	this->kernelMode = kernelMode;
+	this->texelSize = (kernelMode == CLKernelMode::Full) ?
+		sizeof(cl_float4) : sizeof(cl_uchar);
+	this->mappedOutputs = { nullptr, nullptr };
+	this->reprojected = false;
+	this->previousValid = false;
+	this->debugView = false;
+	this->reuseCounts = { 0, 0 };
+	this->reusedTotal = 0;
+	this->tracedTotal = 0;
+	this->stepCounts = { 0, 0 };
+	this->rayTotal = 0;
+	this->stepTotal = 0;
+	this->stepCounted = false;
+	this->fullProgramWidth = 0;
+	this->fullProgramHeight = 0;
+	this->fullSizeArgs = false;
+	this->previousWidth = 0;
+	this->previousHeight = 0;
+	this->refreshPhase = 0;
+	this->reuseFrameCount = 0;
+	this->refineBlockSize = 1;
+	this->rasterSpriteCapacity = 0;
+	this->spriteTileRangeCapacity = 0;
+	this->spriteTileSpriteCapacity = 0;
+	this->gameTime = 0.0;
+	this->shadedGameTime = 0.0;
+	this->presentedWidth = 0;
+	this->presentedHeight = 0;
+	this->cameraChanged = true;
+	this->frameValid = false;
+	this->worldChanged = true;
+
+	if (profiled)
+	{
+		this->profiler = std::unique_ptr<RenderProfiler>(
+			new RenderProfiler(RenderProfiler::DEFAULT_WINDOW_SIZE));
+	}
 
-	// Create the local output pixel buffer.
-	const int renderPixelCount = this->renderWidth * this->renderHeight;
-	this->outputData = std::vector<char>(sizeof(cl_int) * renderPixelCount);
-	
 	// Create streaming texture to be used as the game world frame buffer.	
 	this->texture = renderer.createTexture(SDL_PIXELFORMAT_ARGB8888,
 		SDL_TEXTUREACCESS_STREAMING, this->renderWidth, this->renderHeight);
@@ -101,308 +331,1552 @@ CLProgram::CLProgram(int worldWidth, int worldHeight, int worldDepth,
 		}
 	}
 
-	// Choose the first available device. Users with multiple GPUs might prefer an option.
-	this->device = devices.at(0);
+	// Choose the devices to render on. Without a device split, it's the first available
+	// device. Only the lean kernels can render a band of the frame, because the 
+	// kernel.cl kernels get the render height from the global work size. The bands are
+	// read back in the same frame they're rendered, so they aren't pipelined.
+	std::vector<cl::Device> bandDevices = CLProgram::getSplitDevices(devices, deviceSplit);
+	if ((bandDevices.size() > 1) && (kernelMode == CLKernelMode::Full))
+	{
+		Debug::mention("CLProgram", "Device split needs the lean or fused kernels. "
+			"Using one device.");
+		bandDevices = { devices.at(0) };
+	}
+
+	if ((bandDevices.size() > 1) && pipelined)
+	{
+		Debug::mention("CLProgram", "Device split frames aren't pipelined.");
+		this->pipelined = false;
+	}
+
+	this->device = bandDevices.at(0);
+
+	// Reprojection keeps last frame's depths and hits between the lean kernels, so it
+	// needs them. Bands would each have to reuse from their own rows, so it's only 
+	// done on one device.
+	if (reprojected)
+	{
+		if (kernelMode != CLKernelMode::Lean)
+		{
+			Debug::mention("CLProgram", "Reprojection needs the lean kernels.");
+		}
+		else if (bandDevices.size() > 1)
+		{
+			Debug::mention("CLProgram", "Reprojection isn't done with a device split.");
+		}
+		else
+		{
+			this->reprojected = true;
+		}
+	}
+
+	// Edge refinement also takes the lean intersect kernel's place, so it can't be 
+	// done along with reprojection.
+	if (refineBlockSize > 1)
+	{
+		if (kernelMode != CLKernelMode::Lean)
+		{
+			Debug::mention("CLProgram", "Edge refinement needs the lean kernels.");
+		}
+		else if (bandDevices.size() > 1)
+		{
+			Debug::mention("CLProgram", "Edge refinement isn't done with a device split.");
+		}
+		else if (this->reprojected)
+		{
+			Debug::mention("CLProgram", "Edge refinement isn't done with reprojection.");
+		}
+		else
+		{
+			this->refineBlockSize = refineBlockSize;
+		}
+	}
+
+	// Rasterized sprites are drawn from the lean kernels' depths after shading. Bands
+	// would each need their own sprite lists, so it's only done on one device.
+	if (spriteMode == SpriteMode::Rasterized)
+	{
+		if (kernelMode != CLKernelMode::Lean)
+		{
+			Debug::mention("CLProgram", "Rasterized sprites need the lean kernels.");
+		}
+		else if (bandDevices.size() > 1)
+		{
+			Debug::mention("CLProgram", "Rasterized sprites aren't drawn with a device split.");
+		}
+		else
+		{
+			this->world.setSpriteMode(SpriteMode::Rasterized);
+		}
+	}
+
+	// kernel.cl's kernels only draw whole frames at the full render size, which it
+	// has compiled in unless its kernels take it as arguments. Frames can't be scaled
+	// down or drawn in dirty tiles, and a resize to a size it wasn't built with builds
+	// the program again if the size is compiled in (see buildFullProgram()).
+	if ((kernelMode == CLKernelMode::Full) && (minRenderQuality < maxRenderQuality))
+	{
+		Debug::mention("CLProgram", "Dynamic resolution needs the lean or fused kernels.");
+	}
+
+	// Every ray adds to the same two counters in device memory, which is only worth it
+	// when measuring. Bands would each count on their own device at once.
+	if (stepCounted)
+	{
+		if (kernelMode == CLKernelMode::Full)
+		{
+			Debug::mention("CLProgram", "Step counting needs the lean or fused kernels.");
+		}
+		else if (bandDevices.size() > 1)
+		{
+			Debug::mention("CLProgram", "Steps aren't counted with a device split.");
+		}
+		else
+		{
+			this->stepCounted = true;
+		}
+	}
+
+	// The kernel.cl kernels walk every voxel; they have no chunk level to skip.
+	if (!chunkSkipping && (kernelMode == CLKernelMode::Full))
+	{
+		Debug::mention("CLProgram", "The kernel.cl kernels never skip empty chunks.");
+	}
+
+	// The kernel.cl kernels index voxels themselves, in the linear layout.
+	if ((voxelLayout != VoxelLayout::Linear) && (kernelMode == CLKernelMode::Full))
+	{
+		Debug::mention("CLProgram", "Voxel layouts besides linear need the lean or "
+			"fused kernels.");
+	}
 
-	// Create an OpenCL context.
+	// Create an OpenCL context with all of the devices in it.
 	cl_int status = CL_SUCCESS;
-	this->context = cl::Context(this->device, nullptr, nullptr, nullptr, &status);
+	this->context = cl::Context(bandDevices, nullptr, nullptr, nullptr, &status);
 	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Context.");
 
-	// Create an OpenCL command queue.
-	this->commandQueue = cl::CommandQueue(this->context, this->device, 0, &status);
+	// Create an OpenCL command queue. Profiling makes it record command timestamps.
+	const cl_command_queue_properties queueProperties =
+		profiled ? CL_QUEUE_PROFILING_ENABLE : 0;
+	this->commandQueue = cl::CommandQueue(this->context, this->device, queueProperties,
+		&status);
 	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::CommandQueue.");
 
-	// Read the kernel source from file.
-	std::string source = File::toString(CLProgram::PATH + CLProgram::FILENAME);
+	// Build the lean program into something executable, reusing a cached binary if
+	// there is one. If compilation fails, the program stops. The lean kernels are built
+	// into the executable, index voxels with the same functions as the render world,
+	// and get the render dimensions as arguments, so their program doesn't depend on
+	// the window size. The kernel.cl program is built along with its kernels below.
+	if (kernelMode != CLKernelMode::Full)
+	{
+		const std::string chunkDefines = chunkSkipping ? std::string() :
+			std::string("#define LEAN_NO_CHUNK_SKIPPING\n");
+		const std::string stepDefines = this->stepCounted ?
+			std::string("#define LEAN_COUNT_STEPS\n") : std::string();
+		this->buildProgram(bandDevices, this->getWorldDefines() + chunkDefines +
+			stepDefines + VoxelIndexer::SOURCE + CLLeanKernels::SOURCE,
+			CLProgram::BUILD_OPTIONS);
+	}
 
-	// Make some #defines to add to the kernel source.
-	std::string defines = std::string("#define RENDER_WIDTH ") + std::to_string(this->renderWidth) +
-		std::string("\n") + std::string("#define RENDER_HEIGHT ") +
-		std::to_string(this->renderHeight) + std::string("\n") +
-		std::string("#define WORLD_WIDTH ") + std::to_string(worldWidth) + std::string("\n") +
-		std::string("#define WORLD_HEIGHT ") + std::to_string(worldHeight) + std::string("\n") +
-		std::string("#define WORLD_DEPTH ") + std::to_string(worldDepth) + std::string("\n");
+	// Create the kernels and set their entry function to be a __kernel in the program.
+	if (bandDevices.size() > 1)
+	{
+		// Each band has its own kernels.
+		this->createBands(bandDevices);
+	}
+	else if (kernelMode == CLKernelMode::Full)
+	{
+		this->buildFullProgram();
+	}
+	else if (kernelMode == CLKernelMode::Lean)
+	{
+		// The reprojection kernel takes the intersect kernel's place.
+		if (this->reprojected)
+		{
+			this->reprojectKernel = cl::Kernel(
+				this->program, CLLeanKernels::REPROJECT_KERNEL.c_str(), &status);
+			Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Kernel reprojectKernel.");
 
-	// Put the kernel source in a program object within the OpenCL context.
-	this->program = cl::Program(this->context, defines + source, false, &status);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Program.");
+			this->reuseViewKernel = cl::Kernel(
+				this->program, CLLeanKernels::REUSE_VIEW_KERNEL.c_str(), &status);
+			Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Kernel reuseViewKernel.");
+		}
+		else if (this->refineBlockSize > 1)
+		{
+			// So do the edge refinement kernels.
+			this->refineCornersKernel = cl::Kernel(
+				this->program, CLLeanKernels::REFINE_CORNERS_KERNEL.c_str(), &status);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel refineCornersKernel.");
+
+			this->refineKernel = cl::Kernel(
+				this->program, CLLeanKernels::REFINE_KERNEL.c_str(), &status);
+			Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Kernel refineKernel.");
+
+			this->reuseViewKernel = cl::Kernel(
+				this->program, CLLeanKernels::REUSE_VIEW_KERNEL.c_str(), &status);
+			Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Kernel reuseViewKernel.");
+		}
+		else
+		{
+			this->leanIntersectKernel = cl::Kernel(
+				this->program, CLLeanKernels::INTERSECT_KERNEL.c_str(), &status);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel leanIntersectKernel.");
+		}
 
-	// Add some kernel compilation switches.
-	std::string options("-cl-fast-relaxed-math -cl-strict-aliasing");
+		this->leanShadeKernel = cl::Kernel(
+			this->program, CLLeanKernels::SHADE_KERNEL.c_str(), &status);
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Kernel leanShadeKernel.");
 
-	// Build the program into something executable. If compilation fails, the program stops.
-	status = this->program.build(devices, options.c_str());
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Program::build (" +
-		this->getErrorString(status) + ").");
+		if (this->world.getSpriteMode() == SpriteMode::Rasterized)
+		{
+			this->spritesKernel = cl::Kernel(
+				this->program, CLLeanKernels::SPRITES_KERNEL.c_str(), &status);
+			Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Kernel spritesKernel.");
+		}
+	}
+	else
+	{
+		this->fusedKernel = cl::Kernel(
+			this->program, CLLeanKernels::FUSED_KERNEL.c_str(), &status);
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Kernel fusedKernel.");
+	}
 
-	// Create the kernels and set their entry function to be a __kernel in the program.
-	this->intersectKernel = cl::Kernel(
-		this->program, CLProgram::INTERSECT_KERNEL.c_str(), &status);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Kernel intersectKernel.");
+	// Only the lean and fused shading samples mip levels, so the kernel.cl textures
+	// (four floats per texel) don't make room for them.
+	this->world.setMipmapped(kernelMode != CLKernelMode::Full);
 
-	this->rayTraceKernel = cl::Kernel(
-		this->program, CLProgram::RAY_TRACE_KERNEL.c_str(), &status);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Kernel rayTraceKernel.");
+	// --- TESTING PURPOSES ---
+	// The following code is for testing. Remove it once using actual world data.
 
-	this->convertToRGBKernel = cl::Kernel(
-		this->program, CLProgram::CONVERT_TO_RGB_KERNEL.c_str(), &status);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Kernel convertToRGBKernel.");
+	this->world.makeTestWorld(textureManager);
+
+	// --- END TESTING ---
 
 	// Create the OpenCL buffers in the context for reading and/or writing.
 	// NOTE: The size of some of these buffers is just a placeholder for now.
-	this->cameraBuffer = cl::Buffer(this->context, CL_MEM_READ_ONLY,
-		SIZEOF_CAMERA, nullptr, &status);
+	// The camera and game time (the frame constants) share one buffer so they only 
+	// take one transfer per frame. The kernels get them as sub-buffers, which have to
+	// start at a multiple of the device's base address alignment (given in bits).
+	const cl::size_type baseAlignment = std::max<cl::size_type>(
+		this->device.getInfo<CL_DEVICE_MEM_BASE_ADDR_ALIGN>() / 8, 1);
+	this->gameTimeOffset = ((SIZEOF_CAMERA + baseAlignment - 1) / baseAlignment) *
+		baseAlignment;
+	this->frameConstantsSize = this->gameTimeOffset + sizeof(cl_float);
+
+	this->frameConstantsBuffer = cl::Buffer(this->context, CL_MEM_READ_ONLY,
+		this->frameConstantsSize, nullptr, &status);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer frameConstantsBuffer.");
+
+	cl_buffer_region cameraRegion;
+	cameraRegion.origin = 0;
+	cameraRegion.size = SIZEOF_CAMERA;
+	this->cameraBuffer = this->frameConstantsBuffer.createSubBuffer(CL_MEM_READ_ONLY,
+		CL_BUFFER_CREATE_TYPE_REGION, &cameraRegion, &status);
 	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer cameraBuffer.");
 
+	cl_buffer_region gameTimeRegion;
+	gameTimeRegion.origin = this->gameTimeOffset;
+	gameTimeRegion.size = sizeof(cl_float);
+	this->gameTimeBuffer = this->frameConstantsBuffer.createSubBuffer(CL_MEM_READ_ONLY,
+		CL_BUFFER_CREATE_TYPE_REGION, &gameTimeRegion, &status);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer gameTimeBuffer.");
+
+	// The lean kernels take the step counts even when they aren't built to count.
+	if (kernelMode != CLKernelMode::Full)
+	{
+		this->stepCountBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
+			sizeof(cl_uint) * this->stepCounts.size(), nullptr, &status);
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer stepCountBuffer.");
+	}
+
+	// Reprojection keeps last frame's camera next to its depths and hits.
+	if (this->reprojected)
+	{
+		this->previousCameraBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
+			SIZEOF_CAMERA, nullptr, &status);
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer previousCameraBuffer.");
+
+		this->reuseCountBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
+			sizeof(cl_uint) * this->reuseCounts.size(), nullptr, &status);
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer reuseCountBuffer.");
+
+		const cl_uint pixelArg = static_cast<cl_uint>(CLLeanKernels::WORLD_ARG_COUNT);
+		status = this->reprojectKernel.setArg(pixelArg + 2, this->previousCameraBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg reprojectKernel previousCameraBuffer.");
+
+		status = this->reprojectKernel.setArg(pixelArg + 9, this->reuseCountBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg reprojectKernel reuseCountBuffer.");
+	}
+
+	// Edge refinement counts filled and traced pixels the same way.
+	if (this->refineBlockSize > 1)
+	{
+		this->reuseCountBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
+			sizeof(cl_uint) * this->reuseCounts.size(), nullptr, &status);
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer reuseCountBuffer.");
+
+		const cl_uint pixelArg = static_cast<cl_uint>(CLLeanKernels::WORLD_ARG_COUNT);
+		status = this->refineCornersKernel.setArg(pixelArg + 2,
+			static_cast<cl_int>(this->refineBlockSize));
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg refineCornersKernel blockSize.");
+
+		status = this->refineKernel.setArg(pixelArg + 4,
+			static_cast<cl_int>(this->refineBlockSize));
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg refineKernel blockSize.");
+
+		status = this->refineKernel.setArg(pixelArg + 6, this->reuseCountBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg refineKernel fillCountBuffer.");
+
+		status = this->refineKernel.setArg(pixelArg + 7, static_cast<cl_int>(0));
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg refineKernel countFills.");
+	}
+
+	// The frame constants are written into a ring of slots in pinned host memory that
+	// stays mapped, so a frame's constants need no allocation and no copy before the
+	// transfer. Each slot's transfer is waited on before the slot is written again.
+	this->frameStagingBuffer = cl::Buffer(this->context,
+		CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+		this->frameConstantsSize * FRAME_SLOT_COUNT, nullptr, &status);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer frameStagingBuffer.");
+
+	this->frameStagingData = static_cast<cl_char*>(this->commandQueue.enqueueMapBuffer(
+		this->frameStagingBuffer, CL_TRUE, CL_MAP_WRITE, 0,
+		this->frameConstantsSize * FRAME_SLOT_COUNT, nullptr, nullptr, &status));
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::CommandQueue::enqueueMapBuffer frameStagingBuffer.");
+
+	std::fill(this->frameStagingData,
+		this->frameStagingData + (this->frameConstantsSize * FRAME_SLOT_COUNT), 0);
+	this->frameSlotEvents = std::vector<cl::Event>(FRAME_SLOT_COUNT);
+	this->frameSlot = 0;
+	this->frameConstantsDirty = true;
+
 	this->voxelRefBuffer = cl::Buffer(this->context, CL_MEM_READ_ONLY,
-		SIZEOF_VOXEL_REF * worldWidth * worldHeight * worldDepth, nullptr, &status);
+		SIZEOF_VOXEL_REF * this->world.getVoxelIndexer().getCount(), nullptr, &status);
 	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer voxelRefBuffer.");
 
 	this->spriteRefBuffer = cl::Buffer(this->context, CL_MEM_READ_ONLY,
-		SIZEOF_SPRITE_REF * worldWidth * worldHeight * worldDepth, nullptr, &status);
+		SIZEOF_SPRITE_REF * this->world.getVoxelIndexer().getCount(), nullptr, &status);
 	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer spriteRefBuffer.");
 
 	this->lightRefBuffer = cl::Buffer(this->context, CL_MEM_READ_ONLY,
-		SIZEOF_LIGHT_REF * worldWidth * worldHeight * worldDepth, nullptr, &status);
+		SIZEOF_LIGHT_REF * this->world.getVoxelIndexer().getCount(), nullptr, &status);
 	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer lightRefBuffer.");
 
+	// The rectangle buffer only has room for rectangles that exist. OpenCL buffers
+	// can't be empty, so there is always room for at least one.
+	this->rectangleCapacity = std::max<cl::size_type>(
+		this->world.getRectangles().size(), 1);
 	this->rectangleBuffer = cl::Buffer(this->context, CL_MEM_READ_ONLY,
-		SIZEOF_RECTANGLE * 6 * worldWidth * worldHeight * worldDepth
-		/* This buffer size is actually very naive. Much of it will just be air.
-		Make a mapping of 3D cell coordinates to rectangles at some point to help. */,
-		nullptr, &status);
+		SIZEOF_RECTANGLE * this->rectangleCapacity, nullptr, &status);
 	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer rectangleBuffer.");
 
+	this->spriteRectangleCapacity = std::max<cl::size_type>(
+		this->world.getSpriteHeap().getRectangles().size(), 1);
+	this->spriteRectangleBuffer = cl::Buffer(this->context, CL_MEM_READ_ONLY,
+		SIZEOF_RECTANGLE * this->spriteRectangleCapacity, nullptr, &status);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer spriteRectangleBuffer.");
+
+	const LightManager &lightManager = this->world.getLightManager();
+	this->lightIndexCapacity = std::max<cl::size_type>(
+		lightManager.getLightIndices().size(), 1);
+	this->lightIndexBuffer = cl::Buffer(this->context, CL_MEM_READ_ONLY,
+		sizeof(cl_int) * this->lightIndexCapacity, nullptr, &status);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer lightIndexBuffer.");
+
+	this->lightCapacity = std::max<cl::size_type>(lightManager.getLights().size(), 1);
 	this->lightBuffer = cl::Buffer(this->context, CL_MEM_READ_ONLY,
-		SIZEOF_LIGHT /* Some # of lights * world dims, Placeholder size */, nullptr, &status);
+		SIZEOF_LIGHT * this->lightCapacity, nullptr, &status);
 	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer lightBuffer.");
 
+	this->texelCapacity = std::max<cl::size_type>(this->texturePool.getCapacity(), 1);
 	this->textureBuffer = cl::Buffer(this->context, CL_MEM_READ_ONLY,
-		sizeof(cl_float4) * 64 * 64 * 32 /* Placeholder size, 32 textures */, nullptr, &status);
+		this->texelSize * this->texelCapacity, nullptr, &status);
 	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer textureBuffer.");
 
-	this->gameTimeBuffer = cl::Buffer(this->context, CL_MEM_READ_ONLY,
-		sizeof(cl_float), nullptr, &status);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer gameTimeBuffer.");
+	this->paletteBuffer = cl::Buffer(this->context, CL_MEM_READ_ONLY,
+		sizeof(cl_float4) * this->world.getPalette().size(), nullptr, &status);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer paletteBuffer.");
 
-	this->depthBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
-		sizeof(cl_float) * renderPixelCount, nullptr, &status);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer depthBuffer.");
+	this->chunkOccupancyBuffer = cl::Buffer(this->context, CL_MEM_READ_ONLY,
+		sizeof(cl_uint) * this->world.getChunkOccupancy().size(), nullptr, &status);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer chunkOccupancyBuffer.");
 
-	this->normalBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
-		sizeof(cl_float3) * renderPixelCount, nullptr, &status);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer normalBuffer.");
+	// Tell the kernels where the world buffers live.
+	this->bindWorldBuffers();
 
-	this->viewBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
-		sizeof(cl_float3) * renderPixelCount, nullptr, &status);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer viewBuffer.");
+	// Create the buffers that depend on the render dimensions.
+	this->createPixelBuffers();
 
-	this->pointBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
-		sizeof(cl_float3) * renderPixelCount, nullptr, &status);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer pointBuffer.");
+	// Put the world in device memory. The whole world starts out dirty.
+	this->updateWorld();
+}
 
-	this->uvBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
-		sizeof(cl_float2) * renderPixelCount, nullptr, &status);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer uvBuffer.");
+CLProgram::~CLProgram()
+{
+	this->finishFrames();
 
-	this->rectangleIndexBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
-		sizeof(cl_int) * renderPixelCount, nullptr, &status);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer rectangleIndexBuffer.");
+	this->commandQueue.enqueueUnmapMemObject(this->frameStagingBuffer,
+		this->frameStagingData, nullptr, nullptr);
+	this->commandQueue.finish();
 
-	this->colorBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
-		sizeof(cl_float3) * renderPixelCount, nullptr, &status);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer colorBuffer.");
+	// Destroy the game world frame buffer.
+	// The SDL_Renderer destroys this itself with SDL_DestroyRenderer(), too.
+	SDL_DestroyTexture(this->texture);
+}
 
-	this->outputBuffer = cl::Buffer(this->context, CL_MEM_WRITE_ONLY,
-		sizeof(cl_int) * renderPixelCount, nullptr, &status);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer outputBuffer.");
+std::vector<cl::Platform> CLProgram::getPlatforms()
+{
+	std::vector<cl::Platform> platforms;
+	cl_int status = cl::Platform::get(&platforms);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "CLProgram::getPlatforms.");
 
-	// Tell the intersect kernel arguments where their buffers live.
-	status = this->intersectKernel.setArg(0, this->cameraBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg intersectKernel cameraBuffer.");
+	return platforms;
+}
 
-	status = this->intersectKernel.setArg(1, this->voxelRefBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg intersectKernel voxelRefBuffer.");
+std::vector<cl::Device> CLProgram::getDevices(const cl::Platform &platform,
+	cl_device_type type)
+{
+	std::vector<cl::Device> devices;
+	cl_int status = platform.getDevices(type, &devices);
+	Debug::check((status == CL_SUCCESS) || (status == CL_DEVICE_NOT_FOUND),
+		"CLProgram", "CLProgram::getDevices.");
 
-	status = this->intersectKernel.setArg(2, this->spriteRefBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg intersectKernel spriteRefBuffer.");
+	return devices;
+}
 
-	status = this->intersectKernel.setArg(3, this->rectangleBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg intersectKernel rectangleBuffer.");
+std::vector<cl::Device> CLProgram::getSplitDevices(const std::vector<cl::Device> &devices,
+	CLDeviceSplit deviceSplit)
+{
+	assert(devices.size() > 0);
 
-	status = this->intersectKernel.setArg(4, this->textureBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg intersectKernel textureBuffer.");
+	if (deviceSplit == CLDeviceSplit::Devices)
+	{
+		if (devices.size() > 1)
+		{
+			return devices;
+		}
 
-	status = this->intersectKernel.setArg(5, this->depthBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg intersectKernel depthBuffer.");
+		Debug::mention("CLProgram", "Only one device found, so there is no device split.");
+	}
+	else if (deviceSplit == CLDeviceSplit::NUMA)
+	{
+		// One sub-device per NUMA node. Devices that can't be partitioned (i.e., most
+		// GPUs) are used whole.
+		const cl_device_partition_property properties[] =
+		{
+			CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN,
+			CL_DEVICE_AFFINITY_DOMAIN_NUMA,
+			0
+		};
+
+		cl::Device parentDevice = devices.at(0);
+		std::vector<cl::Device> subDevices;
+		const cl_int status = parentDevice.createSubDevices(properties, &subDevices);
+		if ((status == CL_SUCCESS) && (subDevices.size() > 1))
+		{
+			Debug::mention("CLProgram", "Partitioned device into " +
+				std::to_string(subDevices.size()) + " NUMA sub-devices.");
+			return subDevices;
+		}
 
-	status = this->intersectKernel.setArg(6, this->normalBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg intersectKernel normalBuffer.");
+		Debug::mention("CLProgram", "Couldn't partition device by NUMA node, so there "
+			"is no device split.");
+	}
 
-	status = this->intersectKernel.setArg(7, this->viewBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg intersectKernel viewBuffer.");
+	return { devices.at(0) };
+}
 
-	status = this->intersectKernel.setArg(8, this->pointBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg intersectKernel pointBuffer.");
+void CLProgram::finishFrames()
+{
+	// Give back any output buffer still mapped by pipelined rendering. Its frame
+	// is dropped.
+	for (int i = 0; i < static_cast<int>(this->mappedOutputs.size()); ++i)
+	{
+		if (this->mappedOutputs.at(i) != nullptr)
+		{
+			this->mapEvents.at(i).wait();
+			this->commandQueue.enqueueUnmapMemObject(this->outputBuffers.at(i),
+				this->mappedOutputs.at(i), nullptr, nullptr);
+			this->mappedOutputs.at(i) = nullptr;
+		}
+	}
 
-	status = this->intersectKernel.setArg(9, this->uvBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg intersectKernel uvBuffer.");
+	this->waitForFrames();
+}
 
-	status = this->intersectKernel.setArg(10, this->rectangleIndexBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg intersectKernel rectangleIndexBuffer.");
+cl::Event *CLProgram::makeProfileEvent(const std::string &stageName)
+{
+	if (this->profiler == nullptr)
+	{
+		return nullptr;
+	}
 
-	// Tell the rayTrace kernel arguments where their buffers live.
-	status = this->rayTraceKernel.setArg(0, this->voxelRefBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg rayTraceKernel voxelRefBuffer.");
+	this->profileEvents.push_back(std::make_pair(stageName, cl::Event()));
+	return &this->profileEvents.back().second;
+}
 
-	status = this->rayTraceKernel.setArg(1, this->spriteRefBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg rayTraceKernel spriteRefBuffer.");
+void CLProgram::addProfileEvent(const std::string &stageName, const cl::Event &event)
+{
+	if (this->profiler != nullptr)
+	{
+		this->profileEvents.push_back(std::make_pair(stageName, event));
+	}
+}
 
-	status = this->rayTraceKernel.setArg(2, this->lightRefBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg rayTraceKernel lightRefBuffer.");
+void CLProgram::addHostSample(const std::string &stageName,
+	const std::chrono::high_resolution_clock::time_point &startTime)
+{
+	if (this->profiler != nullptr)
+	{
+		const auto endTime = std::chrono::high_resolution_clock::now();
+		this->profiler->addSample(stageName,
+			std::chrono::duration<double, std::milli>(endTime - startTime).count());
+	}
+}
 
-	status = this->rayTraceKernel.setArg(3, this->rectangleBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg rayTraceKernel rectangleBuffer.");
+void *CLProgram::lockTextureRows(int width, int startRow, int endRow, int *pitch)
+{
+	assert(startRow >= 0);
+	assert(startRow < endRow);
 
-	status = this->rayTraceKernel.setArg(4, this->lightBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg rayTraceKernel lightBuffer.");
+	SDL_Rect rect;
+	rect.x = 0;
+	rect.y = startRow;
+	rect.w = width;
+	rect.h = endRow - startRow;
 
-	status = this->rayTraceKernel.setArg(5, this->textureBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg rayTraceKernel textureBuffer.");
+	void *pixels = nullptr;
+	const int status = SDL_LockTexture(this->texture, &rect, &pixels, pitch);
+	Debug::check(status == 0, "CLProgram", "SDL_LockTexture (" +
+		std::string(SDL_GetError()) + ").");
 
-	status = this->rayTraceKernel.setArg(6, this->gameTimeBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg rayTraceKernel gameTimeBuffer.");
+	return pixels;
+}
 
-	status = this->rayTraceKernel.setArg(7, this->depthBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg rayTraceKernel depthBuffer.");
+void CLProgram::enqueueReadRows(const cl::CommandQueue &queue, const cl::Buffer &buffer,
+	int width, int startRow, int rowCount, void *pixels, int pitch, cl_bool blocking,
+	cl::Event *event)
+{
+	const cl::size_type rowSize = sizeof(cl_int) * width;
+	cl_int status = CL_SUCCESS;
 
-	status = this->rayTraceKernel.setArg(8, this->normalBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg rayTraceKernel normalBuffer.");
+	if (static_cast<cl::size_type>(pitch) == rowSize)
+	{
+		// The texture's rows are packed the same as the output buffer's.
+		status = queue.enqueueReadBuffer(buffer, blocking, rowSize * startRow,
+			rowSize * rowCount, pixels, nullptr, event);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::CommandQueue::enqueueReadBuffer.");
+	}
+	else
+	{
+		// The texture has padding after each row, so let the device skip it.
+		const cl::array<cl::size_type, 3> bufferOrigin = { 0, 
+			static_cast<cl::size_type>(startRow), 0 };
+		const cl::array<cl::size_type, 3> hostOrigin = { 0, 0, 0 };
+		const cl::array<cl::size_type, 3> region = { rowSize,
+			static_cast<cl::size_type>(rowCount), 1 };
+		status = queue.enqueueReadBufferRect(buffer, blocking, bufferOrigin, hostOrigin,
+			region, rowSize, 0, static_cast<cl::size_type>(pitch), 0, pixels, nullptr,
+			event);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::CommandQueue::enqueueReadBufferRect.");
+	}
+}
 
-	status = this->rayTraceKernel.setArg(9, this->viewBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg rayTraceKernel viewBuffer.");
+void CLProgram::presentTexture(int width, int height, Renderer &renderer)
+{
+	SDL_UnlockTexture(this->texture);
+	renderer.fillNative(this->texture, width, height);
+	this->presentedWidth = width;
+	this->presentedHeight = height;
+}
 
-	status = this->rayTraceKernel.setArg(10, this->pointBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg rayTraceKernel pointBuffer.");
+void CLProgram::presentOutput(const void *pixels, int width, int height,
+	Renderer &renderer)
+{
+	int pitch = 0;
+	char *texturePixels = static_cast<char*>(
+		this->lockTextureRows(width, 0, height, &pitch));
 
-	status = this->rayTraceKernel.setArg(11, this->uvBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg rayTraceKernel uvBuffer.");
+	const size_t rowSize = sizeof(cl_int) * width;
+	const char *rowPixels = static_cast<const char*>(pixels);
+	if (static_cast<size_t>(pitch) == rowSize)
+	{
+		std::memcpy(texturePixels, rowPixels, rowSize * height);
+	}
+	else
+	{
+		for (int y = 0; y < height; ++y)
+		{
+			std::memcpy(texturePixels + (y * pitch), rowPixels + (y * rowSize), rowSize);
+		}
+	}
 
-	status = this->rayTraceKernel.setArg(12, this->rectangleIndexBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg rayTraceKernel rectangleIndexBuffer.");
+	this->presentTexture(width, height, renderer);
+}
 
-	status = this->rayTraceKernel.setArg(13, this->colorBuffer);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg rayTraceKernel colorBuffer.");
+void CLProgram::presentMappedOutput(int index, Renderer &renderer)
+{
+	void *mappedOutput = this->mappedOutputs.at(index);
+	assert(mappedOutput != nullptr);
 
-	// Tell the convertToRGB kernel arguments where their buffers live.
-	status = this->convertToRGBKernel.setArg(0, this->colorBuffer);
+	const auto waitStartTime = std::chrono::high_resolution_clock::now();
+	cl_int status = this->mapEvents.at(index).wait();
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Event::wait mapEvent.");
+	this->addHostSample("host wait output", waitStartTime);
+
+	const auto presentStartTime = std::chrono::high_resolution_clock::now();
+	const int width = this->outputWidths.at(index);
+	const int height = this->outputHeights.at(index);
+	this->presentOutput(mappedOutput, width, height, renderer);
+
+	status = this->commandQueue.enqueueUnmapMemObject(this->outputBuffers.at(index),
+		mappedOutput, nullptr, nullptr);
 	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg convertToRGBKernel colorBuffer.");
+		"cl::CommandQueue::enqueueUnmapMemObject.");
+
+	this->mappedOutputs.at(index) = nullptr;
+	this->addHostSample("host present", presentStartTime);
+}
+
+void CLProgram::presentLastFrame(Renderer &renderer)
+{
+	// A pipelined frame that hasn't been shown yet is the last frame.
+	for (int i = 0; i < static_cast<int>(this->mappedOutputs.size()); ++i)
+	{
+		if (this->mappedOutputs.at(i) != nullptr)
+		{
+			this->presentMappedOutput(i, renderer);
+			return;
+		}
+	}
+
+	// Otherwise it's already in the texture.
+	if (this->presentedWidth > 0)
+	{
+		renderer.fillNative(this->texture, this->presentedWidth, this->presentedHeight);
+	}
+}
+
+cl_char *CLProgram::getFrameSlot() const
+{
+	return this->frameStagingData + (this->frameSlot * this->frameConstantsSize);
+}
+
+void CLProgram::submitFrameConstants()
+{
+	if (!this->frameConstantsDirty)
+	{
+		return;
+	}
 
-	status = this->convertToRGBKernel.setArg(1, this->outputBuffer);
+	// One write for the camera and game time together. The queue is in order, so 
+	// it's done before this frame's kernels start.
+	cl_char *slotPtr = this->getFrameSlot();
+	cl::Event &slotEvent = this->frameSlotEvents.at(this->frameSlot);
+	cl_int status = this->commandQueue.enqueueWriteBuffer(this->frameConstantsBuffer,
+		CL_FALSE, 0, this->frameConstantsSize, static_cast<const void*>(slotPtr), nullptr,
+		&slotEvent);
 	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::Kernel::setArg convertToRGBKernel outputBuffer.");
+		"cl::enqueueWriteBuffer frameConstantsBuffer.");
 
-	// --- TESTING PURPOSES ---
-	// The following code is for testing. Remove it once using actual world data.
+	this->addProfileEvent("device write frame constants", slotEvent);
 
-	this->makeTestWorld();
+	// Carry the constants over to the next slot, so a frame that only changes some of
+	// them keeps the rest.
+	const int nextSlot = (this->frameSlot + 1) % FRAME_SLOT_COUNT;
+	cl::Event &nextSlotEvent = this->frameSlotEvents.at(nextSlot);
+	if (nextSlotEvent() != nullptr)
+	{
+		status = nextSlotEvent.wait();
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Event::wait frameSlotEvent.");
+	}
 
-	// --- END TESTING ---
+	std::copy(slotPtr, slotPtr + this->frameConstantsSize,
+		this->frameStagingData + (nextSlot * this->frameConstantsSize));
+	this->frameSlot = nextSlot;
+	this->frameConstantsDirty = false;
 }
 
-CLProgram::~CLProgram()
+void CLProgram::updateResolution(
+	const std::chrono::high_resolution_clock::time_point &startTime)
 {
-	// Destroy the game world frame buffer.
-	// The SDL_Renderer destroys this itself with SDL_DestroyRenderer(), too.
-	SDL_DestroyTexture(this->texture);
+	const auto endTime = std::chrono::high_resolution_clock::now();
+	this->resolutionScaler.update(
+		std::chrono::duration<double, std::milli>(endTime - startTime).count());
 }
 
-CLProgram &CLProgram::operator=(CLProgram &&clProgram)
-{
-	// Is there a better way to do this?
-	this->device = clProgram.device;
-	this->context = clProgram.context;
-	this->commandQueue = clProgram.commandQueue;
-	this->program = clProgram.program;
-	this->intersectKernel = clProgram.intersectKernel;
-	this->rayTraceKernel = clProgram.rayTraceKernel;
-	this->convertToRGBKernel = clProgram.convertToRGBKernel;
-	this->cameraBuffer = clProgram.cameraBuffer;
-	this->voxelRefBuffer = clProgram.voxelRefBuffer;
-	this->spriteRefBuffer = clProgram.spriteRefBuffer;
-	this->lightRefBuffer = clProgram.lightRefBuffer;
-	this->rectangleBuffer = clProgram.rectangleBuffer;
-	this->lightBuffer = clProgram.lightBuffer;
-	this->textureBuffer = clProgram.textureBuffer;
-	this->gameTimeBuffer = clProgram.gameTimeBuffer;
-	this->depthBuffer = clProgram.depthBuffer;
-	this->normalBuffer = clProgram.normalBuffer;
-	this->viewBuffer = clProgram.viewBuffer;
-	this->pointBuffer = clProgram.pointBuffer;
-	this->uvBuffer = clProgram.uvBuffer;
-	this->rectangleIndexBuffer = clProgram.rectangleIndexBuffer;
-	this->colorBuffer = clProgram.colorBuffer;
-	this->outputBuffer = clProgram.outputBuffer;
-	this->outputData = clProgram.outputData;
-	this->textureManager = std::move(clProgram.textureManager);
-	this->renderWidth = clProgram.renderWidth;
-	this->renderHeight = clProgram.renderHeight;
-	this->worldWidth = clProgram.worldWidth;
-	this->worldHeight = clProgram.worldHeight;
-	this->worldDepth = clProgram.worldDepth;
+void CLProgram::collectProfileEvents()
+{
+	// Events still in flight are moved to the front, in order.
+	size_t pendingCount = 0;
+	for (size_t i = 0; i < this->profileEvents.size(); ++i)
+	{
+		auto &profileEvent = this->profileEvents.at(i);
+		const cl::Event &event = profileEvent.second;
 
-	SDL_DestroyTexture(this->texture);
-	this->texture = clProgram.texture;
-	clProgram.texture = nullptr;
+		cl_int status = CL_SUCCESS;
+		const cl_int executionStatus =
+			event.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>(&status);
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Event::getInfo " +
+			this->getErrorString(status) + ".");
 
-	return *this;
+		if (executionStatus == CL_COMPLETE)
+		{
+			// Timestamps are in nanoseconds.
+			const cl_ulong startTime = event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+			const cl_ulong endTime = event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+			const double milliseconds = (endTime > startTime) ?
+				(static_cast<double>(endTime - startTime) / 1000000.0) : 0.0;
+			this->profiler->addSample(profileEvent.first, milliseconds);
+		}
+		else if (executionStatus > CL_COMPLETE)
+		{
+			// Still queued or running. A negative status is a failed command, which
+			// has no times, so it's dropped.
+			if (pendingCount != i)
+			{
+				this->profileEvents.at(pendingCount) = std::move(profileEvent);
+			}
+
+			pendingCount++;
+		}
+	}
+
+	this->profileEvents.erase(this->profileEvents.begin() + pendingCount,
+		this->profileEvents.end());
 }
 
-std::vector<cl::Platform> CLProgram::getPlatforms()
+bool CLProgram::isShadingChanged() const
 {
-	std::vector<cl::Platform> platforms;
-	cl_int status = cl::Platform::get(&platforms);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "CLProgram::getPlatforms.");
+	if (this->gameTime == this->shadedGameTime)
+	{
+		return false;
+	}
 
-	return platforms;
+	// The kernel.cl kernels might shade by game time in any way.
+	if (this->kernelMode == CLKernelMode::Full)
+	{
+		return true;
+	}
+
+	if (std::abs(this->gameTime - this->shadedGameTime) < SHADING_TIME_STEP)
+	{
+		return false;
+	}
+
+	const bool wasNight = getSunDirection(this->shadedGameTime).getY() <= NIGHT_SUN_HEIGHT;
+	const bool isNight = getSunDirection(this->gameTime).getY() <= NIGHT_SUN_HEIGHT;
+	return !(wasNight && isNight);
 }
 
-std::vector<cl::Device> CLProgram::getDevices(const cl::Platform &platform,
-	cl_device_type type)
+void CLProgram::findDirtyTiles()
 {
-	std::vector<cl::Device> devices;
-	cl_int status = platform.getDevices(type, &devices);
-	Debug::check((status == CL_SUCCESS) || (status == CL_DEVICE_NOT_FOUND),
-		"CLProgram", "CLProgram::getDevices.");
+	this->dirtyTiles.clear(this->frameWidth, this->frameHeight);
 
-	return devices;
+	// A new palette changes the color of everything.
+	if (this->world.isPaletteDirty())
+	{
+		this->dirtyTiles.addAll();
+		return;
+	}
+
+	// Changed geometry also changes the sunlight on whatever it shades now or shaded 
+	// before. Those points are below it, away from the sun, down to the ground.
+	const Float3d sunDirection = getSunDirection(this->gameTime);
+	for (const auto &box : this->world.getChangedGeometry())
+	{
+		Float3d minPoint(box.first.getX(), box.first.getY(), box.first.getZ());
+		Float3d maxPoint(box.second.getX(), box.second.getY(), box.second.getZ());
+		if (sunDirection.getY() > 0.0)
+		{
+			const Float3d shadowOffset = sunDirection *
+				-(std::max(maxPoint.getY(), 0.0) / sunDirection.getY());
+			minPoint = minPoint.componentMin(minPoint + shadowOffset);
+			maxPoint = maxPoint.componentMax(maxPoint + shadowOffset);
+		}
+
+		this->dirtyTiles.addBox(minPoint, maxPoint);
+	}
+
+	for (const auto &box : this->world.getChangedLighting())
+	{
+		this->dirtyTiles.addBox(
+			Float3d(box.first.getX(), box.first.getY(), box.first.getZ()),
+			Float3d(box.second.getX(), box.second.getY(), box.second.getZ()));
+	}
+}
+
+void CLProgram::enqueueRects(cl::Kernel &kernel, const std::vector<Rect> &rects,
+	const std::vector<cl::Event> *&waitEvents, const std::string &stageName)
+{
+	for (const Rect &rect : rects)
+	{
+		cl_int status = this->commandQueue.enqueueNDRangeKernel(kernel,
+			cl::NDRange(rect.getLeft(), rect.getTop()),
+			cl::NDRange(rect.getWidth(), rect.getHeight()), cl::NullRange, waitEvents,
+			this->makeProfileEvent(stageName));
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::CommandQueue::enqueueNDRangeKernel " + stageName + ".");
+
+		waitEvents = nullptr;
+	}
+}
+
+std::vector<cl::Kernel*> CLProgram::getLeanKernels()
+{
+	if (this->bands.size() > 0)
+	{
+		std::vector<cl::Kernel*> kernels;
+		for (RenderBand &band : this->bands)
+		{
+			if (this->kernelMode == CLKernelMode::Lean)
+			{
+				kernels.push_back(&band.leanIntersectKernel);
+				kernels.push_back(&band.leanShadeKernel);
+			}
+			else
+			{
+				kernels.push_back(&band.fusedKernel);
+			}
+		}
+
+		return kernels;
+	}
+	else if (this->kernelMode == CLKernelMode::Lean)
+	{
+		std::vector<cl::Kernel*> kernels;
+		if (this->reprojected)
+		{
+			kernels = { &this->reprojectKernel, &this->leanShadeKernel };
+		}
+		else if (this->refineBlockSize > 1)
+		{
+			kernels = { &this->refineCornersKernel, &this->refineKernel,
+				&this->leanShadeKernel };
+		}
+		else
+		{
+			kernels = { &this->leanIntersectKernel, &this->leanShadeKernel };
+		}
+
+		if (this->world.getSpriteMode() == SpriteMode::Rasterized)
+		{
+			kernels.push_back(&this->spritesKernel);
+		}
+
+		return kernels;
+	}
+	else if (this->kernelMode == CLKernelMode::Fused)
+	{
+		return { &this->fusedKernel };
+	}
+	else
+	{
+		return std::vector<cl::Kernel*>();
+	}
+}
+
+void CLProgram::createBands(const std::vector<cl::Device> &bandDevices)
+{
+	assert(this->kernelMode != CLKernelMode::Full);
+
+	cl_int status = CL_SUCCESS;
+	this->bands = std::vector<RenderBand>(bandDevices.size());
+	for (size_t i = 0; i < this->bands.size(); ++i)
+	{
+		RenderBand &band = this->bands.at(i);
+		band.device = bandDevices.at(i);
+		band.startRow = 0;
+		band.rowCount = 0;
+
+		// Band queues always record command times, since the band heights depend on 
+		// them.
+		band.commandQueue = cl::CommandQueue(this->context, band.device,
+			CL_QUEUE_PROFILING_ENABLE, &status);
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::CommandQueue band.");
+
+		if (this->kernelMode == CLKernelMode::Lean)
+		{
+			band.leanIntersectKernel = cl::Kernel(
+				this->program, CLLeanKernels::INTERSECT_KERNEL.c_str(), &status);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel band leanIntersectKernel.");
+
+			band.leanShadeKernel = cl::Kernel(
+				this->program, CLLeanKernels::SHADE_KERNEL.c_str(), &status);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel band leanShadeKernel.");
+		}
+		else
+		{
+			band.fusedKernel = cl::Kernel(
+				this->program, CLLeanKernels::FUSED_KERNEL.c_str(), &status);
+			Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Kernel band fusedKernel.");
+		}
+
+		Debug::mention("CLProgram", "Band " + std::to_string(i) + " on \"" +
+			band.device.getInfo<CL_DEVICE_NAME>() + "\".");
+	}
+
+	this->bandBalancer = std::unique_ptr<BandBalancer>(
+		new BandBalancer(static_cast<int>(this->bands.size())));
+}
+
+void CLProgram::bindWorldBuffers()
+{
+	cl_int status = CL_SUCCESS;
+
+	if (this->kernelMode == CLKernelMode::Full)
+	{
+		// Tell the intersect kernel arguments where their buffers live.
+		status = this->intersectKernel.setArg(0, this->cameraBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg intersectKernel cameraBuffer.");
+
+		status = this->intersectKernel.setArg(1, this->voxelRefBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg intersectKernel voxelRefBuffer.");
+
+		status = this->intersectKernel.setArg(2, this->spriteRefBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg intersectKernel spriteRefBuffer.");
+
+		status = this->intersectKernel.setArg(3, this->rectangleBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg intersectKernel rectangleBuffer.");
+
+		status = this->intersectKernel.setArg(4, this->textureBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg intersectKernel textureBuffer.");
+
+		// Tell the rayTrace kernel arguments where their buffers live.
+		status = this->rayTraceKernel.setArg(0, this->voxelRefBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg rayTraceKernel voxelRefBuffer.");
+
+		status = this->rayTraceKernel.setArg(1, this->spriteRefBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg rayTraceKernel spriteRefBuffer.");
+
+		status = this->rayTraceKernel.setArg(2, this->lightRefBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg rayTraceKernel lightRefBuffer.");
+
+		status = this->rayTraceKernel.setArg(3, this->rectangleBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg rayTraceKernel rectangleBuffer.");
+
+		status = this->rayTraceKernel.setArg(4, this->lightBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg rayTraceKernel lightBuffer.");
+
+		status = this->rayTraceKernel.setArg(5, this->textureBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg rayTraceKernel textureBuffer.");
+
+		status = this->rayTraceKernel.setArg(6, this->gameTimeBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg rayTraceKernel gameTimeBuffer.");
+	}
+	else
+	{
+		// The lean kernels all take the same world arguments in the same order.
+		for (cl::Kernel *kernel : this->getLeanKernels())
+		{
+			status = kernel->setArg(0, this->cameraBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg lean kernel cameraBuffer.");
+
+			status = kernel->setArg(1, this->voxelRefBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg lean kernel voxelRefBuffer.");
+
+			status = kernel->setArg(2, this->rectangleBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg lean kernel rectangleBuffer.");
+
+			status = kernel->setArg(3, this->textureBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg lean kernel textureBuffer.");
+
+			status = kernel->setArg(4, this->paletteBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg lean kernel paletteBuffer.");
+
+			status = kernel->setArg(5, this->chunkOccupancyBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg lean kernel chunkOccupancyBuffer.");
+
+			status = kernel->setArg(6, this->spriteRefBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg lean kernel spriteRefBuffer.");
+
+			status = kernel->setArg(7, this->spriteRectangleBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg lean kernel spriteRectangleBuffer.");
+
+			status = kernel->setArg(8, this->lightRefBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg lean kernel lightRefBuffer.");
+
+			status = kernel->setArg(9, this->lightIndexBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg lean kernel lightIndexBuffer.");
+
+			status = kernel->setArg(10, this->lightBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg lean kernel lightBuffer.");
+
+			status = kernel->setArg(11, this->gameTimeBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg lean kernel gameTimeBuffer.");
+
+			status = kernel->setArg(12, this->stepCountBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg lean kernel stepCountBuffer.");
+		}
+	}
+}
+
+void CLProgram::createPixelBuffers()
+{
+	const int renderPixelCount = this->renderWidth * this->renderHeight;
+	const cl_uint pixelArg = static_cast<cl_uint>(CLLeanKernels::WORLD_ARG_COUNT);
+	cl_int status = CL_SUCCESS;
+
+	// Reset the pipelined output state.
+	this->outputIndex = 0;
+	this->mappedOutputs = { nullptr, nullptr };
+	this->outputWidths = { 0, 0 };
+	this->outputHeights = { 0, 0 };
+
+	if (this->bands.size() > 0)
+	{
+		// Each band has its own per-pixel buffers. They're full size since the band
+		// heights change from frame to frame, and the kernels index by frame row.
+		for (RenderBand &band : this->bands)
+		{
+			band.outputBuffer = cl::Buffer(this->context, CL_MEM_WRITE_ONLY,
+				sizeof(cl_int) * renderPixelCount, nullptr, &status);
+			Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer band outputBuffer.");
+
+			if (this->kernelMode == CLKernelMode::Lean)
+			{
+				band.depthBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
+					sizeof(cl_float) * renderPixelCount, nullptr, &status);
+				Debug::check(status == CL_SUCCESS, "CLProgram",
+					"cl::Buffer band depthBuffer.");
+
+				band.hitBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
+					sizeof(cl_uint) * renderPixelCount, nullptr, &status);
+				Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer band hitBuffer.");
+
+				status = band.leanIntersectKernel.setArg(pixelArg, band.depthBuffer);
+				Debug::check(status == CL_SUCCESS, "CLProgram",
+					"cl::Kernel::setArg band leanIntersectKernel depthBuffer.");
+
+				status = band.leanIntersectKernel.setArg(pixelArg + 1, band.hitBuffer);
+				Debug::check(status == CL_SUCCESS, "CLProgram",
+					"cl::Kernel::setArg band leanIntersectKernel hitBuffer.");
+
+				status = band.leanShadeKernel.setArg(pixelArg, band.depthBuffer);
+				Debug::check(status == CL_SUCCESS, "CLProgram",
+					"cl::Kernel::setArg band leanShadeKernel depthBuffer.");
+
+				status = band.leanShadeKernel.setArg(pixelArg + 1, band.hitBuffer);
+				Debug::check(status == CL_SUCCESS, "CLProgram",
+					"cl::Kernel::setArg band leanShadeKernel hitBuffer.");
+
+				status = band.leanShadeKernel.setArg(pixelArg + 2, band.outputBuffer);
+				Debug::check(status == CL_SUCCESS, "CLProgram",
+					"cl::Kernel::setArg band leanShadeKernel outputBuffer.");
+			}
+			else
+			{
+				status = band.fusedKernel.setArg(pixelArg, band.outputBuffer);
+				Debug::check(status == CL_SUCCESS, "CLProgram",
+					"cl::Kernel::setArg band fusedKernel outputBuffer.");
+			}
+		}
+
+		this->setFrameDimensions(this->renderWidth, this->renderHeight);
+		return;
+	}
+
+	// Pipelined rendering alternates between two output buffers, and they are mapped
+	// instead of read, so ask for memory that the host can get at cheaply. The reuse
+	// view tints what's already in the output buffer, so it reads it too.
+	const bool reuseView = this->reprojected || (this->refineBlockSize > 1);
+	const cl_mem_flags outputFlags = (reuseView ? CL_MEM_READ_WRITE : CL_MEM_WRITE_ONLY) |
+		(this->pipelined ? CL_MEM_ALLOC_HOST_PTR : 0);
+
+	// Without pipelining, the kernel.cl output buffer is transient (see below).
+	const bool transientOutput = (this->kernelMode == CLKernelMode::Full) &&
+		!this->pipelined;
+	const int outputBufferCount = transientOutput ? 0 : (this->pipelined ? 2 : 1);
+	for (int i = 0; i < outputBufferCount; ++i)
+	{
+		this->outputBuffers.at(i) = cl::Buffer(this->context, outputFlags,
+			sizeof(cl_int) * renderPixelCount, nullptr, &status);
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer outputBuffer.");
+	}
+
+	if (this->kernelMode == CLKernelMode::Full)
+	{
+		// The kernel.cl kernels pass a wide G-buffer between them. Every frame is drawn
+		// whole, so none of it outlives the frame, and buffers that are dead by the time
+		// a later pass's are written can share memory with them. Without pipelining, the
+		// output is read back as soon as its frame is done (an unchanged frame shows
+		// the texture again), so it can go where the G-buffer was once rayTrace is done.
+		PassGraph passGraph;
+		const int depth = passGraph.addResource("depth", sizeof(cl_float) * renderPixelCount);
+		const int normal = passGraph.addResource("normal", sizeof(cl_float3) * renderPixelCount);
+		const int view = passGraph.addResource("view", sizeof(cl_float3) * renderPixelCount);
+		const int point = passGraph.addResource("point", sizeof(cl_float3) * renderPixelCount);
+		const int uv = passGraph.addResource("uv", sizeof(cl_float2) * renderPixelCount);
+		const int rectangleIndex = passGraph.addResource("rectangleIndex",
+			sizeof(cl_int) * renderPixelCount);
+		const int color = passGraph.addResource("color", sizeof(cl_float3) * renderPixelCount);
+		const int output = transientOutput ?
+			passGraph.addResource("output", sizeof(cl_int) * renderPixelCount) : -1;
+
+		const std::vector<int> gBuffer = { depth, normal, view, point, uv, rectangleIndex };
+		passGraph.addPass(CLProgram::INTERSECT_KERNEL, {}, gBuffer);
+		passGraph.addPass(CLProgram::RAY_TRACE_KERNEL, gBuffer, { color });
+		passGraph.addPass(CLProgram::CONVERT_TO_RGB_KERNEL, { color },
+			transientOutput ? std::vector<int>{ output } : std::vector<int>());
+
+		const std::vector<cl::Buffer> transientBuffers =
+			this->createTransientBuffers(passGraph);
+		this->depthBuffer = transientBuffers.at(passGraph.getAllocation(depth));
+		this->normalBuffer = transientBuffers.at(passGraph.getAllocation(normal));
+		this->viewBuffer = transientBuffers.at(passGraph.getAllocation(view));
+		this->pointBuffer = transientBuffers.at(passGraph.getAllocation(point));
+		this->uvBuffer = transientBuffers.at(passGraph.getAllocation(uv));
+		this->rectangleIndexBuffer = transientBuffers.at(
+			passGraph.getAllocation(rectangleIndex));
+		this->colorBuffer = transientBuffers.at(passGraph.getAllocation(color));
+		if (transientOutput)
+		{
+			this->outputBuffers.at(0) = transientBuffers.at(passGraph.getAllocation(output));
+		}
+
+		// Tell the kernel arguments where the per-pixel buffers live.
+		status = this->intersectKernel.setArg(5, this->depthBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg intersectKernel depthBuffer.");
+
+		status = this->intersectKernel.setArg(6, this->normalBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg intersectKernel normalBuffer.");
+
+		status = this->intersectKernel.setArg(7, this->viewBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg intersectKernel viewBuffer.");
+
+		status = this->intersectKernel.setArg(8, this->pointBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg intersectKernel pointBuffer.");
+
+		status = this->intersectKernel.setArg(9, this->uvBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg intersectKernel uvBuffer.");
+
+		status = this->intersectKernel.setArg(10, this->rectangleIndexBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg intersectKernel rectangleIndexBuffer.");
+
+		status = this->rayTraceKernel.setArg(7, this->depthBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg rayTraceKernel depthBuffer.");
+
+		status = this->rayTraceKernel.setArg(8, this->normalBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg rayTraceKernel normalBuffer.");
+
+		status = this->rayTraceKernel.setArg(9, this->viewBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg rayTraceKernel viewBuffer.");
+
+		status = this->rayTraceKernel.setArg(10, this->pointBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg rayTraceKernel pointBuffer.");
+
+		status = this->rayTraceKernel.setArg(11, this->uvBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg rayTraceKernel uvBuffer.");
+
+		status = this->rayTraceKernel.setArg(12, this->rectangleIndexBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg rayTraceKernel rectangleIndexBuffer.");
+
+		status = this->rayTraceKernel.setArg(13, this->colorBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg rayTraceKernel colorBuffer.");
+
+		status = this->convertToRGBKernel.setArg(0, this->colorBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg convertToRGBKernel colorBuffer.");
+
+		status = this->convertToRGBKernel.setArg(1, this->outputBuffers.at(0));
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg convertToRGBKernel outputBuffer.");
+	}
+
+	if (this->kernelMode == CLKernelMode::Lean)
+	{
+		// Only a depth and a packed hit per pixel go between the lean kernels. The
+		// shade kernel rebuilds everything else from them and the camera.
+		this->depthBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
+			sizeof(cl_float) * renderPixelCount, nullptr, &status);
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer depthBuffer.");
+
+		this->hitBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
+			sizeof(cl_uint) * renderPixelCount, nullptr, &status);
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer hitBuffer.");
+
+		if (this->reprojected)
+		{
+			// Last frame's depths and hits are kept in a second pair of buffers. The
+			// pairs trade places every frame (see swapReprojectionBuffers()).
+			this->previousDepthBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
+				sizeof(cl_float) * renderPixelCount, nullptr, &status);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Buffer previousDepthBuffer.");
+
+			this->previousHitBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
+				sizeof(cl_uint) * renderPixelCount, nullptr, &status);
+			Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer previousHitBuffer.");
+
+			this->reuseBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
+				sizeof(cl_uchar) * renderPixelCount, nullptr, &status);
+			Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer reuseBuffer.");
+
+			status = this->reprojectKernel.setArg(pixelArg + 8, this->reuseBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg reprojectKernel reuseBuffer.");
+
+			status = this->reuseViewKernel.setArg(0, this->reuseBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg reuseViewKernel reuseBuffer.");
+
+			// The new buffers have nothing in them to reuse yet.
+			this->previousValid = false;
+			this->swapReprojectionBuffers();
+		}
+		else if (this->refineBlockSize > 1)
+		{
+			// One depth and hit per block corner, with an extra column and row of
+			// corners past the far edges.
+			const int cornerCount =
+				(((this->renderWidth + this->refineBlockSize - 1) / this->refineBlockSize) + 1) *
+				(((this->renderHeight + this->refineBlockSize - 1) / this->refineBlockSize) + 1);
+
+			// The corners are only live between the two refinement passes. Depths, hits,
+			// and fill flags are kept for the tiles that aren't drawn again next frame,
+			// so they aren't transient.
+			PassGraph passGraph;
+			const int cornerDepth = passGraph.addResource("cornerDepth",
+				sizeof(cl_float) * cornerCount);
+			const int cornerHit = passGraph.addResource("cornerHit",
+				sizeof(cl_uint) * cornerCount);
+			passGraph.addPass(CLLeanKernels::REFINE_CORNERS_KERNEL, {},
+				{ cornerDepth, cornerHit });
+			passGraph.addPass(CLLeanKernels::REFINE_KERNEL, { cornerDepth, cornerHit }, {});
+
+			const std::vector<cl::Buffer> transientBuffers =
+				this->createTransientBuffers(passGraph);
+			this->cornerDepthBuffer = transientBuffers.at(passGraph.getAllocation(cornerDepth));
+			this->cornerHitBuffer = transientBuffers.at(passGraph.getAllocation(cornerHit));
+
+			this->reuseBuffer = cl::Buffer(this->context, CL_MEM_READ_WRITE,
+				sizeof(cl_uchar) * renderPixelCount, nullptr, &status);
+			Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer reuseBuffer.");
+
+			status = this->refineCornersKernel.setArg(pixelArg, this->cornerDepthBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg refineCornersKernel cornerDepthBuffer.");
+
+			status = this->refineCornersKernel.setArg(pixelArg + 1, this->cornerHitBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg refineCornersKernel cornerHitBuffer.");
+
+			status = this->refineKernel.setArg(pixelArg, this->depthBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg refineKernel depthBuffer.");
+
+			status = this->refineKernel.setArg(pixelArg + 1, this->hitBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg refineKernel hitBuffer.");
+
+			status = this->refineKernel.setArg(pixelArg + 2, this->cornerDepthBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg refineKernel cornerDepthBuffer.");
+
+			status = this->refineKernel.setArg(pixelArg + 3, this->cornerHitBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg refineKernel cornerHitBuffer.");
+
+			status = this->refineKernel.setArg(pixelArg + 5, this->reuseBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg refineKernel fillBuffer.");
+
+			status = this->reuseViewKernel.setArg(0, this->reuseBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg reuseViewKernel reuseBuffer.");
+
+			status = this->leanShadeKernel.setArg(pixelArg, this->depthBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg leanShadeKernel depthBuffer.");
+
+			status = this->leanShadeKernel.setArg(pixelArg + 1, this->hitBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg leanShadeKernel hitBuffer.");
+		}
+		else
+		{
+			status = this->leanIntersectKernel.setArg(pixelArg, this->depthBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg leanIntersectKernel depthBuffer.");
+
+			status = this->leanIntersectKernel.setArg(pixelArg + 1, this->hitBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg leanIntersectKernel hitBuffer.");
+
+			status = this->leanShadeKernel.setArg(pixelArg, this->depthBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg leanShadeKernel depthBuffer.");
+
+			status = this->leanShadeKernel.setArg(pixelArg + 1, this->hitBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg leanShadeKernel hitBuffer.");
+		}
+	}
+
+	// Frames start out at the max quality again.
+	this->setFrameDimensions(this->renderWidth, this->renderHeight);
+}
+
+std::vector<cl::Buffer> CLProgram::createTransientBuffers(PassGraph &passGraph)
+{
+	passGraph.compile();
+
+	std::vector<cl::Buffer> buffers;
+	for (int i = 0; i < passGraph.getAllocationCount(); ++i)
+	{
+		cl_int status = CL_SUCCESS;
+		buffers.push_back(cl::Buffer(this->context, CL_MEM_READ_WRITE,
+			passGraph.getAllocationSize(i), nullptr, &status));
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer transient buffer " +
+			std::to_string(i) + ".");
+	}
+
+	// Worth knowing at high resolutions, where each new pass's buffers would otherwise
+	// add their full size.
+	const size_t totalSize = passGraph.getTotalSize();
+	const size_t unsharedSize = passGraph.getUnsharedSize();
+	if (totalSize < unsharedSize)
+	{
+		Debug::mention("CLProgram", "Transient buffers share " +
+			std::to_string(passGraph.getAllocationCount()) + " allocations of " +
+			std::to_string(totalSize / 1024) + " KB (" +
+			std::to_string((unsharedSize - totalSize) / 1024) + " KB saved).");
+	}
+
+	return buffers;
+}
+
+void CLProgram::setFrameDimensions(int frameWidth, int frameHeight)
+{
+	assert(frameWidth <= this->renderWidth);
+	assert(frameHeight <= this->renderHeight);
+
+	this->frameWidth = frameWidth;
+	this->frameHeight = frameHeight;
+
+	// The last frame is a different size, so it can't be drawn onto.
+	this->frameValid = false;
+
+	if ((this->kernelMode == CLKernelMode::Full) && this->fullSizeArgs)
+	{
+		const std::array<std::pair<cl::Kernel*, cl_uint>, 3> fullKernels =
+		{
+			std::make_pair(&this->intersectKernel, INTERSECT_ARG_COUNT),
+			std::make_pair(&this->rayTraceKernel, RAY_TRACE_ARG_COUNT),
+			std::make_pair(&this->convertToRGBKernel, CONVERT_TO_RGB_ARG_COUNT)
+		};
+
+		for (const auto &pair : fullKernels)
+		{
+			cl_int status = pair.first->setArg(pair.second, static_cast<cl_int>(frameWidth));
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg kernel.cl kernel renderWidth.");
+
+			status = pair.first->setArg(pair.second + 1, static_cast<cl_int>(frameHeight));
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg kernel.cl kernel renderHeight.");
+		}
+	}
+
+	// The lean kernels get the frame dimensions as arguments instead of reading them 
+	// from the global work size. The kernel.cl kernels only use the global work size.
+	const cl_uint pixelArg = static_cast<cl_uint>(CLLeanKernels::WORLD_ARG_COUNT);
+	for (cl::Kernel *kernel : this->getLeanKernels())
+	{
+		cl_int status = kernel->setArg(pixelArg - 2, static_cast<cl_int>(frameWidth));
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg lean kernel renderWidth.");
+
+		status = kernel->setArg(pixelArg - 1, static_cast<cl_int>(frameHeight));
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg lean kernel renderHeight.");
+	}
+}
+
+void CLProgram::buildProgram(const std::vector<cl::Device> &devices,
+	const std::string &source, const std::string &options)
+{
+	// A cached binary is for one device.
+	const bool cached = devices.size() == 1;
+
+	// The key is everything that could make a binary unusable. The defines are part 
+	// of the source. The full key is saved in the file, so a hash collision or a 
+	// driver update just looks like a miss.
+	const std::string key = this->device.getInfo<CL_DEVICE_NAME>() + ";" +
+		this->device.getInfo<CL_DRIVER_VERSION>() + ";" +
+		toHexString(hashString(source)) + ";" + options;
+	const std::string binaryFilename = CLProgram::PATH + CLProgram::BINARY_PREFIX +
+		toHexString(hashString(key)) + CLProgram::BINARY_EXTENSION;
+
+	// Try the cached binary first.
+	if (cached && File::exists(binaryFilename))
+	{
+		const std::string contents = File::toString(binaryFilename);
+		const size_t keyEnd = contents.find('\n');
+
+		if ((keyEnd != std::string::npos) && (contents.compare(0, keyEnd, key) == 0))
+		{
+			cl::Program::Binaries binaries = { std::vector<unsigned char>(
+				contents.begin() + keyEnd + 1, contents.end()) };
+			std::vector<cl_int> binaryStatus;
+			cl_int status = CL_SUCCESS;
+			this->program = cl::Program(this->context, devices, binaries,
+				&binaryStatus, &status);
+
+			// The binary still needs "building", though it's much faster than compiling.
+			if ((status == CL_SUCCESS) && (binaryStatus.size() > 0) &&
+				(binaryStatus.at(0) == CL_SUCCESS))
+			{
+				status = this->program.build(devices, options.c_str());
+			}
+
+			if (status == CL_SUCCESS)
+			{
+				Debug::mention("CLProgram", "Loaded cached program binary \"" +
+					binaryFilename + "\".");
+				return;
+			}
+
+			Debug::mention("CLProgram", "Cached program binary rejected (" +
+				this->getErrorString(status) + "). Building from source.");
+		}
+	}
+
+	// Put the kernel source in a program object within the OpenCL context.
+	cl_int status = CL_SUCCESS;
+	this->program = cl::Program(this->context, source, false, &status);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Program.");
+
+	status = this->program.build(devices, options.c_str());
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Program::build (" +
+		this->getErrorString(status) + ").");
+
+	// Save the binary for next time. Failing to save isn't an error.
+	auto binaries = this->program.getInfo<CL_PROGRAM_BINARIES>(&status);
+	if (cached && (status == CL_SUCCESS) && (binaries.size() > 0) &&
+		(binaries.at(0).size() > 0))
+	{
+		std::ofstream ofs(binaryFilename.c_str(), std::ios::out | std::ios::binary);
+		if (ofs.is_open())
+		{
+			const auto &binary = binaries.at(0);
+			ofs << key << '\n';
+			ofs.write(reinterpret_cast<const char*>(binary.data()), binary.size());
+			Debug::mention("CLProgram", "Saved program binary \"" +
+				binaryFilename + "\".");
+		}
+	}
+}
+
+std::string CLProgram::getWorldDefines() const
+{
+	std::string defines = std::string("#define WORLD_WIDTH ") +
+		std::to_string(this->worldWidth) + std::string("\n") +
+		std::string("#define WORLD_HEIGHT ") + std::to_string(this->worldHeight) + std::string("\n") +
+		std::string("#define WORLD_DEPTH ") + std::to_string(this->worldDepth) + std::string("\n") +
+		std::string("#define CHUNK_WIDTH ") + std::to_string(Chunk::Width) + std::string("\n") +
+		std::string("#define CHUNK_HEIGHT ") + std::to_string(Chunk::Height) + std::string("\n") +
+		std::string("#define CHUNK_DEPTH ") + std::to_string(Chunk::Depth) + std::string("\n");
+
+	if (this->world.getVoxelIndexer().getLayout() == VoxelLayout::Tiled)
+	{
+		defines += std::string("#define VOXEL_LAYOUT_TILED\n");
+	}
+
+	return defines;
+}
+
+void CLProgram::buildFullProgram()
+{
+	assert(this->kernelMode == CLKernelMode::Full);
+
+	// kernel.cl uses the render dimensions as compile-time constants (e.g., for pixel
+	// indices), so they're baked into the source. Each render size gets its own cached
+	// binary.
+	const std::string defines = std::string("#define RENDER_WIDTH ") +
+		std::to_string(this->renderWidth) + std::string("\n") +
+		std::string("#define RENDER_HEIGHT ") + std::to_string(this->renderHeight) +
+		std::string("\n") + this->getWorldDefines();
+	const std::string source = File::toString(CLProgram::PATH + CLProgram::FILENAME);
+	this->buildProgram({ this->device }, defines + source, CLProgram::BUILD_OPTIONS);
+
+	cl_int status = CL_SUCCESS;
+	this->intersectKernel = cl::Kernel(
+		this->program, CLProgram::INTERSECT_KERNEL.c_str(), &status);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Kernel intersectKernel.");
+
+	this->rayTraceKernel = cl::Kernel(
+		this->program, CLProgram::RAY_TRACE_KERNEL.c_str(), &status);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Kernel rayTraceKernel.");
+
+	this->convertToRGBKernel = cl::Kernel(
+		this->program, CLProgram::CONVERT_TO_RGB_KERNEL.c_str(), &status);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Kernel convertToRGBKernel.");
+
+	// A kernel.cl whose kernels all take the frame width and height after their other
+	// arguments gets them from setFrameDimensions(), so its program is kept when the
+	// window is resized. The defines are still there for one that reads them instead.
+	auto takesSize = [](const cl::Kernel &kernel, cl_uint argCount)
+	{
+		return kernel.getInfo<CL_KERNEL_NUM_ARGS>() == (argCount + 2);
+	};
+
+	this->fullSizeArgs = takesSize(this->intersectKernel, INTERSECT_ARG_COUNT) &&
+		takesSize(this->rayTraceKernel, RAY_TRACE_ARG_COUNT) &&
+		takesSize(this->convertToRGBKernel, CONVERT_TO_RGB_ARG_COUNT);
+	this->fullProgramWidth = this->renderWidth;
+	this->fullProgramHeight = this->renderHeight;
 }
 
 std::string CLProgram::getBuildReport() const
@@ -489,419 +1963,760 @@ std::string CLProgram::getErrorString(cl_int error) const
 	}
 }
 
-void CLProgram::makeTestWorld()
+void CLProgram::growBuffers()
 {
-	Debug::mention("CLProgram", "Making test world.");
+	// Device buffers only grow, and they grow by at least double so appending 
+	// rectangles one voxel at a time doesn't reallocate every frame.
+	cl_int status = CL_SUCCESS;
 
-	// This method builds a simple test city with some blocks around.
-	// It does nothing with sprites and lights yet.
+	const cl::size_type rectangleCount = this->world.getRectangles().size();
+	if (rectangleCount > this->rectangleCapacity)
+	{
+		this->rectangleCapacity = std::max(rectangleCount, this->rectangleCapacity * 2);
+		this->rectangleBuffer = cl::Buffer(this->context, CL_MEM_READ_ONLY,
+			SIZEOF_RECTANGLE * this->rectangleCapacity, nullptr, &status);
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer rectangleBuffer.");
+		this->bindWorldBuffers();
+
+		// The new buffer is empty, so everything needs writing, not just changes.
+		this->rectangleData.clear();
+	}
 
-	// Lambda for creating a vector of rectangles for a particular voxel.
-	auto makeBlock = [](int cellX, int cellY, int cellZ)
+	const cl::size_type spriteRectangleCount =
+		this->world.getSpriteHeap().getRectangles().size();
+	if (spriteRectangleCount > this->spriteRectangleCapacity)
 	{
-		float x = static_cast<float>(cellX);
-		float y = static_cast<float>(cellY);
-		float z = static_cast<float>(cellZ);
-		const float sideLength = 1.0f;
+		this->spriteRectangleCapacity = std::max(spriteRectangleCount,
+			this->spriteRectangleCapacity * 2);
+		this->spriteRectangleBuffer = cl::Buffer(this->context, CL_MEM_READ_ONLY,
+			SIZEOF_RECTANGLE * this->spriteRectangleCapacity, nullptr, &status);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Buffer spriteRectangleBuffer.");
+		this->bindWorldBuffers();
+
+		this->spriteRectangleData.clear();
+	}
 
-		// Front.
-		Rect3D r1(
-			Float3f(x + sideLength, y + sideLength, z),
-			Float3f(x + sideLength, y, z),
-			Float3f(x, y, z));
+	const LightManager &lightManager = this->world.getLightManager();
+	const cl::size_type lightIndexCount = lightManager.getLightIndices().size();
+	if (lightIndexCount > this->lightIndexCapacity)
+	{
+		this->lightIndexCapacity = std::max(lightIndexCount, this->lightIndexCapacity * 2);
+		this->lightIndexBuffer = cl::Buffer(this->context, CL_MEM_READ_ONLY,
+			sizeof(cl_int) * this->lightIndexCapacity, nullptr, &status);
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer lightIndexBuffer.");
+		this->bindWorldBuffers();
 
-		// Back.
-		Rect3D r2(
-			Float3f(x, y + sideLength, z + sideLength),
-			Float3f(x, y, z + sideLength),
-			Float3f(x + sideLength, y, z + sideLength));
+		this->lightIndexData.clear();
+	}
+
+	const cl::size_type lightCount = lightManager.getLights().size();
+	if (lightCount > this->lightCapacity)
+	{
+		this->lightCapacity = std::max(lightCount, this->lightCapacity * 2);
+		this->lightBuffer = cl::Buffer(this->context, CL_MEM_READ_ONLY,
+			SIZEOF_LIGHT * this->lightCapacity, nullptr, &status);
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer lightBuffer.");
+		this->bindWorldBuffers();
 
-		// Top.
-		Rect3D r3(
-			Float3f(x + sideLength, y + sideLength, z + sideLength),
-			Float3f(x + sideLength, y + sideLength, z),
-			Float3f(x, y + sideLength, z));
+		this->lightData.clear();
+	}
 
-		// Bottom.
-		Rect3D r4(
-			Float3f(x + sideLength, y, z),
-			Float3f(x + sideLength, y, z + sideLength),
-			Float3f(x, y, z + sideLength));
+	const cl::size_type texelCount = this->texturePool.getCapacity();
+	if (texelCount > this->texelCapacity)
+	{
+		this->texelCapacity = std::max(texelCount, this->texelCapacity * 2);
+		this->textureBuffer = cl::Buffer(this->context, CL_MEM_READ_ONLY,
+			this->texelSize * this->texelCapacity, nullptr, &status);
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer textureBuffer.");
+		this->bindWorldBuffers();
 
-		// Right.
-		Rect3D r5(
-			Float3f(x, y + sideLength, z),
-			Float3f(x, y, z),
-			Float3f(x, y, z + sideLength));
+		this->textureData.clear();
+	}
+}
 
-		// Left.
-		Rect3D r6(
-			Float3f(x + sideLength, y + sideLength, z + sideLength),
-			Float3f(x + sideLength, y, z + sideLength),
-			Float3f(x + sideLength, y, z));
+void CLProgram::updateWorld()
+{
+	const auto &voxelRefDirty = this->world.getDirtyVoxelReferences();
+	const auto &rectangleDirty = this->world.getDirtyRectangles();
+	const auto &chunkOccupancyDirty = this->world.getDirtyChunkOccupancy();
+	const SpriteHeap &spriteHeap = this->world.getSpriteHeap();
+	const auto &spriteRefDirty = spriteHeap.getDirtySpriteReferences();
+	const auto &spriteRectangleDirty = spriteHeap.getDirtyRectangles();
+	const LightManager &lightManager = this->world.getLightManager();
+	const auto &lightRefDirty = lightManager.getDirtyLightReferences();
+	const auto &lightIndexDirty = lightManager.getDirtyLightIndices();
+	const auto &lightDirty = lightManager.getDirtyLights();
+
+	const bool paletteDirty = this->world.isPaletteDirty();
+
+	// Give room in the texture pool to the textures that something started using. It's
+	// checked every time since a rasterized sprite can start using one without changing
+	// anything else that's copied.
+	this->texturePool.update(this->world.getTextureReferences(),
+		this->world.getTextureUseCounts());
+	const bool texturesAdded = this->texturePool.getUploads().size() > 0;
+
+	if (voxelRefDirty.isEmpty() && rectangleDirty.isEmpty() && !texturesAdded &&
+		chunkOccupancyDirty.isEmpty() && spriteRefDirty.isEmpty() &&
+		spriteRectangleDirty.isEmpty() && lightRefDirty.isEmpty() &&
+		lightIndexDirty.isEmpty() && lightDirty.isEmpty() && !paletteDirty)
+	{
+		return;
+	}
 
-		return std::vector<Rect3D>{ r1, r2, r3, r4, r5, r6 };
+	this->worldChanged = true;
+
+	// The host copies can't be touched until the previous writes have read them.
+	if (this->writeEvents.size() > 0)
+	{
+		cl_int status = cl::Event::waitForEvents(this->writeEvents);
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Event::waitForEvents.");
+		this->writeEvents.clear();
+	}
+
+	this->growBuffers();
+
+	const auto &voxelRefs = this->world.getVoxelReferences();
+	const auto &rectangles = this->world.getRectangles();
+	const auto &rectangleTextureIDs = this->world.getRectangleTextureIDs();
+	const auto &textureRefs = this->world.getTextureReferences();
+	const auto &texels = this->world.getTexels();
+	const Palette &palette = this->world.getPalette();
+	const auto &chunkOccupancy = this->world.getChunkOccupancy();
+	const auto &spriteRefs = spriteHeap.getSpriteReferences();
+	const auto &spriteRectangles = spriteHeap.getRectangles();
+	const auto &spriteTextureIDs = spriteHeap.getRectangleTextureIDs();
+	const auto &lightRefs = lightManager.getLightReferences();
+	const auto &lightIndices = lightManager.getLightIndices();
+	const auto &lights = lightManager.getLights();
+
+	// Host copies that were cleared by growBuffers() get fully rewritten.
+	std::vector<std::pair<int, int>> voxelRefRanges = voxelRefDirty.getCoalesced();
+	std::vector<std::pair<int, int>> rectangleRanges = rectangleDirty.getCoalesced();
+	std::vector<std::pair<int, int>> spriteRectangleRanges =
+		spriteRectangleDirty.getCoalesced();
+
+	if (this->rectangleData.size() == 0)
+	{
+		rectangleRanges = { std::make_pair(0, static_cast<int>(rectangles.size())) };
+	}
+
+	if (this->spriteRectangleData.size() == 0)
+	{
+		spriteRectangleRanges = { std::make_pair(0,
+			static_cast<int>(spriteRectangles.size())) };
+	}
+
+	std::vector<std::pair<int, int>> lightIndexRanges = lightIndexDirty.getCoalesced();
+	std::vector<std::pair<int, int>> lightRanges = lightDirty.getCoalesced();
+
+	if (this->lightIndexData.size() == 0)
+	{
+		lightIndexRanges = { std::make_pair(0, static_cast<int>(lightIndices.size())) };
+	}
+
+	if (this->lightData.size() == 0)
+	{
+		lightRanges = { std::make_pair(0, static_cast<int>(lights.size())) };
+	}
+
+	// Textures that were just given room in the pool get their texels copied. The
+	// kernel.cl kernels have the palette's colors baked into the texels, so a new
+	// palette means copying every texture in the pool again.
+	const bool fullMode = this->kernelMode == CLKernelMode::Full;
+	const std::vector<int> uploadIDs =
+		((this->textureData.size() == 0) || (fullMode && paletteDirty)) ?
+		this->texturePool.getResidentTextures() : this->texturePool.getUploads();
+
+	this->voxelRefData.resize(SIZEOF_VOXEL_REF * voxelRefs.size());
+	this->rectangleData.resize(SIZEOF_RECTANGLE * rectangles.size());
+	this->textureData.resize(this->texelSize * this->texturePool.getCapacity());
+	this->paletteData.resize(sizeof(cl_float4) * palette.size());
+	this->chunkOccupancyData.resize(sizeof(cl_uint) * chunkOccupancy.size());
+	this->spriteRefData.resize(SIZEOF_SPRITE_REF * spriteRefs.size());
+	this->spriteRectangleData.resize(SIZEOF_RECTANGLE * spriteRectangles.size());
+	this->lightRefData.resize(SIZEOF_LIGHT_REF * lightRefs.size());
+	this->lightIndexData.resize(sizeof(cl_int) * lightIndices.size());
+	this->lightData.resize(SIZEOF_LIGHT * lights.size());
+
+	// Lambda for converting a range of elements into a host copy and enqueueing a 
+	// non-blocking write of just those bytes. The kernels wait on the write events.
+	auto writeRange = [this](const cl::Buffer &buffer, std::vector<char> &data,
+		cl::size_type elementSize, const std::pair<int, int> &range,
+		const std::function<void(cl_char*, int)> &writeElement)
+	{
+		if (range.second == 0)
+		{
+			return;
+		}
+
+		cl_char *ptr = reinterpret_cast<cl_char*>(data.data());
+		for (int i = range.first; i < (range.first + range.second); ++i)
+		{
+			writeElement(ptr + (i * elementSize), i);
+		}
+
+		const cl::size_type offset = elementSize * range.first;
+		const cl::size_type size = elementSize * range.second;
+
+		cl::Event event;
+		cl_int status = this->commandQueue.enqueueWriteBuffer(buffer, CL_FALSE,
+			offset, size, static_cast<const void*>(ptr + offset), nullptr, &event);
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::enqueueWriteBuffer " +
+			this->getErrorString(status) + ".");
+
+		this->writeEvents.push_back(event);
+		this->addProfileEvent("device write world", event);
 	};
 
-	// Write some rectangles to a rectangle buffer.
-	const int maxRectanglesPerVoxel = 6;
-	size_t rectangleBufferSize = SIZEOF_RECTANGLE * maxRectanglesPerVoxel *
-		this->worldWidth * this->worldHeight * this->worldDepth;
-	std::vector<char> rectangleBuffer(rectangleBufferSize);
-	cl_char *recPtr = reinterpret_cast<cl_char*>(rectangleBuffer.data());
-
-	// Lambda for writing rectangle data to the local buffer.
-	// - NOTE: using texture index here assumes that all textures are 64x64.
-	auto writeRectangle = [this, maxRectanglesPerVoxel, recPtr](const Rect3D &rect,
-		int cellX, int cellY, int cellZ, int rectangleOffset, int textureIndex)
-	{
-		assert(cellX >= 0);
-		assert(cellY >= 0);
-		assert(cellZ >= 0);
-		assert(cellX < this->worldWidth);
-		assert(cellY < this->worldHeight);
-		assert(cellZ < this->worldDepth);
-
-		// Only 6 rectangles max per block for now.
-		assert(rectangleOffset < maxRectanglesPerVoxel);
-
-		// Offset in the local buffer.
-		cl_char *ptr = recPtr + (cellX * SIZEOF_RECTANGLE * maxRectanglesPerVoxel) +
-			((cellY * this->worldWidth) * SIZEOF_RECTANGLE * maxRectanglesPerVoxel) +
-			((cellZ * this->worldWidth * this->worldHeight) * SIZEOF_RECTANGLE *
-				maxRectanglesPerVoxel) + (rectangleOffset * SIZEOF_RECTANGLE);
+	for (const auto &range : voxelRefRanges)
+	{
+		writeRange(this->voxelRefBuffer, this->voxelRefData, SIZEOF_VOXEL_REF, range,
+			[&voxelRefs](cl_char *ptr, int i)
+		{
+			writeVoxelRef(ptr, voxelRefs.at(i));
+		});
+	}
 
-		cl_float *p1Ptr = reinterpret_cast<cl_float*>(ptr);
-		*(p1Ptr + 0) = static_cast<cl_float>(rect.getP1().getX());
-		*(p1Ptr + 1) = static_cast<cl_float>(rect.getP1().getY());
-		*(p1Ptr + 2) = static_cast<cl_float>(rect.getP1().getZ());
+	for (const auto &range : rectangleRanges)
+	{
+		writeRange(this->rectangleBuffer, this->rectangleData, SIZEOF_RECTANGLE, range,
+			[this, &rectangles, &rectangleTextureIDs](cl_char *ptr, int i)
+		{
+			writeRectangle(ptr, rectangles.at(i),
+				this->texturePool.getTextureReference(rectangleTextureIDs.at(i)));
+		});
+	}
 
-		cl_float *p2Ptr = reinterpret_cast<cl_float*>(ptr + sizeof(cl_float3));
-		*(p2Ptr + 0) = static_cast<cl_float>(rect.getP2().getX());
-		*(p2Ptr + 1) = static_cast<cl_float>(rect.getP2().getY());
-		*(p2Ptr + 2) = static_cast<cl_float>(rect.getP2().getZ());
+	for (const int textureID : uploadIDs)
+	{
+		// The pool's copy of a texture (and its mip levels) is somewhere else than the
+		// render world's.
+		const TextureReference poolRef = this->texturePool.getTextureReference(textureID);
+		const int worldOffset = textureRefs.at(textureID).getOffset();
+		const int texelOffset = worldOffset - poolRef.getOffset();
+		writeRange(this->textureBuffer, this->textureData, this->texelSize,
+			std::make_pair(poolRef.getOffset(), TexturePool::getTexelCount(poolRef)),
+			[fullMode, &texels, &palette, texelOffset](cl_char *ptr, int i)
+		{
+			const uint8_t texel = texels.at(i + texelOffset);
+			if (fullMode)
+			{
+				writeColor(ptr, palette.at(texel), texel == 0);
+			}
+			else
+			{
+				*reinterpret_cast<cl_uchar*>(ptr) = texel;
+			}
+		});
+	}
 
-		cl_float *p3Ptr = reinterpret_cast<cl_float*>(ptr + (sizeof(cl_float3) * 2));
-		*(p3Ptr + 0) = static_cast<cl_float>(rect.getP3().getX());
-		*(p3Ptr + 1) = static_cast<cl_float>(rect.getP3().getY());
-		*(p3Ptr + 2) = static_cast<cl_float>(rect.getP3().getZ());
+	for (const auto &range : chunkOccupancyDirty.getCoalesced())
+	{
+		writeRange(this->chunkOccupancyBuffer, this->chunkOccupancyData, sizeof(cl_uint),
+			range, [&chunkOccupancy](cl_char *ptr, int i)
+		{
+			*reinterpret_cast<cl_uint*>(ptr) = chunkOccupancy.at(i);
+		});
+	}
 
-		const Float3f p1p2 = rect.getP2() - rect.getP1();
-		cl_float *p1p2Ptr = reinterpret_cast<cl_float*>(ptr + (sizeof(cl_float3) * 3));
-		*(p1p2Ptr + 0) = static_cast<cl_float>(p1p2.getX());
-		*(p1p2Ptr + 1) = static_cast<cl_float>(p1p2.getY());
-		*(p1p2Ptr + 2) = static_cast<cl_float>(p1p2.getZ());
+	// Only the lean kernels know the sprite rectangle layout, so the kernel.cl kernels
+	// get sprite references without any rectangles.
+	for (const auto &range : spriteRefDirty.getCoalesced())
+	{
+		writeRange(this->spriteRefBuffer, this->spriteRefData, SIZEOF_SPRITE_REF, range,
+			[fullMode, &spriteRefs](cl_char *ptr, int i)
+		{
+			writeSpriteRef(ptr, fullMode ? SpriteReference(0, 0) : spriteRefs.at(i));
+		});
+	}
+
+	for (const auto &range : spriteRectangleRanges)
+	{
+		writeRange(this->spriteRectangleBuffer, this->spriteRectangleData, SIZEOF_RECTANGLE,
+			range, [this, &spriteRectangles, &spriteTextureIDs](cl_char *ptr, int i)
+		{
+			writeRectangle(ptr, spriteRectangles.at(i),
+				this->texturePool.getTextureReference(spriteTextureIDs.at(i)));
+		});
+	}
+
+	// Likewise, the kernel.cl kernels don't know about light indices, so they get
+	// light references without any lights.
+	for (const auto &range : lightRefDirty.getCoalesced())
+	{
+		writeRange(this->lightRefBuffer, this->lightRefData, SIZEOF_LIGHT_REF, range,
+			[fullMode, &lightRefs](cl_char *ptr, int i)
+		{
+			writeLightRef(ptr, fullMode ? LightReference(0, 0) : lightRefs.at(i));
+		});
+	}
+
+	for (const auto &range : lightIndexRanges)
+	{
+		writeRange(this->lightIndexBuffer, this->lightIndexData, sizeof(cl_int), range,
+			[&lightIndices](cl_char *ptr, int i)
+		{
+			*reinterpret_cast<cl_int*>(ptr) = lightIndices.at(i);
+		});
+	}
+
+	for (const auto &range : lightRanges)
+	{
+		writeRange(this->lightBuffer, this->lightData, SIZEOF_LIGHT, range,
+			[&lights](cl_char *ptr, int i)
+		{
+			writeLight(ptr, lights.at(i));
+		});
+	}
+
+	if (paletteDirty && !fullMode)
+	{
+		writeRange(this->paletteBuffer, this->paletteData, sizeof(cl_float4),
+			std::make_pair(0, static_cast<int>(palette.size())),
+			[&palette](cl_char *ptr, int i)
+		{
+			writeColor(ptr, palette.at(i), i == 0);
+		});
+	}
+
+	this->texturePool.clearUploads();
+	this->world.clearDirtyRanges();
+}
+
+void CLProgram::swapReprojectionBuffers()
+{
+	std::swap(this->depthBuffer, this->previousDepthBuffer);
+	std::swap(this->hitBuffer, this->previousHitBuffer);
+
+	const cl_uint pixelArg = static_cast<cl_uint>(CLLeanKernels::WORLD_ARG_COUNT);
+	cl_int status = this->reprojectKernel.setArg(pixelArg, this->depthBuffer);
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::Kernel::setArg reprojectKernel depthBuffer.");
+
+	status = this->reprojectKernel.setArg(pixelArg + 1, this->hitBuffer);
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::Kernel::setArg reprojectKernel hitBuffer.");
+
+	status = this->reprojectKernel.setArg(pixelArg + 3, this->previousDepthBuffer);
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::Kernel::setArg reprojectKernel previousDepthBuffer.");
 
-		const Float3f p2p3 = rect.getP3() - rect.getP2();
-		cl_float *p2p3Ptr = reinterpret_cast<cl_float*>(ptr + (sizeof(cl_float3) * 4));
-		*(p2p3Ptr + 0) = static_cast<cl_float>(p2p3.getX());
-		*(p2p3Ptr + 1) = static_cast<cl_float>(p2p3.getY());
-		*(p2p3Ptr + 2) = static_cast<cl_float>(p2p3.getZ());
+	status = this->reprojectKernel.setArg(pixelArg + 4, this->previousHitBuffer);
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::Kernel::setArg reprojectKernel previousHitBuffer.");
 
-		const Float3f normal = rect.getNormal();
-		cl_float *normalPtr = reinterpret_cast<cl_float*>(ptr + (sizeof(cl_float3) * 5));
-		*(normalPtr + 0) = static_cast<cl_float>(normal.getX());
-		*(normalPtr + 1) = static_cast<cl_float>(normal.getY());
-		*(normalPtr + 2) = static_cast<cl_float>(normal.getZ());
+	status = this->leanShadeKernel.setArg(pixelArg, this->depthBuffer);
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::Kernel::setArg leanShadeKernel depthBuffer.");
 
-		cl_int *offsetPtr = reinterpret_cast<cl_int*>(ptr + (sizeof(cl_float3) * 6));
-		*(offsetPtr + 0) = 64 * 64 * textureIndex; // Number of float4's to skip.
+	status = this->leanShadeKernel.setArg(pixelArg + 1, this->hitBuffer);
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::Kernel::setArg leanShadeKernel hitBuffer.");
+}
 
-		cl_short *dimPtr = reinterpret_cast<cl_short*>(ptr + (sizeof(cl_float3) * 6) +
-			sizeof(cl_int));
-		*(dimPtr + 0) = 64;
-		*(dimPtr + 1) = 64;
-	};
+void CLProgram::enqueueReprojection(const cl::NDRange &workDims,
+	const std::vector<cl::Event> *waitEvents)
+{
+	// This frame's depths and hits go where the frame before last's were.
+	this->swapReprojectionBuffers();
+
+	// Any world change (a moved sprite, an opened door) can cover or uncover anything,
+	// so nothing is reused if there was one since the last hits were traced.
+	const bool reusable = this->previousValid && !this->worldChanged;
+	const cl_uint pixelArg = static_cast<cl_uint>(CLLeanKernels::WORLD_ARG_COUNT);
+	cl_int status = this->reprojectKernel.setArg(pixelArg + 5,
+		static_cast<cl_int>(reusable ? this->previousWidth : 0));
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::Kernel::setArg reprojectKernel previousWidth.");
 
-	// Fill a voxel reference buffer with references to those rectangles.
-	size_t voxelRefBufferSize = SIZEOF_VOXEL_REF * this->worldWidth * 
-		this->worldHeight * this->worldDepth;
-	std::vector<char> voxelRefBuffer(voxelRefBufferSize);
-	cl_char *voxPtr = reinterpret_cast<cl_char*>(voxelRefBuffer.data());
-
-	// Lambda for writing a voxel reference into the local buffer. This only works 
-	// when using the naive rectangle array storage (i.e., *every* voxel has 6 
-	// rectangle slots). Consider making the offset based on the number of rectangles
-	// written, instead of an arbitrary XYZ coordinate.
-	auto writeVoxelRef = [this, voxPtr](int cellX, int cellY, int cellZ, int count)
-	{
-		assert(cellX >= 0);
-		assert(cellY >= 0);
-		assert(cellZ >= 0);
-		assert(cellX < this->worldWidth);
-		assert(cellY < this->worldHeight);
-		assert(cellZ < this->worldDepth);
-		assert(count >= 0);
-
-		cl_char *ptr = voxPtr + (cellX * SIZEOF_VOXEL_REF) +
-			((cellY * this->worldWidth) * SIZEOF_VOXEL_REF) +
-			((cellZ * this->worldWidth * this->worldHeight) * SIZEOF_VOXEL_REF);
+	status = this->reprojectKernel.setArg(pixelArg + 6,
+		static_cast<cl_int>(this->previousHeight));
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::Kernel::setArg reprojectKernel previousHeight.");
 
-		// Number of rectangles to skip in the rectangles array.
-		int offset = 6 * (cellX + (cellY * this->worldWidth) +
-			(cellZ * this->worldWidth * this->worldHeight));
+	status = this->reprojectKernel.setArg(pixelArg + 7,
+		static_cast<cl_int>(this->refreshPhase));
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::Kernel::setArg reprojectKernel refreshPhase.");
 
-		cl_int *offsetPtr = reinterpret_cast<cl_int*>(ptr);
-		*(offsetPtr + 0) = offset;
+	status = this->reprojectKernel.setArg(pixelArg + 10,
+		static_cast<cl_int>(this->debugView ? 1 : 0));
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::Kernel::setArg reprojectKernel countReuse.");
 
-		cl_int *countPtr = reinterpret_cast<cl_int*>(ptr + sizeof(cl_int));
-		*(countPtr + 0) = count;
-	};
+	if (this->debugView)
+	{
+		status = this->commandQueue.enqueueFillBuffer(this->reuseCountBuffer,
+			static_cast<cl_uint>(0), 0, sizeof(cl_uint) * this->reuseCounts.size(),
+			nullptr, nullptr);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::CommandQueue::enqueueFillBuffer reuseCountBuffer.");
+	}
 
-	// Prepare some textures for a local float4 buffer.
-	this->textureManager.setPalette(PaletteFile::fromName(PaletteName::Default));
-	std::vector<const SDL_Surface*> textures =
-	{
-		// Texture indices:
-		// 0: city wall
-		this->textureManager.getSurface("CITYWALL.IMG").getSurface(),
-
-		// 1-3: grounds
-		this->textureManager.getSurfaces("NORM1.SET").at(0),
-		this->textureManager.getSurfaces("NORM1.SET").at(1),
-		this->textureManager.getSurfaces("NORM1.SET").at(2),
-
-		// 4-5: gates
-		this->textureManager.getSurface("DLGT.IMG").getSurface(),
-		this->textureManager.getSurface("DRGT.IMG").getSurface(),
-
-		// 6-9: tavern + door
-		this->textureManager.getSurfaces("MTAVERN.SET").at(0),
-		this->textureManager.getSurfaces("MTAVERN.SET").at(1),
-		this->textureManager.getSurfaces("MTAVERN.SET").at(2),
-		this->textureManager.getSurface("DTAV.IMG").getSurface(),
-
-		// 10-15: temple + door
-		this->textureManager.getSurfaces("MTEMPLE.SET").at(0),
-		this->textureManager.getSurfaces("MTEMPLE.SET").at(1),
-		this->textureManager.getSurfaces("MTEMPLE.SET").at(2),
-		this->textureManager.getSurfaces("MTEMPLE.SET").at(3),
-		this->textureManager.getSurfaces("MTEMPLE.SET").at(4),
-		this->textureManager.getSurface("DTEP.IMG").getSurface(),
-
-		// 16-21: Mages' Guild + door
-		this->textureManager.getSurfaces("MMUGUILD.SET").at(0),
-		this->textureManager.getSurfaces("MMUGUILD.SET").at(1),
-		this->textureManager.getSurfaces("MMUGUILD.SET").at(2),
-		this->textureManager.getSurfaces("MMUGUILD.SET").at(3),
-		this->textureManager.getSurfaces("MMUGUILD.SET").at(4),
-		this->textureManager.getSurface("DMU.IMG").getSurface(),
-
-		// 22-25: Equipment store + door
-		this->textureManager.getSurfaces("MEQUIP.SET").at(0),
-		this->textureManager.getSurfaces("MEQUIP.SET").at(1),
-		this->textureManager.getSurfaces("MEQUIP.SET").at(2),
-		this->textureManager.getSurface("DEQ.IMG").getSurface(),
-
-		// 26-29: Noble house + door
-		this->textureManager.getSurfaces("MNOBLE.SET").at(0),
-		this->textureManager.getSurfaces("MNOBLE.SET").at(1),
-		this->textureManager.getSurfaces("MNOBLE.SET").at(2),
-		this->textureManager.getSurface("DNB1.IMG").getSurface(),
-	};
+	status = this->commandQueue.enqueueNDRangeKernel(this->reprojectKernel,
+		cl::NullRange, workDims, cl::NullRange, waitEvents,
+		this->makeProfileEvent("device lean reproject"));
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::CommandQueue::enqueueNDRangeKernel reprojectKernel.");
+
+	// This frame is next frame's previous one.
+	this->worldChanged = false;
+	this->previousWidth = this->frameWidth;
+	this->previousHeight = this->frameHeight;
+	this->previousValid = true;
+	this->refreshPhase = (this->refreshPhase + 1) % CLLeanKernels::REFRESH_INTERVAL;
+}
+
+bool CLProgram::updateSprites()
+{
+	const auto sortStartTime = std::chrono::high_resolution_clock::now();
+	this->spriteTiles.update(this->world.getSpriteRectangles(),
+		this->world.getActiveSprites(), this->frameWidth, this->frameHeight);
+	this->addHostSample("host sort sprites", sortStartTime);
+
+	const auto &spriteIDs = this->spriteTiles.getSpriteIDs();
+	if (spriteIDs.size() == 0)
+	{
+		return false;
+	}
 
-	const int textureCount = static_cast<int>(textures.size());
-	const int textureWidth = 64;
-	const int textureHeight = 64;
-	size_t textureBufferSize = sizeof(cl_float4) * textureWidth * 
-		textureHeight * textureCount;
-	std::vector<char> textureBuffer(textureBufferSize);
-	cl_char *texPtr = reinterpret_cast<cl_char*>(textureBuffer.data());
-	
-	// Pack the texture data into the local buffer.
-	for (int i = 0; i < textureCount; ++i)
+	// The host copies can't be touched until the previous writes have read them.
+	if (this->spriteWriteEvents.size() > 0)
 	{
-		const SDL_Surface *texture = textures.at(i);
-		const uint32_t *pixels = static_cast<uint32_t*>(texture->pixels);
+		cl_int status = cl::Event::waitForEvents(this->spriteWriteEvents);
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Event::waitForEvents.");
+		this->spriteWriteEvents.clear();
+	}
 
-		int pixelOffset = sizeof(cl_float4) * textureWidth * textureHeight * i;
-		cl_float4 *pixelPtr = reinterpret_cast<cl_float4*>(texPtr + pixelOffset);
+	const auto &tileRanges = this->spriteTiles.getTileRanges();
+	const auto &tileSprites = this->spriteTiles.getTileSprites();
+	const cl_uint pixelArg = static_cast<cl_uint>(CLLeanKernels::WORLD_ARG_COUNT);
 
-		for (int y = 0; y < texture->h; ++y)
+	// Lambda for growing a sprite buffer by at least double if this frame needs more
+	// room, and giving the new one to the sprite kernel.
+	auto growBuffer = [this, pixelArg](cl::Buffer &buffer, cl::size_type &capacity,
+		cl::size_type count, cl::size_type elementSize, cl_uint arg,
+		const std::string &name)
+	{
+		if (count <= capacity)
 		{
-			for (int x = 0; x < texture->w; ++x)
-			{
-				int index = x + (y * texture->w);
+			return;
+		}
 
-				// Convert from ARGB int to RGBA float4.
-				Float4f color = Float4f::fromARGB(pixels[index]);
+		cl_int status = CL_SUCCESS;
+		capacity = std::max(count, capacity * 2);
+		buffer = cl::Buffer(this->context, CL_MEM_READ_ONLY, elementSize * capacity,
+			nullptr, &status);
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Buffer " + name + ".");
 
-				cl_float *colorPtr = reinterpret_cast<cl_float*>(pixelPtr + index);
-				*(colorPtr + 0) = static_cast<cl_float>(color.getX());
-				*(colorPtr + 1) = static_cast<cl_float>(color.getY());
-				*(colorPtr + 2) = static_cast<cl_float>(color.getZ());
+		status = this->spritesKernel.setArg(pixelArg + arg, buffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg spritesKernel " + name + ".");
+	};
 
-				// Transparency depends on whether the pixel is black.
-				*(colorPtr + 3) = static_cast<cl_float>(pixels[index] == 0 ? 0.0f : 1.0f);
-			}
-		}
+	growBuffer(this->rasterSpriteBuffer, this->rasterSpriteCapacity, spriteIDs.size(),
+		SIZEOF_RECTANGLE, 2, "rasterSpriteBuffer");
+	growBuffer(this->spriteTileRangeBuffer, this->spriteTileRangeCapacity,
+		tileRanges.size(), sizeof(cl_int2), 3, "spriteTileRangeBuffer");
+	growBuffer(this->spriteTileSpriteBuffer, this->spriteTileSpriteCapacity,
+		tileSprites.size(), sizeof(cl_int), 4, "spriteTileSpriteBuffer");
+
+	// Convert this frame's sprites to the kernel's rectangle layout, farthest first.
+	const auto &spriteRectangles = this->world.getSpriteRectangles();
+	const auto &spriteTextureIDs = this->world.getSpriteTextureIDs();
+	this->rasterSpriteData.resize(SIZEOF_RECTANGLE * spriteIDs.size());
+	for (size_t i = 0; i < spriteIDs.size(); ++i)
+	{
+		const int spriteID = spriteIDs.at(i);
+		writeRectangle(reinterpret_cast<cl_char*>(this->rasterSpriteData.data()) +
+			(SIZEOF_RECTANGLE * i), spriteRectangles.at(spriteID),
+			this->texturePool.getTextureReference(spriteTextureIDs.at(spriteID)));
 	}
 
-	// Zero out all the voxel references to start.
-	for (int k = 0; k < this->worldDepth; ++k)
+	this->spriteTileRangeData.resize(sizeof(cl_int2) * tileRanges.size());
+	cl_int *tileRangePtr = reinterpret_cast<cl_int*>(this->spriteTileRangeData.data());
+	for (size_t i = 0; i < tileRanges.size(); ++i)
 	{
-		for (int j = 0; j < this->worldHeight; ++j)
-		{
-			for (int i = 0; i < this->worldWidth; ++i)
-			{
-				writeVoxelRef(i, j, k, 0);
-			}
-		}
+		*(tileRangePtr + (i * 2)) = static_cast<cl_int>(tileRanges.at(i).first);
+		*(tileRangePtr + (i * 2) + 1) = static_cast<cl_int>(tileRanges.at(i).second);
 	}
 
-	// Use the same seed so it's not a new city on every screen resize.
-	Random random(2);
+	this->spriteTileSpriteData.resize(sizeof(cl_int) * tileSprites.size());
+	std::copy(tileSprites.begin(), tileSprites.end(),
+		reinterpret_cast<cl_int*>(this->spriteTileSpriteData.data()));
 
-	// Make the ground.
-	for (int k = 0; k < this->worldDepth; ++k)
+	// Non-blocking writes of just this frame's part of each buffer. The queue is in
+	// order, so the sprite kernel runs after them.
+	auto writeData = [this](const cl::Buffer &buffer, const std::vector<char> &data)
 	{
-		for (int i = 0; i < this->worldWidth; ++i)
-		{
-			std::vector<Rect3D> block = makeBlock(i, 0, k);
-			int rectangleCount = static_cast<int>(block.size());
+		cl::Event event;
+		cl_int status = this->commandQueue.enqueueWriteBuffer(buffer, CL_FALSE, 0,
+			data.size(), static_cast<const void*>(data.data()), nullptr, &event);
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::enqueueWriteBuffer " +
+			this->getErrorString(status) + ".");
+
+		this->spriteWriteEvents.push_back(event);
+		this->addProfileEvent("device write sprites", event);
+	};
 
-			int textureIndex = 1 + random.next(3);
-			for (int index = 0; index < rectangleCount; ++index)
-			{
-				writeRectangle(block.at(index), i, 0, k, index, textureIndex);
-			}
+	writeData(this->rasterSpriteBuffer, this->rasterSpriteData);
+	writeData(this->spriteTileRangeBuffer, this->spriteTileRangeData);
+	writeData(this->spriteTileSpriteBuffer, this->spriteTileSpriteData);
 
-			writeVoxelRef(i, 0, k, 6);
-		}
+	cl_int status = this->spritesKernel.setArg(pixelArg + 5,
+		static_cast<cl_int>(this->spriteTiles.getTileCountX()));
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::Kernel::setArg spritesKernel tileCountX.");
+
+	return true;
+}
+
+void CLProgram::collectReuseCounts()
+{
+	if (this->reuseCountEvent() == nullptr)
+	{
+		return;
 	}
 
-	// Make the near X and far X walls.
-	for (int j = 1; j < this->worldHeight; ++j)
+	cl_int status = this->reuseCountEvent.wait();
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Event::wait reuseCountEvent.");
+	this->reuseCountEvent = cl::Event();
+
+	this->reusedTotal += this->reuseCounts.at(0);
+	this->tracedTotal += this->reuseCounts.at(1);
+	this->reuseFrameCount++;
+
+	if (this->reuseFrameCount >= REUSE_MENTION_INTERVAL)
 	{
-		for (int k = 0; k < this->worldDepth; ++k)
+		const cl_ulong pixelTotal = std::max<cl_ulong>(
+			this->reusedTotal + this->tracedTotal, 1);
+		const int reusedPercent = static_cast<int>((this->reusedTotal * 100) / pixelTotal);
+		if (this->reprojected)
+		{
+			Debug::mention("CLProgram", "Reused " + std::to_string(reusedPercent) +
+				"% of primary hits over the last " + std::to_string(this->reuseFrameCount) +
+				" frames.");
+		}
+		else
 		{
-			std::vector<Rect3D> block = makeBlock(0, j, k);
-			int rectangleCount = static_cast<int>(block.size());
+			Debug::mention("CLProgram", "Filled " + std::to_string(reusedPercent) +
+				"% of pixels from their block's corners over the last " +
+				std::to_string(this->reuseFrameCount) + " frames.");
+		}
 
-			for (int index = 0; index < rectangleCount; ++index)
-			{
-				writeRectangle(block.at(index), 0, j, k, index, 0);
-			}
+		this->reusedTotal = 0;
+		this->tracedTotal = 0;
+		this->reuseFrameCount = 0;
+	}
+}
 
-			block = makeBlock(this->worldWidth - 1, j, k);
-			for (int index = 0; index < rectangleCount; ++index)
-			{
-				writeRectangle(block.at(index), this->worldWidth - 1, j, k, index, 0);
-			}
+void CLProgram::collectStepCounts()
+{
+	if (this->stepCountEvent() == nullptr)
+	{
+		return;
+	}
 
-			writeVoxelRef(0, j, k, 6);
-			writeVoxelRef(this->worldWidth - 1, j, k, 6);
-		}
+	cl_int status = this->stepCountEvent.wait();
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Event::wait stepCountEvent.");
+	this->stepCountEvent = cl::Event();
+
+	this->rayTotal += this->stepCounts.at(0);
+	this->stepTotal += this->stepCounts.at(1);
+}
+
+std::vector<Rect> CLProgram::getCornerRects(const std::vector<Rect> &rects) const
+{
+	// A pixel rectangle needs the corners of every block it touches, which is one more
+	// column and row of corners than blocks.
+	std::vector<Rect> cornerRects;
+	for (const Rect &rect : rects)
+	{
+		const int left = rect.getLeft() / this->refineBlockSize;
+		const int top = rect.getTop() / this->refineBlockSize;
+		const int right = ((rect.getLeft() + rect.getWidth() - 1) / this->refineBlockSize) + 2;
+		const int bottom = ((rect.getTop() + rect.getHeight() - 1) / this->refineBlockSize) + 2;
+		cornerRects.push_back(Rect(left, top, right - left, bottom - top));
 	}
 
-	// Make the near Z and far Z walls (ignoring existing corners).
-	for (int j = 1; j < this->worldHeight; ++j)
+	return cornerRects;
+}
+
+void CLProgram::renderBands(Renderer &renderer,
+	const std::chrono::high_resolution_clock::time_point &renderStartTime)
+{
+	// The frame constants and world writes are on the main queue, so the bands wait
+	// for a marker behind them.
+	std::vector<cl::Event> waitEvents(1);
+	cl_int status = this->commandQueue.enqueueMarkerWithWaitList(nullptr, &waitEvents.at(0));
+	Debug::check(status == CL_SUCCESS, "CLProgram",
+		"cl::CommandQueue::enqueueMarkerWithWaitList.");
+
+	status = this->commandQueue.flush();
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::CommandQueue::flush.");
+
+	// Each band renders its rows with a global work offset, so the kernels see the 
+	// same pixel coordinates as they would for the whole frame. Rows of the output are
+	// packed at the frame width, so a band's rows are one range of it. Each band reads
+	// its rows straight into the locked texture, which stays locked until they're done.
+	const std::vector<int> bandRows = this->bandBalancer->split(this->frameHeight);
+	int pitch = 0;
+	char *texturePixels = static_cast<char*>(
+		this->lockTextureRows(this->frameWidth, 0, this->frameHeight, &pitch));
+	int startRow = 0;
+	for (size_t i = 0; i < this->bands.size(); ++i)
 	{
-		for (int i = 1; i < (this->worldWidth - 1); ++i)
-		{
-			std::vector<Rect3D> block = makeBlock(i, j, 0);
-			int rectangleCount = static_cast<int>(block.size());
+		RenderBand &band = this->bands.at(i);
+		band.startRow = startRow;
+		band.rowCount = bandRows.at(i);
+		startRow += band.rowCount;
 
-			for (int index = 0; index < rectangleCount; ++index)
-			{
-				writeRectangle(block.at(index), i, j, 0, index, 0);
-			}
+		if (band.rowCount == 0)
+		{
+			continue;
+		}
 
-			block = makeBlock(i, j, this->worldDepth - 1);
-			for (int index = 0; index < rectangleCount; ++index)
-			{
-				writeRectangle(block.at(index), i, j, this->worldDepth - 1, index, 0);
-			}
+		const cl::NDRange offset(0, band.startRow);
+		const cl::NDRange workDims(this->frameWidth, band.rowCount);
 
-			writeVoxelRef(i, j, 0, 6);
-			writeVoxelRef(i, j, this->worldDepth - 1, 6);
+		if (this->kernelMode == CLKernelMode::Lean)
+		{
+			status = band.commandQueue.enqueueNDRangeKernel(band.leanIntersectKernel,
+				offset, workDims, cl::NullRange, &waitEvents, &band.startEvent);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::CommandQueue::enqueueNDRangeKernel band leanIntersectKernel.");
+
+			status = band.commandQueue.enqueueNDRangeKernel(band.leanShadeKernel,
+				offset, workDims, cl::NullRange, nullptr, nullptr);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::CommandQueue::enqueueNDRangeKernel band leanShadeKernel.");
+		}
+		else
+		{
+			status = band.commandQueue.enqueueNDRangeKernel(band.fusedKernel,
+				offset, workDims, cl::NullRange, &waitEvents, &band.startEvent);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::CommandQueue::enqueueNDRangeKernel band fusedKernel.");
 		}
+
+		this->enqueueReadRows(band.commandQueue, band.outputBuffer, this->frameWidth,
+			band.startRow, band.rowCount, texturePixels + (pitch * band.startRow), pitch,
+			CL_FALSE, &band.readEvent);
+
+		status = band.commandQueue.flush();
+		Debug::check(status == CL_SUCCESS, "CLProgram", "cl::CommandQueue::flush band.");
 	}
 
-	// Lambda for adding some simple cube buildings.
-	auto makeBuilding = [&](int cellX, int cellZ, int width, int height, int depth,
-		const std::vector<int> &textureIndices)
+	// The host waits here for the slowest band.
+	const auto waitStartTime = std::chrono::high_resolution_clock::now();
+	for (RenderBand &band : this->bands)
 	{
-		const int cellY = 1;
-
-		for (int k = 0; k < depth; ++k)
+		if (band.rowCount > 0)
 		{
-			for (int j = 0; j < height; ++j)
-			{
-				for (int i = 0; i < width; ++i)
-				{
-					const int x = cellX + i;
-					const int y = cellY + j;
-					const int z = cellZ + k;
+			status = band.readEvent.wait();
+			Debug::check(status == CL_SUCCESS, "CLProgram", "cl::Event::wait band.");
+		}
+	}
 
-					const std::vector<Rect3D> block = makeBlock(x, y, z);
-					const int rectangleCount = static_cast<int>(block.size());
+	this->addHostSample("host wait output", waitStartTime);
 
-					const int textureIndex = textureIndices.at(random.next(
-						static_cast<int>(textureIndices.size())));
+	// Balance the next frame with each device's time from its first kernel starting to
+	// its read being done. Both times are from the same device's clock.
+	for (size_t i = 0; i < this->bands.size(); ++i)
+	{
+		const RenderBand &band = this->bands.at(i);
+		if (band.rowCount == 0)
+		{
+			continue;
+		}
 
-					for (int index = 0; index < rectangleCount; ++index)
-					{
-						writeRectangle(block.at(index), x, y, z, index, textureIndex);
-					}
+		const cl_ulong startTime =
+			band.startEvent.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+		const cl_ulong endTime = band.readEvent.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+		const double milliseconds = (endTime > startTime) ?
+			(static_cast<double>(endTime - startTime) / 1000000.0) : 0.0;
+		this->bandBalancer->update(static_cast<int>(i), band.rowCount, milliseconds);
 
-					writeVoxelRef(x, y, z, 6);
-				}
-			}
+		if (this->profiler != nullptr)
+		{
+			this->profiler->addSample("device band " + std::to_string(i), milliseconds);
 		}
-	};
+	}
 
-	// Add some simple buildings around. This data should come from a "World" or 
-	// "CityData" class sometime.
+	const auto presentStartTime = std::chrono::high_resolution_clock::now();
+	this->presentTexture(this->frameWidth, this->frameHeight, renderer);
+	this->addHostSample("host present", presentStartTime);
+	this->updateResolution(renderStartTime);
+}
 
-	// Tavern #1
-	makeBuilding(3, 5, 5, 2, 6, { 6, 7, 8 });
-	makeBuilding(3, 6, 1, 1, 1, { 9 });
+const RenderProfiler *CLProgram::getProfiler() const
+{
+	return this->profiler.get();
+}
 
-	// Tavern #2
-	makeBuilding(3, 13, 7, 1, 5, { 6, 7, 8 });
-	makeBuilding(6, 13, 1, 1, 1, { 9 });
+void CLProgram::resetProfiler(int windowSize)
+{
+	if (this->profiler == nullptr)
+	{
+		return;
+	}
 
-	// Temple #1
-	makeBuilding(11, 4, 6, 2, 5, { 10, 11, 12, 13, 14 });
-	makeBuilding(11, 6, 1, 1, 1, { 15 });
+	// Earlier frames' device timings go to the old profiler instead of the new one.
+	this->waitForFrames();
+	this->profiler = std::unique_ptr<RenderProfiler>(new RenderProfiler(windowSize));
+}
 
-	// Mage's Guild #1
-	makeBuilding(12, 12, 5, 2, 4, { 16, 17, 18, 19, 20 });
-	makeBuilding(15, 12, 1, 1, 1, { 21 });
+void CLProgram::waitForFrames()
+{
+	// Unlike finishFrames(), mapped outputs are left mapped so pipelining carries on.
+	this->commandQueue.finish();
+	for (RenderBand &band : this->bands)
+	{
+		band.commandQueue.finish();
+	}
 
-	// Equipment store #1
-	makeBuilding(20, 4, 5, 1, 7, { 22, 23, 24 });
-	makeBuilding(20, 8, 1, 1, 1, { 25 });
+	this->collectProfileEvents();
+}
 
-	// Equipment store #2
-	makeBuilding(11, 19, 6, 2, 6, { 22, 23, 24 });
-	makeBuilding(13, 19, 1, 1, 1, { 25 });
+bool CLProgram::hasDebugView() const
+{
+	return this->reprojected || (this->refineBlockSize > 1);
+}
 
-	// Noble house #1
-	makeBuilding(21, 15, 6, 2, 8, { 26, 27, 28 });
-	makeBuilding(21, 17, 1, 1, 1, { 29 });
+void CLProgram::setDebugView(bool debugView)
+{
+	if (!this->hasDebugView())
+	{
+		return;
+	}
 
-	// Add a city gate with some walls.
-	makeBuilding(8, 0, 1, 1, 1, { 4 });
-	makeBuilding(9, 0, 1, 1, 1, { 5 });
-	makeBuilding(1, 1, 7, this->worldHeight - 1, 1, { 0 });
-	makeBuilding(10, 1, 3, this->worldHeight - 1, 1, { 0 });
+	this->debugView = debugView;
+	this->frameValid = false;
+	this->reusedTotal = 0;
+	this->tracedTotal = 0;
+	this->reuseFrameCount = 0;
+}
 
-	// Write the rectangle buffer to device memory.
-	cl_int status = this->commandQueue.enqueueWriteBuffer(this->rectangleBuffer,
-		CL_TRUE, 0, rectangleBufferSize, static_cast<const void*>(recPtr), nullptr, nullptr);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::enqueueWriteBuffer test rectangleBuffer");
+double CLProgram::getAverageStepsPerRay()
+{
+	if (!this->stepCounted)
+	{
+		return -1.0;
+	}
 
-	// Write the voxel reference buffer to device memory.
-	status = this->commandQueue.enqueueWriteBuffer(this->voxelRefBuffer,
-		CL_TRUE, 0, voxelRefBufferSize, static_cast<const void*>(voxPtr), nullptr, nullptr);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::enqueueWriteBuffer test voxelRefBuffer");
+	this->collectStepCounts();
+	return static_cast<double>(this->stepTotal) /
+		static_cast<double>(std::max<cl_ulong>(this->rayTotal, 1));
+}
 
-	// Write the texture buffer to device memory.
-	status = this->commandQueue.enqueueWriteBuffer(this->textureBuffer,
-		CL_TRUE, 0, textureBufferSize, static_cast<const void*>(texPtr), nullptr, nullptr);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::enqueueWriteBuffer test textureBuffer");
+void CLProgram::resetStepCounts()
+{
+	// Counts still being read belong to frames before the reset.
+	this->collectStepCounts();
+	this->rayTotal = 0;
+	this->stepTotal = 0;
 }
 
 void CLProgram::updateCamera(const Float3d &eye, const Float3d &direction, double fovY)
@@ -909,11 +2724,12 @@ void CLProgram::updateCamera(const Float3d &eye, const Float3d &direction, doubl
 	// Do not scale the direction beforehand.
 	assert(direction.isNormalized());
 
-	std::vector<char> buffer(SIZEOF_CAMERA);
+	// The slot isn't being read by any transfer, so it can be written right away. It
+	// still has the last camera in it, to tell whether this one is any different.
+	cl_char *bufPtr = this->getFrameSlot();
+	const std::vector<cl_char> oldCamera(bufPtr, bufPtr + SIZEOF_CAMERA);
 
-	cl_char *bufPtr = reinterpret_cast<cl_char*>(buffer.data());
-
-	// Write the components of the camera to the local buffer.
+	// Write the components of the camera to the frame constants slot.
 	// Correct spacing is very important.
 	auto *eyePtr = reinterpret_cast<cl_float*>(bufPtr);
 	*(eyePtr + 0) = static_cast<cl_float>(eye.getX());
@@ -942,61 +2758,453 @@ void CLProgram::updateCamera(const Float3d &eye, const Float3d &direction, doubl
 	auto *zoomPtr = reinterpret_cast<cl_float*>(bufPtr + (sizeof(cl_float3) * 4));
 	*zoomPtr = static_cast<cl_float>(zoom);
 
-	// Write the buffer to device memory.
-	cl_int status = this->commandQueue.enqueueWriteBuffer(this->cameraBuffer,
-		CL_TRUE, 0, buffer.size(), static_cast<const void*>(bufPtr), nullptr, nullptr);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::enqueueWriteBuffer updateCamera");
+	if (!std::equal(oldCamera.begin(), oldCamera.end(), bufPtr))
+	{
+		this->cameraChanged = true;
+		this->dirtyTiles.setCamera(eye, direction, right, up, zoom);
+		this->spriteTiles.setCamera(eye, direction, right, up, zoom);
+	}
+
+	// It goes to device memory with the rest of the frame constants in render().
+	this->frameConstantsDirty = true;
 }
 
 void CLProgram::updateGameTime(double gameTime)
 {
 	assert(gameTime >= 0.0);
 
-	std::vector<char> buffer(sizeof(cl_float));
+	auto *timePtr = reinterpret_cast<cl_float*>(this->getFrameSlot() + this->gameTimeOffset);
+	*timePtr = static_cast<cl_float>(gameTime);
+
+	this->gameTime = gameTime;
+	this->frameConstantsDirty = true;
+}
 
-	cl_char *bufPtr = reinterpret_cast<cl_char*>(buffer.data());
+void CLProgram::resize(int renderWidth, int renderHeight, Renderer &renderer)
+{
+	assert(renderWidth > 0);
+	assert(renderHeight > 0);
 
-	auto *timePtr = reinterpret_cast<cl_float*>(bufPtr);
-	*timePtr = static_cast<cl_float>(gameTime);
+	if ((renderWidth == this->renderWidth) && (renderHeight == this->renderHeight))
+	{
+		return;
+	}
+
+	Debug::mention("CLProgram", "Resizing to " + std::to_string(renderWidth) + "x" +
+		std::to_string(renderHeight) + ".");
+
+	// Nothing in flight can still be using the old per-pixel buffers.
+	this->finishFrames();
+
+	this->renderWidth = renderWidth;
+	this->renderHeight = renderHeight;
+
+	// Recreate the frame buffer texture with the new dimensions.
+	SDL_DestroyTexture(this->texture);
+	this->texture = renderer.createTexture(SDL_PIXELFORMAT_ARGB8888,
+		SDL_TEXTUREACCESS_STREAMING, this->renderWidth, this->renderHeight);
+	Debug::check(this->texture != nullptr, "CLProgram", "SDL_CreateTexture");
+
+	// The context and world buffers are all kept as they are. The lean program is kept
+	// too, and so is a kernel.cl that takes the render dimensions as arguments. One 
+	// that has them compiled in is built again for a size it wasn't built with, and 
+	// its new kernels are given the world buffers.
+	const bool fullRebuilt = (this->kernelMode == CLKernelMode::Full) &&
+		!this->fullSizeArgs && ((renderWidth != this->fullProgramWidth) ||
+		(renderHeight != this->fullProgramHeight));
+	if (fullRebuilt)
+	{
+		this->buildFullProgram();
+		this->bindWorldBuffers();
+	}
+
+	this->createPixelBuffers();
+}
+
+void CLProgram::setVoxel(int cellX, int cellY, int cellZ,
+	const std::vector<Rect3D> &rectangles, int textureID)
+{
+	this->world.setVoxel(cellX, cellY, cellZ, rectangles, textureID);
+}
+
+int CLProgram::addSprite(const Rect3D &rectangle, int textureID)
+{
+	return this->world.addSprite(rectangle, textureID);
+}
 
-	// Write the buffer to device memory.
-	cl_int status = this->commandQueue.enqueueWriteBuffer(this->gameTimeBuffer,
-		CL_TRUE, 0, buffer.size(), static_cast<const void*>(bufPtr), nullptr, nullptr);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::enqueueWriteBuffer updateGameTime");
+void CLProgram::moveSprite(int spriteID, const Rect3D &rectangle, int textureID)
+{
+	this->world.moveSprite(spriteID, rectangle, textureID);
+}
+
+void CLProgram::removeSprite(int spriteID)
+{
+	this->world.removeSprite(spriteID);
+}
+
+int CLProgram::addLight(const Float3f &position, const Float3f &color, float radius)
+{
+	return this->world.addLight(position, color, radius);
+}
+
+void CLProgram::moveLight(int lightID, const Float3f &position)
+{
+	this->world.moveLight(lightID, position);
+}
+
+void CLProgram::setLightEnabled(int lightID, bool enabled)
+{
+	this->world.setLightEnabled(lightID, enabled);
+}
+
+void CLProgram::removeLight(int lightID)
+{
+	this->world.removeLight(lightID);
 }
 
 void CLProgram::render(Renderer &renderer)
 {
-	cl::NDRange workDims(this->renderWidth, this->renderHeight);
+	const auto renderStartTime = std::chrono::high_resolution_clock::now();
 
-	// Run the intersect kernel.
-	cl_int status = this->commandQueue.enqueueNDRangeKernel(this->intersectKernel,
-		cl::NullRange, workDims, cl::NullRange, nullptr, nullptr);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::CommandQueue::enqueueNDRangeKernel intersectKernel.");
+	// Time whatever device work from earlier frames is done by now.
+	this->collectProfileEvents();
 
-	// Run the ray tracing kernel using the results from the intersect kernel.
-	status = this->commandQueue.enqueueNDRangeKernel(this->rayTraceKernel,
-		cl::NullRange, workDims, cl::NullRange, nullptr, nullptr);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::CommandQueue::enqueueNDRangeKernel rayTraceKernel.");
+	// Render this frame at the quality picked from the previous frames' render times.
+	const int frameWidth = this->resolutionScaler.getScaledDimension(this->renderWidth);
+	const int frameHeight = this->resolutionScaler.getScaledDimension(this->renderHeight);
+	if ((frameWidth != this->frameWidth) || (frameHeight != this->frameHeight))
+	{
+		this->setFrameDimensions(frameWidth, frameHeight);
+	}
 
-	// Run the RGB conversion kernel using the results from ray tracing.
-	status = this->commandQueue.enqueueNDRangeKernel(this->convertToRGBKernel,
-		cl::NullRange, workDims, cl::NullRange, nullptr, nullptr);
-	Debug::check(status == CL_SUCCESS, "CLProgram",
-		"cl::CommandQueue::enqueueNDRangeKernel convertToRGBKernel.");
+	// Add up the last debug view frame's reuse counts and the last counted frame's
+	// steps, if they've been read.
+	this->collectReuseCounts();
+	this->collectStepCounts();
+
+	// Work out how much of the last frame has to be drawn again. Too many dirty tiles
+	// aren't worth launching kernels for one by one. Only the lean kernels can shade
+	// without tracing. The kernel.cl kernels have the render size compiled in, and
+	// bands each cover their own rows, so both only draw whole frames.
+	this->findDirtyTiles();
+	const bool shadingChanged = this->isShadingChanged();
+	const bool partialKernels = (this->kernelMode != CLKernelMode::Full) &&
+		(this->bands.size() == 0);
+	const bool fullFrame = !this->frameValid || this->cameraChanged ||
+		((this->dirtyTiles.getDirtyCount() * 2) > this->dirtyTiles.getTileCount()) ||
+		(!partialKernels && !this->dirtyTiles.isEmpty()) ||
+		(shadingChanged && (this->kernelMode != CLKernelMode::Lean || !partialKernels));
+
+	if (!fullFrame && !shadingChanged && this->dirtyTiles.isEmpty())
+	{
+		// Nothing can be seen to have changed. Copy any unseen world changes so they
+		// don't pile up, and show the last frame again.
+		const auto updateStartTime = std::chrono::high_resolution_clock::now();
+		this->updateWorld();
+		this->addHostSample("host update world", updateStartTime);
+
+		const auto presentStartTime = std::chrono::high_resolution_clock::now();
+		this->presentLastFrame(renderer);
+		this->addHostSample("host present unchanged", presentStartTime);
+		return;
+	}
 
-	// Copy the output buffer into the destination pixel buffer.
-	void *outputDataPtr = static_cast<void*>(this->outputData.data());
-	const int renderPixelCount = this->renderWidth * this->renderHeight;
-	status = this->commandQueue.enqueueReadBuffer(this->outputBuffer, CL_TRUE, 0,
-		static_cast<cl::size_type>(sizeof(cl_int) * renderPixelCount),
-		outputDataPtr, nullptr, nullptr);
-	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::CommandQueue::enqueueReadBuffer.");
-
-	// Update the frame buffer texture and draw to the renderer.
-	const int pitch = this->renderWidth * sizeof(cl_int);
-	SDL_UpdateTexture(this->texture, nullptr, outputDataPtr, pitch);
-	renderer.fillNative(this->texture);
+	// Keep last frame's camera for reprojecting its hits. The queue is in order, so
+	// the copy is done before this frame's camera is written over it.
+	if (this->reprojected)
+	{
+		cl_int status = this->commandQueue.enqueueCopyBuffer(this->cameraBuffer,
+			this->previousCameraBuffer, 0, 0, SIZEOF_CAMERA, nullptr, nullptr);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::CommandQueue::enqueueCopyBuffer previousCameraBuffer.");
+	}
+
+	// Write this frame's camera and game time, then any world changes since last
+	// frame, to device memory.
+	this->submitFrameConstants();
+
+	const auto updateStartTime = std::chrono::high_resolution_clock::now();
+	this->updateWorld();
+	this->addHostSample("host update world", updateStartTime);
+
+	this->cameraChanged = false;
+	this->frameValid = true;
+	this->shadedGameTime = this->gameTime;
+
+	if (this->bands.size() > 0)
+	{
+		this->renderBands(renderer, renderStartTime);
+		return;
+	}
+
+	cl::NDRange workDims(this->frameWidth, this->frameHeight);
+
+	const cl::Buffer &outputBuffer = this->outputBuffers.at(this->outputIndex);
+
+	// Parts of the frame that have to be traced and shaded again. A new time of day 
+	// shades the whole frame from the depths and hits that are already there.
+	const std::vector<Rect> frameRects = { Rect(this->frameWidth, this->frameHeight) };
+	const std::vector<Rect> traceRects = fullFrame ? frameRects :
+		this->dirtyTiles.getDirtyRects();
+	const std::vector<Rect> shadeRects = (fullFrame || shadingChanged) ? frameRects :
+		traceRects;
+	const bool tilesOnly = !fullFrame && !shadingChanged;
+
+	// The first kernel of the frame waits for the world writes to be done.
+	const std::vector<cl::Event> *waitEvents =
+		(this->writeEvents.size() > 0) ? &this->writeEvents : nullptr;
+	const cl_uint pixelArg = static_cast<cl_uint>(CLLeanKernels::WORLD_ARG_COUNT);
+	cl_int status = CL_SUCCESS;
+
+	// Count this frame's rays and steps from zero.
+	if (this->stepCounted)
+	{
+		status = this->commandQueue.enqueueFillBuffer(this->stepCountBuffer,
+			static_cast<cl_uint>(0), 0, sizeof(cl_uint) * this->stepCounts.size(),
+			nullptr, nullptr);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::CommandQueue::enqueueFillBuffer stepCountBuffer.");
+	}
+
+	// A pipelined frame goes into the other output buffer, so it starts out as a copy 
+	// of the last frame if only some tiles are drawn. The last frame is mapped for 
+	// reading, which doesn't stop the device from reading it too.
+	const int outputBufferCount = this->pipelined ? 2 : 1;
+	const int lastIndex = (this->outputIndex + outputBufferCount - 1) % outputBufferCount;
+	if (tilesOnly && (lastIndex != this->outputIndex))
+	{
+		status = this->commandQueue.enqueueCopyBuffer(this->outputBuffers.at(lastIndex),
+			outputBuffer, 0, 0, sizeof(cl_int) * this->frameWidth * this->frameHeight,
+			nullptr, this->makeProfileEvent("device copy last output"));
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::CommandQueue::enqueueCopyBuffer outputBuffer.");
+	}
+
+	if (this->kernelMode == CLKernelMode::Full)
+	{
+		// Point the RGB conversion kernel at this frame's output buffer.
+		status = this->convertToRGBKernel.setArg(1, outputBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg convertToRGBKernel outputBuffer.");
+
+		status = this->commandQueue.enqueueNDRangeKernel(this->intersectKernel,
+			cl::NullRange, workDims, cl::NullRange, waitEvents,
+			this->makeProfileEvent("device intersect"));
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::CommandQueue::enqueueNDRangeKernel intersectKernel.");
+
+		// Run the ray tracing kernel using the results from the intersect kernel.
+		status = this->commandQueue.enqueueNDRangeKernel(this->rayTraceKernel,
+			cl::NullRange, workDims, cl::NullRange, nullptr,
+			this->makeProfileEvent("device ray trace"));
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::CommandQueue::enqueueNDRangeKernel rayTraceKernel.");
+
+		// Run the RGB conversion kernel using the results from ray tracing.
+		status = this->commandQueue.enqueueNDRangeKernel(this->convertToRGBKernel,
+			cl::NullRange, workDims, cl::NullRange, nullptr,
+			this->makeProfileEvent("device convert to RGB"));
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::CommandQueue::enqueueNDRangeKernel convertToRGBKernel.");
+	}
+	else if (this->kernelMode == CLKernelMode::Lean)
+	{
+		status = this->leanShadeKernel.setArg(pixelArg + 2, outputBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg leanShadeKernel outputBuffer.");
+
+		if (this->reprojected && fullFrame)
+		{
+			this->enqueueReprojection(workDims, waitEvents);
+			waitEvents = nullptr;
+		}
+		else if (this->reprojected)
+		{
+			// Dirty tiles are traced in full on top of the last frame's depths and
+			// hits, so they stay together for reprojecting next frame.
+			status = this->reprojectKernel.setArg(pixelArg + 5, static_cast<cl_int>(0));
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg reprojectKernel previousWidth.");
+
+			status = this->reprojectKernel.setArg(pixelArg + 10, static_cast<cl_int>(0));
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg reprojectKernel countReuse.");
+
+			this->enqueueRects(this->reprojectKernel, traceRects, waitEvents,
+				"device lean reproject tiles");
+		}
+		else if (this->refineBlockSize > 1)
+		{
+			// Trace the block corners first, then fill or trace each pixel from them.
+			// Only whole frames are counted.
+			const bool countFills = this->debugView && fullFrame;
+			status = this->refineKernel.setArg(pixelArg + 7,
+				static_cast<cl_int>(countFills ? 1 : 0));
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg refineKernel countFills.");
+
+			if (countFills)
+			{
+				status = this->commandQueue.enqueueFillBuffer(this->reuseCountBuffer,
+					static_cast<cl_uint>(0), 0, sizeof(cl_uint) * this->reuseCounts.size(),
+					nullptr, nullptr);
+				Debug::check(status == CL_SUCCESS, "CLProgram",
+					"cl::CommandQueue::enqueueFillBuffer reuseCountBuffer.");
+			}
+
+			this->enqueueRects(this->refineCornersKernel, this->getCornerRects(traceRects),
+				waitEvents, fullFrame ? "device lean refine corners" :
+				"device lean refine corners tiles");
+			this->enqueueRects(this->refineKernel, traceRects, waitEvents,
+				fullFrame ? "device lean refine" : "device lean refine tiles");
+		}
+		else
+		{
+			this->enqueueRects(this->leanIntersectKernel, traceRects, waitEvents,
+				fullFrame ? "device lean intersect" : "device lean intersect tiles");
+		}
+
+		// Shade straight into the output buffer from the depths and hits.
+		this->enqueueRects(this->leanShadeKernel, shadeRects, waitEvents,
+			tilesOnly ? "device lean shade tiles" : "device lean shade");
+
+		// Draw the rasterized sprites over the pixels that were just shaded. The depths 
+		// are this frame's, even after reprojection swaps them.
+		if ((this->world.getSpriteMode() == SpriteMode::Rasterized) && this->updateSprites())
+		{
+			status = this->spritesKernel.setArg(pixelArg, this->depthBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg spritesKernel depthBuffer.");
+
+			status = this->spritesKernel.setArg(pixelArg + 1, outputBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg spritesKernel outputBuffer.");
+
+			this->enqueueRects(this->spritesKernel, shadeRects, waitEvents,
+				tilesOnly ? "device lean sprites tiles" : "device lean sprites");
+		}
+
+		if (this->debugView)
+		{
+			// Tint the reused (or filled) pixels that were just shaded.
+			status = this->reuseViewKernel.setArg(1, outputBuffer);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg reuseViewKernel outputBuffer.");
+
+			status = this->reuseViewKernel.setArg(2, static_cast<cl_int>(this->frameWidth));
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg reuseViewKernel renderWidth.");
+
+			status = this->reuseViewKernel.setArg(3, static_cast<cl_int>(this->frameHeight));
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::Kernel::setArg reuseViewKernel renderHeight.");
+
+			this->enqueueRects(this->reuseViewKernel, shadeRects, waitEvents,
+				"device reuse view");
+		}
+
+		if (this->debugView && fullFrame)
+		{
+			// Read this frame's counts without waiting. Only whole frames are counted.
+			status = this->commandQueue.enqueueReadBuffer(this->reuseCountBuffer, CL_FALSE,
+				0, sizeof(cl_uint) * this->reuseCounts.size(), this->reuseCounts.data(),
+				nullptr, &this->reuseCountEvent);
+			Debug::check(status == CL_SUCCESS, "CLProgram",
+				"cl::CommandQueue::enqueueReadBuffer reuseCountBuffer.");
+		}
+	}
+	else
+	{
+		status = this->fusedKernel.setArg(pixelArg, outputBuffer);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::Kernel::setArg fusedKernel outputBuffer.");
+
+		// The fused kernel traces and shades together, so it can't shade without 
+		// tracing.
+		this->enqueueRects(this->fusedKernel, shadeRects, waitEvents,
+			tilesOnly ? "device fused render tiles" : "device fused render");
+	}
+
+	if (this->stepCounted)
+	{
+		// Read this frame's counts without waiting, like the reuse counts.
+		status = this->commandQueue.enqueueReadBuffer(this->stepCountBuffer, CL_FALSE, 0,
+			sizeof(cl_uint) * this->stepCounts.size(), this->stepCounts.data(), nullptr,
+			&this->stepCountEvent);
+		Debug::check(status == CL_SUCCESS, "CLProgram",
+			"cl::CommandQueue::enqueueReadBuffer stepCountBuffer.");
+	}
+
+	// Rows of the output are packed at the frame width, and only the top-left part of
+	// the texture is updated and stretched over the screen. When only some tiles were
+	// drawn, only their rows are read back and updated.
+	int startRow = 0;
+	int endRow = this->frameHeight;
+	if (tilesOnly)
+	{
+		this->dirtyTiles.getDirtyRows(&startRow, &endRow);
+	}
+
+	const int framePixelCount = this->frameWidth * this->frameHeight;
+	const cl::size_type outputSize = static_cast<cl::size_type>(
+		sizeof(cl_int) * framePixelCount);
+
+	if (!this->pipelined)
+	{
+		// Read the output buffer straight into the locked texture rows. Rows that 
+		// weren't drawn are still in the texture from the last frame.
+		int pitch = 0;
+		void *texturePixels = this->lockTextureRows(this->frameWidth, startRow, endRow,
+			&pitch);
+
+		// The host waits here for the whole frame.
+		const auto waitStartTime = std::chrono::high_resolution_clock::now();
+		this->enqueueReadRows(this->commandQueue, outputBuffer, this->frameWidth,
+			startRow, endRow - startRow, texturePixels, pitch, CL_TRUE,
+			this->makeProfileEvent("device read output"));
+		this->addHostSample("host wait output", waitStartTime);
+
+		// Upload the texture and draw to the renderer.
+		const auto presentStartTime = std::chrono::high_resolution_clock::now();
+		this->presentTexture(this->frameWidth, this->frameHeight, renderer);
+		this->addHostSample("host present", presentStartTime);
+
+		// Only whole frames tell the resolution scaler how long a frame takes.
+		if (fullFrame)
+		{
+			this->updateResolution(renderStartTime);
+		}
+
+		return;
+	}
+
+	// Start mapping this frame's pixels, but don't wait for them.
+	const int currentIndex = this->outputIndex;
+	this->outputWidths.at(currentIndex) = this->frameWidth;
+	this->outputHeights.at(currentIndex) = this->frameHeight;
+	this->mappedOutputs.at(currentIndex) = this->commandQueue.enqueueMapBuffer(
+		outputBuffer, CL_FALSE, CL_MAP_READ, 0, outputSize, nullptr,
+		&this->mapEvents.at(currentIndex), &status);
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::CommandQueue::enqueueMapBuffer.");
+	this->addProfileEvent("device map output", this->mapEvents.at(currentIndex));
+
+	status = this->commandQueue.flush();
+	Debug::check(status == CL_SUCCESS, "CLProgram", "cl::CommandQueue::flush.");
+
+	this->outputIndex = (currentIndex + 1) % static_cast<int>(this->outputBuffers.size());
+
+	// Show the previous frame while the device works on this one. The very first 
+	// frame has nothing before it, so the game world is drawn from the next frame on.
+	const int previousIndex = this->outputIndex;
+	if (this->mappedOutputs.at(previousIndex) != nullptr)
+	{
+		this->presentMappedOutput(previousIndex, renderer);
+	}
+
+	// The wait for the previous frame counts too, since that's when the host would
+	// otherwise be idle waiting on the device. Only whole frames are counted.
+	if (fullFrame)
+	{
+		this->updateResolution(renderStartTime);
+	}
 }
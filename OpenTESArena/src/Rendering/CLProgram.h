@@ -1,6 +1,11 @@
 #ifndef CL_PROGRAM_H
 #define CL_PROGRAM_H
 
+#include <array>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <utility>
 #include <vector>
 
 #define CL_HPP_MINIMUM_OPENCL_VERSION 120
@@ -8,11 +13,25 @@
 #define CL_USE_DEPRECATED_OPENCL_1_2_APIS
 #include <CL/cl2.hpp>
 
+#include "BandBalancer.h"
+#include "CLDeviceSplit.h"
+#include "CLKernelMode.h"
+#include "DirtyTiles.h"
+#include "PassGraph.h"
+#include "RenderProgram.h"
+#include "RenderWorld.h"
+#include "ResolutionScaler.h"
+#include "SpriteMode.h"
+#include "SpriteTiles.h"
+#include "TexturePool.h"
 #include "../Math/Float3.h"
 
 // The CLProgram manages all interactions of the application with the 3D graphics
 // engine and the GPU compute schedule. 
 
+// It is one of the render program backends. See the CPUProgram for machines without
+// a usable OpenCL device.
+
 // This object should be kept alive while the game data object is alive. Otherwise, 
 // it would reload the kernel whenever the game world panel was re-entered, which 
 // is unnecessary.
@@ -23,6 +42,9 @@
 // When resizing buffers, the old data either needs to be copied to a temp buffer, 
 // or reloaded completely using the managed IDs to access data, etc..
 
+// Sprites are now managed by the render world's SpriteHeap, which is the heap manager
+// imagined below. The notes are kept for the reasoning behind it.
+
 // To effectively manage sprites, the CLProgram must know:
 // - Sprite positions and directions.
 // - List of voxel coordinates per sprite rectangle.
@@ -51,47 +73,307 @@
 // The more I think about sprite management, the more it feels like a heap manager. I'll
 // probably need to draw this on paper to see how it really works out.
 
+// With a device split, each frame is cut into horizontal bands, one per device or 
+// sub-device, that share one context. The world buffers are shared, but each band has
+// its own queue, kernels, and per-pixel buffers, so no two devices ever write to the
+// same buffer. World writes go through the main queue, and the bands wait on a marker
+// behind them. Band heights follow the measured device times (see BandBalancer).
+
+// Frames are only drawn again where something changed. If the camera, the time of day,
+// and the world are all the same as last frame, the last frame is shown again without
+// running any kernels or updating the texture. World changes only redraw the tiles of
+// the frame they can be seen in, including the shadows they cast (see DirtyTiles). 
+// The lean kernels can also shade the whole frame again for a new time of day without
+// tracing any rays. The kernel.cl kernels and device splits always draw whole frames.
+
+// With rasterized sprites, the lean kernels' traced frame has no sprites in it. They
+// are sorted and binned into screen tiles on the host (see SpriteTiles), and a sprite
+// kernel draws them over the shaded pixels where they're nearer than the depths.
+
+class RenderProfiler;
 class Renderer;
 class TextureManager;
 
 struct SDL_Texture;
 
-class CLProgram
+class CLProgram : public RenderProgram
 {
 private:
 	static const std::string PATH;
 	static const std::string FILENAME;
+	static const std::string BINARY_PREFIX;
+	static const std::string BINARY_EXTENSION;
 	static const std::string INTERSECT_KERNEL;
 	static const std::string RAY_TRACE_KERNEL;
 	static const std::string POST_PROCESS_KERNEL;
 	static const std::string CONVERT_TO_RGB_KERNEL;
+	static const std::string BUILD_OPTIONS;
+
+	// Rows of the frame rendered by one device of a device split.
+	struct RenderBand
+	{
+		cl::Device device;
+		cl::CommandQueue commandQueue; // Always profiled, for load balancing.
+		cl::Kernel leanIntersectKernel, leanShadeKernel, fusedKernel;
+		cl::Buffer depthBuffer, hitBuffer, outputBuffer; // Full size; only its rows are used.
+		cl::Event startEvent, readEvent; // First kernel and output read of the frame.
+		int startRow, rowCount;
+	};
 
-	cl::Device device; // The device selected from the devices list.
+	cl::Device device; // The device selected from the devices list (first band's if split).
 	cl::Context context;
 	cl::CommandQueue commandQueue;
 	cl::Program program;
-	cl::Kernel intersectKernel, rayTraceKernel, convertToRGBKernel;
+	cl::Kernel intersectKernel, rayTraceKernel, convertToRGBKernel; // Full mode.
+	cl::Kernel leanIntersectKernel, leanShadeKernel, fusedKernel; // Lean and fused modes.
+	cl::Kernel reprojectKernel, reuseViewKernel; // Lean mode with reprojection.
+	cl::Kernel refineCornersKernel, refineKernel; // Lean mode with edge refinement.
+	cl::Kernel spritesKernel; // Lean mode with rasterized sprites.
 	cl::Buffer cameraBuffer, voxelRefBuffer, spriteRefBuffer, lightRefBuffer,
 		rectangleBuffer, lightBuffer, textureBuffer, gameTimeBuffer, depthBuffer,
 		normalBuffer, viewBuffer, pointBuffer, uvBuffer, rectangleIndexBuffer, 
-		colorBuffer, outputBuffer;
-	std::vector<char> outputData; // For receiving pixels from the device's output buffer.
-	SDL_Texture *texture; // Streaming render texture for outputData to update.
+		colorBuffer, hitBuffer, paletteBuffer, chunkOccupancyBuffer, spriteRectangleBuffer,
+		lightIndexBuffer;
+	std::array<cl::Buffer, 2> outputBuffers; // The second one is only for pipelining.
+	std::array<cl::Event, 2> mapEvents; // Signaled when an output buffer is mapped.
+	std::array<void*, 2> mappedOutputs; // Host pointers of output buffers not yet shown.
+	std::array<int, 2> outputWidths, outputHeights; // Frame dimensions in each output buffer.
+	cl::Buffer frameConstantsBuffer; // Camera and game time; the kernels see sub-buffers.
+	cl::Buffer frameStagingBuffer; // Ring of frame constants slots in pinned host memory.
+	cl_char *frameStagingData; // The staging ring, mapped for the program's lifetime.
+	std::vector<cl::Event> frameSlotEvents; // Signaled when a slot's write is done with it.
+	cl::size_type frameConstantsSize, gameTimeOffset; // In bytes.
+	int frameSlot; // Staging slot the next frame's constants are written into.
+	bool frameConstantsDirty; // Whether the slot has changes to write.
+	SDL_Texture *texture; // Streaming render texture that frames are read straight into.
 	TextureManager &textureManager;
-	int renderWidth, renderHeight, worldWidth, worldHeight, worldDepth;
+	RenderWorld world; // Host copy of the geometry and textures in device memory.
+	TexturePool texturePool; // Where the used textures are in the texture buffer.
+	ResolutionScaler resolutionScaler;
+	std::vector<char> voxelRefData, rectangleData, textureData, paletteData,
+		chunkOccupancyData, spriteRefData, spriteRectangleData, lightRefData, lightIndexData,
+		lightData; // In the kernel's format.
+	std::vector<cl::Event> writeEvents; // Pending world writes for the kernels to wait on.
+	cl::Buffer rasterSpriteBuffer, spriteTileRangeBuffer, spriteTileSpriteBuffer;
+	std::vector<char> rasterSpriteData, spriteTileRangeData,
+		spriteTileSpriteData; // This frame's sorted sprites and tile lists.
+	std::vector<cl::Event> spriteWriteEvents; // Pending sprite writes.
+	cl::size_type rasterSpriteCapacity, spriteTileRangeCapacity,
+		spriteTileSpriteCapacity; // Sprite buffer sizes in elements.
+	SpriteTiles spriteTiles; // Rasterized sprites sorted and binned for this frame.
+	cl::size_type rectangleCapacity, texelCapacity, spriteRectangleCapacity,
+		lightIndexCapacity, lightCapacity; // Device buffer sizes in elements.
+	cl::size_type texelSize; // Bytes per texel in the texture buffer.
+	int renderWidth, renderHeight; // Per-pixel buffer dimensions, at the max render quality.
+	int frameWidth, frameHeight; // Dimensions of the frame being rendered.
+	int worldWidth, worldHeight, worldDepth;
+	int outputIndex; // Output buffer the next frame is written to.
+	int fullProgramWidth, fullProgramHeight; // Render size kernel.cl was built with.
+	bool fullSizeArgs; // Whether the kernel.cl kernels take the frame size as arguments.
+	bool pipelined; // Whether frames are shown one frame late for more throughput.
+	CLKernelMode kernelMode; // Which kernels run each frame.
+	std::unique_ptr<RenderProfiler> profiler; // Null unless profiled.
+	std::vector<std::pair<std::string, cl::Event>> profileEvents; // Not yet timed.
+	std::vector<RenderBand> bands; // Empty unless the frame is split across devices.
+	std::unique_ptr<BandBalancer> bandBalancer; // Null unless split.
+	cl::Buffer previousCameraBuffer, previousDepthBuffer, previousHitBuffer; // Last frame's.
+	cl::Buffer reuseBuffer, reuseCountBuffer; // Reuse (or fill) flag per pixel, and counts.
+	cl::Buffer cornerDepthBuffer, cornerHitBuffer; // Edge refinement's block corners.
+	std::array<cl_uint, 2> reuseCounts; // Host copy of the counts of a debug view frame.
+	cl::Event reuseCountEvent; // Signaled when the counts are read; null if not reading.
+	cl_ulong reusedTotal, tracedTotal; // Counted since the last mention.
+	cl::Buffer stepCountBuffer; // Rays and grid steps of a frame, for the lean kernels.
+	std::array<cl_uint, 2> stepCounts; // Host copy of the last counted frame's.
+	cl::Event stepCountEvent; // Signaled when the counts are read; null if not reading.
+	cl_ulong rayTotal, stepTotal; // Counted since the last reset.
+	bool stepCounted; // Whether the lean kernels count rays and grid steps.
+	int previousWidth, previousHeight; // Dimensions of last frame's depths and hits.
+	int refreshPhase; // Picks the rows that are traced in full this frame.
+	int reuseFrameCount; // Debug view frames counted since the last mention.
+	int refineBlockSize; // Pixels per side of an edge refinement block; 1 if off.
+	bool reprojected; // Whether the lean intersect reuses last frame's hits.
+	bool previousValid; // Whether last frame's depths and hits can be reused.
+	bool debugView; // Whether reuse is shown and counted.
+	DirtyTiles dirtyTiles; // Parts of the last frame that world changes touched.
+	double gameTime, shadedGameTime; // Latest game time, and the last frame's.
+	int presentedWidth, presentedHeight; // Dimensions of the frame in the texture.
+	bool cameraChanged; // Whether the camera moved since the last frame.
+	bool frameValid; // Whether the last frame can be drawn onto instead of replaced.
+	bool worldChanged; // Whether the world changed since the depths and hits were traced.
+
+	// Gets the devices to split frames across, or just the given devices' first one if
+	// the split doesn't apply.
+	static std::vector<cl::Device> getSplitDevices(const std::vector<cl::Device> &devices,
+		CLDeviceSplit deviceSplit);
+
+	// Makes the program from a cached binary if one matches the device, driver, source
+	// and options. Otherwise it builds from source and caches the binary. Programs for
+	// a device split are always built from source.
+	void buildProgram(const std::vector<cl::Device> &devices, const std::string &source,
+		const std::string &options);
+
+	// Gets the #defines for the world and chunk dimensions and the voxel layout that
+	// every program's source starts with.
+	std::string getWorldDefines() const;
+
+	// Builds kernel.cl with the current render dimensions as defines and creates its
+	// kernels. If they take the frame dimensions as arguments instead, it's kept after
+	// a resize; otherwise it's built again for each new size.
+	void buildFullProgram();
 
 	std::string getBuildReport() const;
 	std::string getErrorString(cl_int error) const;
 
-	// For testing purposes before using actual world data.
-	void makeTestWorld();
+	// Waits for all device work and unmaps any output buffers still mapped.
+	void finishFrames();
+
+	// Returns an event for an enqueue to signal if profiling, so its device time is
+	// sampled once it's done. Otherwise returns null so no event is made.
+	cl::Event *makeProfileEvent(const std::string &stageName);
+
+	// Samples the device time of an event the program keeps anyway, if profiling.
+	void addProfileEvent(const std::string &stageName, const cl::Event &event);
+
+	// Samples the time between the given start time and now as a host stage.
+	void addHostSample(const std::string &stageName,
+		const std::chrono::high_resolution_clock::time_point &startTime);
+
+	// Locks the given rows of the top-left of the texture for writing and returns the
+	// first row's pixels. Rows outside the range are left as they were in the texture.
+	void *lockTextureRows(int width, int startRow, int endRow, int *pitch);
+
+	// Reads rows of an output buffer packed at the frame width into locked texture
+	// pixels with the given pitch.
+	void enqueueReadRows(const cl::CommandQueue &queue, const cl::Buffer &buffer,
+		int width, int startRow, int rowCount, void *pixels, int pitch, cl_bool blocking,
+		cl::Event *event);
+
+	// Unlocks the texture and stretches the frame over the native frame buffer.
+	void presentTexture(int width, int height, Renderer &renderer);
+
+	// Copies a whole frame's pixels packed at its width into the texture and presents
+	// it.
+	void presentOutput(const void *pixels, int width, int height, Renderer &renderer);
+
+	// Shows a frame that pipelined rendering mapped earlier, and unmaps it.
+	void presentMappedOutput(int index, Renderer &renderer);
+
+	// Shows the last frame again, for when nothing changed since it was rendered.
+	void presentLastFrame(Renderer &renderer);
+
+	// Gets the staging slot that the camera and game time are written into.
+	cl_char *getFrameSlot() const;
+
+	// Writes the frame constants slot to device memory with one non-blocking transfer,
+	// if anything in it changed, and moves on to the next slot.
+	void submitFrameConstants();
+
+	// Gives the time since the start of the frame to the resolution scaler.
+	void updateResolution(const std::chrono::high_resolution_clock::time_point &startTime);
+
+	// Samples the device times of the profiled commands that are done, without
+	// waiting for any that aren't.
+	void collectProfileEvents();
+
+	// Returns whether the time of day changed the shading enough since the last frame
+	// to be worth shading again. Nights look the same all the way through.
+	bool isShadingChanged() const;
+
+	// Marks the tiles of the frame that the world changes since the last frame can be
+	// seen in, or every tile if it can't tell.
+	void findDirtyTiles();
+
+	// Runs a kernel over each rectangle of the frame. The first launch waits on the
+	// given events, and then the pointer is set to null.
+	void enqueueRects(cl::Kernel &kernel, const std::vector<Rect> &rects,
+		const std::vector<cl::Event> *&waitEvents, const std::string &stageName);
+
+	// Gets the kernels of the current mode that take the lean kernel arguments,
+	// including every band's.
+	std::vector<cl::Kernel*> getLeanKernels();
+
+	// Makes a queue and kernels of the current mode for each device of a device split.
+	void createBands(const std::vector<cl::Device> &bandDevices);
+
+	// Gives the camera, world, and game time buffers to the kernels.
+	void bindWorldBuffers();
+
+	// Creates the buffers whose size depends on the render dimensions, and gives 
+	// them to the kernels.
+	void createPixelBuffers();
+
+	// Compiles the pass graph of a frame's transient buffers and makes one buffer per
+	// allocation. Resource IDs index the returned buffers through the graph.
+	std::vector<cl::Buffer> createTransientBuffers(PassGraph &passGraph);
+
+	// Changes the dimensions of the frames being rendered, which can be anything up to
+	// the render dimensions. The per-pixel buffers are used as if they were that size.
+	void setFrameDimensions(int frameWidth, int frameHeight);
+
+	// Reallocates the rectangle, sprite rectangle, light index, light, and texture
+	// buffers if the world outgrew them.
+	void growBuffers();
+
+	// Converts the dirty ranges of the render world to the kernel's struct layout and
+	// writes only those bytes to the voxel reference, rectangle, texture, chunk 
+	// occupancy, sprite, and light buffers. Moving a sprite or light only writes the
+	// references and rectangles or indices of the voxels it touched.
+	// The lean kernels look texels up in the palette buffer, so a palette change is 
+	// only a 4 KB write for them. The kernel.cl kernels need every texel rewritten.
+	void updateWorld();
+
+	// Swaps this frame's depths and hits with last frame's and gives both to the 
+	// kernels.
+	void swapReprojectionBuffers();
+
+	// Runs the reprojection kernel in place of the lean intersect kernel, reusing last
+	// frame's hits unless there are none or the world changed since.
+	void enqueueReprojection(const cl::NDRange &workDims,
+		const std::vector<cl::Event> *waitEvents);
+
+	// Sorts and bins the rasterized sprites for this frame, and writes them and each
+	// tile's list of them to device memory. Returns whether any can be seen.
+	bool updateSprites();
+
+	// Adds up the reuse counts of the last debug view frame once they're read, and
+	// mentions the share of reused (or filled) pixels every so often.
+	void collectReuseCounts();
+
+	// Adds up the last counted frame's rays and steps once they're read.
+	void collectStepCounts();
+
+	// Gets the rectangles of block corners that edge refinement traces for the given
+	// pixel rectangles.
+	std::vector<Rect> getCornerRects(const std::vector<Rect> &rects) const;
+
+	// Renders each band of the frame on its own device and shows the frame once all
+	// of them are done, then rebalances the band heights.
+	void renderBands(Renderer &renderer,
+		const std::chrono::high_resolution_clock::time_point &renderStartTime);
 public:
-	// Constructor for the OpenCL render program.
+	// Constructor for the OpenCL render program. When pipelined, each frame's kernels
+	// are enqueued before the previous frame's pixels are copied to the screen, so the
+	// copy overlaps with device work at the cost of one frame of latency. The kernel
+	// mode picks between the kernel.cl kernels and the bandwidth-lean ones. When
+	// profiled, the command queue records the start and end of every kernel and 
+	// transfer, which costs a little driver overhead per command. Each frame is 
+	// rendered at a quality between the min and max quality that holds the target 
+	// frame time (see ResolutionScaler). A device split needs the lean or fused kernels
+	// and isn't pipelined. When reprojected, the lean kernels reuse last frame's hits
+	// where they still hold, which only works on one device. With a refine block size
+	// over 1, the lean kernels only trace one ray per block of pixels and the pixels
+	// of blocks whose corners disagree, which also only works on one device and not 
+	// with reprojection. The voxel layout is the order of the per-voxel buffers, and 
+	// is always linear for the kernel.cl kernels. Sprites can only be rasterized by
+	// the lean kernels on one device, and are traced otherwise. Steps can only be
+	// counted by the lean or fused kernels on one device.
 	CLProgram(int worldWidth, int worldHeight, int worldDepth,
-		TextureManager &textureManager, Renderer &renderer, double renderQuality);
-	~CLProgram();
-
-	CLProgram &operator=(CLProgram &&clProgram);
+		TextureManager &textureManager, Renderer &renderer, double minRenderQuality,
+		double maxRenderQuality, double targetFrameTime, bool pipelined,
+		CLKernelMode kernelMode, CLDeviceSplit deviceSplit, bool reprojected,
+		int refineBlockSize, VoxelLayout voxelLayout, SpriteMode spriteMode,
+		bool chunkSkipping, bool stepCounted, bool profiled);
+	virtual ~CLProgram();
 
 	// These are public in case the options menu is going to need to list them.
 	// There should be a constructor that also takes a platform and device, then.
@@ -99,13 +381,28 @@ public:
 	static std::vector<cl::Device> getDevices(const cl::Platform &platform,
 		cl_device_type type);
 
-	void updateCamera(const Float3d &eye, const Float3d &direction, double fovY);
-
-	// Give this method total ticks instead of delta time so the constructor doesn't
-	// need a "start time". Also, this prevents any additive "double -> float" error.
-	void updateGameTime(double gameTime);
-
-	void render(Renderer &renderer);
+	virtual const RenderProfiler *getProfiler() const override;
+	virtual void resetProfiler(int windowSize) override;
+	virtual void waitForFrames() override;
+	virtual bool hasDebugView() const override;
+	virtual void setDebugView(bool debugView) override;
+	virtual double getAverageStepsPerRay() override;
+	virtual void resetStepCounts() override;
+	virtual void updateCamera(const Float3d &eye, const Float3d &direction,
+		double fovY) override;
+	virtual void updateGameTime(double gameTime) override;
+	virtual void resize(int renderWidth, int renderHeight, Renderer &renderer) override;
+	virtual void setVoxel(int cellX, int cellY, int cellZ,
+		const std::vector<Rect3D> &rectangles, int textureID) override;
+	virtual int addSprite(const Rect3D &rectangle, int textureID) override;
+	virtual void moveSprite(int spriteID, const Rect3D &rectangle, int textureID) override;
+	virtual void removeSprite(int spriteID) override;
+	virtual int addLight(const Float3f &position, const Float3f &color,
+		float radius) override;
+	virtual void moveLight(int lightID, const Float3f &position) override;
+	virtual void setLightEnabled(int lightID, bool enabled) override;
+	virtual void removeLight(int lightID) override;
+	virtual void render(Renderer &renderer) override;
 };
 
 #endif
@@ -0,0 +1,932 @@
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <functional>
+
+#include "SDL.h"
+
+#include "CPUProgram.h"
+
+#include "RenderProfiler.h"
+#include "Renderer.h"
+#include "../Entities/Directable.h"
+#include "../Math/Constants.h"
+#include "../Math/Int2.h"
+#include "../Media/TextureManager.h"
+#include "../Utilities/Debug.h"
+#include "../Utilities/ThreadPool.h"
+#include "../World/Chunk.h"
+
+namespace
+{
+	typedef std::array<float, 3> Vec3;
+
+	// Ray offset for avoiding self-intersection with the surface a ray starts on.
+	const float RAY_EPSILON = 1.0e-4f;
+
+	// Real-time seconds in one game day. The sun starts in the morning.
+	const double SECONDS_PER_DAY = 120.0;
+	const double SUN_START_ANGLE = PI * 0.25;
+
+	// Sky colors at midday and midnight.
+	const Vec3 DAY_SKY_COLOR = { 0.55f, 0.70f, 0.95f };
+	const Vec3 NIGHT_SKY_COLOR = { 0.02f, 0.02f, 0.08f };
+
+	Vec3 toVec3(const Float3d &v)
+	{
+		return Vec3{ static_cast<float>(v.getX()), static_cast<float>(v.getY()),
+			static_cast<float>(v.getZ()) };
+	}
+
+	Vec3 toVec3(const Float3f &v)
+	{
+		return Vec3{ v.getX(), v.getY(), v.getZ() };
+	}
+
+	inline float dot(const Vec3 &a, const Vec3 &b)
+	{
+		return (a[0] * b[0]) + (a[1] * b[1]) + (a[2] * b[2]);
+	}
+
+	inline Vec3 normalized(const Vec3 &v)
+	{
+		const float lengthRecip = 1.0f / std::sqrt(dot(v, v));
+		return Vec3{ v[0] * lengthRecip, v[1] * lengthRecip, v[2] * lengthRecip };
+	}
+
+	inline float clamp01(float value)
+	{
+		return std::min(std::max(value, 0.0f), 1.0f);
+	}
+
+	// Converts a color with 0-1 components to an opaque ARGB8888 pixel.
+	inline uint32_t toARGB(float r, float g, float b)
+	{
+		return 0xFF000000 |
+			(static_cast<uint32_t>(clamp01(r) * 255.0f) << 16) |
+			(static_cast<uint32_t>(clamp01(g) * 255.0f) << 8) |
+			static_cast<uint32_t>(clamp01(b) * 255.0f);
+	}
+}
+
+const int CPUProgram::TILE_WIDTH = 32;
+const int CPUProgram::TILE_HEIGHT = 16;
+
+CPUProgram::CPUProgram(int worldWidth, int worldHeight, int worldDepth,
+	TextureManager &textureManager, Renderer &renderer, double minRenderQuality,
+	double maxRenderQuality, double targetFrameTime, VoxelLayout voxelLayout,
+	SpriteMode spriteMode, bool chunkSkipping, bool stepCounted, bool profiled)
+	: world(worldWidth, worldHeight, worldDepth, voxelLayout),
+	resolutionScaler(minRenderQuality, maxRenderQuality, targetFrameTime)
+{
+	Debug::mention("CPUProgram", "Initializing.");
+
+	const int screenWidth = renderer.getWindowDimensions().getX();
+	const int screenHeight = renderer.getWindowDimensions().getY();
+
+	// Render dimensions for ray tracing. To prevent issues when the user shrinks
+	// the window down too far, clamp them to at least 1.
+	// The texture is big enough for the max quality, and lower quality frames only 
+	// use the top-left part of it.
+	this->renderWidth = std::max(static_cast<int>(screenWidth * maxRenderQuality), 1);
+	this->renderHeight = std::max(static_cast<int>(screenHeight * maxRenderQuality), 1);
+	this->frameWidth = this->renderWidth;
+	this->frameHeight = this->renderHeight;
+	this->skipEmptyChunks = chunkSkipping;
+	this->stepCounted = stepCounted;
+	this->traceCounts = TraceCounts{ 0, 0 };
+
+	// Create streaming texture to be used as the game world frame buffer.
+	this->texture = renderer.createTexture(SDL_PIXELFORMAT_ARGB8888,
+		SDL_TEXTUREACCESS_STREAMING, this->renderWidth, this->renderHeight);
+	Debug::check(this->texture != nullptr, "CPUProgram", "SDL_CreateTexture");
+
+	// One thread per hardware thread.
+	this->threadPool = std::unique_ptr<ThreadPool>(new ThreadPool(0));
+	Debug::mention("CPUProgram", "Using " +
+		std::to_string(this->threadPool->getThreadCount()) + " render thread(s).");
+
+	if (profiled)
+	{
+		this->profiler = std::unique_ptr<RenderProfiler>(
+			new RenderProfiler(RenderProfiler::DEFAULT_WINDOW_SIZE));
+	}
+
+	this->world.setSpriteMode(spriteMode);
+
+	// --- TESTING PURPOSES ---
+	// The following code is for testing. Remove it once using actual world data.
+
+	this->world.makeTestWorld(textureManager);
+
+	// --- END TESTING ---
+
+	this->updateTraceRectangles();
+
+	// Some default camera values until the game world panel sets them.
+	this->updateCamera(Float3d(1.5, 1.5, 1.5), Float3d(0.0, 0.0, 1.0), 90.0);
+	this->updateGameTime(0.0);
+}
+
+CPUProgram::~CPUProgram()
+{
+	// Destroy the game world frame buffer.
+	// The SDL_Renderer destroys this itself with SDL_DestroyRenderer(), too.
+	SDL_DestroyTexture(this->texture);
+}
+
+void CPUProgram::makeTraceRectangle(const Rect3D &rect, int textureID,
+	TraceRectangle &traceRect)
+{
+	const Vec3 p1 = toVec3(rect.getP1());
+	const Vec3 p2 = toVec3(rect.getP2());
+	const Vec3 p3 = toVec3(rect.getP3());
+
+	traceRect.p1 = p1;
+	traceRect.p1p2 = Vec3{ p2[0] - p1[0], p2[1] - p1[1], p2[2] - p1[2] };
+	traceRect.p2p3 = Vec3{ p3[0] - p2[0], p3[1] - p2[1], p3[2] - p2[2] };
+	traceRect.textureID = textureID;
+
+	// Degenerate rectangles are never intersected.
+	const float p1p2LengthSq = dot(traceRect.p1p2, traceRect.p1p2);
+	const float p2p3LengthSq = dot(traceRect.p2p3, traceRect.p2p3);
+	const bool degenerate = (p1p2LengthSq == 0.0f) || (p2p3LengthSq == 0.0f);
+	traceRect.p1p2InvLengthSq = degenerate ? 0.0f : (1.0f / p1p2LengthSq);
+	traceRect.p2p3InvLengthSq = degenerate ? 0.0f : (1.0f / p2p3LengthSq);
+	traceRect.normal = degenerate ? Vec3{ 0.0f, 0.0f, 0.0f } : toVec3(rect.getNormal());
+}
+
+void CPUProgram::updateTraceRectangles()
+{
+	// Convert the rectangle at the given index.
+	auto updateTraceRectangle = [](const std::vector<Rect3D> &rectangles,
+		const std::vector<int> &textureIDs, std::vector<TraceRectangle> &traceRectangles,
+		int i)
+	{
+		CPUProgram::makeTraceRectangle(rectangles.at(i), textureIDs.at(i),
+			traceRectangles.at(i));
+	};
+
+	// Only look at rectangles that changed since last time.
+	const auto &rectangles = this->world.getRectangles();
+	const auto &textureIDs = this->world.getRectangleTextureIDs();
+	this->traceRectangles.resize(rectangles.size());
+
+	for (const auto &range : this->world.getDirtyRectangles().getCoalesced())
+	{
+		for (int i = range.first; i < (range.first + range.second); ++i)
+		{
+			updateTraceRectangle(rectangles, textureIDs, this->traceRectangles, i);
+		}
+	}
+
+	const SpriteHeap &spriteHeap = this->world.getSpriteHeap();
+	const auto &spriteRectangles = spriteHeap.getRectangles();
+	const auto &spriteTextureIDs = spriteHeap.getRectangleTextureIDs();
+	this->traceSpriteRectangles.resize(spriteRectangles.size());
+
+	for (const auto &range : spriteHeap.getDirtyRectangles().getCoalesced())
+	{
+		for (int i = range.first; i < (range.first + range.second); ++i)
+		{
+			updateTraceRectangle(spriteRectangles, spriteTextureIDs,
+				this->traceSpriteRectangles, i);
+		}
+	}
+
+	const LightManager &lightManager = this->world.getLightManager();
+	const auto &lights = lightManager.getLights();
+	this->traceLights.resize(lights.size());
+
+	for (const auto &range : lightManager.getDirtyLights().getCoalesced())
+	{
+		for (int i = range.first; i < (range.first + range.second); ++i)
+		{
+			const PointLight &light = lights.at(i);
+			TraceLight &traceLight = this->traceLights.at(i);
+			traceLight.position = toVec3(light.getPosition());
+			traceLight.color = toVec3(light.getColor());
+			traceLight.radius = light.getRadius();
+		}
+	}
+
+	if (this->world.isPaletteDirty())
+	{
+		const Palette &palette = this->world.getPalette();
+		for (int i = 0; i < static_cast<int>(palette.size()); ++i)
+		{
+			this->paletteColors[i] = palette[i].toARGB();
+		}
+	}
+
+	// Voxel, sprite, and light references, light indices, and texels are read straight
+	// from the render world.
+	this->world.clearDirtyRanges();
+}
+
+bool CPUProgram::intersectRectangles(const std::vector<TraceRectangle> &rectangles,
+	int offset, int count, const Vec3 &origin, const Vec3 &direction, float maxT,
+	Hit &hit) const
+{
+	const auto &textureRefs = this->world.getTextureReferences();
+	const auto &texels = this->world.getTexels();
+
+	bool found = false;
+	for (int i = offset; i < (offset + count); ++i)
+	{
+		const TraceRectangle &rect = rectangles[i];
+		const float denominator = dot(direction, rect.normal);
+		if (denominator == 0.0f)
+		{
+			continue;
+		}
+
+		const Vec3 diff = { rect.p1[0] - origin[0], rect.p1[1] - origin[1],
+			rect.p1[2] - origin[2] };
+		const float t = dot(diff, rect.normal) / denominator;
+		if ((t <= RAY_EPSILON) || (t >= hit.t) || (t > maxT))
+		{
+			continue;
+		}
+
+		const Vec3 point = { origin[0] + (direction[0] * t),
+			origin[1] + (direction[1] * t), origin[2] + (direction[2] * t) };
+		const Vec3 local = { point[0] - rect.p1[0], point[1] - rect.p1[1],
+			point[2] - rect.p1[2] };
+
+		// Texture coordinates are inferred from the rectangle's points.
+		const float u = dot(local, rect.p2p3) * rect.p2p3InvLengthSq;
+		const float v = dot(local, rect.p1p2) * rect.p1p2InvLengthSq;
+		if ((u < 0.0f) || (u > 1.0f) || (v < 0.0f) || (v > 1.0f))
+		{
+			continue;
+		}
+
+		const TextureReference &textureRef = textureRefs[rect.textureID];
+		const int textureWidth = textureRef.getWidth();
+		const int textureHeight = textureRef.getHeight();
+		const int textureX = std::min(static_cast<int>(u * textureWidth),
+			textureWidth - 1);
+		const int textureY = std::min(static_cast<int>(v * textureHeight),
+			textureHeight - 1);
+		const uint8_t texel = texels[textureRef.getOffset() + textureX +
+			(textureY * textureWidth)];
+
+		// Index 0 is transparent.
+		if (texel == 0)
+		{
+			continue;
+		}
+
+		// Make the normal face the ray.
+		const float normalSign = (denominator < 0.0f) ? 1.0f : -1.0f;
+
+		hit.t = t;
+		hit.point = point;
+		hit.normal = Vec3{ rect.normal[0] * normalSign, rect.normal[1] * normalSign,
+			rect.normal[2] * normalSign };
+		hit.texel = this->paletteColors[texel];
+		found = true;
+	}
+
+	return found;
+}
+
+void CPUProgram::updateRasterSprites()
+{
+	const auto &spriteRectangles = this->world.getSpriteRectangles();
+	const auto &spriteTextureIDs = this->world.getSpriteTextureIDs();
+	this->spriteTiles.update(spriteRectangles, this->world.getActiveSprites(),
+		this->frameWidth, this->frameHeight);
+
+	const auto &spriteIDs = this->spriteTiles.getSpriteIDs();
+	this->traceRasterSprites.resize(spriteIDs.size());
+	for (size_t i = 0; i < spriteIDs.size(); ++i)
+	{
+		const int spriteID = spriteIDs.at(i);
+		CPUProgram::makeTraceRectangle(spriteRectangles.at(spriteID),
+			spriteTextureIDs.at(spriteID), this->traceRasterSprites.at(i));
+	}
+}
+
+bool CPUProgram::intersectRasterSprites(int x, int y, const Vec3 &direction,
+	Hit &hit) const
+{
+	const std::pair<int, int> &tileRange = this->spriteTiles.getTileRanges()[
+		(x / SpriteTiles::TILE_SIZE) +
+		((y / SpriteTiles::TILE_SIZE) * this->spriteTiles.getTileCountX())];
+	const auto &tileSprites = this->spriteTiles.getTileSprites();
+
+	// The tile's sprites are farthest first, so going through them backwards, the 
+	// first opaque texel nearer than the hit is the one that would be drawn last.
+	for (int i = tileRange.first + tileRange.second - 1; i >= tileRange.first; --i)
+	{
+		if (this->intersectRectangles(this->traceRasterSprites, tileSprites[i], 1,
+			this->eye, direction, FLT_MAX, hit))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool CPUProgram::castRay(const Vec3 &origin, const Vec3 &direction, Hit &hit,
+	TraceCounts *counts) const
+{
+	if (counts != nullptr)
+	{
+		counts->rayCount++;
+	}
+
+	const std::array<int, 3> gridSize =
+	{
+		this->world.getWidth(), this->world.getHeight(), this->world.getDepth()
+	};
+
+	// Clip the ray against the voxel grid's bounding box.
+	float tStart = 0.0f;
+	float tEnd = FLT_MAX;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		const float bound = static_cast<float>(gridSize[axis]);
+		if (direction[axis] == 0.0f)
+		{
+			if ((origin[axis] < 0.0f) || (origin[axis] > bound))
+			{
+				return false;
+			}
+		}
+		else
+		{
+			const float t1 = -origin[axis] / direction[axis];
+			const float t2 = (bound - origin[axis]) / direction[axis];
+			tStart = std::max(tStart, std::min(t1, t2));
+			tEnd = std::min(tEnd, std::max(t1, t2));
+		}
+	}
+
+	if (tStart > tEnd)
+	{
+		return false;
+	}
+
+	// Set up the 3D-DDA walk from the voxel the ray starts in.
+	std::array<int, 3> cell, step;
+	std::array<float, 3> tMax, tDelta;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		const float start = origin[axis] + (direction[axis] * tStart);
+		cell[axis] = std::min(std::max(static_cast<int>(std::floor(start)), 0),
+			gridSize[axis] - 1);
+
+		if (direction[axis] > 0.0f)
+		{
+			step[axis] = 1;
+			tDelta[axis] = 1.0f / direction[axis];
+			tMax[axis] = (static_cast<float>(cell[axis] + 1) - origin[axis]) / direction[axis];
+		}
+		else if (direction[axis] < 0.0f)
+		{
+			step[axis] = -1;
+			tDelta[axis] = -1.0f / direction[axis];
+			tMax[axis] = (static_cast<float>(cell[axis]) - origin[axis]) / direction[axis];
+		}
+		else
+		{
+			step[axis] = 0;
+			tDelta[axis] = FLT_MAX;
+			tMax[axis] = FLT_MAX;
+		}
+	}
+
+	const auto &voxelRefs = this->world.getVoxelReferences();
+	const auto &spriteRefs = this->world.getSpriteHeap().getSpriteReferences();
+	const auto &chunkOccupancy = this->world.getChunkOccupancy();
+	const bool tiled = this->world.getVoxelIndexer().getLayout() == VoxelLayout::Tiled;
+	const std::array<int, 3> chunkSize = { Chunk::Width, Chunk::Height, Chunk::Depth };
+	const int chunkCountX = this->world.getChunkCountX();
+	const int chunkSlice = chunkCountX * this->world.getChunkCountY();
+
+	while (true)
+	{
+		if (counts != nullptr)
+		{
+			counts->stepCount++;
+		}
+
+		if (this->skipEmptyChunks)
+		{
+			const int chunkIndex = (cell[0] / chunkSize[0]) +
+				((cell[1] / chunkSize[1]) * chunkCountX) +
+				((cell[2] / chunkSize[2]) * chunkSlice);
+
+			if (((chunkOccupancy[chunkIndex / 32] >> (chunkIndex % 32)) & 1) == 0)
+			{
+				// Find where the ray leaves the chunk. Chunks on the far edges of the
+				// grid can be cut short.
+				std::array<int, 3> chunkMin, chunkMax;
+				int exitAxis = 0;
+				float tExit = FLT_MAX;
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					chunkMin[axis] = (cell[axis] / chunkSize[axis]) * chunkSize[axis];
+					chunkMax[axis] = std::min(chunkMin[axis] + chunkSize[axis],
+						gridSize[axis]);
+
+					if (step[axis] != 0)
+					{
+						const int boundary = (step[axis] > 0) ?
+							chunkMax[axis] : chunkMin[axis];
+						const float t = (static_cast<float>(boundary) - origin[axis]) /
+							direction[axis];
+						if (t < tExit)
+						{
+							tExit = t;
+							exitAxis = axis;
+						}
+					}
+				}
+
+				if (tExit > tEnd)
+				{
+					return false;
+				}
+
+				// Continue from the first voxel past the chunk on the exit axis, and the
+				// voxel the ray is in on the other axes.
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					if (axis == exitAxis)
+					{
+						cell[axis] = (step[axis] > 0) ?
+							chunkMax[axis] : (chunkMin[axis] - 1);
+						if ((cell[axis] < 0) || (cell[axis] >= gridSize[axis]))
+						{
+							return false;
+						}
+					}
+					else
+					{
+						const float exitPoint = origin[axis] + (direction[axis] * tExit);
+						cell[axis] = std::min(std::max(static_cast<int>(std::floor(exitPoint)),
+							chunkMin[axis]), chunkMax[axis] - 1);
+					}
+
+					if (step[axis] > 0)
+					{
+						tMax[axis] = (static_cast<float>(cell[axis] + 1) - origin[axis]) /
+							direction[axis];
+					}
+					else if (step[axis] < 0)
+					{
+						tMax[axis] = (static_cast<float>(cell[axis]) - origin[axis]) /
+							direction[axis];
+					}
+				}
+
+				continue;
+			}
+		}
+
+		const int voxelIndex = tiled ?
+			getTiledVoxelIndex(cell[0], cell[1], cell[2], gridSize[0], gridSize[1]) :
+			getLinearVoxelIndex(cell[0], cell[1], cell[2], gridSize[0], gridSize[1]);
+		const VoxelReference &voxelRef = voxelRefs[voxelIndex];
+		const SpriteReference &spriteRef = spriteRefs[voxelIndex];
+		const int rectangleCount = voxelRef.getRectangleCount();
+		const int spriteCount = spriteRef.getRectangleCount();
+
+		if ((rectangleCount > 0) || (spriteCount > 0))
+		{
+			// Geometry in a voxel never leaves the voxel, so nothing further along the
+			// ray can be closer than its closest opaque rectangle. Sprites can stick out
+			// of the voxel, but they have a copy in every voxel they touch, so only hits
+			// before the ray leaves this voxel count.
+			hit.t = FLT_MAX;
+			const float tVoxelExit = std::min(tMax[0], std::min(tMax[1], tMax[2]));
+			const bool foundRectangle = this->intersectRectangles(this->traceRectangles,
+				voxelRef.getOffset(), rectangleCount, origin, direction, FLT_MAX, hit);
+			const bool foundSprite = this->intersectRectangles(this->traceSpriteRectangles,
+				spriteRef.getOffset(), spriteCount, origin, direction, tVoxelExit, hit);
+
+			if (foundRectangle || foundSprite)
+			{
+				return true;
+			}
+		}
+
+		// Step to the next voxel along whichever axis boundary is closest.
+		const int axis = (tMax[0] < tMax[1]) ?
+			((tMax[0] < tMax[2]) ? 0 : 2) :
+			((tMax[1] < tMax[2]) ? 1 : 2);
+
+		if (tMax[axis] > tEnd)
+		{
+			return false;
+		}
+
+		cell[axis] += step[axis];
+		if ((cell[axis] < 0) || (cell[axis] >= gridSize[axis]))
+		{
+			return false;
+		}
+
+		tMax[axis] += tDelta[axis];
+	}
+}
+
+uint32_t CPUProgram::shadePixel(int x, int y, TraceCounts *counts) const
+{
+	// Screen coordinates in [-1, 1], with +Y going up.
+	const float screenX = ((2.0f * (static_cast<float>(x) + 0.5f)) /
+		static_cast<float>(this->frameWidth)) - 1.0f;
+	const float screenY = 1.0f - ((2.0f * (static_cast<float>(y) + 0.5f)) /
+		static_cast<float>(this->frameHeight));
+
+	const float rightPercent = screenX * this->aspect;
+	const Vec3 direction = normalized(Vec3
+	{
+		(this->forward[0] * this->zoom) + (this->right[0] * rightPercent) + (this->up[0] * screenY),
+		(this->forward[1] * this->zoom) + (this->right[1] * rightPercent) + (this->up[1] * screenY),
+		(this->forward[2] * this->zoom) + (this->right[2] * rightPercent) + (this->up[2] * screenY)
+	});
+
+	Hit hit;
+	bool found = this->castRay(this->eye, direction, hit, counts);
+
+	// Rasterized sprites are drawn where they're nearer than the traced hit.
+	if (this->world.getSpriteMode() == SpriteMode::Rasterized)
+	{
+		if (!found)
+		{
+			hit.t = FLT_MAX;
+		}
+
+		found = this->intersectRasterSprites(x, y, direction, hit) || found;
+	}
+
+	if (!found)
+	{
+		return toARGB(this->skyColor[0], this->skyColor[1], this->skyColor[2]);
+	}
+
+	float light = this->ambient;
+
+	// Add sunlight if the surface faces the sun and nothing is in the way.
+	const float normalDotSun = dot(hit.normal, this->sunDirection);
+	if ((this->sunIntensity > 0.0f) && (normalDotSun > 0.0f))
+	{
+		const Vec3 shadowOrigin =
+		{
+			hit.point[0] + (hit.normal[0] * RAY_EPSILON),
+			hit.point[1] + (hit.normal[1] * RAY_EPSILON),
+			hit.point[2] + (hit.normal[2] * RAY_EPSILON)
+		};
+
+		Hit shadowHit;
+		if (!this->castRay(shadowOrigin, this->sunDirection, shadowHit, counts))
+		{
+			light += normalDotSun * this->sunIntensity;
+		}
+	}
+
+	// Add the point lights that reach into the voxel the hit point is in. The point is
+	// nudged off the surface so it's in the voxel on the ray's side.
+	Vec3 lightColor = { light, light, light };
+	const std::array<int, 3> gridSize =
+	{
+		this->world.getWidth(), this->world.getHeight(), this->world.getDepth()
+	};
+
+	std::array<int, 3> cell;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		const float coord = hit.point[axis] + (hit.normal[axis] * RAY_EPSILON);
+		cell[axis] = std::min(std::max(static_cast<int>(std::floor(coord)), 0),
+			gridSize[axis] - 1);
+	}
+
+	const LightManager &lightManager = this->world.getLightManager();
+	const LightReference &lightRef = lightManager.getLightReferences()[
+		this->world.getVoxelIndex(cell[0], cell[1], cell[2])];
+	const auto &lightIndices = lightManager.getLightIndices();
+	const int lightOffset = lightRef.getOffset();
+	for (int i = lightOffset; i < (lightOffset + lightRef.getLightCount()); ++i)
+	{
+		const TraceLight &traceLight = this->traceLights[lightIndices[i]];
+		const Vec3 toLight =
+		{
+			traceLight.position[0] - hit.point[0],
+			traceLight.position[1] - hit.point[1],
+			traceLight.position[2] - hit.point[2]
+		};
+
+		const float distanceSq = dot(toLight, toLight);
+		const float radiusSq = traceLight.radius * traceLight.radius;
+		if ((distanceSq >= radiusSq) || (distanceSq == 0.0f))
+		{
+			continue;
+		}
+
+		const float distance = std::sqrt(distanceSq);
+		const float normalDotLight = dot(hit.normal, toLight) / distance;
+		if (normalDotLight <= 0.0f)
+		{
+			continue;
+		}
+
+		// Light fades out smoothly towards the edge of the radius.
+		const float falloff = 1.0f - (distance / traceLight.radius);
+		const float intensity = normalDotLight * falloff * falloff;
+		lightColor[0] += traceLight.color[0] * intensity;
+		lightColor[1] += traceLight.color[1] * intensity;
+		lightColor[2] += traceLight.color[2] * intensity;
+	}
+
+	const float r = static_cast<float>((hit.texel >> 16) & 0xFF) / 255.0f;
+	const float g = static_cast<float>((hit.texel >> 8) & 0xFF) / 255.0f;
+	const float b = static_cast<float>(hit.texel & 0xFF) / 255.0f;
+	return toARGB(r * lightColor[0], g * lightColor[1], b * lightColor[2]);
+}
+
+void CPUProgram::renderTile(int tileIndex, uint32_t *pixels, int pitch,
+	TraceCounts *counts) const
+{
+	const int tilesPerRow = (this->frameWidth + CPUProgram::TILE_WIDTH - 1) /
+		CPUProgram::TILE_WIDTH;
+	const int startX = (tileIndex % tilesPerRow) * CPUProgram::TILE_WIDTH;
+	const int startY = (tileIndex / tilesPerRow) * CPUProgram::TILE_HEIGHT;
+	const int endX = std::min(startX + CPUProgram::TILE_WIDTH, this->frameWidth);
+	const int endY = std::min(startY + CPUProgram::TILE_HEIGHT, this->frameHeight);
+
+	// The tile is counted on its own, so threads don't write next to each other's
+	// counts for every ray.
+	TraceCounts tileCounts = { 0, 0 };
+	TraceCounts *tileCountsPtr = (counts != nullptr) ? &tileCounts : nullptr;
+
+	for (int y = startY; y < endY; ++y)
+	{
+		// The pitch is in bytes and might be wider than the render width.
+		uint32_t *row = reinterpret_cast<uint32_t*>(
+			reinterpret_cast<uint8_t*>(pixels) + (y * pitch));
+
+		for (int x = startX; x < endX; ++x)
+		{
+			row[x] = this->shadePixel(x, y, tileCountsPtr);
+		}
+	}
+
+	if (counts != nullptr)
+	{
+		*counts = tileCounts;
+	}
+}
+
+const RenderProfiler *CPUProgram::getProfiler() const
+{
+	return this->profiler.get();
+}
+
+void CPUProgram::resetProfiler(int windowSize)
+{
+	if (this->profiler != nullptr)
+	{
+		this->profiler = std::unique_ptr<RenderProfiler>(new RenderProfiler(windowSize));
+	}
+}
+
+void CPUProgram::waitForFrames()
+{
+	// Every frame is done by the time render() returns.
+}
+
+bool CPUProgram::hasDebugView() const
+{
+	// Every pixel is traced, so there are no reused pixels to show.
+	return false;
+}
+
+void CPUProgram::setDebugView(bool debugView)
+{
+	static_cast<void>(debugView);
+}
+
+double CPUProgram::getAverageStepsPerRay()
+{
+	if (!this->stepCounted)
+	{
+		return -1.0;
+	}
+
+	return static_cast<double>(this->traceCounts.stepCount) /
+		static_cast<double>(std::max<int64_t>(this->traceCounts.rayCount, 1));
+}
+
+void CPUProgram::resetStepCounts()
+{
+	this->traceCounts = TraceCounts{ 0, 0 };
+}
+
+void CPUProgram::updateCamera(const Float3d &eye, const Float3d &direction, double fovY)
+{
+	// Do not scale the direction beforehand.
+	assert(direction.isNormalized());
+
+	const Float3d right = direction.cross(Directable::getGlobalUp()).normalized();
+	const Float3d up = right.cross(direction).normalized();
+
+	this->eye = toVec3(eye);
+	this->forward = toVec3(direction);
+	this->right = toVec3(right);
+	this->up = toVec3(up);
+
+	// Zoom is a function of field of view.
+	const double zoom = 1.0 / std::tan(fovY * 0.5 * DEG_TO_RAD);
+	this->zoom = static_cast<float>(zoom);
+	this->aspect = static_cast<float>(this->renderWidth) /
+		static_cast<float>(this->renderHeight);
+	this->spriteTiles.setCamera(eye, direction, right, up, zoom);
+}
+
+void CPUProgram::updateGameTime(double gameTime)
+{
+	assert(gameTime >= 0.0);
+
+	// The sun goes around the world once per day, rising in the east (+Z) and 
+	// setting in the west, tilted a little toward the south.
+	const double sunAngle = SUN_START_ANGLE + ((2.0 * PI) * (gameTime / SECONDS_PER_DAY));
+	this->sunDirection = normalized(Vec3
+	{
+		-0.25f,
+		static_cast<float>(std::sin(sunAngle)),
+		static_cast<float>(std::cos(sunAngle))
+	});
+
+	// Daylight fades out as the sun goes below the horizon.
+	const float sunHeight = this->sunDirection[1];
+	const float daylight = clamp01((sunHeight * 2.0f) + 0.5f);
+	this->sunIntensity = clamp01(sunHeight * 3.0f) * 0.75f;
+	this->ambient = 0.10f + (0.30f * daylight);
+
+	for (int i = 0; i < 3; ++i)
+	{
+		this->skyColor[i] = NIGHT_SKY_COLOR[i] +
+			((DAY_SKY_COLOR[i] - NIGHT_SKY_COLOR[i]) * daylight);
+	}
+}
+
+void CPUProgram::resize(int renderWidth, int renderHeight, Renderer &renderer)
+{
+	assert(renderWidth > 0);
+	assert(renderHeight > 0);
+
+	if ((renderWidth == this->renderWidth) && (renderHeight == this->renderHeight))
+	{
+		return;
+	}
+
+	this->renderWidth = renderWidth;
+	this->renderHeight = renderHeight;
+	this->frameWidth = renderWidth;
+	this->frameHeight = renderHeight;
+	this->aspect = static_cast<float>(this->renderWidth) /
+		static_cast<float>(this->renderHeight);
+
+	SDL_DestroyTexture(this->texture);
+	this->texture = renderer.createTexture(SDL_PIXELFORMAT_ARGB8888,
+		SDL_TEXTUREACCESS_STREAMING, this->renderWidth, this->renderHeight);
+	Debug::check(this->texture != nullptr, "CPUProgram", "SDL_CreateTexture");
+}
+
+void CPUProgram::setVoxel(int cellX, int cellY, int cellZ,
+	const std::vector<Rect3D> &rectangles, int textureID)
+{
+	this->world.setVoxel(cellX, cellY, cellZ, rectangles, textureID);
+}
+
+int CPUProgram::addSprite(const Rect3D &rectangle, int textureID)
+{
+	return this->world.addSprite(rectangle, textureID);
+}
+
+void CPUProgram::moveSprite(int spriteID, const Rect3D &rectangle, int textureID)
+{
+	this->world.moveSprite(spriteID, rectangle, textureID);
+}
+
+void CPUProgram::removeSprite(int spriteID)
+{
+	this->world.removeSprite(spriteID);
+}
+
+int CPUProgram::addLight(const Float3f &position, const Float3f &color, float radius)
+{
+	return this->world.addLight(position, color, radius);
+}
+
+void CPUProgram::moveLight(int lightID, const Float3f &position)
+{
+	this->world.moveLight(lightID, position);
+}
+
+void CPUProgram::setLightEnabled(int lightID, bool enabled)
+{
+	this->world.setLightEnabled(lightID, enabled);
+}
+
+void CPUProgram::removeLight(int lightID)
+{
+	this->world.removeLight(lightID);
+}
+
+void CPUProgram::render(Renderer &renderer)
+{
+	const auto renderStartTime = std::chrono::high_resolution_clock::now();
+
+	// Lambda for timing a stage of the frame if profiling.
+	auto timeStage = [this](const std::string &stageName, const std::function<void()> &stage)
+	{
+		if (this->profiler == nullptr)
+		{
+			stage();
+			return;
+		}
+
+		const auto startTime = std::chrono::high_resolution_clock::now();
+		stage();
+		const auto endTime = std::chrono::high_resolution_clock::now();
+		this->profiler->addSample(stageName,
+			std::chrono::duration<double, std::milli>(endTime - startTime).count());
+	};
+
+	// Bring the trace rectangles up to date with any world changes.
+	timeStage("host update world", [this]()
+	{
+		this->updateTraceRectangles();
+	});
+
+	// Trace this frame at the quality picked from the previous frames' render times.
+	// The aspect ratio stays the one of the whole texture since the frame is stretched
+	// over all of it.
+	this->frameWidth = this->resolutionScaler.getScaledDimension(this->renderWidth);
+	this->frameHeight = this->resolutionScaler.getScaledDimension(this->renderHeight);
+
+	if (this->world.getSpriteMode() == SpriteMode::Rasterized)
+	{
+		timeStage("host sort sprites", [this]()
+		{
+			this->updateRasterSprites();
+		});
+	}
+
+	SDL_Rect frameRect;
+	frameRect.x = 0;
+	frameRect.y = 0;
+	frameRect.w = this->frameWidth;
+	frameRect.h = this->frameHeight;
+
+	// Write straight into the streaming texture's pixels.
+	void *lockedPixels = nullptr;
+	int pitch = 0;
+	const int status = SDL_LockTexture(this->texture, &frameRect, &lockedPixels, &pitch);
+	Debug::check(status == 0, "CPUProgram", "SDL_LockTexture (" +
+		std::string(SDL_GetError()) + ").");
+
+	uint32_t *pixels = static_cast<uint32_t*>(lockedPixels);
+
+	// Hand out the tiles to the thread pool.
+	const int tilesPerRow = (this->frameWidth + CPUProgram::TILE_WIDTH - 1) /
+		CPUProgram::TILE_WIDTH;
+	const int tilesPerColumn = (this->frameHeight + CPUProgram::TILE_HEIGHT - 1) /
+		CPUProgram::TILE_HEIGHT;
+	const int tileCount = tilesPerRow * tilesPerColumn;
+	std::vector<TraceCounts> tileCounts(this->stepCounted ? tileCount : 0,
+		TraceCounts{ 0, 0 });
+	timeStage("host trace", [this, pixels, pitch, tileCount, &tileCounts]()
+	{
+		this->threadPool->run(tileCount, [this, pixels, pitch, &tileCounts](int tileIndex)
+		{
+			this->renderTile(tileIndex, pixels, pitch,
+				(tileCounts.size() > 0) ? &tileCounts[tileIndex] : nullptr);
+		});
+	});
+
+	for (const TraceCounts &counts : tileCounts)
+	{
+		this->traceCounts.rayCount += counts.rayCount;
+		this->traceCounts.stepCount += counts.stepCount;
+	}
+
+	timeStage("host present", [this, &renderer]()
+	{
+		SDL_UnlockTexture(this->texture);
+		renderer.fillNative(this->texture, this->frameWidth, this->frameHeight);
+	});
+
+	const auto renderEndTime = std::chrono::high_resolution_clock::now();
+	this->resolutionScaler.update(
+		std::chrono::duration<double, std::milli>(renderEndTime - renderStartTime).count());
+}
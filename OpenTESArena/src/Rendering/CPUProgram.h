@@ -0,0 +1,166 @@
+#ifndef CPU_PROGRAM_H
+#define CPU_PROGRAM_H
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "RenderProgram.h"
+#include "RenderWorld.h"
+#include "ResolutionScaler.h"
+#include "SpriteMode.h"
+#include "SpriteTiles.h"
+
+// The CPUProgram is a software ray tracer with the same interface as the CLProgram.
+// It is for machines that have no GPU and no usable OpenCL runtime, where the CLProgram
+// can't find a device and the game would otherwise have to exit.
+
+// It traces the same render world as the OpenCL kernel does (a 3D-DDA walk through
+// the voxel grid, testing the rectangles and sprites of each voxel along the way).
+// Point lights are only looked at if they are in the light list of the voxel being
+// shaded. The frame is split into tiles, and the tiles are handed out to a thread
+// pool. Each thread writes straight into the locked pixels of the streaming texture,
+// so there's no separate output buffer to copy from.
+
+// The Float3 classes aren't used in the inner loops because their operators live in
+// a different translation unit and can't be inlined.
+
+// Rasterized sprites (see SpriteMode) are sorted and binned into screen tiles once per
+// frame (see SpriteTiles). Each pixel tests the sprites in its screen tile against its
+// traced hit after the walk through the voxel grid.
+
+class RenderProfiler;
+class Renderer;
+class TextureManager;
+class ThreadPool;
+
+struct SDL_Texture;
+
+class CPUProgram : public RenderProgram
+{
+private:
+	// Rectangle data in a more convenient format for intersection tests.
+	struct TraceRectangle
+	{
+		std::array<float, 3> p1, p1p2, p2p3, normal;
+		float p1p2InvLengthSq, p2p3InvLengthSq;
+		int textureID;
+	};
+
+	// Point light data in a more convenient format for shading.
+	struct TraceLight
+	{
+		std::array<float, 3> position, color;
+		float radius;
+	};
+
+	// The result of casting a ray into the voxel grid.
+	struct Hit
+	{
+		float t;
+		std::array<float, 3> point, normal;
+		uint32_t texel; // ARGB8888.
+	};
+
+	// Rays cast and voxel grid steps taken, for the average steps per ray.
+	struct TraceCounts
+	{
+		int64_t rayCount, stepCount;
+	};
+
+	static const int TILE_WIDTH;
+	static const int TILE_HEIGHT;
+
+	RenderWorld world;
+	ResolutionScaler resolutionScaler;
+	std::vector<TraceRectangle> traceRectangles, traceSpriteRectangles;
+	std::vector<TraceRectangle> traceRasterSprites; // This frame's, farthest first.
+	SpriteTiles spriteTiles; // Rasterized sprites sorted and binned for this frame.
+	std::vector<TraceLight> traceLights;
+	std::array<uint32_t, 256> paletteColors; // ARGB8888 color of each texel index.
+	std::unique_ptr<ThreadPool> threadPool;
+	std::unique_ptr<RenderProfiler> profiler; // Null unless profiled.
+	std::array<float, 3> eye, forward, right, up, sunDirection, skyColor;
+	float zoom, aspect, ambient, sunIntensity;
+	SDL_Texture *texture; // Streaming render texture for the threads to write into.
+	int renderWidth, renderHeight; // Texture dimensions, at the max render quality.
+	int frameWidth, frameHeight; // Dimensions of the frame being traced.
+	bool skipEmptyChunks; // Whether rays jump over chunks with no rectangles.
+	bool stepCounted; // Whether rays and their steps are counted.
+	TraceCounts traceCounts; // Counted since the last reset.
+
+	// Converts a rectangle to the intersection-friendly format.
+	static void makeTraceRectangle(const Rect3D &rect, int textureID,
+		TraceRectangle &traceRect);
+
+	// Regenerates the intersection-friendly rectangles (voxel and sprite), lights, and 
+	// palette colors that changed in the render world.
+	void updateTraceRectangles();
+
+	// Finds the closest opaque rectangle in a range of rectangles that is closer than 
+	// both the given hit and the max distance. Returns whether there was one.
+	bool intersectRectangles(const std::vector<TraceRectangle> &rectangles, int offset,
+		int count, const std::array<float, 3> &origin, const std::array<float, 3> &direction,
+		float maxT, Hit &hit) const;
+
+	// Walks the voxel grid and finds the closest opaque rectangle the ray hits, if any.
+	// Empty chunks are skipped in one step unless chunk skipping is off. The ray and
+	// its steps are added to the counts if they aren't null.
+	bool castRay(const std::array<float, 3> &origin, const std::array<float, 3> &direction,
+		Hit &hit, TraceCounts *counts) const;
+
+	// Sorts and bins the rasterized sprites for this frame.
+	void updateRasterSprites();
+
+	// Finds the nearest opaque rasterized sprite in a pixel's screen tile that is 
+	// closer than the given hit, and updates the hit if there is one.
+	bool intersectRasterSprites(int x, int y, const std::array<float, 3> &direction,
+		Hit &hit) const;
+
+	// Calculates the color of the pixel at the given screen coordinate.
+	uint32_t shadePixel(int x, int y, TraceCounts *counts) const;
+
+	// Renders one tile of the frame into the locked texture pixels, and writes the
+	// tile's rays and steps to the counts if they aren't null.
+	void renderTile(int tileIndex, uint32_t *pixels, int pitch, TraceCounts *counts) const;
+public:
+	// Constructor for the CPU render program. Each frame is traced at a render quality
+	// between the min and max quality that holds the target frame time (see 
+	// ResolutionScaler). The voxel layout is the order of the render world's per-voxel
+	// lists. The sprite mode decides whether sprites are found by walking the grid or
+	// drawn over the traced hits. Chunk skipping lets rays jump over empty chunks; it's
+	// only turned off to measure what it saves. When steps are counted, every ray adds
+	// its grid steps to the average steps per ray. When profiled, it times its world
+	// updates, tracing, and presenting each frame.
+	CPUProgram(int worldWidth, int worldHeight, int worldDepth,
+		TextureManager &textureManager, Renderer &renderer, double minRenderQuality,
+		double maxRenderQuality, double targetFrameTime, VoxelLayout voxelLayout,
+		SpriteMode spriteMode, bool chunkSkipping, bool stepCounted, bool profiled);
+	virtual ~CPUProgram();
+
+	virtual const RenderProfiler *getProfiler() const override;
+	virtual void resetProfiler(int windowSize) override;
+	virtual void waitForFrames() override;
+	virtual bool hasDebugView() const override;
+	virtual void setDebugView(bool debugView) override;
+	virtual double getAverageStepsPerRay() override;
+	virtual void resetStepCounts() override;
+	virtual void updateCamera(const Float3d &eye, const Float3d &direction,
+		double fovY) override;
+	virtual void updateGameTime(double gameTime) override;
+	virtual void resize(int renderWidth, int renderHeight, Renderer &renderer) override;
+	virtual void setVoxel(int cellX, int cellY, int cellZ,
+		const std::vector<Rect3D> &rectangles, int textureID) override;
+	virtual int addSprite(const Rect3D &rectangle, int textureID) override;
+	virtual void moveSprite(int spriteID, const Rect3D &rectangle, int textureID) override;
+	virtual void removeSprite(int spriteID) override;
+	virtual int addLight(const Float3f &position, const Float3f &color,
+		float radius) override;
+	virtual void moveLight(int lightID, const Float3f &position) override;
+	virtual void setLightEnabled(int lightID, bool enabled) override;
+	virtual void removeLight(int lightID) override;
+	virtual void render(Renderer &renderer) override;
+};
+
+#endif
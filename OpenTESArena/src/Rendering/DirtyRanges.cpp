@@ -0,0 +1,68 @@
+#include <algorithm>
+#include <cassert>
+
+#include "DirtyRanges.h"
+
+DirtyRanges::DirtyRanges()
+{
+
+}
+
+DirtyRanges::~DirtyRanges()
+{
+
+}
+
+bool DirtyRanges::isEmpty() const
+{
+	return this->ranges.size() == 0;
+}
+
+std::vector<std::pair<int, int>> DirtyRanges::getCoalesced() const
+{
+	if (this->ranges.size() == 0)
+	{
+		return std::vector<std::pair<int, int>>();
+	}
+
+	std::vector<std::pair<int, int>> sorted(this->ranges);
+	std::sort(sorted.begin(), sorted.end());
+
+	// Extend the last merged range while the next one starts at or before its end.
+	std::vector<std::pair<int, int>> coalesced;
+	coalesced.push_back(sorted.front());
+
+	for (size_t i = 1; i < sorted.size(); ++i)
+	{
+		const auto &range = sorted.at(i);
+		auto &last = coalesced.back();
+		const int lastEnd = last.first + last.second;
+
+		if (range.first <= lastEnd)
+		{
+			last.second = std::max(lastEnd, range.first + range.second) - last.first;
+		}
+		else
+		{
+			coalesced.push_back(range);
+		}
+	}
+
+	return coalesced;
+}
+
+void DirtyRanges::add(int offset, int count)
+{
+	assert(offset >= 0);
+	assert(count >= 0);
+
+	if (count > 0)
+	{
+		this->ranges.push_back(std::make_pair(offset, count));
+	}
+}
+
+void DirtyRanges::clear()
+{
+	this->ranges.clear();
+}
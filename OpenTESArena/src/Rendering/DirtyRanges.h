@@ -0,0 +1,32 @@
+#ifndef DIRTY_RANGES_H
+#define DIRTY_RANGES_H
+
+#include <utility>
+#include <vector>
+
+// Dirty ranges record which elements of a host array have changed since they were 
+// last copied to a render program, so only those elements need to be copied again.
+
+// Ranges are recorded as they come, in any order, and are only sorted and merged when
+// asked for. Each range is an offset and a count of elements.
+
+class DirtyRanges
+{
+private:
+	std::vector<std::pair<int, int>> ranges;
+public:
+	DirtyRanges();
+	~DirtyRanges();
+
+	bool isEmpty() const;
+
+	// Gets the ranges sorted by offset, with overlapping and adjacent ranges merged.
+	std::vector<std::pair<int, int>> getCoalesced() const;
+
+	// Marks some elements as changed.
+	void add(int offset, int count);
+
+	void clear();
+};
+
+#endif
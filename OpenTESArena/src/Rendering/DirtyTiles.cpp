@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "DirtyTiles.h"
+
+namespace
+{
+	// Distance in front of the camera that a point has to be to be projected. Same as
+	// the lean kernels' ray epsilon.
+	const double NEAR_DISTANCE = 1.0e-4;
+}
+
+const int DirtyTiles::TILE_SIZE = 32;
+
+DirtyTiles::DirtyTiles()
+{
+	this->zoom = 1.0;
+	this->frameWidth = 0;
+	this->frameHeight = 0;
+	this->tileCountX = 0;
+	this->tileCountY = 0;
+	this->dirtyCount = 0;
+}
+
+DirtyTiles::~DirtyTiles()
+{
+
+}
+
+void DirtyTiles::addTiles(int minTileX, int minTileY, int maxTileX, int maxTileY)
+{
+	const int startX = std::max(minTileX, 0);
+	const int startY = std::max(minTileY, 0);
+	const int endX = std::min(maxTileX, this->tileCountX - 1);
+	const int endY = std::min(maxTileY, this->tileCountY - 1);
+	for (int y = startY; y <= endY; ++y)
+	{
+		for (int x = startX; x <= endX; ++x)
+		{
+			const int index = x + (y * this->tileCountX);
+			if (!this->tiles.at(index))
+			{
+				this->tiles.at(index) = true;
+				this->dirtyCount++;
+			}
+		}
+	}
+}
+
+int DirtyTiles::getTileCount() const
+{
+	return this->tileCountX * this->tileCountY;
+}
+
+int DirtyTiles::getDirtyCount() const
+{
+	return this->dirtyCount;
+}
+
+bool DirtyTiles::isEmpty() const
+{
+	return this->dirtyCount == 0;
+}
+
+std::vector<Rect> DirtyTiles::getDirtyRects() const
+{
+	std::vector<Rect> rects;
+	for (int y = 0; y < this->tileCountY; ++y)
+	{
+		int x = 0;
+		while (x < this->tileCountX)
+		{
+			if (!this->tiles.at(x + (y * this->tileCountX)))
+			{
+				x++;
+				continue;
+			}
+
+			// Extend the run to the last dirty tile in a row.
+			const int startX = x;
+			while ((x < this->tileCountX) && this->tiles.at(x + (y * this->tileCountX)))
+			{
+				x++;
+			}
+
+			const int left = startX * DirtyTiles::TILE_SIZE;
+			const int top = y * DirtyTiles::TILE_SIZE;
+			const int right = std::min(x * DirtyTiles::TILE_SIZE, this->frameWidth);
+			const int bottom = std::min(top + DirtyTiles::TILE_SIZE, this->frameHeight);
+			rects.push_back(Rect(left, top, right - left, bottom - top));
+		}
+	}
+
+	return rects;
+}
+
+void DirtyTiles::getDirtyRows(int *startRow, int *endRow) const
+{
+	*startRow = this->frameHeight;
+	*endRow = 0;
+	for (int y = 0; y < this->tileCountY; ++y)
+	{
+		const auto rowBegin = this->tiles.begin() + (y * this->tileCountX);
+		const auto rowEnd = rowBegin + this->tileCountX;
+		if (std::find(rowBegin, rowEnd, true) != rowEnd)
+		{
+			*startRow = std::min(*startRow, y * DirtyTiles::TILE_SIZE);
+			*endRow = std::min((y + 1) * DirtyTiles::TILE_SIZE, this->frameHeight);
+		}
+	}
+
+	*startRow = std::min(*startRow, *endRow);
+}
+
+void DirtyTiles::setCamera(const Float3d &eye, const Float3d &forward,
+	const Float3d &right, const Float3d &up, double zoom)
+{
+	assert(zoom > 0.0);
+
+	this->eye = eye;
+	this->forward = forward;
+	this->right = right;
+	this->up = up;
+	this->zoom = zoom;
+}
+
+void DirtyTiles::clear(int frameWidth, int frameHeight)
+{
+	assert(frameWidth > 0);
+	assert(frameHeight > 0);
+
+	this->frameWidth = frameWidth;
+	this->frameHeight = frameHeight;
+	this->tileCountX = (frameWidth + DirtyTiles::TILE_SIZE - 1) / DirtyTiles::TILE_SIZE;
+	this->tileCountY = (frameHeight + DirtyTiles::TILE_SIZE - 1) / DirtyTiles::TILE_SIZE;
+	this->tiles = std::vector<bool>(this->tileCountX * this->tileCountY, false);
+	this->dirtyCount = 0;
+}
+
+void DirtyTiles::addBox(const Float3d &minPoint, const Float3d &maxPoint)
+{
+	const double aspect = static_cast<double>(this->frameWidth) /
+		static_cast<double>(this->frameHeight);
+
+	// Screen bounds of the box's corners, in pixels like the lean kernels' ray
+	// directions (i.e., pixel centers are at whole numbers).
+	double minX = HUGE_VAL;
+	double minY = HUGE_VAL;
+	double maxX = -HUGE_VAL;
+	double maxY = -HUGE_VAL;
+	int behindCount = 0;
+
+	for (int i = 0; i < 8; ++i)
+	{
+		const Float3d corner(
+			((i & 1) != 0) ? maxPoint.getX() : minPoint.getX(),
+			((i & 2) != 0) ? maxPoint.getY() : minPoint.getY(),
+			((i & 4) != 0) ? maxPoint.getZ() : minPoint.getZ());
+		const Float3d local = corner - this->eye;
+		const double distance = local.dot(this->forward);
+		if (distance <= NEAR_DISTANCE)
+		{
+			behindCount++;
+			continue;
+		}
+
+		const double scale = distance / this->zoom;
+		const double screenX = local.dot(this->right) / (scale * aspect);
+		const double screenY = local.dot(this->up) / scale;
+		const double pixelX = (((screenX + 1.0) * 0.5) * this->frameWidth) - 0.5;
+		const double pixelY = (((1.0 - screenY) * 0.5) * this->frameHeight) - 0.5;
+		minX = std::min(minX, pixelX);
+		minY = std::min(minY, pixelY);
+		maxX = std::max(maxX, pixelX);
+		maxY = std::max(maxY, pixelY);
+	}
+
+	if (behindCount == 8)
+	{
+		return;
+	}
+	else if (behindCount > 0)
+	{
+		this->addAll();
+		return;
+	}
+
+	// Skip boxes entirely off screen before converting to ints, since far off screen
+	// projections can be huge.
+	if ((maxX < -1.0) || (maxY < -1.0) || (minX > this->frameWidth) ||
+		(minY > this->frameHeight))
+	{
+		return;
+	}
+
+	// Any pixel whose center is between the bounds can see into the box.
+	const int minPixelX = static_cast<int>(std::floor(std::max(minX, 0.0)));
+	const int minPixelY = static_cast<int>(std::floor(std::max(minY, 0.0)));
+	const int maxPixelX = static_cast<int>(std::ceil(
+		std::min(maxX, static_cast<double>(this->frameWidth))));
+	const int maxPixelY = static_cast<int>(std::ceil(
+		std::min(maxY, static_cast<double>(this->frameHeight))));
+	this->addTiles(minPixelX / DirtyTiles::TILE_SIZE, minPixelY / DirtyTiles::TILE_SIZE,
+		maxPixelX / DirtyTiles::TILE_SIZE, maxPixelY / DirtyTiles::TILE_SIZE);
+}
+
+void DirtyTiles::addAll()
+{
+	this->addTiles(0, 0, this->tileCountX - 1, this->tileCountY - 1);
+}
@@ -0,0 +1,58 @@
+#ifndef DIRTY_TILES_H
+#define DIRTY_TILES_H
+
+#include <vector>
+
+#include "../Math/Float3.h"
+#include "../Math/Rect.h"
+
+// Dirty tiles record which parts of the last frame have to be drawn again because
+// something in the world changed. The frame is split into square tiles, and a change
+// is a box in world space. Every tile that the box's projection touches is dirty.
+
+// The projection is the same as the lean kernels' (see CLLeanKernels), so it takes the
+// same camera. A box that's partly behind the camera makes every tile dirty, and one
+// that's all behind it doesn't touch any.
+
+class DirtyTiles
+{
+private:
+	std::vector<bool> tiles;
+	Float3d eye, forward, right, up;
+	double zoom;
+	int frameWidth, frameHeight, tileCountX, tileCountY, dirtyCount;
+
+	void addTiles(int minTileX, int minTileY, int maxTileX, int maxTileY);
+public:
+	DirtyTiles();
+	~DirtyTiles();
+
+	// Width and height of a tile in pixels.
+	static const int TILE_SIZE;
+
+	int getTileCount() const;
+	int getDirtyCount() const;
+	bool isEmpty() const;
+
+	// Gets the pixel rectangles of the dirty tiles, clipped to the frame. Dirty tiles
+	// next to each other in a row are joined into one rectangle.
+	std::vector<Rect> getDirtyRects() const;
+
+	// Gets the first and one past the last row with any dirty tiles.
+	void getDirtyRows(int *startRow, int *endRow) const;
+
+	// Sets the camera that boxes are projected with. Its direction, right, and up
+	// vectors have to be normalized.
+	void setCamera(const Float3d &eye, const Float3d &forward, const Float3d &right,
+		const Float3d &up, double zoom);
+
+	// Makes every tile clean for a frame of the given dimensions.
+	void clear(int frameWidth, int frameHeight);
+
+	// Makes every tile whose pixels can see into the box dirty.
+	void addBox(const Float3d &minPoint, const Float3d &maxPoint);
+
+	void addAll();
+};
+
+#endif
@@ -0,0 +1,337 @@
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <climits>
+#include <cmath>
+
+#include "LightManager.h"
+
+namespace
+{
+	// Room a voxel's light list gets the first time a light reaches it.
+	const int MIN_LIGHT_LIST_CAPACITY = 4;
+
+	// Holes that are never worth packing for.
+	const int MIN_PACK_HOLE_COUNT = 256;
+}
+
+LightManager::LightManager(int width, int height, int depth, VoxelLayout voxelLayout)
+	: voxelIndexer(width, height, depth, voxelLayout)
+{
+	assert(width > 0);
+	assert(height > 0);
+	assert(depth > 0);
+
+	this->width = width;
+	this->height = height;
+	this->depth = depth;
+	this->usedIndexCount = 0;
+
+	// No voxel has any lights to start with.
+	const int voxelCount = this->voxelIndexer.getCount();
+	this->lightRefs = std::vector<LightReference>(voxelCount, LightReference(0, 0));
+	this->lightRefCapacities = std::vector<int>(voxelCount, 0);
+	this->dirtyLightRefs.add(0, voxelCount);
+}
+
+LightManager::~LightManager()
+{
+
+}
+
+std::vector<int> LightManager::getLightVoxelIndices(const PointLight &light) const
+{
+	const Float3f &position = light.getPosition();
+	const float radius = light.getRadius();
+	const std::array<float, 3> center = { position.getX(), position.getY(),
+		position.getZ() };
+	const std::array<int, 3> gridSize = { this->width, this->height, this->depth };
+
+	// Voxel range of the light's bounding box, clamped to the grid.
+	std::array<int, 3> minCell, maxCell;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		minCell[axis] = std::max(static_cast<int>(std::floor(center[axis] - radius)), 0);
+		maxCell[axis] = std::min(static_cast<int>(std::floor(center[axis] + radius)),
+			gridSize[axis] - 1);
+	}
+
+	// Only keep voxels whose closest point to the light is inside the radius.
+	std::vector<int> voxelIndices;
+	const float radiusSq = radius * radius;
+	for (int z = minCell[2]; z <= maxCell[2]; ++z)
+	{
+		const float dz = center[2] - std::min(std::max(center[2],
+			static_cast<float>(z)), static_cast<float>(z + 1));
+
+		for (int y = minCell[1]; y <= maxCell[1]; ++y)
+		{
+			const float dy = center[1] - std::min(std::max(center[1],
+				static_cast<float>(y)), static_cast<float>(y + 1));
+
+			for (int x = minCell[0]; x <= maxCell[0]; ++x)
+			{
+				const float dx = center[0] - std::min(std::max(center[0],
+					static_cast<float>(x)), static_cast<float>(x + 1));
+
+				if (((dx * dx) + (dy * dy) + (dz * dz)) <= radiusSq)
+				{
+					voxelIndices.push_back(this->voxelIndexer.getIndex(x, y, z));
+				}
+			}
+		}
+	}
+
+	// Only the linear layout is already in ascending order.
+	std::sort(voxelIndices.begin(), voxelIndices.end());
+	return voxelIndices;
+}
+
+void LightManager::addToVoxel(int voxelIndex, int lightID)
+{
+	const LightReference &lightRef = this->lightRefs.at(voxelIndex);
+	const int oldOffset = lightRef.getOffset();
+	const int count = lightRef.getLightCount();
+	int &capacity = this->lightRefCapacities.at(voxelIndex);
+
+	// Move the list to the end of the index list with more room if it's full.
+	int offset = oldOffset;
+	if (count == capacity)
+	{
+		const int newCapacity = std::max(capacity * 2, MIN_LIGHT_LIST_CAPACITY);
+		offset = static_cast<int>(this->lightIndices.size());
+		this->lightIndices.resize(offset + newCapacity, -1);
+		std::copy(this->lightIndices.begin() + oldOffset,
+			this->lightIndices.begin() + oldOffset + count,
+			this->lightIndices.begin() + offset);
+
+		this->usedIndexCount += newCapacity - capacity;
+		capacity = newCapacity;
+		this->dirtyLightIndices.add(offset, count);
+	}
+
+	this->lightIndices.at(offset + count) = lightID;
+	this->lightRefs.at(voxelIndex) = LightReference(offset, count + 1);
+	this->dirtyLightIndices.add(offset + count, 1);
+	this->dirtyLightRefs.add(voxelIndex, 1);
+}
+
+void LightManager::removeFromVoxel(int voxelIndex, int lightID)
+{
+	const LightReference &lightRef = this->lightRefs.at(voxelIndex);
+	const int offset = lightRef.getOffset();
+	const int count = lightRef.getLightCount() - 1;
+
+	const auto begin = this->lightIndices.begin() + offset;
+	const auto iter = std::find(begin, begin + count + 1, lightID);
+	assert(iter != (begin + count + 1));
+
+	// Order in a list doesn't matter, so fill the gap with the list's last index.
+	const int index = static_cast<int>(iter - this->lightIndices.begin());
+	const int lastIndex = offset + count;
+	if (index != lastIndex)
+	{
+		this->lightIndices.at(index) = this->lightIndices.at(lastIndex);
+		this->dirtyLightIndices.add(index, 1);
+	}
+
+	this->lightIndices.at(lastIndex) = -1;
+
+	// An empty list gives up its room.
+	if (count == 0)
+	{
+		this->usedIndexCount -= this->lightRefCapacities.at(voxelIndex);
+		this->lightRefCapacities.at(voxelIndex) = 0;
+		this->lightRefs.at(voxelIndex) = LightReference(0, 0);
+	}
+	else
+	{
+		this->lightRefs.at(voxelIndex) = LightReference(offset, count);
+	}
+
+	this->dirtyLightRefs.add(voxelIndex, 1);
+}
+
+void LightManager::setLightVoxels(int lightID, std::vector<int> &&voxelIndices)
+{
+	std::vector<int> &oldVoxelIndices = this->lightVoxelIndices.at(lightID);
+
+	// Both lists are sorted, so walk them together. Voxels in both are left alone.
+	size_t oldIndex = 0;
+	size_t newIndex = 0;
+	while ((oldIndex < oldVoxelIndices.size()) || (newIndex < voxelIndices.size()))
+	{
+		const int oldVoxel = (oldIndex < oldVoxelIndices.size()) ?
+			oldVoxelIndices[oldIndex] : INT_MAX;
+		const int newVoxel = (newIndex < voxelIndices.size()) ?
+			voxelIndices[newIndex] : INT_MAX;
+
+		if (oldVoxel == newVoxel)
+		{
+			oldIndex++;
+			newIndex++;
+		}
+		else if (oldVoxel < newVoxel)
+		{
+			this->removeFromVoxel(oldVoxel, lightID);
+			oldIndex++;
+		}
+		else
+		{
+			this->addToVoxel(newVoxel, lightID);
+			newIndex++;
+		}
+	}
+
+	oldVoxelIndices = std::move(voxelIndices);
+
+	const int holeCount = static_cast<int>(this->lightIndices.size()) -
+		this->usedIndexCount;
+	if ((holeCount > this->usedIndexCount) && (holeCount > MIN_PACK_HOLE_COUNT))
+	{
+		this->pack();
+	}
+}
+
+void LightManager::pack()
+{
+	std::vector<int> packedIndices;
+	packedIndices.reserve(this->usedIndexCount);
+
+	const int voxelCount = static_cast<int>(this->lightRefs.size());
+	for (int i = 0; i < voxelCount; ++i)
+	{
+		const LightReference &lightRef = this->lightRefs.at(i);
+		const int offset = lightRef.getOffset();
+		const int count = lightRef.getLightCount();
+		if (count == 0)
+		{
+			continue;
+		}
+
+		// Each list keeps its room so it doesn't have to move again right away.
+		const int newOffset = static_cast<int>(packedIndices.size());
+		packedIndices.insert(packedIndices.end(), this->lightIndices.begin() + offset,
+			this->lightIndices.begin() + offset + count);
+		packedIndices.resize(newOffset + this->lightRefCapacities.at(i), -1);
+
+		// Only references that moved need copying again.
+		if (newOffset != offset)
+		{
+			this->lightRefs.at(i) = LightReference(newOffset, count);
+			this->dirtyLightRefs.add(i, 1);
+		}
+	}
+
+	assert(static_cast<int>(packedIndices.size()) == this->usedIndexCount);
+	this->lightIndices = std::move(packedIndices);
+
+	// The indices all moved, so all of them need copying again.
+	this->dirtyLightIndices.clear();
+	this->dirtyLightIndices.add(0, static_cast<int>(this->lightIndices.size()));
+}
+
+const std::vector<PointLight> &LightManager::getLights() const
+{
+	return this->lights;
+}
+
+const std::vector<LightReference> &LightManager::getLightReferences() const
+{
+	return this->lightRefs;
+}
+
+const std::vector<int> &LightManager::getLightIndices() const
+{
+	return this->lightIndices;
+}
+
+const DirtyRanges &LightManager::getDirtyLights() const
+{
+	return this->dirtyLights;
+}
+
+const DirtyRanges &LightManager::getDirtyLightReferences() const
+{
+	return this->dirtyLightRefs;
+}
+
+const DirtyRanges &LightManager::getDirtyLightIndices() const
+{
+	return this->dirtyLightIndices;
+}
+
+int LightManager::addLight(const Float3f &position, const Float3f &color, float radius)
+{
+	const PointLight light(position, color, radius);
+
+	// Reuse the ID of a removed light if there is one.
+	int lightID;
+	if (this->freeLightIDs.size() > 0)
+	{
+		lightID = this->freeLightIDs.back();
+		this->freeLightIDs.pop_back();
+		this->lights.at(lightID) = light;
+		this->activeLights.at(lightID) = true;
+		this->enabledLights.at(lightID) = true;
+	}
+	else
+	{
+		lightID = static_cast<int>(this->lights.size());
+		this->lights.push_back(light);
+		this->lightVoxelIndices.push_back(std::vector<int>());
+		this->activeLights.push_back(true);
+		this->enabledLights.push_back(true);
+	}
+
+	this->dirtyLights.add(lightID, 1);
+	this->setLightVoxels(lightID, this->getLightVoxelIndices(light));
+
+	return lightID;
+}
+
+void LightManager::moveLight(int lightID, const Float3f &position)
+{
+	assert(this->activeLights.at(lightID));
+
+	const PointLight &oldLight = this->lights.at(lightID);
+	this->lights.at(lightID) = PointLight(position, oldLight.getColor(),
+		oldLight.getRadius());
+	this->dirtyLights.add(lightID, 1);
+
+	if (this->enabledLights.at(lightID))
+	{
+		this->setLightVoxels(lightID, this->getLightVoxelIndices(this->lights.at(lightID)));
+	}
+}
+
+void LightManager::setLightEnabled(int lightID, bool enabled)
+{
+	assert(this->activeLights.at(lightID));
+
+	if (this->enabledLights.at(lightID) == enabled)
+	{
+		return;
+	}
+
+	this->enabledLights.at(lightID) = enabled;
+	this->setLightVoxels(lightID, enabled ?
+		this->getLightVoxelIndices(this->lights.at(lightID)) : std::vector<int>());
+}
+
+void LightManager::removeLight(int lightID)
+{
+	assert(this->activeLights.at(lightID));
+
+	this->setLightVoxels(lightID, std::vector<int>());
+	this->activeLights.at(lightID) = false;
+	this->enabledLights.at(lightID) = false;
+	this->freeLightIDs.push_back(lightID);
+}
+
+void LightManager::clearDirtyRanges()
+{
+	this->dirtyLights.clear();
+	this->dirtyLightRefs.clear();
+	this->dirtyLightIndices.clear();
+}
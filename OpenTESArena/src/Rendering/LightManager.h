@@ -0,0 +1,81 @@
+#ifndef LIGHT_MANAGER_H
+#define LIGHT_MANAGER_H
+
+#include <vector>
+
+#include "DirtyRanges.h"
+#include "LightReference.h"
+#include "PointLight.h"
+#include "VoxelIndexer.h"
+
+// The light manager keeps track of which point lights reach into which voxels. Each
+// voxel has a light reference to its own list of light indices, so shading a point 
+// only looks at the few lights near it. The cost per pixel stays the same no matter
+// how many torches and braziers the whole city has.
+
+// A light is in the list of every voxel its radius sphere touches. When a light moves
+// or is toggled, only the voxels it entered or left have their lists changed.
+
+// Each voxel's list has some room to grow. A list that outgrows its room is moved to
+// the end of the light index list with twice the room, and the old range becomes a 
+// hole. The holes are packed away once they're more than half of the list.
+
+// Every change is recorded in dirty ranges, so a render program only needs to copy
+// the lights, light references, and light indices that changed since it last looked.
+
+class LightManager
+{
+private:
+	std::vector<PointLight> lights;
+	std::vector<std::vector<int>> lightVoxelIndices; // Voxels each light is in.
+	std::vector<bool> activeLights, enabledLights;
+	std::vector<int> freeLightIDs;
+	std::vector<LightReference> lightRefs; // One per voxel, in the voxel layout's order.
+	std::vector<int> lightRefCapacities; // Room in each voxel's range.
+	std::vector<int> lightIndices;
+	DirtyRanges dirtyLights, dirtyLightRefs, dirtyLightIndices;
+	VoxelIndexer voxelIndexer;
+	int width, height, depth;
+	int usedIndexCount; // Room in the light index list that isn't a hole.
+
+	// Gets the indices of the voxels a light's radius touches, in ascending order.
+	std::vector<int> getLightVoxelIndices(const PointLight &light) const;
+
+	void addToVoxel(int voxelIndex, int lightID);
+	void removeFromVoxel(int voxelIndex, int lightID);
+
+	// Changes the voxels a light is in, only touching voxels it entered or left.
+	void setLightVoxels(int lightID, std::vector<int> &&voxelIndices);
+
+	// Rebuilds the light index list without holes, in voxel index order.
+	void pack();
+public:
+	LightManager(int width, int height, int depth, VoxelLayout voxelLayout);
+	~LightManager();
+
+	const std::vector<PointLight> &getLights() const;
+	const std::vector<LightReference> &getLightReferences() const;
+	const std::vector<int> &getLightIndices() const;
+
+	// Changes since the last call to clearDirtyRanges().
+	const DirtyRanges &getDirtyLights() const;
+	const DirtyRanges &getDirtyLightReferences() const;
+	const DirtyRanges &getDirtyLightIndices() const;
+
+	// Adds a light that is turned on, and returns its light ID.
+	int addLight(const Float3f &position, const Float3f &color, float radius);
+
+	void moveLight(int lightID, const Float3f &position);
+
+	// Turns a light on or off (i.e., a torch being lit at dusk). A light that is off
+	// isn't in any voxel's list.
+	void setLightEnabled(int lightID, bool enabled);
+
+	// Removes a light. Its light ID may be given to a later light.
+	void removeLight(int lightID);
+
+	// Called by a render program once it has copied all changes.
+	void clearDirtyRanges();
+};
+
+#endif
@@ -0,0 +1,22 @@
+#include "LightReference.h"
+
+LightReference::LightReference(int offset, int count)
+{
+	this->offset = offset;
+	this->count = count;
+}
+
+LightReference::~LightReference()
+{
+
+}
+
+int LightReference::getOffset() const
+{
+	return this->offset;
+}
+
+int LightReference::getLightCount() const
+{
+	return this->count;
+}
@@ -0,0 +1,24 @@
+#ifndef LIGHT_REFERENCE_H
+#define LIGHT_REFERENCE_H
+
+// A light reference has an offset into the light index list and a count of how many
+// indices to use at that offset. Each index is a light whose radius reaches into the
+// voxel, so shading a point only has to look at the lights of the voxel it's in.
+
+// Unlike sprite references, these point at indices instead of copies of the lights
+// themselves. A light's radius covers many voxels, and a moving torch would otherwise
+// have to rewrite its whole light in every one of them each frame.
+
+class LightReference
+{
+private:
+	int offset, count;
+public:
+	LightReference(int offset, int count);
+	~LightReference();
+
+	int getOffset() const;
+	int getLightCount() const;
+};
+
+#endif
@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <cassert>
+
+#include "PassGraph.h"
+
+#include "../Utilities/Debug.h"
+
+PassGraph::PassGraph()
+{
+	this->compiled = false;
+}
+
+PassGraph::~PassGraph()
+{
+
+}
+
+int PassGraph::addResource(const std::string &name, size_t size)
+{
+	assert(!this->compiled);
+	assert(size > 0);
+
+	Resource resource;
+	resource.name = name;
+	resource.size = size;
+	resource.firstPass = -1;
+	resource.lastPass = -1;
+	resource.allocation = -1;
+	this->resources.push_back(resource);
+	return static_cast<int>(this->resources.size()) - 1;
+}
+
+void PassGraph::addPass(const std::string &name, const std::vector<int> &reads,
+	const std::vector<int> &writes)
+{
+	assert(!this->compiled);
+
+	const int passIndex = static_cast<int>(this->passNames.size());
+	this->passNames.push_back(name);
+
+	for (const int resourceID : reads)
+	{
+		Resource &resource = this->resources.at(resourceID);
+
+		// Anything read before it's written would be read from someone else's data.
+		// A pass that reads and writes a buffer has to find it written earlier, too.
+		Debug::check(resource.firstPass != -1, "PassGraph", "Pass \"" + name +
+			"\" reads \"" + resource.name + "\" before any pass writes it.");
+
+		resource.lastPass = passIndex;
+	}
+
+	for (const int resourceID : writes)
+	{
+		Resource &resource = this->resources.at(resourceID);
+		if (resource.firstPass == -1)
+		{
+			resource.firstPass = passIndex;
+		}
+
+		resource.lastPass = passIndex;
+	}
+}
+
+void PassGraph::compile()
+{
+	assert(!this->compiled);
+
+	// Go through the buffers in the order they come alive, biggest first among those
+	// that start together. Each one goes on the free allocation closest to its size
+	// (growing it if it's too small), or on a new one if none are free. An allocation
+	// is free once the last pass of every buffer on it is before this buffer's first.
+	std::vector<int> order(this->resources.size());
+	for (int i = 0; i < static_cast<int>(order.size()); ++i)
+	{
+		order.at(i) = i;
+	}
+
+	std::stable_sort(order.begin(), order.end(), [this](int a, int b)
+	{
+		const Resource &resourceA = this->resources.at(a);
+		const Resource &resourceB = this->resources.at(b);
+		return (resourceA.firstPass < resourceB.firstPass) ||
+			((resourceA.firstPass == resourceB.firstPass) &&
+			(resourceA.size > resourceB.size));
+	});
+
+	std::vector<int> allocationLastPasses;
+	for (const int resourceID : order)
+	{
+		Resource &resource = this->resources.at(resourceID);
+
+		// A buffer no pass uses still gets memory, so kernels can be given it.
+		const bool unused = resource.firstPass == -1;
+
+		int bestAllocation = -1;
+		for (int i = 0; i < static_cast<int>(this->allocationSizes.size()); ++i)
+		{
+			if (unused || (allocationLastPasses.at(i) >= resource.firstPass))
+			{
+				continue;
+			}
+
+			if (bestAllocation == -1)
+			{
+				bestAllocation = i;
+				continue;
+			}
+
+			// Prefer the smallest one that fits, then the biggest one that doesn't.
+			const size_t size = this->allocationSizes.at(i);
+			const size_t bestSize = this->allocationSizes.at(bestAllocation);
+			const bool fits = size >= resource.size;
+			const bool bestFits = bestSize >= resource.size;
+			if ((fits && (!bestFits || (size < bestSize))) ||
+				(!fits && !bestFits && (size > bestSize)))
+			{
+				bestAllocation = i;
+			}
+		}
+
+		if (bestAllocation == -1)
+		{
+			this->allocationSizes.push_back(resource.size);
+			allocationLastPasses.push_back(resource.lastPass);
+			resource.allocation = static_cast<int>(this->allocationSizes.size()) - 1;
+		}
+		else
+		{
+			size_t &allocationSize = this->allocationSizes.at(bestAllocation);
+			allocationSize = std::max(allocationSize, resource.size);
+			allocationLastPasses.at(bestAllocation) = resource.lastPass;
+			resource.allocation = bestAllocation;
+		}
+	}
+
+	this->compiled = true;
+}
+
+int PassGraph::getAllocationCount() const
+{
+	assert(this->compiled);
+	return static_cast<int>(this->allocationSizes.size());
+}
+
+size_t PassGraph::getAllocationSize(int allocation) const
+{
+	assert(this->compiled);
+	return this->allocationSizes.at(allocation);
+}
+
+int PassGraph::getAllocation(int resourceID) const
+{
+	assert(this->compiled);
+	return this->resources.at(resourceID).allocation;
+}
+
+size_t PassGraph::getTotalSize() const
+{
+	assert(this->compiled);
+
+	size_t total = 0;
+	for (const size_t size : this->allocationSizes)
+	{
+		total += size;
+	}
+
+	return total;
+}
+
+size_t PassGraph::getUnsharedSize() const
+{
+	size_t total = 0;
+	for (const Resource &resource : this->resources)
+	{
+		total += resource.size;
+	}
+
+	return total;
+}
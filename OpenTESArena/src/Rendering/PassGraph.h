@@ -0,0 +1,64 @@
+#ifndef PASS_GRAPH_H
+#define PASS_GRAPH_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// A pass graph works out which per-pixel buffers of a frame can share device memory.
+// Each pass (i.e., a kernel) is added in the order it runs, with the transient buffers
+// it reads and writes. A transient buffer is live from the first pass that uses it to
+// the last one, and buffers whose lifetimes don't overlap are put on the same
+// allocation, which is as big as the biggest buffer on it.
+
+// Only buffers that are dead once the frame's last pass is done are transient. Ones
+// that have to last between frames (like a pipelined output, or the depths that dirty
+// tiles are shaded again from) have their own allocations and aren't added.
+
+// It doesn't know anything about OpenCL. A render program makes one buffer per
+// allocation and hands it to every kernel argument of the buffers on it.
+
+class PassGraph
+{
+private:
+	struct Resource
+	{
+		std::string name;
+		size_t size; // In bytes.
+		int firstPass, lastPass; // -1 until a pass uses it.
+		int allocation; // -1 until compiled.
+	};
+
+	std::vector<std::string> passNames;
+	std::vector<Resource> resources;
+	std::vector<size_t> allocationSizes;
+	bool compiled;
+public:
+	PassGraph();
+	~PassGraph();
+
+	// Adds a transient buffer of the given size in bytes and returns its resource ID.
+	int addResource(const std::string &name, size_t size);
+
+	// Adds a pass that runs after the ones added before it. A pass that reads and
+	// writes a buffer lists it in both.
+	void addPass(const std::string &name, const std::vector<int> &reads,
+		const std::vector<int> &writes);
+
+	// Works out each buffer's lifetime and puts it on an allocation. Every buffer has
+	// to be written by a pass before any pass reads it, since whatever was on its
+	// allocation before is garbage to it.
+	void compile();
+
+	int getAllocationCount() const;
+	size_t getAllocationSize(int allocation) const;
+
+	// Gets the allocation a resource was put on.
+	int getAllocation(int resourceID) const;
+
+	// Bytes taken by all allocations, and the bytes it would take if none were shared.
+	size_t getTotalSize() const;
+	size_t getUnsharedSize() const;
+};
+
+#endif
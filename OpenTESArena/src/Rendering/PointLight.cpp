@@ -0,0 +1,31 @@
+#include <cassert>
+
+#include "PointLight.h"
+
+PointLight::PointLight(const Float3f &position, const Float3f &color, float radius)
+	: position(position), color(color)
+{
+	assert(radius > 0.0f);
+
+	this->radius = radius;
+}
+
+PointLight::~PointLight()
+{
+
+}
+
+const Float3f &PointLight::getPosition() const
+{
+	return this->position;
+}
+
+const Float3f &PointLight::getColor() const
+{
+	return this->color;
+}
+
+float PointLight::getRadius() const
+{
+	return this->radius;
+}
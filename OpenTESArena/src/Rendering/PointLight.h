@@ -0,0 +1,23 @@
+#ifndef POINT_LIGHT_H
+#define POINT_LIGHT_H
+
+#include "../Math/Float3.h"
+
+// A point light is a light source like a torch or a brazier. Its light fades out
+// over its radius, and it doesn't light anything past that.
+
+class PointLight
+{
+private:
+	Float3f position, color;
+	float radius;
+public:
+	PointLight(const Float3f &position, const Float3f &color, float radius);
+	~PointLight();
+
+	const Float3f &getPosition() const;
+	const Float3f &getColor() const;
+	float getRadius() const;
+};
+
+#endif
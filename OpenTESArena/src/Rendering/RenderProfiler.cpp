@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <cassert>
+#include <iomanip>
+#include <sstream>
+
+#include "RenderProfiler.h"
+
+const int RenderProfiler::DEFAULT_WINDOW_SIZE = 240;
+
+RenderProfiler::RenderProfiler(int windowSize)
+{
+	assert(windowSize > 0);
+
+	this->windowSize = windowSize;
+}
+
+RenderProfiler::~RenderProfiler()
+{
+
+}
+
+const RenderProfiler::Stage *RenderProfiler::findStage(const std::string &name) const
+{
+	const auto stageIter = std::find_if(this->stages.begin(), this->stages.end(),
+		[&name](const Stage &stage) { return stage.name == name; });
+	return (stageIter != this->stages.end()) ? &(*stageIter) : nullptr;
+}
+
+std::vector<std::string> RenderProfiler::getStageNames() const
+{
+	std::vector<std::string> names;
+	for (const auto &stage : this->stages)
+	{
+		names.push_back(stage.name);
+	}
+
+	return names;
+}
+
+double RenderProfiler::getMinimum(const std::string &stageName) const
+{
+	const Stage *stage = this->findStage(stageName);
+	if ((stage == nullptr) || (stage->samples.size() == 0))
+	{
+		return 0.0;
+	}
+
+	return *std::min_element(stage->samples.begin(), stage->samples.end());
+}
+
+double RenderProfiler::getAverage(const std::string &stageName) const
+{
+	const Stage *stage = this->findStage(stageName);
+	if ((stage == nullptr) || (stage->samples.size() == 0))
+	{
+		return 0.0;
+	}
+
+	double sum = 0.0;
+	for (const double sample : stage->samples)
+	{
+		sum += sample;
+	}
+
+	return sum / static_cast<double>(stage->samples.size());
+}
+
+double RenderProfiler::getPercentile99(const std::string &stageName) const
+{
+	const Stage *stage = this->findStage(stageName);
+	if ((stage == nullptr) || (stage->samples.size() == 0))
+	{
+		return 0.0;
+	}
+
+	// The smallest sample that at least 99% of the samples are less than or equal to.
+	std::vector<double> sorted(stage->samples);
+	const size_t rank = (sorted.size() * 99 + 99) / 100;
+	const auto nth = sorted.begin() + (rank - 1);
+	std::nth_element(sorted.begin(), nth, sorted.end());
+	return *nth;
+}
+
+std::string RenderProfiler::getReport() const
+{
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(3);
+
+	for (const auto &stage : this->stages)
+	{
+		ss << stage.name << ": min " << this->getMinimum(stage.name) << " ms, avg " <<
+			this->getAverage(stage.name) << " ms, p99 " <<
+			this->getPercentile99(stage.name) << " ms (" << stage.samples.size() <<
+			" of " << stage.totalCount << " samples)\n";
+	}
+
+	return ss.str();
+}
+
+void RenderProfiler::addSample(const std::string &stageName, double milliseconds)
+{
+	auto stageIter = std::find_if(this->stages.begin(), this->stages.end(),
+		[&stageName](const Stage &stage) { return stage.name == stageName; });
+
+	if (stageIter == this->stages.end())
+	{
+		Stage stage;
+		stage.name = stageName;
+		stage.nextIndex = 0;
+		stage.totalCount = 0;
+		this->stages.push_back(stage);
+		stageIter = this->stages.end() - 1;
+	}
+
+	Stage &stage = *stageIter;
+	if (static_cast<int>(stage.samples.size()) < this->windowSize)
+	{
+		stage.samples.push_back(milliseconds);
+	}
+	else
+	{
+		// The ring is full, so overwrite the oldest sample.
+		stage.samples.at(stage.nextIndex) = milliseconds;
+		stage.nextIndex = (stage.nextIndex + 1) % this->windowSize;
+	}
+
+	stage.totalCount++;
+}
+
+void RenderProfiler::clear()
+{
+	this->stages.clear();
+}
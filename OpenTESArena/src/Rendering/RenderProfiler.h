@@ -0,0 +1,57 @@
+#ifndef RENDER_PROFILER_H
+#define RENDER_PROFILER_H
+
+#include <string>
+#include <vector>
+
+// A render profiler keeps the most recent timings of each stage of a render program's
+// frame, in milliseconds, and gives the minimum, average, and 99th percentile of them.
+// Only the last few seconds of samples are kept, so the numbers follow what is on the
+// screen instead of being averaged over the whole session.
+
+// Stages are named by the render program, and are reported in the order they were
+// first seen. The OpenCL program prefixes its stage names with "device" or "host" so
+// kernel and transfer times can be told apart from time spent on the CPU.
+
+class RenderProfiler
+{
+private:
+	struct Stage
+	{
+		std::string name;
+		std::vector<double> samples; // Ring of the most recent samples.
+		int nextIndex; // Where the next sample goes once the ring is full.
+		int totalCount; // Samples ever added, including overwritten ones.
+	};
+
+	std::vector<Stage> stages;
+	int windowSize; // Max samples kept per stage.
+
+	const Stage *findStage(const std::string &name) const;
+public:
+	RenderProfiler(int windowSize);
+	~RenderProfiler();
+
+	// Number of samples kept per stage if not told otherwise. About four seconds at 
+	// 60 frames per second.
+	static const int DEFAULT_WINDOW_SIZE;
+
+	std::vector<std::string> getStageNames() const;
+
+	// Statistics of the samples currently kept for a stage. A stage with no samples 
+	// gives zero.
+	double getMinimum(const std::string &stageName) const;
+	double getAverage(const std::string &stageName) const;
+	double getPercentile99(const std::string &stageName) const;
+
+	// One line per stage with its min, average, and 99th percentile, for the console
+	// or the screen.
+	std::string getReport() const;
+
+	void addSample(const std::string &stageName, double milliseconds);
+
+	// Forgets all samples, i.e., when the render settings change.
+	void clear();
+};
+
+#endif
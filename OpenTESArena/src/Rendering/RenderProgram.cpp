@@ -0,0 +1,43 @@
+#include "RenderProgram.h"
+
+#include "CLProgram.h"
+#include "CPUProgram.h"
+#include "RenderProgramType.h"
+#include "RenderSettings.h"
+#include "../Utilities/Debug.h"
+
+RenderProgram::~RenderProgram()
+{
+
+}
+
+std::unique_ptr<RenderProgram> RenderProgram::make(int worldWidth, int worldHeight,
+	int worldDepth, TextureManager &textureManager, Renderer &renderer,
+	double renderQuality, const RenderSettings &settings)
+{
+	// Without dynamic resolution, the render quality never goes below the given one.
+	const double minRenderQuality = settings.dynamicResolution ?
+		settings.minRenderQuality : renderQuality;
+
+	if (settings.renderProgramType == RenderProgramType::OpenCL)
+	{
+		return std::unique_ptr<RenderProgram>(new CLProgram(worldWidth, worldHeight,
+			worldDepth, textureManager, renderer, minRenderQuality, renderQuality,
+			settings.targetFrameTime, settings.pipelined, settings.clKernelMode,
+			settings.clDeviceSplit, settings.reprojected, settings.refineBlockSize,
+			settings.voxelLayout, settings.spriteMode, settings.chunkSkipping,
+			settings.stepCounted, settings.profiled));
+	}
+	else if (settings.renderProgramType == RenderProgramType::CPU)
+	{
+		return std::unique_ptr<RenderProgram>(new CPUProgram(worldWidth, worldHeight,
+			worldDepth, textureManager, renderer, minRenderQuality, renderQuality,
+			settings.targetFrameTime, settings.voxelLayout, settings.spriteMode,
+			settings.chunkSkipping, settings.stepCounted, settings.profiled));
+	}
+	else
+	{
+		Debug::crash("RenderProgram", "Unrecognized render program type.");
+		return nullptr;
+	}
+}
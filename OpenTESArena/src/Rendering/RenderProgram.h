@@ -0,0 +1,106 @@
+#ifndef RENDER_PROGRAM_H
+#define RENDER_PROGRAM_H
+
+#include <memory>
+#include <vector>
+
+#include "../Math/Float3.h"
+
+// A render program draws the 3D game world into the native frame buffer. The game
+// world panel only talks to this interface, so the backend (OpenCL or CPU) can be
+// chosen at startup without the rest of the game knowing which one is running.
+
+class Rect3D;
+class RenderProfiler;
+class Renderer;
+class TextureManager;
+
+struct RenderSettings;
+
+class RenderProgram
+{
+public:
+	virtual ~RenderProgram();
+
+	// Creates the render program picked by the render settings for a world with the
+	// given dimensions. With dynamic resolution, each frame's render quality is picked
+	// between the settings' min quality and the given one to hold the target frame
+	// time; otherwise it stays at the given one. Pipelining only applies to backends
+	// that can overlap their work with the frame copy (i.e., OpenCL). The CPU backend
+	// ignores it, the kernel mode, the device split, reprojection, and the refine block
+	// size. Chunk skipping and step counting only apply to the lean and fused kernels
+	// and the CPU backend. When profiled, the program times each stage of its frames
+	// (see getProfiler()).
+	static std::unique_ptr<RenderProgram> make(int worldWidth, int worldHeight,
+		int worldDepth, TextureManager &textureManager, Renderer &renderer,
+		double renderQuality, const RenderSettings &settings);
+
+	// Gets the timings of recent frames, or null if the program isn't profiled. Device
+	// timings arrive a frame or two after the frame they belong to.
+	virtual const RenderProfiler *getProfiler() const = 0;
+
+	// Forgets the profiler's samples, including the device timings of earlier frames
+	// that haven't arrived yet, and keeps up to the given number of samples per stage
+	// from now on (i.e., one per stage for each of a timedemo's timed frames).
+	// Programs that aren't profiled ignore it.
+	virtual void resetProfiler(int windowSize) = 0;
+
+	// Waits for the device work of every frame so far to be done, so that their
+	// timings are in the profiler.
+	virtual void waitForFrames() = 0;
+
+	// Returns whether the program has a debug view. Only the OpenCL program has one,
+	// and only with reprojection or edge refinement. The CPU program has neither, so
+	// it has nothing to show.
+	virtual bool hasDebugView() const = 0;
+
+	// Turns the program's debug view on or off. The OpenCL program shows which pixels
+	// it reused from the last frame (or filled from their block's corners) and logs
+	// how many. Programs without a debug view ignore it.
+	virtual void setDebugView(bool debugView) = 0;
+
+	// Gets the average number of voxel grid steps per ray (sun shadow rays included)
+	// since the counts were last reset, or a negative number if the program doesn't
+	// count steps. Waits for any counts the device is still writing.
+	virtual double getAverageStepsPerRay() = 0;
+
+	// Starts counting rays and steps again from zero (i.e., after a timedemo's warmup).
+	virtual void resetStepCounts() = 0;
+
+	virtual void updateCamera(const Float3d &eye, const Float3d &direction, double fovY) = 0;
+
+	// Give this method total ticks instead of delta time so the constructor doesn't
+	// need a "start time". Also, this prevents any additive "double -> float" error.
+	virtual void updateGameTime(double gameTime) = 0;
+
+	// Changes the render dimensions (i.e., when the window is resized). Everything that
+	// doesn't depend on the render dimensions is kept. That includes the programs, 
+	// except for a kernel.cl with the render size compiled in (see CLProgram).
+	virtual void resize(int renderWidth, int renderHeight, Renderer &renderer) = 0;
+
+	// Changes the rectangles of a voxel (i.e., a door opening). Only the change itself
+	// is copied to the render program's world data before the next frame.
+	virtual void setVoxel(int cellX, int cellY, int cellZ,
+		const std::vector<Rect3D> &rectangles, int textureID) = 0;
+
+	// Adds a moving sprite (i.e., an NPC or projectile) and returns its sprite ID.
+	virtual int addSprite(const Rect3D &rectangle, int textureID) = 0;
+
+	// Changes a sprite's rectangle and texture. This can be called for hundreds of 
+	// sprites every frame; only the voxels each sprite touches are copied again.
+	virtual void moveSprite(int spriteID, const Rect3D &rectangle, int textureID) = 0;
+
+	virtual void removeSprite(int spriteID) = 0;
+
+	// Adds a point light (i.e., a torch) that is turned on and returns its light ID.
+	// Each voxel only shades with the lights whose radius reaches it.
+	virtual int addLight(const Float3f &position, const Float3f &color, float radius) = 0;
+
+	virtual void moveLight(int lightID, const Float3f &position) = 0;
+	virtual void setLightEnabled(int lightID, bool enabled) = 0;
+	virtual void removeLight(int lightID) = 0;
+
+	virtual void render(Renderer &renderer) = 0;
+};
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef RENDER_PROGRAM_TYPE_H
+#define RENDER_PROGRAM_TYPE_H
+
+// A render program type decides which backend draws the 3D game world. OpenCL is 
+// the default. The CPU one is a fallback for machines without a usable OpenCL device
+// (i.e., no GPU and no OpenCL CPU runtime).
+
+enum class RenderProgramType
+{
+	OpenCL,
+	CPU
+};
+
+#endif
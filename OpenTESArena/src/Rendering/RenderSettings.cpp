@@ -0,0 +1,19 @@
+#include "RenderSettings.h"
+
+RenderSettings::RenderSettings()
+{
+	this->renderProgramType = RenderProgramType::OpenCL;
+	this->dynamicResolution = false;
+	this->minRenderQuality = 1.0;
+	this->targetFrameTime = 1000.0 / 60.0;
+	this->pipelined = false;
+	this->clKernelMode = CLKernelMode::Full;
+	this->clDeviceSplit = CLDeviceSplit::None;
+	this->reprojected = false;
+	this->refineBlockSize = 1;
+	this->voxelLayout = VoxelLayout::Linear;
+	this->spriteMode = SpriteMode::Traced;
+	this->chunkSkipping = true;
+	this->stepCounted = false;
+	this->profiled = false;
+}
@@ -0,0 +1,37 @@
+#ifndef RENDER_SETTINGS_H
+#define RENDER_SETTINGS_H
+
+#include "CLDeviceSplit.h"
+#include "CLKernelMode.h"
+#include "RenderProgramType.h"
+#include "SpriteMode.h"
+#include "VoxelLayout.h"
+
+// Render settings pick and tune the 3D render program. They're kept together so they
+// can go from the options file to RenderProgram::make() as one thing instead of as a
+// long list of arguments that are easy to mix up.
+
+// Each setting's default is the renderer from before the setting existed, so options
+// files that don't have a setting keep the original behavior.
+
+struct RenderSettings
+{
+	RenderProgramType renderProgramType;
+	bool dynamicResolution; // Lowers the render quality when frames take too long.
+	double minRenderQuality; // Lowest render quality with dynamic resolution.
+	double targetFrameTime; // Render time dynamic resolution aims for, in milliseconds.
+	bool pipelined; // Trades one frame of latency for throughput.
+	CLKernelMode clKernelMode; // Only for the OpenCL render program.
+	CLDeviceSplit clDeviceSplit; // Only for the OpenCL render program.
+	bool reprojected; // Reuses last frame's hits where it can.
+	int refineBlockSize; // Pixels per side of an edge refinement block; 1 if off.
+	VoxelLayout voxelLayout; // Order of the per-voxel render lists.
+	SpriteMode spriteMode; // Whether sprites are traced or rasterized.
+	bool chunkSkipping; // Rays jump over empty chunks. Only turned off by timedemos.
+	bool stepCounted; // Counts grid steps per ray. Only turned on by timedemos.
+	bool profiled; // Times each stage of the render program's frames.
+
+	RenderSettings();
+};
+
+#endif
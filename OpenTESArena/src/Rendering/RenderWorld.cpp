@@ -0,0 +1,1035 @@
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <climits>
+#include <cmath>
+#include <unordered_map>
+
+#include "SDL.h"
+
+#include "RenderWorld.h"
+
+#include "../Math/Random.h"
+#include "../Media/PaletteFile.h"
+#include "../Media/PaletteName.h"
+#include "../Media/TextureManager.h"
+#include "../Utilities/Debug.h"
+#include "../World/Chunk.h"
+
+namespace
+{
+	// Gets the index of the palette color closest to the given ARGB color. Index 0
+	// is only for transparent pixels.
+	uint8_t getClosestPaletteIndex(const Palette &palette, uint32_t argb)
+	{
+		const Color color = Color::fromARGB(argb);
+		int closestIndex = 1;
+		int closestDistance = INT_MAX;
+		for (int i = 1; i < static_cast<int>(palette.size()); ++i)
+		{
+			const int dr = static_cast<int>(palette[i].getR()) - color.getR();
+			const int dg = static_cast<int>(palette[i].getG()) - color.getG();
+			const int db = static_cast<int>(palette[i].getB()) - color.getB();
+			const int distance = (dr * dr) + (dg * dg) + (db * db);
+			if (distance < closestDistance)
+			{
+				closestIndex = i;
+				closestDistance = distance;
+			}
+		}
+
+		return static_cast<uint8_t>(closestIndex);
+	}
+
+	// Appends the next mip level of a texture whose last level is at the given offset
+	// in the texels. Each mip texel comes from the (up to) 2x2 texels under it.
+	void appendMipLevel(std::vector<uint8_t> &texels, const Palette &palette, int offset,
+		int width, int height)
+	{
+		const int mipWidth = std::max(width / 2, 1);
+		const int mipHeight = std::max(height / 2, 1);
+		for (int y = 0; y < mipHeight; ++y)
+		{
+			for (int x = 0; x < mipWidth; ++x)
+			{
+				std::array<uint8_t, 4> block;
+				int blockCount = 0;
+				int opaqueCount = 0;
+				int r = 0;
+				int g = 0;
+				int b = 0;
+				for (int j = y * 2; j < std::min((y * 2) + 2, height); ++j)
+				{
+					for (int i = x * 2; i < std::min((x * 2) + 2, width); ++i)
+					{
+						const uint8_t texel = texels.at(offset + i + (j * width));
+						block.at(blockCount) = texel;
+						blockCount++;
+
+						if (texel != 0)
+						{
+							opaqueCount++;
+							r += palette[texel].getR();
+							g += palette[texel].getG();
+							b += palette[texel].getB();
+						}
+					}
+				}
+
+				// Transparent wins only if most of the block is, so thin things like
+				// fences don't vanish in the distance.
+				if ((opaqueCount * 2) < blockCount)
+				{
+					texels.push_back(0);
+					continue;
+				}
+
+				r /= opaqueCount;
+				g /= opaqueCount;
+				b /= opaqueCount;
+
+				uint8_t closestTexel = 0;
+				int closestDistance = INT_MAX;
+				for (int i = 0; i < blockCount; ++i)
+				{
+					const uint8_t texel = block.at(i);
+					if (texel == 0)
+					{
+						continue;
+					}
+
+					const int dr = static_cast<int>(palette[texel].getR()) - r;
+					const int dg = static_cast<int>(palette[texel].getG()) - g;
+					const int db = static_cast<int>(palette[texel].getB()) - b;
+					const int distance = (dr * dr) + (dg * dg) + (db * db);
+					if (distance < closestDistance)
+					{
+						closestTexel = texel;
+						closestDistance = distance;
+					}
+				}
+
+				texels.push_back(closestTexel);
+			}
+		}
+	}
+}
+
+const int RenderWorld::MAX_RECTANGLES_PER_VOXEL = 6;
+
+RenderWorld::RenderWorld(int width, int height, int depth, VoxelLayout voxelLayout)
+	: spriteHeap(VoxelIndexer(width, height, depth, voxelLayout).getCount()),
+	lightManager(width, height, depth, voxelLayout),
+	voxelIndexer(width, height, depth, voxelLayout)
+{
+	assert(width > 0);
+	assert(height > 0);
+	assert(depth > 0);
+
+	this->width = width;
+	this->height = height;
+	this->depth = depth;
+
+	this->spriteMode = SpriteMode::Traced;
+	this->mipmapped = false;
+	this->usedRectangleCount = 0;
+	this->paletteDirty = true;
+
+	// Every voxel starts out as air, with no rectangles.
+	const int voxelCount = this->voxelIndexer.getCount();
+	this->voxelRefs = std::vector<VoxelReference>(voxelCount, VoxelReference(0, 0));
+	this->dirtyVoxelRefs.add(0, voxelCount);
+
+	// Every chunk starts out empty, too.
+	this->chunkCountX = (width + Chunk::Width - 1) / Chunk::Width;
+	this->chunkCountY = (height + Chunk::Height - 1) / Chunk::Height;
+	this->chunkCountZ = (depth + Chunk::Depth - 1) / Chunk::Depth;
+
+	const int chunkCount = this->chunkCountX * this->chunkCountY * this->chunkCountZ;
+	const int chunkWordCount = (chunkCount + 31) / 32;
+	this->chunkOccupantCounts = std::vector<int>(chunkCount, 0);
+	this->chunkOccupancy = std::vector<uint32_t>(chunkWordCount, 0);
+	this->dirtyChunkOccupancy.add(0, chunkWordCount);
+}
+
+RenderWorld::~RenderWorld()
+{
+
+}
+
+void RenderWorld::addChunkOccupants(int voxelIndex, int count)
+{
+	int cellX, cellY, cellZ;
+	this->voxelIndexer.getCell(voxelIndex, &cellX, &cellY, &cellZ);
+	const int chunkIndex = this->getChunkIndex(cellX, cellY, cellZ);
+
+	int &occupantCount = this->chunkOccupantCounts.at(chunkIndex);
+	occupantCount += count;
+	assert(occupantCount >= 0);
+
+	const int wordIndex = chunkIndex / 32;
+	const uint32_t bit = 1u << (chunkIndex % 32);
+	uint32_t &word = this->chunkOccupancy.at(wordIndex);
+	const uint32_t oldWord = word;
+	word = (occupantCount > 0) ? (word | bit) : (word & ~bit);
+
+	if (word != oldWord)
+	{
+		this->dirtyChunkOccupancy.add(wordIndex, 1);
+	}
+}
+
+std::vector<int> RenderWorld::getSpriteVoxelIndices(const Rect3D &rectangle) const
+{
+	const Float3f &p1 = rectangle.getP1();
+	const Float3f &p2 = rectangle.getP2();
+	const Float3f &p3 = rectangle.getP3();
+	const Float3f p4 = p1 + (p3 - p2);
+
+	// Voxel range of the bounding box on each axis, clamped to the grid.
+	const std::array<float, 4> xs = { p1.getX(), p2.getX(), p3.getX(), p4.getX() };
+	const std::array<float, 4> ys = { p1.getY(), p2.getY(), p3.getY(), p4.getY() };
+	const std::array<float, 4> zs = { p1.getZ(), p2.getZ(), p3.getZ(), p4.getZ() };
+	auto getCellRange = [](const std::array<float, 4> &values, int size, int &minCell,
+		int &maxCell)
+	{
+		const auto minMax = std::minmax_element(values.begin(), values.end());
+		minCell = std::max(static_cast<int>(std::floor(*minMax.first)), 0);
+		maxCell = std::min(static_cast<int>(std::floor(*minMax.second)), size - 1);
+	};
+
+	int minX, maxX, minY, maxY, minZ, maxZ;
+	getCellRange(xs, this->width, minX, maxX);
+	getCellRange(ys, this->height, minY, maxY);
+	getCellRange(zs, this->depth, minZ, maxZ);
+
+	// A sprite entirely outside the grid is in no voxels.
+	std::vector<int> voxelIndices;
+	for (int z = minZ; z <= maxZ; ++z)
+	{
+		for (int y = minY; y <= maxY; ++y)
+		{
+			for (int x = minX; x <= maxX; ++x)
+			{
+				voxelIndices.push_back(this->getVoxelIndex(x, y, z));
+			}
+		}
+	}
+
+	// Only the linear layout is already in ascending order.
+	std::sort(voxelIndices.begin(), voxelIndices.end());
+	return voxelIndices;
+}
+
+std::vector<Rect3D> RenderWorld::makeBlock(int cellX, int cellY, int cellZ)
+{
+	float x = static_cast<float>(cellX);
+	float y = static_cast<float>(cellY);
+	float z = static_cast<float>(cellZ);
+	const float sideLength = 1.0f;
+
+	// Front.
+	Rect3D r1(
+		Float3f(x + sideLength, y + sideLength, z),
+		Float3f(x + sideLength, y, z),
+		Float3f(x, y, z));
+
+	// Back.
+	Rect3D r2(
+		Float3f(x, y + sideLength, z + sideLength),
+		Float3f(x, y, z + sideLength),
+		Float3f(x + sideLength, y, z + sideLength));
+
+	// Top.
+	Rect3D r3(
+		Float3f(x + sideLength, y + sideLength, z + sideLength),
+		Float3f(x + sideLength, y + sideLength, z),
+		Float3f(x, y + sideLength, z));
+
+	// Bottom.
+	Rect3D r4(
+		Float3f(x + sideLength, y, z),
+		Float3f(x + sideLength, y, z + sideLength),
+		Float3f(x, y, z + sideLength));
+
+	// Right.
+	Rect3D r5(
+		Float3f(x, y + sideLength, z),
+		Float3f(x, y, z),
+		Float3f(x, y, z + sideLength));
+
+	// Left.
+	Rect3D r6(
+		Float3f(x + sideLength, y + sideLength, z + sideLength),
+		Float3f(x + sideLength, y, z + sideLength),
+		Float3f(x + sideLength, y, z));
+
+	return std::vector<Rect3D>{ r1, r2, r3, r4, r5, r6 };
+}
+
+void RenderWorld::addChangedVoxels(const std::vector<int> &voxelIndices)
+{
+	if (voxelIndices.size() == 0)
+	{
+		return;
+	}
+
+	// Voxel indices aren't in cell order in every layout, so look at each voxel's cell.
+	int minX = INT_MAX, minY = INT_MAX, minZ = INT_MAX;
+	int maxX = INT_MIN, maxY = INT_MIN, maxZ = INT_MIN;
+	for (const int voxelIndex : voxelIndices)
+	{
+		int x, y, z;
+		this->voxelIndexer.getCell(voxelIndex, &x, &y, &z);
+		minX = std::min(minX, x);
+		minY = std::min(minY, y);
+		minZ = std::min(minZ, z);
+		maxX = std::max(maxX, x);
+		maxY = std::max(maxY, y);
+		maxZ = std::max(maxZ, z);
+	}
+
+	this->changedGeometry.push_back(std::make_pair(
+		Float3f(static_cast<float>(minX), static_cast<float>(minY),
+			static_cast<float>(minZ)),
+		Float3f(static_cast<float>(maxX + 1), static_cast<float>(maxY + 1),
+			static_cast<float>(maxZ + 1))));
+}
+
+void RenderWorld::addChangedLight(int lightID)
+{
+	const PointLight &light = this->lightManager.getLights().at(lightID);
+	const float radius = light.getRadius();
+	const Float3f extent(radius, radius, radius);
+	this->changedLighting.push_back(std::make_pair(light.getPosition() - extent,
+		light.getPosition() + extent));
+}
+
+int RenderWorld::getWidth() const
+{
+	return this->width;
+}
+
+int RenderWorld::getHeight() const
+{
+	return this->height;
+}
+
+int RenderWorld::getDepth() const
+{
+	return this->depth;
+}
+
+int RenderWorld::getChunkCountX() const
+{
+	return this->chunkCountX;
+}
+
+int RenderWorld::getChunkCountY() const
+{
+	return this->chunkCountY;
+}
+
+int RenderWorld::getChunkCountZ() const
+{
+	return this->chunkCountZ;
+}
+
+int RenderWorld::getVoxelIndex(int cellX, int cellY, int cellZ) const
+{
+	return this->voxelIndexer.getIndex(cellX, cellY, cellZ);
+}
+
+const VoxelIndexer &RenderWorld::getVoxelIndexer() const
+{
+	return this->voxelIndexer;
+}
+
+int RenderWorld::getChunkIndex(int cellX, int cellY, int cellZ) const
+{
+	assert(cellX >= 0);
+	assert(cellY >= 0);
+	assert(cellZ >= 0);
+	assert(cellX < this->width);
+	assert(cellY < this->height);
+	assert(cellZ < this->depth);
+
+	const int chunkX = cellX / Chunk::Width;
+	const int chunkY = cellY / Chunk::Height;
+	const int chunkZ = cellZ / Chunk::Depth;
+	return chunkX + (chunkY * this->chunkCountX) +
+		(chunkZ * this->chunkCountX * this->chunkCountY);
+}
+
+bool RenderWorld::isChunkEmpty(int chunkIndex) const
+{
+	assert(chunkIndex >= 0);
+	assert(chunkIndex < static_cast<int>(this->chunkOccupantCounts.size()));
+
+	return ((this->chunkOccupancy[chunkIndex / 32] >> (chunkIndex % 32)) & 1) == 0;
+}
+
+const VoxelReference &RenderWorld::getVoxelReference(int cellX, int cellY, int cellZ) const
+{
+	return this->voxelRefs.at(this->getVoxelIndex(cellX, cellY, cellZ));
+}
+
+const std::vector<VoxelReference> &RenderWorld::getVoxelReferences() const
+{
+	return this->voxelRefs;
+}
+
+const std::vector<Rect3D> &RenderWorld::getRectangles() const
+{
+	return this->rectangles;
+}
+
+const std::vector<int> &RenderWorld::getRectangleTextureIDs() const
+{
+	return this->rectangleTextureIDs;
+}
+
+const std::vector<TextureReference> &RenderWorld::getTextureReferences() const
+{
+	return this->textureRefs;
+}
+
+const std::vector<uint8_t> &RenderWorld::getTexels() const
+{
+	return this->texels;
+}
+
+const std::vector<int> &RenderWorld::getTextureUseCounts() const
+{
+	return this->textureUseCounts;
+}
+
+const std::vector<uint32_t> &RenderWorld::getChunkOccupancy() const
+{
+	return this->chunkOccupancy;
+}
+
+const SpriteHeap &RenderWorld::getSpriteHeap() const
+{
+	return this->spriteHeap;
+}
+
+const LightManager &RenderWorld::getLightManager() const
+{
+	return this->lightManager;
+}
+
+const Palette &RenderWorld::getPalette() const
+{
+	return this->palette;
+}
+
+SpriteMode RenderWorld::getSpriteMode() const
+{
+	return this->spriteMode;
+}
+
+bool RenderWorld::isMipmapped() const
+{
+	return this->mipmapped;
+}
+
+const std::vector<Rect3D> &RenderWorld::getSpriteRectangles() const
+{
+	return this->spriteRectangles;
+}
+
+const std::vector<int> &RenderWorld::getSpriteTextureIDs() const
+{
+	return this->spriteTextureIDs;
+}
+
+const std::vector<bool> &RenderWorld::getActiveSprites() const
+{
+	return this->activeSprites;
+}
+
+int RenderWorld::addTexture(const SDL_Surface *surface)
+{
+	assert(surface != nullptr);
+
+	// One level per halving until both sides are 1, or just the full size one.
+	int mipLevelCount = 1;
+	while (this->mipmapped && (((surface->w >> (mipLevelCount - 1)) > 1) ||
+		((surface->h >> (mipLevelCount - 1)) > 1)))
+	{
+		mipLevelCount++;
+	}
+
+	const int offset = static_cast<int>(this->texels.size());
+	const int textureID = static_cast<int>(this->textureRefs.size());
+	this->textureRefs.push_back(TextureReference(offset,
+		static_cast<short>(surface->w), static_cast<short>(surface->h), mipLevelCount));
+	this->textureUseCounts.push_back(0);
+
+	// The surface only has the palette's colors, so turn them back into indices. Fully
+	// transparent pixels are index 0 no matter what color they have.
+	std::unordered_map<uint32_t, uint8_t> paletteIndices;
+	for (int i = static_cast<int>(this->palette.size()) - 1; i > 0; --i)
+	{
+		paletteIndices[this->palette[i].toARGB()] = static_cast<uint8_t>(i);
+	}
+
+	// Read one row at a time in case the surface has padding at the end of its rows.
+	const uint8_t *pixels = static_cast<const uint8_t*>(surface->pixels);
+	for (int y = 0; y < surface->h; ++y)
+	{
+		const uint32_t *row = reinterpret_cast<const uint32_t*>(
+			pixels + (y * surface->pitch));
+		for (int x = 0; x < surface->w; ++x)
+		{
+			const uint32_t argb = row[x];
+			if ((argb >> 24) == 0)
+			{
+				this->texels.push_back(0);
+				continue;
+			}
+
+			auto indexIter = paletteIndices.find(argb);
+			if (indexIter == paletteIndices.end())
+			{
+				indexIter = paletteIndices.insert(std::make_pair(argb,
+					getClosestPaletteIndex(this->palette, argb))).first;
+			}
+
+			this->texels.push_back(indexIter->second);
+		}
+	}
+
+	int levelOffset = offset;
+	int levelWidth = surface->w;
+	int levelHeight = surface->h;
+	for (int i = 1; i < mipLevelCount; ++i)
+	{
+		appendMipLevel(this->texels, this->palette, levelOffset, levelWidth, levelHeight);
+		levelOffset += levelWidth * levelHeight;
+		levelWidth = std::max(levelWidth / 2, 1);
+		levelHeight = std::max(levelHeight / 2, 1);
+	}
+
+	this->dirtyTexels.add(offset, static_cast<int>(this->texels.size()) - offset);
+
+	return textureID;
+}
+
+const DirtyRanges &RenderWorld::getDirtyVoxelReferences() const
+{
+	return this->dirtyVoxelRefs;
+}
+
+const DirtyRanges &RenderWorld::getDirtyRectangles() const
+{
+	return this->dirtyRectangles;
+}
+
+const DirtyRanges &RenderWorld::getDirtyTexels() const
+{
+	return this->dirtyTexels;
+}
+
+const DirtyRanges &RenderWorld::getDirtyChunkOccupancy() const
+{
+	return this->dirtyChunkOccupancy;
+}
+
+bool RenderWorld::isPaletteDirty() const
+{
+	return this->paletteDirty;
+}
+
+const std::vector<std::pair<Float3f, Float3f>> &RenderWorld::getChangedGeometry() const
+{
+	return this->changedGeometry;
+}
+
+const std::vector<std::pair<Float3f, Float3f>> &RenderWorld::getChangedLighting() const
+{
+	return this->changedLighting;
+}
+
+bool RenderWorld::isPacked() const
+{
+	return this->usedRectangleCount == static_cast<int>(this->rectangles.size());
+}
+
+void RenderWorld::setVoxel(int cellX, int cellY, int cellZ,
+	const std::vector<Rect3D> &rectangles, int textureID)
+{
+	assert(textureID >= 0);
+	assert(textureID < static_cast<int>(this->textureRefs.size()));
+
+	const int rectangleCount = static_cast<int>(rectangles.size());
+	Debug::check(rectangleCount <= RenderWorld::MAX_RECTANGLES_PER_VOXEL, "RenderWorld",
+		"Too many rectangles (" + std::to_string(rectangleCount) + ") in voxel.");
+
+	const int voxelIndex = this->getVoxelIndex(cellX, cellY, cellZ);
+	const VoxelReference &oldVoxelRef = this->voxelRefs.at(voxelIndex);
+	const int oldRectangleCount = oldVoxelRef.getRectangleCount();
+
+	for (int i = 0; i < oldRectangleCount; ++i)
+	{
+		this->textureUseCounts.at(
+			this->rectangleTextureIDs.at(oldVoxelRef.getOffset() + i))--;
+	}
+
+	this->textureUseCounts.at(textureID) += rectangleCount;
+
+	// Reuse the voxel's range if the new rectangles fit. Otherwise, append them.
+	int offset;
+	if (rectangleCount <= oldRectangleCount)
+	{
+		offset = oldVoxelRef.getOffset();
+
+		for (int i = 0; i < rectangleCount; ++i)
+		{
+			this->rectangles.at(offset + i) = rectangles.at(i);
+			this->rectangleTextureIDs.at(offset + i) = textureID;
+		}
+	}
+	else
+	{
+		offset = static_cast<int>(this->rectangles.size());
+
+		for (const auto &rectangle : rectangles)
+		{
+			this->rectangles.push_back(rectangle);
+			this->rectangleTextureIDs.push_back(textureID);
+		}
+	}
+
+	this->usedRectangleCount += rectangleCount - oldRectangleCount;
+	this->voxelRefs.at(voxelIndex) = VoxelReference(offset, rectangleCount);
+
+	this->dirtyVoxelRefs.add(voxelIndex, 1);
+	this->dirtyRectangles.add(offset, rectangleCount);
+	this->addChangedVoxels({ voxelIndex });
+
+	// Update the chunk's bit if the voxel went between air and not air.
+	const bool wasAir = oldRectangleCount == 0;
+	const bool isAir = rectangleCount == 0;
+	if (wasAir != isAir)
+	{
+		this->addChunkOccupants(voxelIndex, isAir ? -1 : 1);
+	}
+}
+
+int RenderWorld::addSprite(const Rect3D &rectangle, int textureID)
+{
+	assert(textureID >= 0);
+	assert(textureID < static_cast<int>(this->textureRefs.size()));
+
+	// Reuse the ID of a removed sprite if there is one.
+	int spriteID;
+	if (this->freeSpriteIDs.size() > 0)
+	{
+		spriteID = this->freeSpriteIDs.back();
+		this->freeSpriteIDs.pop_back();
+		this->activeSprites.at(spriteID) = true;
+	}
+	else
+	{
+		spriteID = static_cast<int>(this->activeSprites.size());
+		this->activeSprites.push_back(true);
+		this->spriteVoxelIndices.push_back(std::vector<int>());
+		this->spriteRectangles.push_back(rectangle);
+		this->spriteTextureIDs.push_back(textureID);
+	}
+
+	this->spriteRectangles.at(spriteID) = rectangle;
+	this->spriteTextureIDs.at(spriteID) = textureID;
+	this->textureUseCounts.at(textureID)++;
+
+	// Rasterized sprites still keep the voxels they touch, so the screen behind where
+	// they were can be drawn again when they move.
+	std::vector<int> &voxelIndices = this->spriteVoxelIndices.at(spriteID);
+	voxelIndices = this->getSpriteVoxelIndices(rectangle);
+	if (this->spriteMode == SpriteMode::Traced)
+	{
+		for (const int voxelIndex : voxelIndices)
+		{
+			this->spriteHeap.add(voxelIndex, spriteID, rectangle, textureID);
+			this->addChunkOccupants(voxelIndex, 1);
+		}
+	}
+
+	this->addChangedVoxels(voxelIndices);
+	return spriteID;
+}
+
+void RenderWorld::moveSprite(int spriteID, const Rect3D &rectangle, int textureID)
+{
+	assert(this->activeSprites.at(spriteID));
+	assert(textureID >= 0);
+	assert(textureID < static_cast<int>(this->textureRefs.size()));
+
+	std::vector<int> &oldVoxelIndices = this->spriteVoxelIndices.at(spriteID);
+	std::vector<int> newVoxelIndices = this->getSpriteVoxelIndices(rectangle);
+	this->addChangedVoxels(oldVoxelIndices);
+	this->addChangedVoxels(newVoxelIndices);
+	this->spriteRectangles.at(spriteID) = rectangle;
+	this->textureUseCounts.at(this->spriteTextureIDs.at(spriteID))--;
+	this->textureUseCounts.at(textureID)++;
+	this->spriteTextureIDs.at(spriteID) = textureID;
+
+	if (this->spriteMode == SpriteMode::Rasterized)
+	{
+		oldVoxelIndices = std::move(newVoxelIndices);
+		return;
+	}
+
+	// Both lists are sorted, so walk them together. Voxels in both only get their copy
+	// of the rectangle overwritten.
+	size_t oldIndex = 0;
+	size_t newIndex = 0;
+	while ((oldIndex < oldVoxelIndices.size()) || (newIndex < newVoxelIndices.size()))
+	{
+		const int oldVoxel = (oldIndex < oldVoxelIndices.size()) ?
+			oldVoxelIndices[oldIndex] : INT_MAX;
+		const int newVoxel = (newIndex < newVoxelIndices.size()) ?
+			newVoxelIndices[newIndex] : INT_MAX;
+
+		if (oldVoxel == newVoxel)
+		{
+			this->spriteHeap.update(oldVoxel, spriteID, rectangle, textureID);
+			oldIndex++;
+			newIndex++;
+		}
+		else if (oldVoxel < newVoxel)
+		{
+			this->spriteHeap.remove(oldVoxel, spriteID);
+			this->addChunkOccupants(oldVoxel, -1);
+			oldIndex++;
+		}
+		else
+		{
+			this->spriteHeap.add(newVoxel, spriteID, rectangle, textureID);
+			this->addChunkOccupants(newVoxel, 1);
+			newIndex++;
+		}
+	}
+
+	oldVoxelIndices = std::move(newVoxelIndices);
+}
+
+void RenderWorld::removeSprite(int spriteID)
+{
+	assert(this->activeSprites.at(spriteID));
+
+	std::vector<int> &voxelIndices = this->spriteVoxelIndices.at(spriteID);
+	this->addChangedVoxels(voxelIndices);
+	if (this->spriteMode == SpriteMode::Traced)
+	{
+		for (const int voxelIndex : voxelIndices)
+		{
+			this->spriteHeap.remove(voxelIndex, spriteID);
+			this->addChunkOccupants(voxelIndex, -1);
+		}
+	}
+
+	voxelIndices.clear();
+	this->activeSprites.at(spriteID) = false;
+	this->textureUseCounts.at(this->spriteTextureIDs.at(spriteID))--;
+	this->freeSpriteIDs.push_back(spriteID);
+}
+
+int RenderWorld::addLight(const Float3f &position, const Float3f &color, float radius)
+{
+	const int lightID = this->lightManager.addLight(position, color, radius);
+	this->addChangedLight(lightID);
+	return lightID;
+}
+
+void RenderWorld::moveLight(int lightID, const Float3f &position)
+{
+	// Both where the light was and where it is now look different.
+	this->addChangedLight(lightID);
+	this->lightManager.moveLight(lightID, position);
+	this->addChangedLight(lightID);
+}
+
+void RenderWorld::setLightEnabled(int lightID, bool enabled)
+{
+	this->lightManager.setLightEnabled(lightID, enabled);
+	this->addChangedLight(lightID);
+}
+
+void RenderWorld::removeLight(int lightID)
+{
+	this->addChangedLight(lightID);
+	this->lightManager.removeLight(lightID);
+}
+
+void RenderWorld::pack()
+{
+	// The exclusive prefix sum of the voxels' rectangle counts is where each voxel's 
+	// rectangles go in the packed list.
+	const int voxelCount = static_cast<int>(this->voxelRefs.size());
+	std::vector<int> offsets(voxelCount);
+
+	int rectangleCount = 0;
+	for (int i = 0; i < voxelCount; ++i)
+	{
+		offsets.at(i) = rectangleCount;
+		rectangleCount += this->voxelRefs.at(i).getRectangleCount();
+	}
+
+	assert(rectangleCount == this->usedRectangleCount);
+
+	std::vector<Rect3D> packedRectangles;
+	std::vector<int> packedTextureIDs;
+	packedRectangles.reserve(rectangleCount);
+	packedTextureIDs.reserve(rectangleCount);
+
+	for (int i = 0; i < voxelCount; ++i)
+	{
+		const VoxelReference &voxelRef = this->voxelRefs.at(i);
+		const int offset = voxelRef.getOffset();
+		const int count = voxelRef.getRectangleCount();
+		assert(static_cast<int>(packedRectangles.size()) == offsets.at(i));
+
+		packedRectangles.insert(packedRectangles.end(),
+			this->rectangles.begin() + offset, this->rectangles.begin() + offset + count);
+		packedTextureIDs.insert(packedTextureIDs.end(),
+			this->rectangleTextureIDs.begin() + offset,
+			this->rectangleTextureIDs.begin() + offset + count);
+
+		this->voxelRefs.at(i) = VoxelReference(offsets.at(i), count);
+	}
+
+	this->rectangles = std::move(packedRectangles);
+	this->rectangleTextureIDs = std::move(packedTextureIDs);
+
+	// Everything moved, so all of it needs copying again.
+	this->dirtyVoxelRefs.clear();
+	this->dirtyRectangles.clear();
+	this->dirtyVoxelRefs.add(0, voxelCount);
+	this->dirtyRectangles.add(0, rectangleCount);
+}
+
+void RenderWorld::setPalette(const Palette &palette)
+{
+	this->palette = palette;
+	this->paletteDirty = true;
+}
+
+void RenderWorld::setSpriteMode(SpriteMode spriteMode)
+{
+	assert(std::find(this->activeSprites.begin(), this->activeSprites.end(), true) ==
+		this->activeSprites.end());
+
+	this->spriteMode = spriteMode;
+}
+
+void RenderWorld::setMipmapped(bool mipmapped)
+{
+	assert(this->textureRefs.size() == 0);
+
+	this->mipmapped = mipmapped;
+}
+
+void RenderWorld::clearDirtyRanges()
+{
+	this->dirtyVoxelRefs.clear();
+	this->dirtyRectangles.clear();
+	this->dirtyTexels.clear();
+	this->dirtyChunkOccupancy.clear();
+	this->changedGeometry.clear();
+	this->changedLighting.clear();
+	this->spriteHeap.clearDirtyRanges();
+	this->lightManager.clearDirtyRanges();
+	this->paletteDirty = false;
+}
+
+void RenderWorld::makeTestWorld(TextureManager &textureManager)
+{
+	Debug::mention("RenderWorld", "Making test world.");
+
+	// Prepare some textures.
+	textureManager.setPalette(PaletteFile::fromName(PaletteName::Default));
+	this->setPalette(textureManager.getPalette());
+	std::vector<const SDL_Surface*> textures =
+	{
+		// Texture indices:
+		// 0: city wall
+		textureManager.getSurface("CITYWALL.IMG").getSurface(),
+
+		// 1-3: grounds
+		textureManager.getSurfaces("NORM1.SET").at(0),
+		textureManager.getSurfaces("NORM1.SET").at(1),
+		textureManager.getSurfaces("NORM1.SET").at(2),
+
+		// 4-5: gates
+		textureManager.getSurface("DLGT.IMG").getSurface(),
+		textureManager.getSurface("DRGT.IMG").getSurface(),
+
+		// 6-9: tavern + door
+		textureManager.getSurfaces("MTAVERN.SET").at(0),
+		textureManager.getSurfaces("MTAVERN.SET").at(1),
+		textureManager.getSurfaces("MTAVERN.SET").at(2),
+		textureManager.getSurface("DTAV.IMG").getSurface(),
+
+		// 10-15: temple + door
+		textureManager.getSurfaces("MTEMPLE.SET").at(0),
+		textureManager.getSurfaces("MTEMPLE.SET").at(1),
+		textureManager.getSurfaces("MTEMPLE.SET").at(2),
+		textureManager.getSurfaces("MTEMPLE.SET").at(3),
+		textureManager.getSurfaces("MTEMPLE.SET").at(4),
+		textureManager.getSurface("DTEP.IMG").getSurface(),
+
+		// 16-21: Mages' Guild + door
+		textureManager.getSurfaces("MMUGUILD.SET").at(0),
+		textureManager.getSurfaces("MMUGUILD.SET").at(1),
+		textureManager.getSurfaces("MMUGUILD.SET").at(2),
+		textureManager.getSurfaces("MMUGUILD.SET").at(3),
+		textureManager.getSurfaces("MMUGUILD.SET").at(4),
+		textureManager.getSurface("DMU.IMG").getSurface(),
+
+		// 22-25: Equipment store + door
+		textureManager.getSurfaces("MEQUIP.SET").at(0),
+		textureManager.getSurfaces("MEQUIP.SET").at(1),
+		textureManager.getSurfaces("MEQUIP.SET").at(2),
+		textureManager.getSurface("DEQ.IMG").getSurface(),
+
+		// 26-29: Noble house + door
+		textureManager.getSurfaces("MNOBLE.SET").at(0),
+		textureManager.getSurfaces("MNOBLE.SET").at(1),
+		textureManager.getSurfaces("MNOBLE.SET").at(2),
+		textureManager.getSurface("DNB1.IMG").getSurface(),
+	};
+
+	for (const auto *texture : textures)
+	{
+		this->addTexture(texture);
+	}
+
+	// Use the same seed so it's not a new city on every screen resize.
+	Random random(2);
+
+	// Make the ground.
+	for (int k = 0; k < this->depth; ++k)
+	{
+		for (int i = 0; i < this->width; ++i)
+		{
+			const int textureID = 1 + random.next(3);
+			this->setVoxel(i, 0, k, RenderWorld::makeBlock(i, 0, k), textureID);
+		}
+	}
+
+	// Make the near X and far X walls.
+	for (int j = 1; j < this->height; ++j)
+	{
+		for (int k = 0; k < this->depth; ++k)
+		{
+			this->setVoxel(0, j, k, RenderWorld::makeBlock(0, j, k), 0);
+			this->setVoxel(this->width - 1, j, k,
+				RenderWorld::makeBlock(this->width - 1, j, k), 0);
+		}
+	}
+
+	// Make the near Z and far Z walls (ignoring existing corners).
+	for (int j = 1; j < this->height; ++j)
+	{
+		for (int i = 1; i < (this->width - 1); ++i)
+		{
+			this->setVoxel(i, j, 0, RenderWorld::makeBlock(i, j, 0), 0);
+			this->setVoxel(i, j, this->depth - 1,
+				RenderWorld::makeBlock(i, j, this->depth - 1), 0);
+		}
+	}
+
+	// Lambda for adding some simple cube buildings.
+	auto makeBuilding = [this, &random](int cellX, int cellZ, int width, int height,
+		int depth, const std::vector<int> &textureIDs)
+	{
+		const int cellY = 1;
+
+		for (int k = 0; k < depth; ++k)
+		{
+			for (int j = 0; j < height; ++j)
+			{
+				for (int i = 0; i < width; ++i)
+				{
+					const int x = cellX + i;
+					const int y = cellY + j;
+					const int z = cellZ + k;
+
+					const int textureID = textureIDs.at(random.next(
+						static_cast<int>(textureIDs.size())));
+
+					this->setVoxel(x, y, z, RenderWorld::makeBlock(x, y, z), textureID);
+				}
+			}
+		}
+	};
+
+	// Add some simple buildings around. This data should come from a "World" or 
+	// "CityData" class sometime.
+
+	// Tavern #1
+	makeBuilding(3, 5, 5, 2, 6, { 6, 7, 8 });
+	makeBuilding(3, 6, 1, 1, 1, { 9 });
+
+	// Tavern #2
+	makeBuilding(3, 13, 7, 1, 5, { 6, 7, 8 });
+	makeBuilding(6, 13, 1, 1, 1, { 9 });
+
+	// Temple #1
+	makeBuilding(11, 4, 6, 2, 5, { 10, 11, 12, 13, 14 });
+	makeBuilding(11, 6, 1, 1, 1, { 15 });
+
+	// Mage's Guild #1
+	makeBuilding(12, 12, 5, 2, 4, { 16, 17, 18, 19, 20 });
+	makeBuilding(15, 12, 1, 1, 1, { 21 });
+
+	// Equipment store #1
+	makeBuilding(20, 4, 5, 1, 7, { 22, 23, 24 });
+	makeBuilding(20, 8, 1, 1, 1, { 25 });
+
+	// Equipment store #2
+	makeBuilding(11, 19, 6, 2, 6, { 22, 23, 24 });
+	makeBuilding(13, 19, 1, 1, 1, { 25 });
+
+	// Noble house #1
+	makeBuilding(21, 15, 6, 2, 8, { 26, 27, 28 });
+	makeBuilding(21, 17, 1, 1, 1, { 29 });
+
+	// Add a city gate with some walls.
+	makeBuilding(8, 0, 1, 1, 1, { 4 });
+	makeBuilding(9, 0, 1, 1, 1, { 5 });
+	makeBuilding(1, 1, 7, this->height - 1, 1, { 0 });
+	makeBuilding(10, 1, 3, this->height - 1, 1, { 0 });
+
+	// Put a torch by each door and a brazier on each side of the city gate (inside).
+	const Float3f torchColor(1.0f, 0.60f, 0.25f);
+	const float torchRadius = 4.0f;
+	const std::vector<Float3f> torchPositions =
+	{
+		Float3f(2.5f, 1.8f, 6.5f), // Tavern #1
+		Float3f(6.5f, 1.8f, 12.5f), // Tavern #2
+		Float3f(10.5f, 1.8f, 6.5f), // Temple #1
+		Float3f(15.5f, 1.8f, 11.5f), // Mage's Guild #1
+		Float3f(19.5f, 1.8f, 8.5f), // Equipment store #1
+		Float3f(13.5f, 1.8f, 18.5f), // Equipment store #2
+		Float3f(20.5f, 1.8f, 17.5f), // Noble house #1
+		Float3f(7.5f, 1.5f, 2.5f), // City gate
+		Float3f(10.5f, 1.5f, 2.5f)
+	};
+
+	for (const auto &position : torchPositions)
+	{
+		this->addLight(position, torchColor, torchRadius);
+	}
+
+	// Drop the holes left by overwritten voxels.
+	this->pack();
+
+	Debug::mention("RenderWorld", "Test world has " +
+		std::to_string(this->rectangles.size()) + " rectangles and " +
+		std::to_string(this->lightManager.getLights().size()) + " lights in " +
+		std::to_string(this->voxelRefs.size()) + " voxels.");
+}
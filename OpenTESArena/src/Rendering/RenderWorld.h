@@ -0,0 +1,242 @@
+#ifndef RENDER_WORLD_H
+#define RENDER_WORLD_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "DirtyRanges.h"
+#include "LightManager.h"
+#include "SpriteHeap.h"
+#include "SpriteMode.h"
+#include "TextureReference.h"
+#include "VoxelIndexer.h"
+#include "VoxelReference.h"
+#include "../Math/Rect3D.h"
+#include "../Media/Palette.h"
+
+// A render world is the host's copy of the geometry and textures that the 3D render
+// programs draw. It has a voxel reference for every cell in the voxel grid, the list 
+// of rectangles those references point into, and the texels of every texture used by
+// the rectangles.
+
+// The voxel references (and the sprite heap's and light manager's per-voxel lists)
+// are in the order of a voxel layout (see VoxelIndexer), which render programs have
+// to index them with.
+
+// Texels are 8-bit indices into the palette, like in Arena's own files. Index 0 is 
+// transparent. Changing the palette (i.e., for a night or underwater tint) recolors
+// every texture without touching the texels.
+
+// When mipmapped, each texture is followed by its mip levels, each half the size of the
+// one before down to 1x1, so far away surfaces can be sampled without scattered texel
+// reads. Only render programs that sample them (the lean kernels) turn it on. A
+// mip texel is one of the texels under it, not an average, so it's still an index
+// that any palette can recolor. It's the one closest to their average color in the
+// palette the texture was added with, or transparent if most of them are.
+
+// It doesn't know anything about OpenCL or SDL textures. Each render program reads 
+// from it and converts the data into whatever format it needs (i.e., the CLProgram 
+// packs it into byte buffers that match the kernel structs).
+
+// Only rectangles that exist are stored. Each voxel's rectangles are back to back in
+// the rectangle list, and air voxels take no room at all. Changing a voxel reuses its
+// range if the new rectangles fit, otherwise they are appended to the end of the list
+// and the old range becomes a hole. pack() removes the holes by giving every voxel
+// a new offset from a prefix sum of the rectangle counts.
+
+// Sprites (NPCs, projectiles, etc.) move every frame, so they live in a sprite heap 
+// instead. A sprite gets a copy of its rectangle in every voxel its rectangle's 
+// bounding box touches. When sprites are rasterized (see SpriteMode), they stay out
+// of the sprite heap and the chunk occupancy, and render programs draw them from the
+// list of sprite rectangles instead.
+
+// Point lights are kept by a light manager, which gives each voxel a list of the
+// lights that reach into it.
+
+// On top of the voxel references is a coarse level with one bit per chunk (the same 
+// 8x4x8 voxels as a Chunk) that says whether the chunk has any rectangles, including
+// sprites. A ray can skip over a whole empty chunk at once instead of stepping through
+// every voxel.
+// The bits are packed 32 to a word, in chunk index order (X, then Y, then Z).
+
+// Every change is also recorded in dirty ranges, so a render program only needs to 
+// convert and copy the parts of the world that changed since it last looked. Changes
+// that can be seen are also recorded as boxes in world space, so a render program 
+// can tell which parts of the screen need to be drawn again.
+
+class TextureManager;
+
+struct SDL_Surface;
+
+class RenderWorld
+{
+private:
+	std::vector<VoxelReference> voxelRefs;
+	std::vector<Rect3D> rectangles;
+	std::vector<int> rectangleTextureIDs; // One texture ID per rectangle.
+	std::vector<TextureReference> textureRefs; // One per texture ID.
+	std::vector<int> textureUseCounts; // Voxel rectangles and sprites using each one.
+	std::vector<uint8_t> texels; // Palette indices of all textures.
+	std::vector<int> chunkOccupantCounts; // Non-air voxels and sprite copies per chunk.
+	std::vector<uint32_t> chunkOccupancy; // One bit per chunk with any rectangles.
+	std::vector<std::vector<int>> spriteVoxelIndices; // Voxels each sprite is in.
+	std::vector<Rect3D> spriteRectangles; // One per sprite ID.
+	std::vector<int> spriteTextureIDs; // One per sprite ID.
+	std::vector<bool> activeSprites; // Whether each sprite ID is in use.
+	std::vector<int> freeSpriteIDs;
+	SpriteHeap spriteHeap;
+	LightManager lightManager;
+	Palette palette;
+	VoxelIndexer voxelIndexer;
+	SpriteMode spriteMode;
+	bool mipmapped; // Whether textures get mip levels.
+	int width, height, depth;
+	int chunkCountX, chunkCountY, chunkCountZ;
+	DirtyRanges dirtyVoxelRefs, dirtyRectangles, dirtyTexels, dirtyChunkOccupancy;
+	std::vector<std::pair<Float3f, Float3f>> changedGeometry, changedLighting; // Min, max.
+	int usedRectangleCount; // Rectangles referenced by a voxel (i.e., not in a hole).
+	bool paletteDirty;
+
+	// Adds to the number of occupants in a voxel's chunk, and updates the chunk's bit.
+	void addChunkOccupants(int voxelIndex, int count);
+
+	// Gets the indices of the voxels a sprite rectangle's bounding box touches, in
+	// ascending order.
+	std::vector<int> getSpriteVoxelIndices(const Rect3D &rectangle) const;
+
+	// Records the bounding box of some voxels as changed geometry.
+	void addChangedVoxels(const std::vector<int> &voxelIndices);
+
+	// Records the reach of a point light as changed lighting.
+	void addChangedLight(int lightID);
+public:
+	RenderWorld(int width, int height, int depth, VoxelLayout voxelLayout);
+	~RenderWorld();
+
+	// Max number of rectangles each voxel can have.
+	static const int MAX_RECTANGLES_PER_VOXEL;
+
+	// Creates the six rectangles of a 1x1x1 block at the given voxel.
+	static std::vector<Rect3D> makeBlock(int cellX, int cellY, int cellZ);
+
+	int getWidth() const;
+	int getHeight() const;
+	int getDepth() const;
+
+	// Number of chunks along each axis. Chunks on the far edges can be partial.
+	int getChunkCountX() const;
+	int getChunkCountY() const;
+	int getChunkCountZ() const;
+
+	// Gets the index of a voxel in the voxel reference list.
+	int getVoxelIndex(int cellX, int cellY, int cellZ) const;
+
+	// Gets the indexer for the per-voxel lists, whose length can be more than the 
+	// number of voxels.
+	const VoxelIndexer &getVoxelIndexer() const;
+
+	// Gets the index of the chunk that a voxel is in.
+	int getChunkIndex(int cellX, int cellY, int cellZ) const;
+
+	// Returns whether the chunk at the given chunk index has no rectangles.
+	bool isChunkEmpty(int chunkIndex) const;
+
+	const VoxelReference &getVoxelReference(int cellX, int cellY, int cellZ) const;
+	const std::vector<VoxelReference> &getVoxelReferences() const;
+	const std::vector<Rect3D> &getRectangles() const;
+	const std::vector<int> &getRectangleTextureIDs() const;
+	const std::vector<TextureReference> &getTextureReferences() const;
+	const std::vector<uint8_t> &getTexels() const;
+
+	// Gets how many voxel rectangles and active sprites use each texture ID. A render
+	// program only needs the textures whose count is above zero.
+	const std::vector<int> &getTextureUseCounts() const;
+	const std::vector<uint32_t> &getChunkOccupancy() const;
+	const SpriteHeap &getSpriteHeap() const;
+	const LightManager &getLightManager() const;
+	const Palette &getPalette() const;
+	SpriteMode getSpriteMode() const;
+	bool isMipmapped() const;
+
+	// Rectangles, texture IDs, and whether each sprite ID is in use, indexed by sprite
+	// ID. Removed sprites keep their last rectangle and texture.
+	const std::vector<Rect3D> &getSpriteRectangles() const;
+	const std::vector<int> &getSpriteTextureIDs() const;
+	const std::vector<bool> &getActiveSprites() const;
+
+	// Changes how sprites are kept for rendering. Sprites are traced by default. It 
+	// can only be changed while there are no sprites.
+	void setSpriteMode(SpriteMode spriteMode);
+
+	// Changes whether textures are followed by their mip levels. Textures only have
+	// their full size level by default. It can only be changed while there are no
+	// textures.
+	void setMipmapped(bool mipmapped);
+
+	// Copies a surface's pixels into the texel list as indices into the current palette,
+	// followed by its mip levels if mipmapped, and returns its texture ID. The surface
+	// should have been made with the same palette. Pixels that aren't in the palette get
+	// the closest color's index.
+	int addTexture(const SDL_Surface *surface);
+
+	// Changes the colors that texel indices refer to.
+	void setPalette(const Palette &palette);
+
+	// Changes since the last call to clearDirtyRanges(). Rectangle ranges also cover
+	// the rectangles' texture IDs.
+	const DirtyRanges &getDirtyVoxelReferences() const;
+	const DirtyRanges &getDirtyRectangles() const;
+	const DirtyRanges &getDirtyTexels() const;
+	const DirtyRanges &getDirtyChunkOccupancy() const; // In words, not chunks.
+	bool isPaletteDirty() const;
+
+	// World-space boxes (min and max points) around the changes since the last call to
+	// clearDirtyRanges() that can be seen. Geometry boxes are around changed voxels and
+	// sprites, which can also change the shadows behind them. Lighting boxes are around
+	// the reach of changed point lights.
+	const std::vector<std::pair<Float3f, Float3f>> &getChangedGeometry() const;
+	const std::vector<std::pair<Float3f, Float3f>> &getChangedLighting() const;
+
+	// Returns whether the rectangle list has no holes left by changed voxels.
+	bool isPacked() const;
+
+	// Sets the rectangles of a voxel, all using the same texture. An empty list of
+	// rectangles makes the voxel air.
+	void setVoxel(int cellX, int cellY, int cellZ, const std::vector<Rect3D> &rectangles,
+		int textureID);
+
+	// Adds a sprite with the given rectangle and texture, and returns its sprite ID.
+	int addSprite(const Rect3D &rectangle, int textureID);
+
+	// Changes the rectangle and texture of a sprite (i.e., when it walks or animates).
+	// Only voxels the sprite entered or left get their sprite references changed.
+	void moveSprite(int spriteID, const Rect3D &rectangle, int textureID);
+
+	// Removes a sprite. Its sprite ID may be given to a later sprite.
+	void removeSprite(int spriteID);
+
+	// Adds a point light that is turned on, and returns its light ID.
+	int addLight(const Float3f &position, const Float3f &color, float radius);
+
+	// Changes a light's position. Only voxels the light entered or left get their
+	// light lists changed.
+	void moveLight(int lightID, const Float3f &position);
+
+	void setLightEnabled(int lightID, bool enabled);
+	void removeLight(int lightID);
+
+	// Rebuilds the rectangle list without holes, in voxel index order.
+	void pack();
+
+	// Called by a render program once it has copied all changes, including the sprite
+	// heap's and light manager's.
+	void clearDirtyRanges();
+
+	// For testing purposes before using actual world data. This builds a simple test 
+	// city with some blocks around, and some torches by the doors. It does nothing with
+	// sprites yet.
+	void makeTestWorld(TextureManager &textureManager);
+};
+
+#endif
@@ -406,6 +406,18 @@ void Renderer::fillNative(SDL_Texture *texture)
 	SDL_RenderCopy(this->renderer, texture, nullptr, nullptr);
 }
 
+void Renderer::fillNative(SDL_Texture *texture, int width, int height)
+{
+	SDL_Rect rect;
+	rect.x = 0;
+	rect.y = 0;
+	rect.w = width;
+	rect.h = height;
+
+	SDL_SetRenderTarget(this->renderer, this->nativeTexture);
+	SDL_RenderCopy(this->renderer, texture, &rect, nullptr);
+}
+
 void Renderer::drawOriginalToNative()
 {
 	SDL_SetRenderTarget(this->renderer, this->nativeTexture);
@@ -423,3 +435,20 @@ void Renderer::present()
 	SDL_RenderCopy(this->renderer, this->nativeTexture, nullptr, nullptr);
 	SDL_RenderPresent(this->renderer);
 }
+
+void Renderer::saveNative(const std::string &filename)
+{
+	int width, height;
+	SDL_QueryTexture(this->nativeTexture, nullptr, nullptr, &width, &height);
+
+	Surface surface(width, height);
+	SDL_SetRenderTarget(this->renderer, this->nativeTexture);
+	int status = SDL_RenderReadPixels(this->renderer, nullptr, SDL_PIXELFORMAT_ARGB8888,
+		surface.getSurface()->pixels, surface.getSurface()->pitch);
+	Debug::check(status == 0, "Renderer", "Couldn't read native frame buffer, " +
+		std::string(SDL_GetError()));
+
+	status = SDL_SaveBMP(surface.getSurface(), filename.c_str());
+	Debug::check(status == 0, "Renderer", "Couldn't save \"" + filename + "\", " +
+		std::string(SDL_GetError()));
+}
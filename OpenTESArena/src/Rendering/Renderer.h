@@ -108,12 +108,20 @@ public:
 	// Stretches a texture over the entire native frame buffer.
 	void fillNative(SDL_Texture *texture);
 
+	// Stretches the top-left width x height pixels of a texture over the entire native 
+	// frame buffer (i.e., a frame rendered at a lower resolution than the texture).
+	void fillNative(SDL_Texture *texture, int width, int height);
+
 	// Scales and copies the original frame buffer onto the native frame buffer.
 	// If Renderer::useTransparencyBlending() is set to true, it also uses blending.
 	void drawOriginalToNative();
 
 	// Refreshes the displayed frame buffer.
 	void present();
+
+	// Writes the native frame buffer to a BMP file. This reads pixels back from the
+	// graphics card, so it is slow and only meant for timedemo frame dumps.
+	void saveNative(const std::string &filename);
 };
 
 #endif
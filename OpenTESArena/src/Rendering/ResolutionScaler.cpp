@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "ResolutionScaler.h"
+
+namespace
+{
+	// How much of each new frame's cost goes into the smoothed cost.
+	const double SMOOTHING = 0.2;
+
+	// Largest change in quality per frame, as a fraction of the current quality.
+	const double MAX_STEP_DOWN = 0.1;
+	const double MAX_STEP_UP = 0.02;
+
+	// The quality only goes up once the render time is this far under the target.
+	const double HEADROOM = 0.85;
+}
+
+ResolutionScaler::ResolutionScaler(double minQuality, double maxQuality,
+	double targetMilliseconds)
+{
+	assert(minQuality > 0.0);
+	assert(minQuality <= maxQuality);
+	assert(targetMilliseconds > 0.0);
+
+	this->minQuality = minQuality;
+	this->maxQuality = maxQuality;
+	this->quality = maxQuality;
+	this->targetMilliseconds = targetMilliseconds;
+	this->averageCost = -1.0;
+}
+
+ResolutionScaler::~ResolutionScaler()
+{
+
+}
+
+bool ResolutionScaler::isFixed() const
+{
+	return this->minQuality == this->maxQuality;
+}
+
+double ResolutionScaler::getQuality() const
+{
+	return this->quality;
+}
+
+int ResolutionScaler::getScaledDimension(int maxDimension) const
+{
+	assert(maxDimension > 0);
+
+	const double scale = this->quality / this->maxQuality;
+	return std::max(static_cast<int>(static_cast<double>(maxDimension) * scale), 1);
+}
+
+void ResolutionScaler::update(double renderMilliseconds)
+{
+	if (this->isFixed())
+	{
+		return;
+	}
+
+	const double cost = renderMilliseconds / (this->quality * this->quality);
+	this->averageCost = (this->averageCost < 0.0) ? cost :
+		(this->averageCost + ((cost - this->averageCost) * SMOOTHING));
+
+	if (this->averageCost <= 0.0)
+	{
+		return;
+	}
+
+	// Predicted render time at the current quality, and the quality that would render
+	// in exactly the target time.
+	const double predictedMilliseconds = this->averageCost * this->quality * this->quality;
+	const double idealQuality = std::sqrt(this->targetMilliseconds / this->averageCost);
+
+	if (predictedMilliseconds > this->targetMilliseconds)
+	{
+		this->quality = std::max(idealQuality, this->quality * (1.0 - MAX_STEP_DOWN));
+	}
+	else if (predictedMilliseconds < (this->targetMilliseconds * HEADROOM))
+	{
+		// Aim a little under the target so the quality settles inside the headroom.
+		this->quality = std::min(idealQuality * std::sqrt(HEADROOM),
+			this->quality * (1.0 + MAX_STEP_UP));
+	}
+
+	this->quality = std::min(std::max(this->quality, this->minQuality), this->maxQuality);
+}
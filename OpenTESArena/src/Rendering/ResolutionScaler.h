@@ -0,0 +1,40 @@
+#ifndef RESOLUTION_SCALER_H
+#define RESOLUTION_SCALER_H
+
+// A resolution scaler picks the render quality of each frame so the render program
+// holds a target frame time. Busy scenes get a lower resolution instead of a lower 
+// frame rate, and quiet scenes get sharper again. The render program still fills 
+// the whole native frame buffer, so only the sharpness changes.
+
+// Render time is about proportional to the pixel count, which goes with the square of
+// the quality, so the scaler smooths the render time per squared quality (the cost of
+// the scene) and picks the quality whose predicted time meets the target. Measuring 
+// the cost instead of the time itself keeps old frames at another quality from 
+// skewing the prediction. The quality drops quickly when over budget and climbs 
+// slowly when well under it, which keeps it from bouncing between two resolutions.
+
+// If the min and max quality are the same, the quality never changes.
+
+class ResolutionScaler
+{
+private:
+	double minQuality, maxQuality, quality;
+	double targetMilliseconds;
+	double averageCost; // Smoothed render time per squared quality, or negative at first.
+public:
+	ResolutionScaler(double minQuality, double maxQuality, double targetMilliseconds);
+	~ResolutionScaler();
+
+	bool isFixed() const;
+
+	// Gets the current render quality, between the min and max quality.
+	double getQuality() const;
+
+	// Scales a render dimension at the max quality down to the current quality.
+	int getScaledDimension(int maxDimension) const;
+
+	// Adjusts the quality for the next frame with how long the last one took to render.
+	void update(double renderMilliseconds);
+};
+
+#endif
@@ -0,0 +1,278 @@
+#include <cassert>
+#include <string>
+
+#include "SpriteHeap.h"
+
+#include "../Utilities/Debug.h"
+
+namespace
+{
+	// Rectangles in the smallest size class.
+	const int MIN_BLOCK_CAPACITY = 2;
+
+	// Unused rectangles that are never worth compacting for, so a nearly empty heap
+	// doesn't compact every time a sprite leaves a voxel.
+	const int MIN_COMPACT_UNUSED_COUNT = 256;
+}
+
+const int SpriteHeap::SIZE_CLASS_COUNT = 8;
+
+SpriteHeap::SpriteHeap(int voxelCount)
+{
+	assert(voxelCount > 0);
+
+	this->usedRectangleCount = 0;
+
+	// No voxel has any sprites to start with.
+	this->spriteRefs = std::vector<SpriteReference>(voxelCount, SpriteReference(0, 0));
+	this->blockSizeClasses = std::vector<int>(voxelCount, -1);
+	this->freeBlocks = std::vector<std::vector<int>>(SpriteHeap::SIZE_CLASS_COUNT);
+	this->dirtySpriteRefs.add(0, voxelCount);
+}
+
+SpriteHeap::~SpriteHeap()
+{
+
+}
+
+int SpriteHeap::getBlockCapacity(int sizeClass)
+{
+	assert(sizeClass >= 0);
+	assert(sizeClass < SpriteHeap::SIZE_CLASS_COUNT);
+
+	return MIN_BLOCK_CAPACITY << sizeClass;
+}
+
+int SpriteHeap::allocateBlock(int sizeClass)
+{
+	std::vector<int> &freeList = this->freeBlocks.at(sizeClass);
+	if (freeList.size() > 0)
+	{
+		const int offset = freeList.back();
+		freeList.pop_back();
+		return offset;
+	}
+
+	// Nothing to reuse, so append a new block. Its rectangles are placeholders until
+	// sprites are added.
+	const int offset = static_cast<int>(this->rectangles.size());
+	const int capacity = SpriteHeap::getBlockCapacity(sizeClass);
+	this->rectangles.insert(this->rectangles.end(), capacity,
+		Rect3D(Float3f(), Float3f(), Float3f()));
+	this->rectangleTextureIDs.insert(this->rectangleTextureIDs.end(), capacity, 0);
+	this->rectangleSpriteIDs.insert(this->rectangleSpriteIDs.end(), capacity, -1);
+	return offset;
+}
+
+int SpriteHeap::findRectangle(int voxelIndex, int spriteID) const
+{
+	const SpriteReference &spriteRef = this->spriteRefs.at(voxelIndex);
+	const int offset = spriteRef.getOffset();
+	for (int i = offset; i < (offset + spriteRef.getRectangleCount()); ++i)
+	{
+		if (this->rectangleSpriteIDs.at(i) == spriteID)
+		{
+			return i;
+		}
+	}
+
+	Debug::crash("SpriteHeap", "Sprite " + std::to_string(spriteID) +
+		" not in voxel " + std::to_string(voxelIndex) + ".");
+	return -1;
+}
+
+const std::vector<SpriteReference> &SpriteHeap::getSpriteReferences() const
+{
+	return this->spriteRefs;
+}
+
+const std::vector<Rect3D> &SpriteHeap::getRectangles() const
+{
+	return this->rectangles;
+}
+
+const std::vector<int> &SpriteHeap::getRectangleTextureIDs() const
+{
+	return this->rectangleTextureIDs;
+}
+
+const DirtyRanges &SpriteHeap::getDirtySpriteReferences() const
+{
+	return this->dirtySpriteRefs;
+}
+
+const DirtyRanges &SpriteHeap::getDirtyRectangles() const
+{
+	return this->dirtyRectangles;
+}
+
+bool SpriteHeap::isFragmented() const
+{
+	const int unusedCount = static_cast<int>(this->rectangles.size()) -
+		this->usedRectangleCount;
+	return (unusedCount > this->usedRectangleCount) &&
+		(unusedCount > MIN_COMPACT_UNUSED_COUNT);
+}
+
+void SpriteHeap::add(int voxelIndex, int spriteID, const Rect3D &rectangle, int textureID)
+{
+	assert(spriteID >= 0);
+
+	const SpriteReference &spriteRef = this->spriteRefs.at(voxelIndex);
+	const int oldOffset = spriteRef.getOffset();
+	const int count = spriteRef.getRectangleCount();
+	int &sizeClass = this->blockSizeClasses.at(voxelIndex);
+
+	int offset = oldOffset;
+	if (sizeClass == -1)
+	{
+		sizeClass = 0;
+		offset = this->allocateBlock(sizeClass);
+	}
+	else if (count == SpriteHeap::getBlockCapacity(sizeClass))
+	{
+		// The block is full, so move its rectangles into one of the next size class.
+		Debug::check((sizeClass + 1) < SpriteHeap::SIZE_CLASS_COUNT, "SpriteHeap",
+			"Too many sprites (" + std::to_string(count + 1) + ") in voxel.");
+
+		const int oldSizeClass = sizeClass;
+		sizeClass++;
+		offset = this->allocateBlock(sizeClass);
+
+		for (int i = 0; i < count; ++i)
+		{
+			this->rectangles.at(offset + i) = this->rectangles.at(oldOffset + i);
+			this->rectangleTextureIDs.at(offset + i) =
+				this->rectangleTextureIDs.at(oldOffset + i);
+			this->rectangleSpriteIDs.at(offset + i) =
+				this->rectangleSpriteIDs.at(oldOffset + i);
+			this->rectangleSpriteIDs.at(oldOffset + i) = -1;
+		}
+
+		this->freeBlocks.at(oldSizeClass).push_back(oldOffset);
+		this->dirtyRectangles.add(offset, count);
+	}
+
+	this->rectangles.at(offset + count) = rectangle;
+	this->rectangleTextureIDs.at(offset + count) = textureID;
+	this->rectangleSpriteIDs.at(offset + count) = spriteID;
+	this->usedRectangleCount++;
+
+	this->spriteRefs.at(voxelIndex) = SpriteReference(offset, count + 1);
+	this->dirtySpriteRefs.add(voxelIndex, 1);
+	this->dirtyRectangles.add(offset + count, 1);
+}
+
+void SpriteHeap::update(int voxelIndex, int spriteID, const Rect3D &rectangle,
+	int textureID)
+{
+	const int index = this->findRectangle(voxelIndex, spriteID);
+	this->rectangles.at(index) = rectangle;
+	this->rectangleTextureIDs.at(index) = textureID;
+	this->dirtyRectangles.add(index, 1);
+}
+
+void SpriteHeap::remove(int voxelIndex, int spriteID)
+{
+	const int index = this->findRectangle(voxelIndex, spriteID);
+	const SpriteReference &spriteRef = this->spriteRefs.at(voxelIndex);
+	const int offset = spriteRef.getOffset();
+	const int count = spriteRef.getRectangleCount() - 1;
+
+	// Order in a block doesn't matter, so fill the gap with the block's last rectangle.
+	const int lastIndex = offset + count;
+	if (index != lastIndex)
+	{
+		this->rectangles.at(index) = this->rectangles.at(lastIndex);
+		this->rectangleTextureIDs.at(index) = this->rectangleTextureIDs.at(lastIndex);
+		this->rectangleSpriteIDs.at(index) = this->rectangleSpriteIDs.at(lastIndex);
+		this->dirtyRectangles.add(index, 1);
+	}
+
+	this->rectangleSpriteIDs.at(lastIndex) = -1;
+	this->usedRectangleCount--;
+
+	// An empty block goes back on its free list.
+	int &sizeClass = this->blockSizeClasses.at(voxelIndex);
+	if (count == 0)
+	{
+		this->freeBlocks.at(sizeClass).push_back(offset);
+		sizeClass = -1;
+		this->spriteRefs.at(voxelIndex) = SpriteReference(0, 0);
+	}
+	else
+	{
+		this->spriteRefs.at(voxelIndex) = SpriteReference(offset, count);
+	}
+
+	this->dirtySpriteRefs.add(voxelIndex, 1);
+
+	if (this->isFragmented())
+	{
+		this->compact();
+	}
+}
+
+void SpriteHeap::compact()
+{
+	std::vector<Rect3D> compactRectangles;
+	std::vector<int> compactTextureIDs, compactSpriteIDs;
+
+	const int voxelCount = static_cast<int>(this->spriteRefs.size());
+	for (int i = 0; i < voxelCount; ++i)
+	{
+		const SpriteReference &spriteRef = this->spriteRefs.at(i);
+		const int offset = spriteRef.getOffset();
+		const int count = spriteRef.getRectangleCount();
+		if (count == 0)
+		{
+			continue;
+		}
+
+		// Smallest size class with room for the voxel's sprites.
+		int sizeClass = 0;
+		while (SpriteHeap::getBlockCapacity(sizeClass) < count)
+		{
+			sizeClass++;
+		}
+
+		const int newOffset = static_cast<int>(compactRectangles.size());
+		const int capacity = SpriteHeap::getBlockCapacity(sizeClass);
+		for (int j = 0; j < capacity; ++j)
+		{
+			const bool used = j < count;
+			compactRectangles.push_back(used ? this->rectangles.at(offset + j) :
+				Rect3D(Float3f(), Float3f(), Float3f()));
+			compactTextureIDs.push_back(used ? this->rectangleTextureIDs.at(offset + j) : 0);
+			compactSpriteIDs.push_back(used ? this->rectangleSpriteIDs.at(offset + j) : -1);
+		}
+
+		// Only references that moved need copying again.
+		if (newOffset != offset)
+		{
+			this->spriteRefs.at(i) = SpriteReference(newOffset, count);
+			this->dirtySpriteRefs.add(i, 1);
+		}
+
+		this->blockSizeClasses.at(i) = sizeClass;
+	}
+
+	this->rectangles = std::move(compactRectangles);
+	this->rectangleTextureIDs = std::move(compactTextureIDs);
+	this->rectangleSpriteIDs = std::move(compactSpriteIDs);
+
+	for (auto &freeList : this->freeBlocks)
+	{
+		freeList.clear();
+	}
+
+	// The rectangles all moved, so all of them need copying again.
+	this->dirtyRectangles.clear();
+	this->dirtyRectangles.add(0, static_cast<int>(this->rectangles.size()));
+}
+
+void SpriteHeap::clearDirtyRanges()
+{
+	this->dirtySpriteRefs.clear();
+	this->dirtyRectangles.clear();
+}
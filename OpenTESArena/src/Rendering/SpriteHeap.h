@@ -0,0 +1,84 @@
+#ifndef SPRITE_HEAP_H
+#define SPRITE_HEAP_H
+
+#include <vector>
+
+#include "DirtyRanges.h"
+#include "SpriteReference.h"
+#include "../Math/Rect3D.h"
+
+// A sprite heap stores the rectangles of moving sprites with single indirection (see
+// the SpriteReference.h comments). Each voxel has a sprite reference to its own block
+// of the sprite rectangle list, and a sprite that touches several voxels has a copy
+// of its rectangle in each of their blocks.
+
+// Blocks come in size classes, each twice as big as the last, starting with room for
+// two sprites. When a voxel's block is full, its rectangles are relocated to a block
+// of the next size class and the old block goes on that class's free list. New blocks
+// come from the free lists first, then from the end of the rectangle list. Blocks are
+// never shrunk while in use, so sprites walking back and forth don't reallocate.
+
+// Free blocks can pile up over time, so the heap compacts itself when more than half
+// of the rectangle list (and more than a few hundred rectangles) is unused. That gives
+// every voxel a snug block again, in voxel index order.
+
+// Every change is recorded in dirty ranges, so moving a sprite only means copying the
+// few sprite references and rectangles it touched, not the whole heap.
+
+class SpriteHeap
+{
+private:
+	std::vector<SpriteReference> spriteRefs; // One per voxel.
+	std::vector<int> blockSizeClasses; // One per voxel, or -1 if it has no block.
+	std::vector<Rect3D> rectangles;
+	std::vector<int> rectangleTextureIDs; // One texture ID per rectangle.
+	std::vector<int> rectangleSpriteIDs; // Which sprite each rectangle is a copy of.
+	std::vector<std::vector<int>> freeBlocks; // Offsets of free blocks per size class.
+	DirtyRanges dirtySpriteRefs, dirtyRectangles;
+	int usedRectangleCount; // Rectangles referenced by a voxel.
+
+	static int getBlockCapacity(int sizeClass);
+
+	// Gets a free block of the given size class and returns its offset.
+	int allocateBlock(int sizeClass);
+
+	// Gets the index of a sprite's rectangle in a voxel's block.
+	int findRectangle(int voxelIndex, int spriteID) const;
+public:
+	SpriteHeap(int voxelCount);
+	~SpriteHeap();
+
+	// Number of size classes. The biggest block has room for 256 sprites.
+	static const int SIZE_CLASS_COUNT;
+
+	const std::vector<SpriteReference> &getSpriteReferences() const;
+	const std::vector<Rect3D> &getRectangles() const;
+	const std::vector<int> &getRectangleTextureIDs() const;
+
+	// Changes since the last call to clearDirtyRanges(). Rectangle ranges also cover
+	// the rectangles' texture IDs.
+	const DirtyRanges &getDirtySpriteReferences() const;
+	const DirtyRanges &getDirtyRectangles() const;
+
+	// Returns whether enough of the rectangle list is unused to be worth compacting.
+	bool isFragmented() const;
+
+	// Adds a copy of a sprite's rectangle to a voxel's block.
+	void add(int voxelIndex, int spriteID, const Rect3D &rectangle, int textureID);
+
+	// Overwrites the copy of a sprite's rectangle in a voxel's block.
+	void update(int voxelIndex, int spriteID, const Rect3D &rectangle, int textureID);
+
+	// Removes the copy of a sprite's rectangle from a voxel's block. The heap compacts
+	// itself afterwards if it's fragmented.
+	void remove(int voxelIndex, int spriteID);
+
+	// Rebuilds the rectangle list with the smallest block that fits each voxel, in
+	// voxel index order.
+	void compact();
+
+	// Called by a render program once it has copied all changes.
+	void clearDirtyRanges();
+};
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef SPRITE_MODE_H
+#define SPRITE_MODE_H
+
+// A sprite mode decides how sprites (NPCs, projectiles, etc.) get drawn. Traced puts
+// a copy of each sprite's rectangle in every voxel it touches (see SpriteHeap), so
+// rays find them while walking the voxel grid, and they cast shadows like any other
+// rectangle. Rasterized keeps them out of the grid. They're sorted back to front each
+// frame and drawn over the traced frame where they're nearer than its depth (see
+// SpriteTiles), so lots of sprites only cost the pixels they cover, not every ray.
+
+enum class SpriteMode
+{
+	Traced,
+	Rasterized
+};
+
+#endif
@@ -0,0 +1,238 @@
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+
+#include "SpriteTiles.h"
+
+namespace
+{
+	// Distance in front of the camera that a point has to be to be projected. Same as
+	// the lean kernels' ray epsilon.
+	const double NEAR_DISTANCE = 1.0e-4;
+
+	// A sprite that's going to be binned, with its distance for sorting and the tiles
+	// it touches.
+	struct VisibleSprite
+	{
+		double distance;
+		int spriteID;
+		int minTileX, minTileY, maxTileX, maxTileY;
+	};
+}
+
+const int SpriteTiles::TILE_SIZE = 32;
+
+SpriteTiles::SpriteTiles()
+{
+	this->zoom = 1.0;
+	this->frameWidth = 0;
+	this->frameHeight = 0;
+	this->tileCountX = 0;
+	this->tileCountY = 0;
+}
+
+SpriteTiles::~SpriteTiles()
+{
+
+}
+
+bool SpriteTiles::getTileBounds(const Rect3D &rectangle, int *minTileX, int *minTileY,
+	int *maxTileX, int *maxTileY) const
+{
+	const double aspect = static_cast<double>(this->frameWidth) /
+		static_cast<double>(this->frameHeight);
+
+	const Float3f &p1 = rectangle.getP1();
+	const Float3f &p2 = rectangle.getP2();
+	const Float3f &p3 = rectangle.getP3();
+	const std::array<Float3f, 4> corners = { p1, p2, p3, p1 + (p3 - p2) };
+
+	// Screen bounds of the rectangle's corners, in pixels like the lean kernels' ray
+	// directions (i.e., pixel centers are at whole numbers).
+	double minX = HUGE_VAL;
+	double minY = HUGE_VAL;
+	double maxX = -HUGE_VAL;
+	double maxY = -HUGE_VAL;
+	int behindCount = 0;
+
+	for (const Float3f &corner : corners)
+	{
+		const Float3d local = Float3d(corner.getX(), corner.getY(), corner.getZ()) -
+			this->eye;
+		const double distance = local.dot(this->forward);
+		if (distance <= NEAR_DISTANCE)
+		{
+			behindCount++;
+			continue;
+		}
+
+		const double scale = distance / this->zoom;
+		const double screenX = local.dot(this->right) / (scale * aspect);
+		const double screenY = local.dot(this->up) / scale;
+		const double pixelX = (((screenX + 1.0) * 0.5) * this->frameWidth) - 0.5;
+		const double pixelY = (((1.0 - screenY) * 0.5) * this->frameHeight) - 0.5;
+		minX = std::min(minX, pixelX);
+		minY = std::min(minY, pixelY);
+		maxX = std::max(maxX, pixelX);
+		maxY = std::max(maxY, pixelY);
+	}
+
+	if (behindCount == static_cast<int>(corners.size()))
+	{
+		return false;
+	}
+	else if (behindCount > 0)
+	{
+		*minTileX = 0;
+		*minTileY = 0;
+		*maxTileX = this->tileCountX - 1;
+		*maxTileY = this->tileCountY - 1;
+		return true;
+	}
+
+	// Skip sprites entirely off screen before converting to ints, since far off screen
+	// projections can be huge.
+	if ((maxX < -1.0) || (maxY < -1.0) || (minX > this->frameWidth) ||
+		(minY > this->frameHeight))
+	{
+		return false;
+	}
+
+	// Any pixel whose center is between the bounds can see the sprite.
+	const int minPixelX = static_cast<int>(std::floor(std::max(minX, 0.0)));
+	const int minPixelY = static_cast<int>(std::floor(std::max(minY, 0.0)));
+	const int maxPixelX = static_cast<int>(std::ceil(
+		std::min(maxX, static_cast<double>(this->frameWidth - 1))));
+	const int maxPixelY = static_cast<int>(std::ceil(
+		std::min(maxY, static_cast<double>(this->frameHeight - 1))));
+	*minTileX = minPixelX / SpriteTiles::TILE_SIZE;
+	*minTileY = minPixelY / SpriteTiles::TILE_SIZE;
+	*maxTileX = maxPixelX / SpriteTiles::TILE_SIZE;
+	*maxTileY = maxPixelY / SpriteTiles::TILE_SIZE;
+	return true;
+}
+
+int SpriteTiles::getTileCountX() const
+{
+	return this->tileCountX;
+}
+
+int SpriteTiles::getTileCountY() const
+{
+	return this->tileCountY;
+}
+
+const std::vector<int> &SpriteTiles::getSpriteIDs() const
+{
+	return this->spriteIDs;
+}
+
+const std::vector<std::pair<int, int>> &SpriteTiles::getTileRanges() const
+{
+	return this->tileRanges;
+}
+
+const std::vector<int> &SpriteTiles::getTileSprites() const
+{
+	return this->tileSprites;
+}
+
+void SpriteTiles::setCamera(const Float3d &eye, const Float3d &forward,
+	const Float3d &right, const Float3d &up, double zoom)
+{
+	assert(zoom > 0.0);
+
+	this->eye = eye;
+	this->forward = forward;
+	this->right = right;
+	this->up = up;
+	this->zoom = zoom;
+}
+
+void SpriteTiles::update(const std::vector<Rect3D> &rectangles,
+	const std::vector<bool> &activeSprites, int frameWidth, int frameHeight)
+{
+	assert(rectangles.size() == activeSprites.size());
+	assert(frameWidth > 0);
+	assert(frameHeight > 0);
+
+	this->frameWidth = frameWidth;
+	this->frameHeight = frameHeight;
+	this->tileCountX = (frameWidth + SpriteTiles::TILE_SIZE - 1) / SpriteTiles::TILE_SIZE;
+	this->tileCountY = (frameHeight + SpriteTiles::TILE_SIZE - 1) / SpriteTiles::TILE_SIZE;
+
+	// Find the sprites that can be seen, and sort them by the distance of their center
+	// along the camera's forward axis, farthest first. Ties go by sprite ID so the
+	// order doesn't flicker.
+	std::vector<VisibleSprite> visibleSprites;
+	for (int i = 0; i < static_cast<int>(rectangles.size()); ++i)
+	{
+		if (!activeSprites.at(i))
+		{
+			continue;
+		}
+
+		VisibleSprite visibleSprite;
+		const Rect3D &rectangle = rectangles.at(i);
+		if (!this->getTileBounds(rectangle, &visibleSprite.minTileX,
+			&visibleSprite.minTileY, &visibleSprite.maxTileX, &visibleSprite.maxTileY))
+		{
+			continue;
+		}
+
+		const Float3f center = (rectangle.getP1() + rectangle.getP3()) * 0.5f;
+		visibleSprite.distance = (Float3d(center.getX(), center.getY(), center.getZ()) -
+			this->eye).dot(this->forward);
+		visibleSprite.spriteID = i;
+		visibleSprites.push_back(visibleSprite);
+	}
+
+	std::sort(visibleSprites.begin(), visibleSprites.end(),
+		[](const VisibleSprite &a, const VisibleSprite &b)
+	{
+		return (a.distance > b.distance) ||
+			((a.distance == b.distance) && (a.spriteID < b.spriteID));
+	});
+
+	// Count the sprites in each tile, then give each tile its offset from a prefix sum
+	// of the counts and fill them in, keeping the back to front order.
+	const int tileCount = this->tileCountX * this->tileCountY;
+	this->tileRanges = std::vector<std::pair<int, int>>(tileCount, std::make_pair(0, 0));
+	for (const VisibleSprite &visibleSprite : visibleSprites)
+	{
+		for (int y = visibleSprite.minTileY; y <= visibleSprite.maxTileY; ++y)
+		{
+			for (int x = visibleSprite.minTileX; x <= visibleSprite.maxTileX; ++x)
+			{
+				this->tileRanges.at(x + (y * this->tileCountX)).second++;
+			}
+		}
+	}
+
+	int offset = 0;
+	for (auto &tileRange : this->tileRanges)
+	{
+		tileRange.first = offset;
+		offset += tileRange.second;
+		tileRange.second = 0;
+	}
+
+	this->spriteIDs.resize(visibleSprites.size());
+	this->tileSprites.resize(offset);
+	for (int i = 0; i < static_cast<int>(visibleSprites.size()); ++i)
+	{
+		const VisibleSprite &visibleSprite = visibleSprites.at(i);
+		this->spriteIDs.at(i) = visibleSprite.spriteID;
+
+		for (int y = visibleSprite.minTileY; y <= visibleSprite.maxTileY; ++y)
+		{
+			for (int x = visibleSprite.minTileX; x <= visibleSprite.maxTileX; ++x)
+			{
+				auto &tileRange = this->tileRanges.at(x + (y * this->tileCountX));
+				this->tileSprites.at(tileRange.first + tileRange.second) = i;
+				tileRange.second++;
+			}
+		}
+	}
+}
@@ -0,0 +1,67 @@
+#ifndef SPRITE_TILES_H
+#define SPRITE_TILES_H
+
+#include <utility>
+#include <vector>
+
+#include "../Math/Float3.h"
+#include "../Math/Rect3D.h"
+
+// Sprite tiles are the host's half of drawing rasterized sprites (see SpriteMode).
+// Each frame, the sprites in front of the camera are sorted back to front by their
+// distance along the camera's forward axis, and each one is binned into every square
+// tile of the frame that its projection touches. A render program then only has to
+// test a pixel against the sprites in its tile, nearest first, and stop at the first
+// opaque texel that's nearer than the traced depth.
+
+// The projection is the same as the lean kernels' (and DirtyTiles'), so it takes the
+// same camera. A sprite that's partly behind the camera is binned into every tile,
+// and one that's all behind it isn't binned at all.
+
+class SpriteTiles
+{
+private:
+	std::vector<int> spriteIDs; // Sprites in front of the camera, farthest first.
+	std::vector<std::pair<int, int>> tileRanges; // Offset and count per tile.
+	std::vector<int> tileSprites; // Indices into the sprite IDs, farthest first.
+	Float3d eye, forward, right, up;
+	double zoom;
+	int frameWidth, frameHeight, tileCountX, tileCountY;
+
+	// Gets the range of tiles that a sprite rectangle's projection touches. Returns
+	// false if it can't be seen.
+	bool getTileBounds(const Rect3D &rectangle, int *minTileX, int *minTileY,
+		int *maxTileX, int *maxTileY) const;
+public:
+	SpriteTiles();
+	~SpriteTiles();
+
+	// Width and height of a tile in pixels.
+	static const int TILE_SIZE;
+
+	int getTileCountX() const;
+	int getTileCountY() const;
+
+	// Gets the IDs of the sprites that were binned, farthest first.
+	const std::vector<int> &getSpriteIDs() const;
+
+	// Gets the offset and count of each tile's sprites in the tile sprite list, in
+	// rows of tiles.
+	const std::vector<std::pair<int, int>> &getTileRanges() const;
+
+	// Gets every tile's sprites back to back, as indices into the sprite ID list. A
+	// tile's sprites are farthest first.
+	const std::vector<int> &getTileSprites() const;
+
+	// Sets the camera that sprites are projected with. Its direction, right, and up
+	// vectors have to be normalized.
+	void setCamera(const Float3d &eye, const Float3d &forward, const Float3d &right,
+		const Float3d &up, double zoom);
+
+	// Sorts and bins the sprites in front of the camera for a frame of the given
+	// dimensions. Rectangles and active flags are indexed by sprite ID.
+	void update(const std::vector<Rect3D> &rectangles, const std::vector<bool> &activeSprites,
+		int frameWidth, int frameHeight);
+};
+
+#endif
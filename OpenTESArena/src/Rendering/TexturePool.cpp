@@ -0,0 +1,203 @@
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+#include "TexturePool.h"
+
+TexturePool::TexturePool()
+{
+	this->updateCount = 0;
+	this->capacity = 0;
+}
+
+TexturePool::~TexturePool()
+{
+
+}
+
+int TexturePool::getTexelCount(const TextureReference &textureRef)
+{
+	// Same halving as the render world's mip levels.
+	int width = textureRef.getWidth();
+	int height = textureRef.getHeight();
+	int count = 0;
+	for (int i = 0; i < textureRef.getMipLevelCount(); ++i)
+	{
+		count += width * height;
+		width = std::max(width / 2, 1);
+		height = std::max(height / 2, 1);
+	}
+
+	return count;
+}
+
+int TexturePool::allocate(int size)
+{
+	for (auto iter = this->freeBlocks.begin(); iter != this->freeBlocks.end(); ++iter)
+	{
+		if (iter->second >= size)
+		{
+			const int offset = iter->first;
+			const int remaining = iter->second - size;
+			this->freeBlocks.erase(iter);
+
+			if (remaining > 0)
+			{
+				this->freeBlocks.insert(std::make_pair(offset + size, remaining));
+			}
+
+			return offset;
+		}
+	}
+
+	return -1;
+}
+
+void TexturePool::release(int offset, int size)
+{
+	auto iter = this->freeBlocks.insert(std::make_pair(offset, size)).first;
+
+	// Join with the next block if it starts where this one ends.
+	auto nextIter = std::next(iter);
+	if ((nextIter != this->freeBlocks.end()) &&
+		(nextIter->first == (iter->first + iter->second)))
+	{
+		iter->second += nextIter->second;
+		this->freeBlocks.erase(nextIter);
+	}
+
+	// Join with the previous block if it ends where this one starts.
+	if (iter != this->freeBlocks.begin())
+	{
+		auto prevIter = std::prev(iter);
+		if ((prevIter->first + prevIter->second) == iter->first)
+		{
+			prevIter->second += iter->second;
+			this->freeBlocks.erase(iter);
+		}
+	}
+}
+
+bool TexturePool::evictOne(const std::vector<int> &useCounts)
+{
+	int oldestID = -1;
+	for (int i = 0; i < static_cast<int>(this->resident.size()); ++i)
+	{
+		if (this->resident.at(i) && (useCounts.at(i) == 0) &&
+			((oldestID == -1) || (this->lastUses.at(i) < this->lastUses.at(oldestID))))
+		{
+			oldestID = i;
+		}
+	}
+
+	if (oldestID == -1)
+	{
+		return false;
+	}
+
+	const TextureReference &handle = this->handles.at(oldestID);
+	this->release(handle.getOffset(), TexturePool::getTexelCount(handle));
+	this->resident.at(oldestID) = false;
+	return true;
+}
+
+int TexturePool::getCapacity() const
+{
+	return this->capacity;
+}
+
+TextureReference TexturePool::getTextureReference(int textureID) const
+{
+	if (!this->resident.at(textureID))
+	{
+		return TextureReference(0, 1, 1, 1);
+	}
+
+	return this->handles.at(textureID);
+}
+
+const std::vector<int> &TexturePool::getUploads() const
+{
+	return this->uploads;
+}
+
+std::vector<int> TexturePool::getResidentTextures() const
+{
+	std::vector<int> textureIDs;
+	for (int i = 0; i < static_cast<int>(this->resident.size()); ++i)
+	{
+		if (this->resident.at(i))
+		{
+			textureIDs.push_back(i);
+		}
+	}
+
+	return textureIDs;
+}
+
+void TexturePool::update(const std::vector<TextureReference> &textureRefs,
+	const std::vector<int> &useCounts)
+{
+	assert(textureRefs.size() == useCounts.size());
+
+	this->updateCount++;
+	this->handles.resize(textureRefs.size(), TextureReference(0, 1, 1, 1));
+	this->resident.resize(textureRefs.size(), false);
+	this->lastUses.resize(textureRefs.size(), 0);
+
+	// Find the used textures that need room, biggest first so the small ones can fill
+	// in the gaps.
+	std::vector<int> missingIDs;
+	for (int i = 0; i < static_cast<int>(useCounts.size()); ++i)
+	{
+		if (useCounts.at(i) > 0)
+		{
+			this->lastUses.at(i) = this->updateCount;
+
+			if (!this->resident.at(i))
+			{
+				missingIDs.push_back(i);
+			}
+		}
+	}
+
+	std::stable_sort(missingIDs.begin(), missingIDs.end(),
+		[&textureRefs](int a, int b)
+	{
+		return TexturePool::getTexelCount(textureRefs.at(a)) >
+			TexturePool::getTexelCount(textureRefs.at(b));
+	});
+
+	for (const int textureID : missingIDs)
+	{
+		const TextureReference &textureRef = textureRefs.at(textureID);
+		const int size = TexturePool::getTexelCount(textureRef);
+
+		int offset = this->allocate(size);
+		while ((offset == -1) && this->evictOne(useCounts))
+		{
+			offset = this->allocate(size);
+		}
+
+		// Grow by at least double, like the other buffers. The new room is joined with
+		// a free block at the old end, if there is one.
+		if (offset == -1)
+		{
+			const int newCapacity = std::max(this->capacity * 2, this->capacity + size);
+			this->release(this->capacity, newCapacity - this->capacity);
+			this->capacity = newCapacity;
+			offset = this->allocate(size);
+			assert(offset != -1);
+		}
+
+		this->handles.at(textureID) = TextureReference(offset, textureRef.getWidth(),
+			textureRef.getHeight(), textureRef.getMipLevelCount());
+		this->resident.at(textureID) = true;
+		this->uploads.push_back(textureID);
+	}
+}
+
+void TexturePool::clearUploads()
+{
+	this->uploads.clear();
+}
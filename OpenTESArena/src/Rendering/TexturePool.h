@@ -0,0 +1,78 @@
+#ifndef TEXTURE_POOL_H
+#define TEXTURE_POOL_H
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "TextureReference.h"
+
+// A texture pool decides where each texture's texels (and mip levels) go in a render
+// program's texture buffer. The render world keeps every texture it was ever given,
+// but the device only needs the ones that something in the world uses, so a texture
+// is only given room in the pool once a rectangle or sprite uses it.
+
+// Textures can be any size, so the pool is a list of free blocks that allocations
+// are taken from (first fit) and given back to (joined with the blocks next to them).
+// When nothing fits, textures nothing uses anymore are evicted, least recently used
+// first. If that's not enough, the pool grows, and the render program has to grow its
+// buffer to match. Resident textures never move, so growing doesn't change any of
+// their offsets.
+
+// The pool's handle table is where each texture ID is in the pool, and rectangles
+// are given those texture references instead of the render world's. A texture that
+// was evicted and then used again can come back anywhere, but every rectangle that
+// uses it again is new, so it gets the new offset when it's written anyway.
+
+// It doesn't know anything about OpenCL. Offsets and sizes are in texels.
+
+class TexturePool
+{
+private:
+	std::vector<TextureReference> handles; // Pool reference per texture ID.
+	std::vector<bool> resident; // Whether each texture ID has room in the pool.
+	std::vector<uint64_t> lastUses; // Update each texture ID was last used in.
+	std::map<int, int> freeBlocks; // Offset and size of each free block.
+	std::vector<int> uploads; // Texture IDs given room since the last clear.
+	uint64_t updateCount;
+	int capacity;
+
+	// Takes a block of the given size from the free blocks. Returns -1 if none fit.
+	int allocate(int size);
+
+	// Gives a block back to the free blocks, joining it with its neighbors.
+	void release(int offset, int size);
+
+	// Evicts the least recently used texture that nothing uses. Returns false if
+	// every resident texture is still used.
+	bool evictOne(const std::vector<int> &useCounts);
+public:
+	TexturePool();
+	~TexturePool();
+
+	// Gets the texels in a texture and all of its mip levels.
+	static int getTexelCount(const TextureReference &textureRef);
+
+	// Gets the size of the pool in texels.
+	int getCapacity() const;
+
+	// Gets the reference of a texture in the pool. Textures that aren't in the pool
+	// get the first texel (only rectangles that nothing can reach still use them).
+	TextureReference getTextureReference(int textureID) const;
+
+	// Gets the texture IDs that were given room in the pool since the last clear. Their
+	// texels have to be copied from the render world.
+	const std::vector<int> &getUploads() const;
+
+	// Gets the texture IDs of every texture in the pool.
+	std::vector<int> getResidentTextures() const;
+
+	// Makes room for every texture with a use count above zero, evicting and growing as
+	// needed. References and use counts are indexed by texture ID (see RenderWorld).
+	void update(const std::vector<TextureReference> &textureRefs,
+		const std::vector<int> &useCounts);
+
+	void clearUploads();
+};
+
+#endif
@@ -1,10 +1,12 @@
 #include "TextureReference.h"
 
-TextureReference::TextureReference(int offset, short width, short height)
+TextureReference::TextureReference(int offset, short width, short height,
+	int mipLevelCount)
 {
 	this->offset = offset;
 	this->width = width;
 	this->height = height;
+	this->mipLevelCount = mipLevelCount;
 }
 
 TextureReference::~TextureReference()
@@ -26,3 +28,8 @@ short TextureReference::getHeight() const
 {
 	return this->height;
 }
+
+int TextureReference::getMipLevelCount() const
+{
+	return this->mipLevelCount;
+}
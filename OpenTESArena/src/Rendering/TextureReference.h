@@ -1,22 +1,26 @@
-#ifndef TEXTURE_REFERENCE_H
-#define TEXTURE_REFERENCE_H
-
-// This class should be in the host so it can maintain the references. The kernel
-// will use it during rendering.
-
-class TextureReference
-{
-private:
-	// Offset is the number of float4's to skip.
-	int offset;
-	short width, height;
-public:
-	TextureReference(int offset, short width, short height);
-	~TextureReference();
-
-	int getOffset() const;
-	short getWidth() const;
-	short getHeight() const;
-};
-
-#endif
+#ifndef TEXTURE_REFERENCE_H
+#define TEXTURE_REFERENCE_H
+
+// This class should be in the host so it can maintain the references. The kernel
+// will use it during rendering.
+
+class TextureReference
+{
+private:
+	// Offset is the index of the texture's first texel in the texture buffer. The lean
+	// kernels' texels are one uchar each, so it's also a byte offset there; kernel.cl's
+	// texels are float4's.
+	int offset;
+	short width, height;
+	int mipLevelCount; // Including the full size level.
+public:
+	TextureReference(int offset, short width, short height, int mipLevelCount);
+	~TextureReference();
+
+	int getOffset() const;
+	short getWidth() const;
+	short getHeight() const;
+	int getMipLevelCount() const;
+};
+
+#endif
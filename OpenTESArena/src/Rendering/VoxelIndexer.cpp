@@ -0,0 +1,96 @@
+#include <cassert>
+
+#include "VoxelIndexer.h"
+
+// The host's copy of the index functions is stringized here (after the qualifier is
+// expanded to nothing) for the kernels.
+#define VOXEL_STRINGIFY(...) #__VA_ARGS__
+#define VOXEL_EXPAND_STRINGIFY(...) VOXEL_STRINGIFY(__VA_ARGS__)
+
+const std::string VoxelIndexer::SOURCE =
+	std::string(VOXEL_EXPAND_STRINGIFY(VOXEL_INDEX_FUNCTIONS())) + R"CL(
+
+int getVoxelIndex(int x, int y, int z)
+{
+#ifdef VOXEL_LAYOUT_TILED
+	return getTiledVoxelIndex(x, y, z, WORLD_WIDTH, WORLD_HEIGHT);
+#else
+	return getLinearVoxelIndex(x, y, z, WORLD_WIDTH, WORLD_HEIGHT);
+#endif
+}
+)CL";
+
+VoxelIndexer::VoxelIndexer(int width, int height, int depth, VoxelLayout layout)
+{
+	assert(width > 0);
+	assert(height > 0);
+	assert(depth > 0);
+
+	this->layout = layout;
+	this->width = width;
+	this->height = height;
+	this->depth = depth;
+}
+
+VoxelIndexer::~VoxelIndexer()
+{
+
+}
+
+VoxelLayout VoxelIndexer::getLayout() const
+{
+	return this->layout;
+}
+
+int VoxelIndexer::getCount() const
+{
+	if (this->layout == VoxelLayout::Tiled)
+	{
+		const int tilesX = (this->width + 3) / 4;
+		const int tilesY = (this->height + 3) / 4;
+		const int tilesZ = (this->depth + 3) / 4;
+		return tilesX * tilesY * tilesZ * 64;
+	}
+	else
+	{
+		return this->width * this->height * this->depth;
+	}
+}
+
+int VoxelIndexer::getIndex(int cellX, int cellY, int cellZ) const
+{
+	assert(cellX >= 0);
+	assert(cellY >= 0);
+	assert(cellZ >= 0);
+	assert(cellX < this->width);
+	assert(cellY < this->height);
+	assert(cellZ < this->depth);
+
+	return (this->layout == VoxelLayout::Tiled) ?
+		getTiledVoxelIndex(cellX, cellY, cellZ, this->width, this->height) :
+		getLinearVoxelIndex(cellX, cellY, cellZ, this->width, this->height);
+}
+
+void VoxelIndexer::getCell(int index, int *cellX, int *cellY, int *cellZ) const
+{
+	assert(index >= 0);
+	assert(index < this->getCount());
+
+	if (this->layout == VoxelLayout::Tiled)
+	{
+		// Undo the tile order, then pull the Morton bits apart.
+		const int tilesX = (this->width + 3) / 4;
+		const int tilesY = (this->height + 3) / 4;
+		const int tile = index >> 6;
+		const int inner = index & 63;
+		*cellX = ((tile % tilesX) * 4) | (inner & 1) | ((inner >> 2) & 2);
+		*cellY = (((tile / tilesX) % tilesY) * 4) | ((inner >> 1) & 1) | ((inner >> 3) & 2);
+		*cellZ = ((tile / (tilesX * tilesY)) * 4) | ((inner >> 2) & 1) | ((inner >> 4) & 2);
+	}
+	else
+	{
+		*cellX = index % this->width;
+		*cellY = (index / this->width) % this->height;
+		*cellZ = index / (this->width * this->height);
+	}
+}
@@ -0,0 +1,61 @@
+#ifndef VOXEL_INDEXER_H
+#define VOXEL_INDEXER_H
+
+#include <string>
+
+#include "VoxelLayout.h"
+
+// A voxel indexer turns a voxel's cell into its index in the per-voxel lists for a 
+// voxel layout, and back again.
+
+// The index functions below are written once in the subset of C that both C++ and 
+// OpenCL C compile. The host compiles them as inline functions, and the kernels get
+// the same text as a string (see SOURCE), so the two can't disagree.
+
+// A tiled grid is rounded up to whole tiles, so its lists can be longer than the 
+// number of voxels. The extra voxels are outside the grid and always stay empty.
+
+#define VOXEL_INDEX_FUNCTIONS(qualifier) \
+	qualifier int getLinearVoxelIndex(int x, int y, int z, int width, int height) \
+	{ \
+		return x + (y * width) + (z * width * height); \
+	} \
+	qualifier int getTiledVoxelIndex(int x, int y, int z, int width, int height) \
+	{ \
+		const int tilesX = (width + 3) >> 2; \
+		const int tilesY = (height + 3) >> 2; \
+		const int tile = (x >> 2) + ((y >> 2) * tilesX) + ((z >> 2) * tilesX * tilesY); \
+		const int inner = (x & 1) | ((y & 1) << 1) | ((z & 1) << 2) | ((x & 2) << 2) | \
+			((y & 2) << 3) | ((z & 2) << 4); \
+		return (tile << 6) | inner; \
+	}
+
+VOXEL_INDEX_FUNCTIONS(inline)
+
+class VoxelIndexer
+{
+private:
+	VoxelLayout layout;
+	int width, height, depth;
+public:
+	VoxelIndexer(int width, int height, int depth, VoxelLayout layout);
+	~VoxelIndexer();
+
+	// OpenCL C source of the index functions, and of getVoxelIndex(x, y, z) for the
+	// WORLD_WIDTH and WORLD_HEIGHT grid. getVoxelIndex() uses the tiled layout if
+	// VOXEL_LAYOUT_TILED is defined before it, and the linear layout otherwise.
+	static const std::string SOURCE;
+
+	VoxelLayout getLayout() const;
+
+	// Gets the length of the per-voxel lists, including any voxels outside the grid.
+	int getCount() const;
+
+	// Gets the index of a voxel in the per-voxel lists.
+	int getIndex(int cellX, int cellY, int cellZ) const;
+
+	// Gets the cell of the voxel at an index in the per-voxel lists.
+	void getCell(int index, int *cellX, int *cellY, int *cellZ) const;
+};
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef VOXEL_LAYOUT_H
+#define VOXEL_LAYOUT_H
+
+// A voxel layout decides where each voxel's references are in the per-voxel lists
+// (voxel, sprite, and light references). Linear is X, then Y, then Z, so a ray going
+// along Z jumps a whole XY slice every step. Tiled groups the grid into 4x4x4 tiles 
+// of 64 voxels back to back, with the voxels in a tile in Morton (Z-order), so 
+// neighbors along any axis are usually in the same tile.
+
+enum class VoxelLayout
+{
+	Linear,
+	Tiled
+};
+
+#endif
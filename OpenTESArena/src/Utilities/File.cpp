@@ -21,3 +21,9 @@ std::string File::toString(const std::string &filename)
 
 	return std::string(&bytes.at(0), fileSize);
 }
+
+bool File::exists(const std::string &filename)
+{
+	std::ifstream ifs(filename.c_str());
+	return ifs.good();
+}
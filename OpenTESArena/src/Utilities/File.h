@@ -12,6 +12,9 @@ private:
 public:
 	// Reads a file into a string.
 	static std::string toString(const std::string &filename);
+
+	// Returns whether the file exists and can be opened for reading.
+	static bool exists(const std::string &filename);
 };
 
 #endif
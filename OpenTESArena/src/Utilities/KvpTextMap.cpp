@@ -62,6 +62,11 @@ const std::string &KvpTextMap::getValue(const std::string &key) const
 	return pairs.at(key);
 }
 
+bool KvpTextMap::hasKey(const std::string &key) const
+{
+	return this->pairs.find(key) != this->pairs.end();
+}
+
 bool KvpTextMap::getBoolean(const std::string &key) const
 {
 	const std::string &value = this->getValue(key);
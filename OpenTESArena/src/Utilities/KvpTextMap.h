@@ -22,6 +22,10 @@ public:
 	KvpTextMap(const std::string &filename);
 	~KvpTextMap();
 
+	// Returns whether the file has a value for the key. Newer keys that an older file
+	// might not have can be checked with this before being read.
+	bool hasKey(const std::string &key) const;
+
 	bool getBoolean(const std::string &key) const;
 	int getInteger(const std::string &key) const;
 	double getDouble(const std::string &key) const;
@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <cassert>
+
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(int threadCount)
+	: job(nullptr), nextJobIndex(0)
+{
+	if (threadCount <= 0)
+	{
+		// hardware_concurrency() is allowed to return 0 if it doesn't know.
+		threadCount = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+	}
+
+	this->jobCount = 0;
+	this->busyWorkerCount = 0;
+	this->batchID = 0;
+	this->stopping = false;
+
+	// The calling thread counts as one of the threads.
+	for (int i = 1; i < threadCount; ++i)
+	{
+		this->workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = true;
+	}
+
+	this->startCondition.notify_all();
+
+	for (auto &worker : this->workers)
+	{
+		worker.join();
+	}
+}
+
+int ThreadPool::getThreadCount() const
+{
+	return static_cast<int>(this->workers.size()) + 1;
+}
+
+void ThreadPool::runJobs()
+{
+	while (true)
+	{
+		const int jobIndex = this->nextJobIndex.fetch_add(1);
+		if (jobIndex >= this->jobCount)
+		{
+			break;
+		}
+
+		(*this->job)(jobIndex);
+	}
+}
+
+void ThreadPool::workerLoop()
+{
+	unsigned int lastBatchID = 0;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->startCondition.wait(lock, [this, lastBatchID]()
+			{
+				return this->stopping || (this->batchID != lastBatchID);
+			});
+
+			if (this->stopping)
+			{
+				return;
+			}
+
+			lastBatchID = this->batchID;
+		}
+
+		this->runJobs();
+
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			--this->busyWorkerCount;
+		}
+
+		this->doneCondition.notify_one();
+	}
+}
+
+void ThreadPool::run(int jobCount, const std::function<void(int)> &job)
+{
+	assert(jobCount >= 0);
+
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->job = &job;
+		this->jobCount = jobCount;
+		this->nextJobIndex = 0;
+		this->busyWorkerCount = static_cast<int>(this->workers.size());
+		++this->batchID;
+	}
+
+	this->startCondition.notify_all();
+
+	// Help out with the batch instead of just waiting.
+	this->runJobs();
+
+	// Wait for the workers to finish their last jobs.
+	std::unique_lock<std::mutex> lock(this->mutex);
+	this->doneCondition.wait(lock, [this]()
+	{
+		return this->busyWorkerCount == 0;
+	});
+
+	this->job = nullptr;
+}
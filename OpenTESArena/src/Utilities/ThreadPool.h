@@ -0,0 +1,48 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A thread pool for splitting a batch of independent jobs (like screen tiles) across
+// several CPU cores. The worker threads are created once and sleep between batches,
+// so there's no thread creation cost per frame.
+
+// The calling thread also works on the batch, so a pool of N threads only creates
+// N - 1 worker threads. Jobs are handed out one at a time with an atomic counter,
+// which keeps the load balanced when some jobs are more expensive than others.
+
+class ThreadPool
+{
+private:
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable startCondition, doneCondition;
+	const std::function<void(int)> *job; // Only valid while a batch is running.
+	std::atomic<int> nextJobIndex;
+	int jobCount, busyWorkerCount;
+	unsigned int batchID;
+	bool stopping;
+
+	// Takes jobs from the current batch until there are none left.
+	void runJobs();
+
+	void workerLoop();
+public:
+	// A thread count of zero or less uses the number of hardware threads.
+	ThreadPool(int threadCount);
+	~ThreadPool();
+
+	// Gets the number of threads that work on a batch (including the caller).
+	int getThreadCount() const;
+
+	// Runs the job once for each index in [0, jobCount) and returns when all of 
+	// them are finished.
+	void run(int jobCount, const std::function<void(int)> &job);
+};
+
+#endif
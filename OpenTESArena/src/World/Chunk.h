@@ -11,10 +11,13 @@
 
 class Chunk
 {
-private:
+public:
+	// Dimensions in voxels. The render world uses the same ones for its coarse
+	// occupancy level.
 	static const int Width = 8;
 	static const int Height = 4;
 	static const int Depth = 8;
+private:
 	static const int MaxVolume = Chunk::Width * Chunk::Height * Chunk::Depth;
 
 	std::array<Voxel, Chunk::MaxVolume> voxels;
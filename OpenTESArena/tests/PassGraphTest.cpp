@@ -0,0 +1,118 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../src/Rendering/PassGraph.h"
+
+// Checks that the pass graph shares memory between buffers whose lifetimes don't
+// overlap, using the same passes as the kernel.cl and edge refinement frames.
+
+namespace
+{
+	int failureCount = 0;
+
+	void expect(bool condition, const std::string &message)
+	{
+		if (!condition)
+		{
+			std::cerr << "PassGraphTest failed: " << message << "\n";
+			failureCount++;
+		}
+	}
+
+	void testFullFrame()
+	{
+		// Per-pixel sizes of the kernel.cl buffers (float, float3, float2, int).
+		const size_t pixelCount = 64;
+		PassGraph passGraph;
+		const int depth = passGraph.addResource("depth", 4 * pixelCount);
+		const int normal = passGraph.addResource("normal", 16 * pixelCount);
+		const int view = passGraph.addResource("view", 16 * pixelCount);
+		const int point = passGraph.addResource("point", 16 * pixelCount);
+		const int uv = passGraph.addResource("uv", 8 * pixelCount);
+		const int rectangleIndex = passGraph.addResource("rectangleIndex", 4 * pixelCount);
+		const int color = passGraph.addResource("color", 16 * pixelCount);
+		const int output = passGraph.addResource("output", 4 * pixelCount);
+
+		const std::vector<int> gBuffer = { depth, normal, view, point, uv, rectangleIndex };
+		passGraph.addPass("intersect", {}, gBuffer);
+		passGraph.addPass("rayTrace", gBuffer, { color });
+		passGraph.addPass("convertToRGB", { color }, { output });
+		passGraph.compile();
+
+		// The G-buffer is dead once rayTrace is done, so the output goes on one of its
+		// allocations instead of a new one.
+		bool outputShared = false;
+		for (const int resourceID : gBuffer)
+		{
+			outputShared |= passGraph.getAllocation(output) ==
+				passGraph.getAllocation(resourceID);
+		}
+
+		expect(outputShared, "output doesn't share memory with the dead G-buffer.");
+		expect(passGraph.getAllocation(output) != passGraph.getAllocation(color),
+			"output shares memory with the color it's converted from.");
+		expect(passGraph.getAllocationCount() == 7, "expected 7 allocations, got " +
+			std::to_string(passGraph.getAllocationCount()) + ".");
+		expect(passGraph.getTotalSize() == (passGraph.getUnsharedSize() - (4 * pixelCount)),
+			"sharing didn't save the output's size.");
+
+		// Everything rayTrace reads is live while it writes color.
+		for (const int resourceID : gBuffer)
+		{
+			expect(passGraph.getAllocation(resourceID) != passGraph.getAllocation(color),
+				"color shares memory with a G-buffer entry rayTrace reads.");
+		}
+	}
+
+	void testRefineCorners()
+	{
+		// The corner depths and hits are written together and read together.
+		const size_t cornerCount = 81;
+		PassGraph passGraph;
+		const int cornerDepth = passGraph.addResource("cornerDepth", 4 * cornerCount);
+		const int cornerHit = passGraph.addResource("cornerHit", 4 * cornerCount);
+		passGraph.addPass("refineCorners", {}, { cornerDepth, cornerHit });
+		passGraph.addPass("refine", { cornerDepth, cornerHit }, {});
+		passGraph.compile();
+
+		expect(passGraph.getAllocation(cornerDepth) != passGraph.getAllocation(cornerHit),
+			"corner depths and hits share memory while both are live.");
+		expect(passGraph.getTotalSize() == passGraph.getUnsharedSize(),
+			"buffers that are live together saved memory.");
+	}
+
+	void testGrowsSharedAllocation()
+	{
+		// A bigger buffer that comes alive after a smaller one dies grows its allocation
+		// instead of getting a new one.
+		PassGraph passGraph;
+		const int small = passGraph.addResource("small", 16);
+		const int big = passGraph.addResource("big", 64);
+		passGraph.addPass("first", {}, { small });
+		passGraph.addPass("second", { small }, {});
+		passGraph.addPass("third", {}, { big });
+		passGraph.compile();
+
+		expect(passGraph.getAllocation(small) == passGraph.getAllocation(big),
+			"dead small buffer's memory wasn't reused.");
+		expect(passGraph.getAllocationCount() == 1, "expected 1 allocation.");
+		expect(passGraph.getTotalSize() == 64, "shared allocation isn't the biggest size.");
+	}
+}
+
+int main()
+{
+	testFullFrame();
+	testRefineCorners();
+	testGrowsSharedAllocation();
+
+	if (failureCount > 0)
+	{
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "PassGraphTest passed.\n";
+	return EXIT_SUCCESS;
+}
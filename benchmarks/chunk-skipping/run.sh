@@ -0,0 +1,50 @@
+#!/bin/sh
+# Runs the chunk skipping benchmark: both camera paths with empty chunk skipping on
+# and off, and prints the average and 99th percentile frame times and the average
+# voxel grid steps per ray. It measures the render program picked in the options, so
+# set RenderBackend and KernelMode to the one being compared (the lean and fused
+# kernels and the CPU backend skip chunks; the kernel.cl kernels don't).
+#
+# Counting steps slows the rays down, so each setting is run twice: once for the
+# frame times and once with --count-steps for the steps.
+#
+# Usage: run.sh <OpenTESArena executable> [frames]
+# Run it from the folder with the "data" and "options" folders, like the game.
+
+set -e
+
+EXECUTABLE="$1"
+FRAMES="${2:-600}"
+HERE="$(cd "$(dirname "$0")" && pwd)"
+OUT="${TMPDIR:-/tmp}/chunk-skipping-benchmark"
+
+if [ -z "$EXECUTABLE" ]; then
+	echo "Usage: $0 <OpenTESArena executable> [frames]" >&2
+	exit 1
+fi
+
+mkdir -p "$OUT"
+
+printf "%-10s %-8s %12s %12s %14s\n" path skipping "average ms" "p99 ms" "steps per ray"
+
+for PATH_NAME in turn corner; do
+	for SKIPPING in On Off; do
+		REPORT="$OUT/$PATH_NAME-$SKIPPING.txt"
+		"$EXECUTABLE" --timedemo "$HERE/$PATH_NAME.txt" --frames "$FRAMES" \
+			--warmup 60 --chunk-skipping "$SKIPPING" --report "$REPORT" \
+			--dummy-video > /dev/null
+
+		STEPS_REPORT="$OUT/$PATH_NAME-$SKIPPING-steps.txt"
+		"$EXECUTABLE" --timedemo "$HERE/$PATH_NAME.txt" --frames "$FRAMES" \
+			--warmup 60 --chunk-skipping "$SKIPPING" --count-steps \
+			--report "$STEPS_REPORT" --dummy-video > /dev/null
+
+		AVERAGE=$(grep "^average:" "$REPORT" | cut -d " " -f 2)
+		P99=$(grep "^p99:" "$REPORT" | cut -d " " -f 2)
+		STEPS=$(grep "^steps per ray:" "$STEPS_REPORT" | cut -d " " -f 4)
+		printf "%-10s %-8s %12s %12s %14s\n" "$PATH_NAME" "$SKIPPING" "$AVERAGE" "$P99" \
+			"$STEPS"
+	done
+done
+
+echo "Reports are in $OUT."
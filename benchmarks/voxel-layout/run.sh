@@ -0,0 +1,55 @@
+#!/bin/sh
+# Runs the voxel layout benchmark: both camera paths with each voxel layout, and 
+# prints the average and 99th percentile frame times. If Linux perf is installed, 
+# the cache references and misses of each run are printed too.
+#
+# Usage: run.sh <OpenTESArena executable> [frames]
+# Run it from the folder with the "data" and "options" folders, like the game.
+
+set -e
+
+EXECUTABLE="$1"
+FRAMES="${2:-600}"
+HERE="$(cd "$(dirname "$0")" && pwd)"
+OUT="${TMPDIR:-/tmp}/voxel-layout-benchmark"
+
+if [ -z "$EXECUTABLE" ]; then
+	echo "Usage: $0 <OpenTESArena executable> [frames]" >&2
+	exit 1
+fi
+
+mkdir -p "$OUT"
+
+PERF=""
+if command -v perf > /dev/null 2>&1; then
+	PERF="perf stat -x , -e cache-references,cache-misses -o"
+fi
+
+printf "%-10s %-8s %12s %12s %16s %16s\n" path layout "average ms" "p99 ms" \
+	"cache refs" "cache misses"
+
+for PATH_NAME in axis diagonal; do
+	for LAYOUT in Linear Tiled; do
+		REPORT="$OUT/$PATH_NAME-$LAYOUT.txt"
+		PERF_REPORT="$OUT/$PATH_NAME-$LAYOUT.perf"
+		set -- --timedemo "$HERE/$PATH_NAME.txt" --frames "$FRAMES" --warmup 60 \
+			--voxel-layout "$LAYOUT" --report "$REPORT" --dummy-video
+
+		if [ -n "$PERF" ]; then
+			$PERF "$PERF_REPORT" "$EXECUTABLE" "$@" > /dev/null
+			REFS=$(grep cache-references "$PERF_REPORT" | cut -d , -f 1)
+			MISSES=$(grep cache-misses "$PERF_REPORT" | cut -d , -f 1)
+		else
+			"$EXECUTABLE" "$@" > /dev/null
+			REFS="-"
+			MISSES="-"
+		fi
+
+		AVERAGE=$(grep "^average:" "$REPORT" | cut -d " " -f 2)
+		P99=$(grep "^p99:" "$REPORT" | cut -d " " -f 2)
+		printf "%-10s %-8s %12s %12s %16s %16s\n" "$PATH_NAME" "$LAYOUT" "$AVERAGE" \
+			"$P99" "$REFS" "$MISSES"
+	done
+done
+
+echo "Reports are in $OUT."